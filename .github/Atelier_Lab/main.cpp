@@ -4,6 +4,7 @@
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <cstdlib>  
 #include <random>
@@ -11,17 +12,56 @@
 #include <regex>
 #include <limits>
 #include <map>
+#include <unordered_map>
+#include <set>
+#include <queue>
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <memory>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <cstring>
+#include <list>
+#include <array>
+#include <csignal>
+#include <cerrno>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include <SDL2/SDL_ttf.h>
+#include <zlib.h>
+#if defined(__linux__)
+#include <sys/inotify.h>
+#endif
+#if !defined(_WIN32)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
 
-static bool runViewer(const std::string& basePath);
-static void editMode(const std::string& basePath);
+struct AppShell;
+static bool runViewer(AppShell& shell, const std::string& basePath);
+static void editMode(AppShell& shell, const std::string& basePath, const std::string& recordFile = std::string());
+static bool runGallery(AppShell& shell, std::string& basePath);
 static void showHelpFromJson(const std::string& jsonPath);
 static SDL_Rect drawWindowHeaderWithClose(SDL_Renderer* r, int winW);
+static int runToolCommand(const std::vector<std::string>& args, std::ostream& out);
+static void printToolUsage(std::ostream& out);
+static std::vector<std::string> splitCommandLine(const std::string& line);
 
+// Scene coordinates are sub-pixel; drawing rounds them to the nearest pixel.
 struct Point {
-    int x, y;
+    float x, y;
 };
 
+static inline int toPixel(float v) { return (int)std::floor(v + 0.5f); }
+
 using Path = std::vector<Point>;
 
 enum class ShapeType : int {
@@ -31,10 +71,146 @@ enum class ShapeType : int {
     Quadrilateral = 3
 };
 
+// Compact path files replace the text form in place (same file names):
+//   "ATPZ", version byte, float32 step, shift byte, varint path count, then per path a
+//   varint point count followed by its points as zig-zag varint deltas of
+//   round(coord / step) >> shift from the previous point (carried across paths).
+// A step of 1/32 px keeps 1/64 px precision; shift drops low bits that are zero in every
+// coordinate, so drawings that happen to sit on whole pixels cost no more than ints.
+static const char kCompactMagic[4] = { 'A', 'T', 'P', 'Z' };
+static constexpr float kDefaultCompactStep = 1.0f / 32.0f;
+
+static inline void putVarint(std::string& out, Uint64 v) {
+    while (v >= 0x80) { out += (char)(v | 0x80); v >>= 7; }
+    out += (char)v;
+}
+
+static inline Uint64 zigzag(long long v) { return ((Uint64)v << 1) ^ (Uint64)(v >> 63); }
+static inline long long unzigzag(Uint64 v) { return (long long)(v >> 1) ^ -(long long)(v & 1); }
+
+static std::string encodeCompactPaths(const std::vector<Path>& paths, float step) {
+    std::string out(kCompactMagic, 4);
+    out += (char)1;
+    char stepBytes[4];
+    std::memcpy(stepBytes, &step, 4);
+    out.append(stepBytes, 4);
+    size_t points = 0;
+    Uint64 bits = 0;
+    for (const auto& path : paths) {
+        points += path.size();
+        for (const auto& pt : path) bits |= (Uint64)std::llround(pt.x / step) | (Uint64)std::llround(pt.y / step);
+    }
+    int shift = 0;
+    while (bits && shift < 16 && !(bits & 1)) { bits >>= 1; ++shift; }
+    out += (char)shift;
+    out.reserve(out.size() + paths.size() * 2 + points * 3);
+    putVarint(out, paths.size());
+    long long px = 0, py = 0;
+    for (const auto& path : paths) {
+        putVarint(out, path.size());
+        for (const auto& pt : path) {
+            long long qx = std::llround(pt.x / step) >> shift, qy = std::llround(pt.y / step) >> shift;
+            putVarint(out, zigzag(qx - px));
+            putVarint(out, zigzag(qy - py));
+            px = qx; py = qy;
+        }
+    }
+    return out;
+}
+
+// Reads varints from memory; a truncated or overlong value clears ok and yields 0.
+struct VarintReader {
+    const unsigned char* p;
+    const unsigned char* end;
+    bool ok = true;
+
+    Uint64 next() {
+        if (p < end && *p < 0x80) return *p++;
+        Uint64 v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (p >= end) break;
+            Uint8 b = *p++;
+            v |= (Uint64)(b & 0x7F) << shift;
+            if (!(b & 0x80)) return v;
+        }
+        ok = false;
+        return 0;
+    }
+    size_t left() const { return (size_t)(end - p); }
+};
+
+// Tight loop over the in-memory file: one-byte varints (deltas under 2 px at the default
+// step) take the branch-predictable fast path.
+static bool decodeCompactPaths(const std::string& data, std::vector<Path>& paths) {
+    const unsigned char* p = (const unsigned char*)data.data();
+    if (data.size() < 10 || std::memcmp(p, kCompactMagic, 4) != 0 || p[4] != 1 || p[9] > 16) return false;
+    float step;
+    std::memcpy(&step, p + 5, 4);
+    step *= (float)(1 << p[9]);
+    VarintReader in{ p + 10, p + data.size() };
+    Uint64 count = in.next();
+    if (!in.ok || count > data.size()) return false;
+    paths.assign((size_t)count, Path{});
+    long long qx = 0, qy = 0;
+    for (auto& path : paths) {
+        Uint64 n = in.next();
+        if (!in.ok || n > in.left()) return false;
+        path.resize((size_t)n);
+        for (auto& pt : path) {
+            qx += unzigzag(in.next());
+            qy += unzigzag(in.next());
+            pt = { (float)qx * step, (float)qy * step };
+        }
+        if (!in.ok) return false;
+    }
+    return true;
+}
+
+static bool readWholeFile(const std::string& filename, std::string& data) {
+    std::ifstream in(filename, std::ios::binary);
+    if (!in.is_open()) return false;
+    in.seekg(0, std::ios::end);
+    data.resize((size_t)in.tellg());
+    in.seekg(0, std::ios::beg);
+    in.read(&data[0], (std::streamsize)data.size());
+    return (bool)in;
+}
+
+static Uint64 hashBytes(const char* data, size_t n) {
+    Uint64 h = 1469598103934665603ull ^ n;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        Uint64 w;
+        std::memcpy(&w, data + i, 8);
+        h = (h ^ w) * 0x100000001b3ull;
+        h ^= h >> 29;
+    }
+    for (; i < n; ++i) h = (h ^ (Uint8)data[i]) * 1099511628211ull;
+    return h ^ (h >> 32);
+}
+
+// Step of an existing compact path file, or 0 if it is missing or text.
+static float compactStepOf(const std::string& filename) {
+    std::ifstream in(filename, std::ios::binary);
+    char head[9];
+    if (!in.read(head, 9) || std::memcmp(head, kCompactMagic, 4) != 0) return 0.0f;
+    float step;
+    std::memcpy(&step, head + 5, 4);
+    return step > 0.0f ? step : 0.0f;
+}
+
 std::vector<Path> readPaths(const std::string& filename) {
-    std::ifstream in(filename);
     std::vector<Path> paths;
+    if (compactStepOf(filename) > 0.0f) {
+        std::string data;
+        if (!readWholeFile(filename, data) || !decodeCompactPaths(data, paths)) {
+            std::cerr << "Corrupt path file " << filename << "\n";
+            paths.clear();
+        }
+        return paths;
+    }
 
+    std::ifstream in(filename);
     if (!in.is_open()) {
         std::cerr << "Cannot open " << filename << "\n";
         return paths;
@@ -48,7 +224,7 @@ std::vector<Path> readPaths(const std::string& filename) {
         in >> numPoints;
         Path path;
         for (int j = 0; j < numPoints; j++) {
-            int x, y;
+            float x, y;
             in >> x >> y;
             path.push_back({x, y});
         }
@@ -59,12 +235,27 @@ std::vector<Path> readPaths(const std::string& filename) {
     return paths;
 }
 
+static bool writeCompactPaths(const std::string& filename, const std::vector<Path>& paths, float step) {
+    std::string data = encodeCompactPaths(paths, step);
+    std::ofstream out(filename, std::ios::binary);
+    if (!out.is_open()) {
+        std::cerr << "Cannot write to " << filename << "\n";
+        return false;
+    }
+    out.write(data.data(), (std::streamsize)data.size());
+    return (bool)out;
+}
+
+// Keeps whichever format the file already has, so compacted scenes stay compact on save.
 static bool writePaths(const std::string& filename, const std::vector<Path>& paths) {
+    float step = compactStepOf(filename);
+    if (step > 0.0f) return writeCompactPaths(filename, paths, step);
     std::ofstream out(filename);
     if (!out.is_open()) {
         std::cerr << "Cannot write to " << filename << "\n";
         return false;
     }
+    out.precision(7); // ~1/1000 px for on-screen coordinates
     out << paths.size() << "\n";
     for (const auto& path : paths) {
         out << path.size() << "\n";
@@ -126,6 +317,213 @@ static bool writeTypes(const std::string& filename, const std::vector<ShapeType>
     return true;
 }
 
+struct SceneLayer {
+    std::vector<Path> paths;
+    std::vector<SDL_Color> colors;
+    std::vector<ShapeType> types;
+};
+
+// Instanced symbols: a named group of shapes stored once, in coordinates relative to
+// the symbol origin, and placed any number of times.
+//
+//   symbols.txt:   <count>, then per symbol "<name> <shapes>" and per shape
+//                  "<type> <r> <g> <b> <a> <points> x y x y ..."
+//   instances.txt: <count>, then per instance "<name> <x> <y> <rotation-deg> <scale> <r> <g> <b> <a>"
+//
+// The instance color tints (multiplies) the symbol; 255 255 255 255 leaves it unchanged.
+struct Symbol {
+    std::string name;
+    SceneLayer shapes;
+    SDL_Rect bounds{0, 0, 0, 0};
+};
+
+struct SymbolInstance {
+    int symbol = 0;
+    float x = 0.0f, y = 0.0f;
+    float rotation = 0.0f; // degrees, clockwise on screen
+    float scale = 1.0f;
+    SDL_Color tint{255, 255, 255, 255};
+};
+
+// foliage is paths.txt, trunks is current.txt; each carries .colors/.types sidecars
+struct Scene {
+    SceneLayer foliage;
+    SceneLayer trunks;
+    std::vector<Symbol> symbols;
+    std::vector<SymbolInstance> instances;
+};
+
+// Area a shape covers before stroke thickness; circles use their center and radius.
+static SDL_Rect shapeBounds(const Path& p, ShapeType type) {
+    if (p.empty()) return SDL_Rect{0, 0, 0, 0};
+    if (type == ShapeType::Circle && p.size() >= 2) {
+        int cx = toPixel((p[0].x + p[1].x) * 0.5f), cy = toPixel((p[0].y + p[1].y) * 0.5f);
+        float dx = p[0].x - p[1].x, dy = p[0].y - p[1].y;
+        int r = (int)std::ceil(std::sqrt(dx*dx + dy*dy) / 2.0f);
+        return SDL_Rect{ cx - r, cy - r, 2 * r + 1, 2 * r + 1 };
+    }
+    float x0 = p[0].x, y0 = p[0].y, x1 = x0, y1 = y0;
+    for (const auto& q : p) {
+        x0 = std::min(x0, q.x); y0 = std::min(y0, q.y);
+        x1 = std::max(x1, q.x); y1 = std::max(y1, q.y);
+    }
+    int ix0 = (int)std::floor(x0), iy0 = (int)std::floor(y0);
+    return SDL_Rect{ ix0, iy0, (int)std::ceil(x1) - ix0 + 1, (int)std::ceil(y1) - iy0 + 1 };
+}
+
+static SDL_Rect drawnBounds(const Path& p, ShapeType t) {
+    SDL_Rect r = shapeBounds(p, t);
+    return SDL_Rect{ r.x - 3, r.y - 3, r.w + 6, r.h + 6 }; // stroke thickness
+}
+
+static SDL_Rect unionRect(const SDL_Rect& a, const SDL_Rect& b) {
+    if (a.w <= 0 || a.h <= 0) return b;
+    if (b.w <= 0 || b.h <= 0) return a;
+    int x0 = std::min(a.x, b.x), y0 = std::min(a.y, b.y);
+    int x1 = std::max(a.x + a.w, b.x + b.w), y1 = std::max(a.y + a.h, b.y + b.h);
+    return SDL_Rect{ x0, y0, x1 - x0, y1 - y0 };
+}
+
+static void updateSymbolBounds(Symbol& sym) {
+    sym.bounds = SDL_Rect{0, 0, 0, 0};
+    for (size_t i = 0; i < sym.shapes.paths.size(); ++i) {
+        sym.bounds = unionRect(sym.bounds, shapeBounds(sym.shapes.paths[i], sym.shapes.types[i]));
+    }
+}
+
+static std::vector<Symbol> readSymbols(const std::string& filename) {
+    std::vector<Symbol> symbols;
+    std::ifstream in(filename);
+    if (!in.is_open()) return symbols;
+    size_t n = 0; in >> n;
+    for (size_t i = 0; i < n && in; ++i) {
+        Symbol sym;
+        size_t shapes = 0;
+        in >> sym.name >> shapes;
+        for (size_t k = 0; k < shapes && in; ++k) {
+            int type = 0, r = 255, g = 255, b = 255, a = 255;
+            size_t points = 0;
+            in >> type >> r >> g >> b >> a >> points;
+            Path path(points);
+            for (auto& pt : path) in >> pt.x >> pt.y;
+            sym.shapes.paths.push_back(std::move(path));
+            sym.shapes.colors.push_back(SDL_Color{ (Uint8)r, (Uint8)g, (Uint8)b, (Uint8)a });
+            sym.shapes.types.push_back(type < 0 || type > 3 ? ShapeType::Line : static_cast<ShapeType>(type));
+        }
+        updateSymbolBounds(sym);
+        symbols.push_back(std::move(sym));
+    }
+    return symbols;
+}
+
+static bool writeSymbols(const std::string& filename, const std::vector<Symbol>& symbols) {
+    std::ofstream out(filename);
+    if (!out.is_open()) return false;
+    out.precision(7);
+    out << symbols.size() << "\n";
+    for (const auto& sym : symbols) {
+        out << sym.name << ' ' << sym.shapes.paths.size() << "\n";
+        for (size_t k = 0; k < sym.shapes.paths.size(); ++k) {
+            SDL_Color c = sym.shapes.colors[k];
+            out << static_cast<int>(sym.shapes.types[k]) << ' ' << (int)c.r << ' ' << (int)c.g << ' ' << (int)c.b << ' ' << (int)c.a
+                << ' ' << sym.shapes.paths[k].size();
+            for (const auto& pt : sym.shapes.paths[k]) out << ' ' << pt.x << ' ' << pt.y;
+            out << "\n";
+        }
+    }
+    return true;
+}
+
+static int findSymbol(const std::vector<Symbol>& symbols, const std::string& name) {
+    for (size_t i = 0; i < symbols.size(); ++i) if (symbols[i].name == name) return (int)i;
+    return -1;
+}
+
+static std::vector<SymbolInstance> readInstances(const std::string& filename, const std::vector<Symbol>& symbols) {
+    std::vector<SymbolInstance> instances;
+    std::ifstream in(filename);
+    if (!in.is_open()) return instances;
+    size_t n = 0; in >> n;
+    instances.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        std::string name;
+        SymbolInstance inst;
+        int r = 255, g = 255, b = 255, a = 255;
+        if (!(in >> name >> inst.x >> inst.y >> inst.rotation >> inst.scale >> r >> g >> b >> a)) break;
+        inst.symbol = findSymbol(symbols, name);
+        if (inst.symbol < 0) {
+            std::cerr << filename << ": unknown symbol " << name << "\n";
+            continue;
+        }
+        inst.tint = SDL_Color{ (Uint8)r, (Uint8)g, (Uint8)b, (Uint8)a };
+        instances.push_back(inst);
+    }
+    return instances;
+}
+
+static bool writeInstances(const std::string& filename, const std::vector<Symbol>& symbols, const std::vector<SymbolInstance>& instances) {
+    std::ofstream out(filename);
+    if (!out.is_open()) return false;
+    out << instances.size() << "\n";
+    for (const auto& inst : instances) {
+        out << symbols[inst.symbol].name << ' ' << inst.x << ' ' << inst.y << ' ' << inst.rotation << ' ' << inst.scale << ' '
+            << (int)inst.tint.r << ' ' << (int)inst.tint.g << ' ' << (int)inst.tint.b << ' ' << (int)inst.tint.a << "\n";
+    }
+    return true;
+}
+
+static SceneLayer readLayer(const std::string& filename) {
+    SceneLayer layer;
+    layer.paths  = readPaths(filename);
+    layer.colors = readColors(filename + ".colors", layer.paths.size());
+    layer.types  = readTypes(filename + ".types", layer.paths.size());
+    return layer;
+}
+
+static bool writeLayer(const std::string& filename, const SceneLayer& layer) {
+    bool ok = writePaths(filename, layer.paths);
+    ok = writeColors(filename + ".colors", layer.colors) && ok;
+    ok = writeTypes(filename + ".types", layer.types) && ok;
+    return ok;
+}
+
+static Scene loadScene(const std::string& basePath) {
+    Scene scene;
+    scene.foliage = readLayer(basePath + "/paths.txt");
+    scene.trunks  = readLayer(basePath + "/current.txt");
+    scene.symbols   = readSymbols(basePath + "/symbols.txt");
+    scene.instances = readInstances(basePath + "/instances.txt", scene.symbols);
+    return scene;
+}
+
+static bool saveScene(const std::string& basePath, const Scene& scene) {
+    bool ok = writeLayer(basePath + "/paths.txt", scene.foliage);
+    ok = writeLayer(basePath + "/current.txt", scene.trunks) && ok;
+    if (!scene.symbols.empty()) {
+        ok = writeSymbols(basePath + "/symbols.txt", scene.symbols) && ok;
+        ok = writeInstances(basePath + "/instances.txt", scene.symbols, scene.instances) && ok;
+    } else {
+        std::remove((basePath + "/symbols.txt").c_str());
+        std::remove((basePath + "/instances.txt").c_str());
+    }
+    return ok;
+}
+
+// Runs fn(0..count-1) across the hardware threads; fn must only touch its own index's data.
+static void parallelFor(size_t count, const std::function<void(size_t)>& fn) {
+    size_t n = std::min<size_t>(count, std::max(1u, std::thread::hardware_concurrency()));
+    if (n <= 1) {
+        for (size_t i = 0; i < count; ++i) fn(i);
+        return;
+    }
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < n; ++t) {
+        pool.emplace_back([&]() { for (size_t i; (i = next++) < count; ) fn(i); });
+    }
+    for (auto& t : pool) t.join();
+}
+
 void drawThickPaths(SDL_Renderer* renderer, const std::vector<Path>& paths, SDL_Color color, int thickness) {
     SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
     SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
@@ -137,8 +535,8 @@ void drawThickPaths(SDL_Renderer* renderer, const std::vector<Path>& paths, SDL_
                 if (path.size() < 2) continue;
                 for (size_t i = 1; i < path.size(); i++) {
                     SDL_RenderDrawLine(renderer,
-                        path[i-1].x + dx, path[i-1].y + dy,
-                        path[i].x + dx, path[i].y + dy);
+                        toPixel(path[i-1].x) + dx, toPixel(path[i-1].y) + dy,
+                        toPixel(path[i].x) + dx, toPixel(path[i].y) + dy);
                 }
             }
         }
@@ -201,970 +599,8153 @@ static bool getBasePathFromCwd(std::string& basePathOut) {
     return true;
     }
 
+static void renderShape(SDL_Renderer* renderer, const Path& p, SDL_Color c, ShapeType type) {
+    if (type == ShapeType::Circle && p.size() >= 2) {
+        int cx = toPixel((p[0].x + p[1].x) * 0.5f);
+        int cy = toPixel((p[0].y + p[1].y) * 0.5f);
+        float dx = p[0].x - p[1].x; float dy = p[0].y - p[1].y; int radius = (int)std::round(std::sqrt(dx*dx + dy*dy) / 2.0f);
+        drawCircleOutline(renderer, cx, cy, radius, c, 2);
+        return;
+    }
+    if (type == ShapeType::Triangle && p.size() >= 3) {
+        Path closed = p; closed.push_back(p.front());
+        drawThickPaths(renderer, std::vector<Path>{closed}, c, 2);
+        return;
+    }
+    if (type == ShapeType::Quadrilateral && p.size() >= 4) {
+        Path closed = p; closed.push_back(p.front());
+        drawThickPaths(renderer, std::vector<Path>{closed}, c, 2);
+        return;
+    }
+
+    drawThickPaths(renderer, std::vector<Path>{p}, c, 2);
+}
+
 static void renderStaticSceneColored(SDL_Renderer* renderer,
     const std::vector<Path>& foliage, const std::vector<SDL_Color>& foliageColors, const std::vector<ShapeType>& foliageTypes,
     const std::vector<Path>& trunks, const std::vector<SDL_Color>& trunksColors, const std::vector<ShapeType>& trunksTypes) {
-    auto renderOne = [&](const Path& p, SDL_Color c, ShapeType type) {
-        if (type == ShapeType::Circle && p.size() >= 2) {
-            int cx = (p[0].x + p[1].x) / 2;
-            int cy = (p[0].y + p[1].y) / 2;
-            int dx = p[0].x - p[1].x; int dy = p[0].y - p[1].y; int radius = (int)std::round(std::sqrt((float)(dx*dx + dy*dy)) / 2.0f);
-            drawCircleOutline(renderer, cx, cy, radius, c, 2);
-            return;
-        }
-        if (type == ShapeType::Triangle && p.size() >= 3) {
-            Path closed = p; closed.push_back(p.front());
-            drawThickPaths(renderer, std::vector<Path>{closed}, c, 2);
-            return;
-        }
-        if (type == ShapeType::Quadrilateral && p.size() >= 4) {
-            Path closed = p; closed.push_back(p.front());
-            drawThickPaths(renderer, std::vector<Path>{closed}, c, 2);
-            return;
-        }
-       
-        drawThickPaths(renderer, std::vector<Path>{p}, c, 2);
-    };
     for (size_t i = 0; i < foliage.size(); ++i) {
         SDL_Color c = i < foliageColors.size() ? foliageColors[i] : SDL_Color{255,255,255,255};
         ShapeType t = i < foliageTypes.size() ? foliageTypes[i] : ShapeType::Line;
-        renderOne(foliage[i], c, t);
+        renderShape(renderer, foliage[i], c, t);
     }
     for (size_t i = 0; i < trunks.size(); ++i) {
         SDL_Color c = i < trunksColors.size() ? trunksColors[i] : SDL_Color{255,255,255,255};
         ShapeType t = i < trunksTypes.size() ? trunksTypes[i] : ShapeType::Line;
-        renderOne(trunks[i], c, t);
+        renderShape(renderer, trunks[i], c, t);
     }
 }
 
-static bool runViewer(const std::string& basePath) {
-    std::string pathsFile   = basePath + "/paths.txt";
-    std::string currentFile = basePath + "/current.txt";
+// Animation: keyframe tracks and expression bindings read from <scene>/anim.txt.
+//
+//   duration <seconds>                                      (default: last key time)
+//   loop <0|1>                                              (default: 1)
+//   param  <name> <keys> [step|linear|smooth]               then <keys> lines: t value
+//   vertex <foliage|trunks> <shape> <vertex> <keys> [interp]  then <keys> lines: t x y
+//   color  <foliage|trunks> <shape> <keys> [interp]           then <keys> lines: t r g b a
+//   bind   <foliage|trunks> <shape> <vertex> <exprX> ; <exprY>
+//
+// Expressions use + - * / ^, sin cos sqrt abs, pi, the clip time t and any param name.
+struct AnimExpr {
+    enum Op : Uint8 { Num, Var, Add, Sub, Mul, Div, Pow, Neg, Sin, Cos, Sqrt, Abs };
+    struct Instr { Op op; float value; int slot; };
+    std::vector<Instr> code;
+};
 
-    auto allPaths    = readPaths(pathsFile);
-    auto currentPath = readPaths(currentFile);
-    auto allColors   = readColors(pathsFile + ".colors", allPaths.size());
-    auto currColors  = readColors(currentFile + ".colors", currentPath.size());
-    auto allTypes    = readTypes(pathsFile + ".types", allPaths.size());
-    auto currTypes   = readTypes(currentFile + ".types", currentPath.size());
- 
-    allPaths.clear();
-    allColors.clear();
-
-    if (allPaths.empty() && currentPath.empty()) {
-        std::cerr << "Warning: No paths were loaded. Check file format and path.\n";
-    }
+struct AnimExprParser {
+    const std::string& src;
+    std::map<std::string, int>& slots;
+    AnimExpr& out;
+    size_t pos = 0;
+    bool ok = true;
 
-    bool initedVideoHere = false;
-    if (SDL_WasInit(SDL_INIT_VIDEO) == 0) {
-    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
-        std::cerr << "SDL could not initialize! SDL_Error: " << SDL_GetError() << "\n";
-        return false;
-    }
-        initedVideoHere = true;
-    }
-    bool initedImgHere = false;
-    if (!(IMG_Init(IMG_INIT_PNG) & IMG_INIT_PNG)) {
-       
-    if (!(IMG_Init(IMG_INIT_PNG) & IMG_INIT_PNG)) {
-        std::cerr << "SDL_image could not initialize! SDL_image Error: " << IMG_GetError() << "\n";
-            if (initedVideoHere) SDL_Quit();
-        return false;
+    void skip() { while (pos < src.size() && std::isspace((unsigned char)src[pos])) ++pos; }
+    bool accept(char c) { skip(); if (pos < src.size() && src[pos] == c) { ++pos; return true; } return false; }
+    void emit(AnimExpr::Op op, float v = 0.0f, int slot = 0) { out.code.push_back({op, v, slot}); }
+
+    void parseExpr() {
+        parseTerm();
+        while (ok) {
+            if (accept('+')) { parseTerm(); emit(AnimExpr::Add); }
+            else if (accept('-')) { parseTerm(); emit(AnimExpr::Sub); }
+            else break;
         }
-        initedImgHere = true;
     }
-
-    SDL_Window* window = SDL_CreateWindow("Atelier Viewer",
-        SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-        800, 600, SDL_WINDOW_SHOWN);
-    if (!window) {
-        std::cerr << "Window could not be created! SDL_Error: " << SDL_GetError() << "\n";
-        IMG_Quit();
-        SDL_Quit();
-        return false;
+    void parseTerm() {
+        parseUnary();
+        while (ok) {
+            if (accept('*')) { parseUnary(); emit(AnimExpr::Mul); }
+            else if (accept('/')) { parseUnary(); emit(AnimExpr::Div); }
+            else break;
+        }
     }
-    SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
-    if (!renderer) {
-        std::cerr << "Renderer could not be created! SDL_Error: " << SDL_GetError() << "\n";
-        SDL_DestroyWindow(window);
-        IMG_Quit();
-        SDL_Quit();
-        return false;
+    void parseUnary() {
+        if (accept('-')) { parseUnary(); emit(AnimExpr::Neg); return; }
+        parseAtom();
+        if (accept('^')) { parseUnary(); emit(AnimExpr::Pow); }
     }
-
-    bool running = true;
-    SDL_Rect closeRect{0,0,0,0};
-    while (running) {
-        SDL_Event e;
-        while (SDL_PollEvent(&e)) {
-            if (e.type == SDL_QUIT) running = false;
-            if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_ESCAPE) running = false;
-            if (e.type == SDL_MOUSEBUTTONDOWN && e.button.button == SDL_BUTTON_LEFT) {
-                int mx = e.button.x, my = e.button.y;
-                if (mx >= closeRect.x && mx < closeRect.x + closeRect.w && my >= closeRect.y && my < closeRect.y + closeRect.h) {
-                    running = false;
-                }
+    void parseAtom() {
+        skip();
+        if (pos >= src.size()) { ok = false; return; }
+        if (accept('(')) { parseExpr(); if (!accept(')')) ok = false; return; }
+        char c = src[pos];
+        if (std::isdigit((unsigned char)c) || c == '.') {
+            char* end = nullptr;
+            float v = std::strtof(src.c_str() + pos, &end);
+            pos = (size_t)(end - src.c_str());
+            emit(AnimExpr::Num, v);
+            return;
+        }
+        if (std::isalpha((unsigned char)c) || c == '_') {
+            size_t start = pos;
+            while (pos < src.size() && (std::isalnum((unsigned char)src[pos]) || src[pos] == '_')) ++pos;
+            std::string name = src.substr(start, pos - start);
+            if (accept('(')) {
+                parseExpr();
+                if (!accept(')')) { ok = false; return; }
+                if (name == "sin") emit(AnimExpr::Sin);
+                else if (name == "cos") emit(AnimExpr::Cos);
+                else if (name == "sqrt") emit(AnimExpr::Sqrt);
+                else if (name == "abs") emit(AnimExpr::Abs);
+                else ok = false;
+                return;
             }
+            if (name == "pi") { emit(AnimExpr::Num, 3.14159265f); return; }
+            int slot = slots.emplace(name, (int)slots.size()).first->second;
+            emit(AnimExpr::Var, 0.0f, slot);
+            return;
         }
-        
-        SDL_SetRenderDrawColor(renderer, 8, 12, 18, 255);
-        SDL_RenderClear(renderer);
-      
-        closeRect = drawWindowHeaderWithClose(renderer, 800);
-        
-        renderStaticSceneColored(renderer, allPaths, allColors, allTypes, currentPath, currColors, currTypes);
-        SDL_RenderPresent(renderer);
-        SDL_Delay(10);
+        ok = false;
     }
+};
 
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
-    if (initedImgHere) IMG_Quit();
-    if (initedVideoHere) SDL_Quit();
+static const int kAnimExprStack = 32;
+
+static bool compileAnimExpr(const std::string& src, std::map<std::string, int>& slots, AnimExpr& out) {
+    out.code.clear();
+    AnimExprParser parser{src, slots, out};
+    parser.parseExpr();
+    parser.skip();
+    if (!parser.ok || parser.pos != src.size() || out.code.empty()) return false;
+    int depth = 0;
+    for (const auto& in : out.code) {
+        if (in.op == AnimExpr::Num || in.op == AnimExpr::Var) depth++;
+        else if (in.op >= AnimExpr::Add && in.op <= AnimExpr::Pow) depth--;
+        if (depth > kAnimExprStack) return false;
+    }
     return true;
 }
 
-static void showHelpFromJson(const std::string& jsonPath) {
-    std::ifstream in(jsonPath);
-    if (!in.is_open()) {
-        std::cerr << "Cannot open commands file: " << jsonPath << "\n";
-        return;
-    }
-    std::string line;
-    std::string currentCommand;
-    std::regex keyRegex("\\s*\"([^\"]+)\"\\s*:");
-    std::regex descRegex("\\s*\"description\"\\s*:\\s*\"([^\"]*)\"");
-    while (std::getline(in, line)) {
-        std::smatch m;
-        if (currentCommand.empty()) {
-            if (std::regex_search(line, m, keyRegex)) {
-                std::string key = m[1].str();
-                if (key != "help" && key != "draw" && key != "edit") {
-                   
-                }
-                currentCommand = key;
-            }
-        } else {
-            if (std::regex_search(line, m, descRegex)) {
-                std::string desc = m[1].str();
-                std::cout << currentCommand << " - " << desc << "\n";
-                currentCommand.clear();
-            }
-          
-            if (line.find('}') != std::string::npos) {
-                currentCommand.clear();
-            }
+static float evalAnimExpr(const AnimExpr& e, const std::vector<float>& params) {
+    float st[kAnimExprStack];
+    int sp = 0;
+    for (const auto& in : e.code) {
+        switch (in.op) {
+            case AnimExpr::Num:  st[sp++] = in.value; break;
+            case AnimExpr::Var:  st[sp++] = params[in.slot]; break;
+            case AnimExpr::Add:  sp--; st[sp-1] += st[sp]; break;
+            case AnimExpr::Sub:  sp--; st[sp-1] -= st[sp]; break;
+            case AnimExpr::Mul:  sp--; st[sp-1] *= st[sp]; break;
+            case AnimExpr::Div:  sp--; st[sp-1] = st[sp] != 0.0f ? st[sp-1] / st[sp] : 0.0f; break;
+            case AnimExpr::Pow:  sp--; st[sp-1] = std::pow(st[sp-1], st[sp]); break;
+            case AnimExpr::Neg:  st[sp-1] = -st[sp-1]; break;
+            case AnimExpr::Sin:  st[sp-1] = std::sin(st[sp-1]); break;
+            case AnimExpr::Cos:  st[sp-1] = std::cos(st[sp-1]); break;
+            case AnimExpr::Sqrt: st[sp-1] = std::sqrt(std::max(0.0f, st[sp-1])); break;
+            case AnimExpr::Abs:  st[sp-1] = std::fabs(st[sp-1]); break;
         }
     }
+    return sp > 0 ? st[sp-1] : 0.0f;
 }
 
-static std::string collectHelpFromJson(const std::string& jsonPath) {
-    std::ifstream in(jsonPath);
-    if (!in.is_open()) {
-        return std::string("Cannot open commands file: ") + jsonPath + "\n";
+enum class AnimInterp : int { Step = 0, Linear = 1, Smooth = 2 };
+enum class AnimTarget : int { Param = 0, Vertex = 1, Color = 2 };
+
+struct AnimKey {
+    float t;
+    float v[4];
+};
+
+struct AnimTrack {
+    AnimTarget target = AnimTarget::Param;
+    bool foliage = false;
+    size_t shape = 0;
+    int index = 0; // vertex index, or parameter slot for Param tracks
+    AnimInterp interp = AnimInterp::Linear;
+    std::vector<AnimKey> keys;
+    size_t cursor = 0; // last key used; playback moves forward so lookups are O(1) amortized
+};
+
+struct AnimBinding {
+    bool foliage = false;
+    size_t shape = 0;
+    int vertex = 0;
+    AnimExpr x, y;
+};
+
+struct AnimTimeline {
+    float duration = 0.0f;
+    bool loop = true;
+    std::map<std::string, int> slots;
+    std::vector<float> params;
+    std::vector<AnimTrack> tracks;       // sorted: Param tracks first, so bindings see current values
+    std::vector<AnimBinding> bindings;
+    std::vector<char> animatedMask[2];   // [0] foliage, [1] trunks
+    std::vector<size_t> animatedShapes[2];
+};
+
+static void sampleAnimTrack(AnimTrack& tr, float t, float* out) {
+    const auto& k = tr.keys;
+    if (t < k[tr.cursor].t) tr.cursor = 0;
+    while (tr.cursor + 1 < k.size() && k[tr.cursor + 1].t <= t) ++tr.cursor;
+    const AnimKey& a = k[tr.cursor];
+    if (tr.cursor + 1 >= k.size() || t <= a.t || tr.interp == AnimInterp::Step) {
+        for (int i = 0; i < 4; ++i) out[i] = a.v[i];
+        return;
     }
+    const AnimKey& b = k[tr.cursor + 1];
+    float u = (t - a.t) / (b.t - a.t);
+    if (tr.interp == AnimInterp::Smooth) u = u * u * (3.0f - 2.0f * u);
+    for (int i = 0; i < 4; ++i) out[i] = a.v[i] + (b.v[i] - a.v[i]) * u;
+}
+
+// Targets are checked against the layers as loaded.
+static bool loadAnimTimeline(const std::string& filename, const SceneLayer& foliage, const SceneLayer& trunks, AnimTimeline& tl) {
+    std::ifstream in(filename);
+    if (!in.is_open()) return false;
+    tl = AnimTimeline{};
+    tl.slots["t"] = 0;
+    bool durationSet = false;
+    float lastKey = 0.0f;
+
+    auto layerOf = [&](const std::string& name, bool& foliage) {
+        if (name == "foliage") { foliage = true; return true; }
+        if (name == "trunks") { foliage = false; return true; }
+        return false;
+    };
+    auto shapeOk = [&](bool isFoliage, size_t shape, int vertex, bool needVertex) {
+        const SceneLayer& l = isFoliage ? foliage : trunks;
+        return shape < l.paths.size() && (!needVertex || (vertex >= 0 && (size_t)vertex < l.paths[shape].size()));
+    };
+    auto interpOf = [](const std::string& s) {
+        if (s == "step") return AnimInterp::Step;
+        if (s == "smooth") return AnimInterp::Smooth;
+        return AnimInterp::Linear;
+    };
+
     std::string line;
-    std::string currentCommand;
-    std::regex keyRegex("\\s*\"([^\"]+)\"\\s*:");
-    std::regex descRegex("\\s*\"description\"\\s*:\\s*\"([^\"]*)\"");
-    std::ostringstream out;
+    int lineNo = 0;
     while (std::getline(in, line)) {
-        std::smatch m;
-        if (currentCommand.empty()) {
-            if (std::regex_search(line, m, keyRegex)) {
-                std::string key = m[1].str();
-                currentCommand = key;
-            }
-        } else {
-            if (std::regex_search(line, m, descRegex)) {
-                std::string desc = m[1].str();
-                out << currentCommand << " - " << desc << "\n";
-                currentCommand.clear();
+        lineNo++;
+        std::istringstream ls(line);
+        std::string kw;
+        if (!(ls >> kw) || kw[0] == '#') continue;
+        if (kw == "duration") { ls >> tl.duration; durationSet = true; continue; }
+        if (kw == "loop") { int v = 1; ls >> v; tl.loop = v != 0; continue; }
+        if (kw == "bind") {
+            AnimBinding b;
+            std::string layer;
+            ls >> layer >> b.shape >> b.vertex;
+            std::string rest; std::getline(ls, rest);
+            size_t semi = rest.find(';');
+            if (!ls.eof() || !layerOf(layer, b.foliage) || semi == std::string::npos
+                || !compileAnimExpr(rest.substr(0, semi), tl.slots, b.x)
+                || !compileAnimExpr(rest.substr(semi + 1), tl.slots, b.y)) {
+                std::cerr << filename << ":" << lineNo << ": bad bind\n";
+                continue;
             }
-            if (line.find('}') != std::string::npos) {
-                currentCommand.clear();
+            if (!shapeOk(b.foliage, b.shape, b.vertex, true)) {
+                std::cerr << filename << ":" << lineNo << ": bind target out of range\n";
+                continue;
             }
+            tl.bindings.push_back(std::move(b));
+            continue;
+        }
+
+        AnimTrack tr;
+        size_t numKeys = 0;
+        int comps = 1;
+        std::string interp;
+        bool valid = true;
+        if (kw == "param") {
+            std::string name; ls >> name >> numKeys >> interp;
+            tr.target = AnimTarget::Param;
+            tr.index = tl.slots.emplace(name, (int)tl.slots.size()).first->second;
+            valid = !name.empty() && name != "t";
+        } else if (kw == "vertex") {
+            std::string layer; ls >> layer >> tr.shape >> tr.index >> numKeys >> interp;
+            tr.target = AnimTarget::Vertex; comps = 2;
+            valid = layerOf(layer, tr.foliage);
+        } else if (kw == "color") {
+            std::string layer; ls >> layer >> tr.shape >> numKeys >> interp;
+            tr.target = AnimTarget::Color; comps = 4;
+            valid = layerOf(layer, tr.foliage);
+        } else {
+            std::cerr << filename << ":" << lineNo << ": unknown keyword " << kw << "\n";
+            continue;
+        }
+        tr.interp = interpOf(interp);
+        for (size_t k = 0; k < numKeys && std::getline(in, line); ++k) {
+            lineNo++;
+            std::istringstream ks(line);
+            AnimKey key{0.0f, {0.0f, 0.0f, 0.0f, 255.0f}};
+            ks >> key.t;
+            for (int c = 0; c < comps; ++c) ks >> key.v[c];
+            if (!ks) valid = false;
+            tr.keys.push_back(key);
+        }
+        if (!valid || tr.keys.size() != numKeys || numKeys == 0) {
+            std::cerr << filename << ":" << lineNo << ": bad " << kw << " track\n";
+            continue;
+        }
+        if (tr.target != AnimTarget::Param && !shapeOk(tr.foliage, tr.shape, tr.index, tr.target == AnimTarget::Vertex)) {
+            std::cerr << filename << ":" << lineNo << ": " << kw << " target out of range\n";
+            continue;
         }
+        std::stable_sort(tr.keys.begin(), tr.keys.end(), [](const AnimKey& a, const AnimKey& b){ return a.t < b.t; });
+        lastKey = std::max(lastKey, tr.keys.back().t);
+        tl.tracks.push_back(std::move(tr));
     }
-    return out.str();
+
+    if (!durationSet) tl.duration = lastKey;
+    tl.params.assign(tl.slots.size(), 0.0f);
+    std::stable_sort(tl.tracks.begin(), tl.tracks.end(), [](const AnimTrack& a, const AnimTrack& b){
+        return (a.target == AnimTarget::Param) > (b.target == AnimTarget::Param);
+    });
+
+    tl.animatedMask[0].assign(foliage.paths.size(), 0);
+    tl.animatedMask[1].assign(trunks.paths.size(), 0);
+    auto mark = [&](bool foliage, size_t shape) {
+        int l = foliage ? 0 : 1;
+        if (!tl.animatedMask[l][shape]) { tl.animatedMask[l][shape] = 1; tl.animatedShapes[l].push_back(shape); }
+    };
+    for (const auto& tr : tl.tracks) if (tr.target != AnimTarget::Param) mark(tr.foliage, tr.shape);
+    for (const auto& b : tl.bindings) mark(b.foliage, b.shape);
+    for (auto& v : tl.animatedShapes) std::sort(v.begin(), v.end());
+    return true;
 }
 
-static float distanceSquared(int x1, int y1, int x2, int y2) {
-    float dx = static_cast<float>(x1 - x2);
-    float dy = static_cast<float>(y1 - y2);
-    return dx*dx + dy*dy;
+static bool loadAnimTimeline(const std::string& filename, const Scene& scene, AnimTimeline& tl) {
+    return loadAnimTimeline(filename, scene.foliage, scene.trunks, tl);
 }
 
-static float distancePointToSegmentSquared(int px, int py, int x1, int y1, int x2, int y2) {
-    float vx = static_cast<float>(x2 - x1);
-    float vy = static_cast<float>(y2 - y1);
-    float wx = static_cast<float>(px - x1);
-    float wy = static_cast<float>(py - y1);
-    float c1 = vx * wx + vy * wy;
-    if (c1 <= 0.0f) return distanceSquared(px, py, x1, y1);
-    float c2 = vx * vx + vy * vy;
-    if (c2 <= c1) return distanceSquared(px, py, x2, y2);
-    float b = c1 / c2;
-    float bx = x1 + b * vx;
-    float by = y1 + b * vy;
-    return distanceSquared(px, py, static_cast<int>(std::round(bx)), static_cast<int>(std::round(by)));
+// Drops the foliage tracks and bindings, for views that do not show foliage.
+static void dropAnimFoliage(AnimTimeline& tl) {
+    tl.tracks.erase(std::remove_if(tl.tracks.begin(), tl.tracks.end(), [](const AnimTrack& tr) {
+        return tr.target != AnimTarget::Param && tr.foliage; }), tl.tracks.end());
+    tl.bindings.erase(std::remove_if(tl.bindings.begin(), tl.bindings.end(), [](const AnimBinding& b) {
+        return b.foliage; }), tl.bindings.end());
+    tl.animatedMask[0].clear();
+    tl.animatedShapes[0].clear();
 }
 
-struct Theme {
-    SDL_Color background;     
-    SDL_Color panel;       
-    SDL_Color panelAccent;    
-    SDL_Color inputBg;        
-    SDL_Color inputBorder;    
-    SDL_Color textPrimary;    
-    SDL_Color textSecondary;  
-    SDL_Color buttonBg;        
-    SDL_Color buttonHover;     
-    SDL_Color cursor;          
+// Writes the state at `time` into the animated shapes of `scene`; static shapes are never touched.
+static void evaluateTimeline(AnimTimeline& tl, double time, Scene& scene) {
+    float t = (float)time;
+    if (tl.duration > 0.0f) t = tl.loop ? std::fmod(t, tl.duration) : std::min(t, tl.duration);
+    tl.params[0] = t;
+    for (auto& tr : tl.tracks) {
+        float v[4];
+        sampleAnimTrack(tr, t, v);
+        SceneLayer& l = tr.foliage ? scene.foliage : scene.trunks;
+        switch (tr.target) {
+            case AnimTarget::Param:
+                tl.params[tr.index] = v[0];
+                break;
+            case AnimTarget::Vertex:
+                l.paths[tr.shape][tr.index] = { v[0], v[1] };
+                break;
+            case AnimTarget::Color:
+                if (tr.shape < l.colors.size()) {
+                    auto ch = [](float f) { return (Uint8)std::max(0.0f, std::min(255.0f, std::round(f))); };
+                    l.colors[tr.shape] = SDL_Color{ ch(v[0]), ch(v[1]), ch(v[2]), ch(v[3]) };
+                }
+                break;
+        }
+    }
+    for (const auto& b : tl.bindings) {
+        SceneLayer& l = b.foliage ? scene.foliage : scene.trunks;
+        l.paths[b.shape][b.vertex] = { evalAnimExpr(b.x, tl.params), evalAnimExpr(b.y, tl.params) };
+    }
+}
+
+static void renderLayerShape(SDL_Renderer* renderer, const SceneLayer& layer, size_t i) {
+    SDL_Color c = i < layer.colors.size() ? layer.colors[i] : SDL_Color{255,255,255,255};
+    ShapeType t = i < layer.types.size() ? layer.types[i] : ShapeType::Line;
+    renderShape(renderer, layer.paths[i], c, t);
+}
+
+// Shapes driven by the timeline; everything else is drawn once into a static layer.
+static bool animDriven(const AnimTimeline& tl, int layer, size_t i) {
+    return i < tl.animatedMask[layer].size() && tl.animatedMask[layer][i];
+}
+
+// CPU raster target following the same drawing rules as renderShape. Unlike an
+// SDL_Renderer it can be used from any thread, which headless export relies on.
+struct Canvas {
+    int w = 0, h = 0;
+    std::vector<Uint32> px; // ARGB8888
+    int clipX0 = 0, clipY0 = 0; // drawing is limited to [clipX0, clipX1) x [clipY0, clipY1)
+    int clipX1 = std::numeric_limits<int>::max(), clipY1 = std::numeric_limits<int>::max();
 };
 
-static Theme makeDarkOceanTheme() {
-    Theme t{};
-    t.background    = { 5, 9, 14, 255 };        
-    t.panel         = { 14, 22, 35, 210 };     
-    t.panelAccent   = { 18, 28, 44, 235 };      
-    t.inputBg       = { 9, 14, 22, 230 };
-    t.inputBorder   = { 60, 120, 220, 180 };     
-    t.textPrimary   = { 236, 242, 252, 255 };   
-    t.textSecondary = { 160, 176, 200, 255 };
-    t.buttonBg      = { 24, 42, 68, 220 };
-    t.buttonHover   = { 34, 62, 98, 240 };
-    t.cursor        = { 255, 255, 255, 255 };
-    return t;
+static Canvas makeCanvas(int w, int h, SDL_Color bg) {
+    Canvas cv;
+    cv.w = w; cv.h = h;
+    cv.px.assign((size_t)w * h, ((Uint32)bg.a << 24) | ((Uint32)bg.r << 16) | ((Uint32)bg.g << 8) | bg.b);
+    return cv;
 }
 
-static void setColor(SDL_Renderer* r, SDL_Color c) {
-    SDL_SetRenderDrawColor(r, c.r, c.g, c.b, c.a);
+// As SDL_RenderSetClipRect; nullptr lifts the clip.
+static void canvasSetClip(Canvas& cv, const SDL_Rect* r) {
+    cv.clipX0 = r ? r->x : 0;
+    cv.clipY0 = r ? r->y : 0;
+    cv.clipX1 = r ? r->x + r->w : std::numeric_limits<int>::max();
+    cv.clipY1 = r ? r->y + r->h : std::numeric_limits<int>::max();
 }
 
-static void drawFilledCircle(SDL_Renderer* renderer, int cx, int cy, int radius, SDL_Color color); // fwd
+static void canvasFillRect(Canvas& cv, const SDL_Rect& r, SDL_Color c) {
+    int x0 = std::max(0, r.x), x1 = std::min(cv.w, r.x + r.w);
+    int y0 = std::max(0, r.y), y1 = std::min(cv.h, r.y + r.h);
+    Uint32 v = ((Uint32)c.a << 24) | ((Uint32)c.r << 16) | ((Uint32)c.g << 8) | c.b;
+    for (int y = y0; y < y1 && x0 < x1; ++y) std::fill_n(cv.px.begin() + (size_t)y * cv.w + x0, x1 - x0, v);
+}
 
-static void drawVerticalGradient(SDL_Renderer* r, SDL_Rect rect, SDL_Color top, SDL_Color bottom) {
-    for (int y = 0; y < rect.h; ++y) {
-        float t = rect.h <= 1 ? 0.0f : (float)y / (float)(rect.h - 1);
-        Uint8 rr = (Uint8)((1.0f - t) * top.r + t * bottom.r);
-        Uint8 gg = (Uint8)((1.0f - t) * top.g + t * bottom.g);
-        Uint8 bb = (Uint8)((1.0f - t) * top.b + t * bottom.b);
-        Uint8 aa = (Uint8)((1.0f - t) * top.a + t * bottom.a);
-        SDL_SetRenderDrawColor(r, rr, gg, bb, aa);
-        SDL_RenderDrawLine(r, rect.x, rect.y + y, rect.x + rect.w, rect.y + y);
+static inline void canvasBlend(Canvas& cv, int x, int y, SDL_Color c) {
+    if ((unsigned)x >= (unsigned)cv.w || (unsigned)y >= (unsigned)cv.h) return;
+    if (x < cv.clipX0 || y < cv.clipY0 || x >= cv.clipX1 || y >= cv.clipY1) return;
+    Uint32& d = cv.px[(size_t)y * cv.w + x];
+    if (c.a == 255) { d = 0xFF000000u | ((Uint32)c.r << 16) | ((Uint32)c.g << 8) | c.b; return; }
+    if (c.a == 0) return;
+    Uint32 da = d >> 24;
+    if (da == 255) {
+        Uint32 ia = 255 - c.a;
+        Uint32 r = (c.r * c.a + ((d >> 16) & 0xFF) * ia) / 255;
+        Uint32 g = (c.g * c.a + ((d >> 8) & 0xFF) * ia) / 255;
+        Uint32 b = (c.b * c.a + (d & 0xFF) * ia) / 255;
+        d = 0xFF000000u | (r << 16) | (g << 8) | b;
+        return;
     }
+    // transparent target (symbol rasters): straight-alpha "over"
+    Uint32 wd = da * (255 - c.a) / 255;
+    Uint32 a = c.a + wd;
+    Uint32 r = (c.r * c.a + ((d >> 16) & 0xFF) * wd) / a;
+    Uint32 g = (c.g * c.a + ((d >> 8) & 0xFF) * wd) / a;
+    Uint32 b = (c.b * c.a + (d & 0xFF) * wd) / a;
+    d = (a << 24) | (r << 16) | (g << 8) | b;
 }
 
-static SDL_Rect drawWindowHeaderWithClose(SDL_Renderer* r, int winW) {
-    SDL_Rect header{0, 0, winW, 40};
-    SDL_Color a{ 18, 28, 44, 220 }, b{ 12, 18, 28, 220 };
-    drawVerticalGradient(r, header, a, b);
-    
-    int radius = 8;
-    int cx = winW - 20;
-    int cy = header.y + header.h / 2;
-    drawFilledCircle(r, cx, cy, radius, { 235, 80, 80, 255 });
+static void canvasLine(Canvas& cv, int x0, int y0, int x1, int y1, SDL_Color c) {
+    int dx = std::abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
+    int dy = -std::abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
+    int err = dx + dy;
+    for (;;) {
+        canvasBlend(cv, x0, y0, c);
+        if (x0 == x1 && y0 == y1) break;
+        int e2 = 2 * err;
+        if (e2 >= dy) { err += dy; x0 += sx; }
+        if (e2 <= dx) { err += dx; y0 += sy; }
+    }
+}
 
-    SDL_SetRenderDrawColor(r, 250, 230, 230, 230);
-    SDL_RenderDrawLine(r, cx - 3, cy - 3, cx + 3, cy + 3);      
-    SDL_RenderDrawLine(r, cx - 3, cy + 3, cx + 3, cy - 3);
-   
-    SDL_Rect closeRect{ cx - radius - 2, cy - radius - 2, (radius + 2) * 2, (radius + 2) * 2 };
-    return closeRect;
+static void canvasThickPath(Canvas& cv, const Path& path, bool closed, SDL_Color c, int thickness) {
+    if (path.size() < 2) return;
+    int r = std::max(0, thickness);
+    for (int dy = -r; dy <= r; ++dy) {
+        for (int dx = -r; dx <= r; ++dx) {
+            if (dx*dx + dy*dy > r*r) continue;
+            for (size_t i = 1; i < path.size(); i++) {
+                canvasLine(cv, toPixel(path[i-1].x) + dx, toPixel(path[i-1].y) + dy, toPixel(path[i].x) + dx, toPixel(path[i].y) + dy, c);
+            }
+            if (closed) canvasLine(cv, toPixel(path.back().x) + dx, toPixel(path.back().y) + dy, toPixel(path.front().x) + dx, toPixel(path.front().y) + dy, c);
+        }
+    }
 }
 
-static void drawWindowHeaderWithControls(SDL_Renderer* r, int winW, SDL_Rect& closeRectOut, SDL_Rect& penRectOut) {
-    SDL_Rect header{0, 0, winW, 40};
-    SDL_Color a{ 18, 28, 44, 220 }, b{ 12, 18, 28, 220 };
-    drawVerticalGradient(r, header, a, b);
-    
-    int radius = 8;
-    int cx = winW - 20;
-    int cy = header.y + header.h / 2;
-    drawFilledCircle(r, cx, cy, radius, { 235, 80, 80, 255 });
-    SDL_SetRenderDrawColor(r, 250, 230, 230, 230);
-    SDL_RenderDrawLine(r, cx - 3, cy - 3, cx + 3, cy + 3);
-    SDL_RenderDrawLine(r, cx - 3, cy + 3, cx + 3, cy - 3);
-    closeRectOut = { cx - radius - 2, cy - radius - 2, (radius + 2) * 2, (radius + 2) * 2 };
+static void canvasCircleOutline(Canvas& cv, int cx, int cy, int radius, SDL_Color c, int thickness) {
+    for (int t = -thickness; t <= thickness; ++t) {
+        int r = std::max(1, radius + t);
+        int r2 = r * r;
+        for (int dy = -r; dy <= r; ++dy) {
+            int dx = (int)std::round(std::sqrt(std::max(0, r2 - dy*dy)));
+            canvasBlend(cv, cx + dx, cy + dy, c);
+            canvasBlend(cv, cx - dx, cy + dy, c);
+        }
+    }
+}
 
-    int pcx = winW - 50;
-    int pcy = cy;
-    drawFilledCircle(r, pcx, pcy, radius, { 90, 150, 255, 230 });
+static void canvasShape(Canvas& cv, const Path& p, SDL_Color c, ShapeType type) {
+    if (type == ShapeType::Circle && p.size() >= 2) {
+        int cx = toPixel((p[0].x + p[1].x) * 0.5f);
+        int cy = toPixel((p[0].y + p[1].y) * 0.5f);
+        float dx = p[0].x - p[1].x; float dy = p[0].y - p[1].y; int radius = (int)std::round(std::sqrt(dx*dx + dy*dy) / 2.0f);
+        canvasCircleOutline(cv, cx, cy, radius, c, 2);
+        return;
+    }
+    bool closed = (type == ShapeType::Triangle && p.size() >= 3) || (type == ShapeType::Quadrilateral && p.size() >= 4);
+    canvasThickPath(cv, p, closed, c, 2);
+}
 
-    SDL_SetRenderDrawColor(r, 20, 30, 60, 255);
-    SDL_RenderDrawLine(r, pcx - 3, pcy + 2, pcx + 3, pcy - 4);
-    SDL_RenderDrawLine(r, pcx - 1, pcy + 2, pcx + 5, pcy - 4);
-    penRectOut = { pcx - radius - 2, pcy - radius - 2, (radius + 2) * 2, (radius + 2) * 2 };
+static void canvasLayerShape(Canvas& cv, const SceneLayer& layer, size_t i) {
+    SDL_Color c = i < layer.colors.size() ? layer.colors[i] : SDL_Color{255,255,255,255};
+    ShapeType t = i < layer.types.size() ? layer.types[i] : ShapeType::Line;
+    canvasShape(cv, layer.paths[i], c, t);
 }
 
-static void fillRoundedRect(SDL_Renderer* r, SDL_Rect rect, int radius, SDL_Color color) {
-    setColor(r, color);
+// Symbols are rasterized once per scale bucket (quarter octaves) and reused for every
+// instance in that bucket; strokes keep their on-screen thickness at any scale.
+static const int kSymbolPad = 4;
+static const int kSymbolMaxRaster = 4096; // larger symbols rasterize at a lower scale and stretch
 
-    SDL_Rect body = { rect.x + radius, rect.y, rect.w - 2*radius, rect.h };
-    SDL_RenderFillRect(r, &body);
+static int symbolScaleBucket(float scale) {
+    return (int)std::lround(std::log2(std::max(scale, 1.0f / 64.0f)) * 4.0f);
+}
 
-    SDL_Rect left = { rect.x, rect.y + radius, radius, rect.h - 2*radius };
-    SDL_Rect right = { rect.x + rect.w - radius, rect.y + radius, radius, rect.h - 2*radius };
-    SDL_RenderFillRect(r, &left);
-    SDL_RenderFillRect(r, &right);
-    
-    drawFilledCircle(r, rect.x + radius, rect.y + radius, radius, color);
-    drawFilledCircle(r, rect.x + rect.w - radius - 1, rect.y + radius, radius, color);
-    drawFilledCircle(r, rect.x + radius, rect.y + rect.h - radius - 1, radius, color);
-    drawFilledCircle(r, rect.x + rect.w - radius - 1, rect.y + rect.h - radius - 1, radius, color);
+struct SymbolRaster {
+    Canvas canvas;
+    float originX = 0.0f, originY = 0.0f; // symbol origin inside the raster
+    float scale = 1.0f;
+};
+
+static float symbolRasterScale(const Symbol& sym, int bucket) {
+    float scale = std::exp2(bucket / 4.0f);
+    float room = (float)(kSymbolMaxRaster - 2 * kSymbolPad - 1);
+    float extent = std::max(sym.bounds.w, sym.bounds.h) * scale;
+    return extent > room ? scale * room / extent : scale;
 }
 
-static void drawRectBorder(SDL_Renderer* r, SDL_Rect rect, int radius, SDL_Color color) {
-    setColor(r, color);
-    SDL_RenderDrawLine(r, rect.x + radius, rect.y, rect.x + rect.w - radius, rect.y);
-    SDL_RenderDrawLine(r, rect.x + radius, rect.y + rect.h - 1, rect.x + rect.w - radius, rect.y + rect.h - 1);
-    SDL_RenderDrawLine(r, rect.x, rect.y + radius, rect.x, rect.y + rect.h - radius);
-    SDL_RenderDrawLine(r, rect.x + rect.w - 1, rect.y + radius, rect.x + rect.w - 1, rect.y + rect.h - radius);
+static SymbolRaster rasterizeSymbol(const Symbol& sym, int bucket) {
+    SymbolRaster r;
+    r.scale = symbolRasterScale(sym, bucket);
+    r.originX = -sym.bounds.x * r.scale + kSymbolPad;
+    r.originY = -sym.bounds.y * r.scale + kSymbolPad;
+    int w = std::min(kSymbolMaxRaster, (int)std::ceil(sym.bounds.w * r.scale) + 2 * kSymbolPad + 1);
+    int h = std::min(kSymbolMaxRaster, (int)std::ceil(sym.bounds.h * r.scale) + 2 * kSymbolPad + 1);
+    r.canvas = makeCanvas(w, h, SDL_Color{0, 0, 0, 0});
+    for (size_t i = 0; i < sym.shapes.paths.size(); ++i) {
+        Path p = sym.shapes.paths[i];
+        for (auto& pt : p) {
+            pt = { pt.x * r.scale + r.originX, pt.y * r.scale + r.originY };
+        }
+        canvasShape(r.canvas, p, sym.shapes.colors[i], sym.shapes.types[i]);
+    }
+    return r;
 }
 
-static TTF_Font* tryLoadAnyFont(int size) {
-    const char* candidates[] = {
-        "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf",
-        "/usr/share/fonts/truetype/ubuntu/Ubuntu-R.ttf",
-        "/usr/share/fonts/truetype/freefont/FreeSans.ttf",
-        "/usr/share/fonts/truetype/liberation/LiberationSans-Regular.ttf",
-        "/usr/share/fonts/TTF/DejaVuSans.ttf"
-    };
-    for (const char* path : candidates) {
-        TTF_Font* f = TTF_OpenFont(path, size);
-        if (f) return f;
+// Inverse-maps every covered pixel into the symbol raster (nearest sample), tints, blends.
+static void canvasBlitInstance(Canvas& cv, const SymbolRaster& r, const SymbolInstance& inst) {
+    float k = inst.scale / r.scale;
+    if (k <= 0.0f) return;
+    float rad = inst.rotation * 3.14159265f / 180.0f;
+    float cs = std::cos(rad), sn = std::sin(rad);
+    float minX = 1e9f, minY = 1e9f, maxX = -1e9f, maxY = -1e9f;
+    const float corners[4][2] = { {0, 0}, {(float)r.canvas.w, 0}, {0, (float)r.canvas.h}, {(float)r.canvas.w, (float)r.canvas.h} };
+    for (const auto& q : corners) {
+        float lx = (q[0] - r.originX) * k, ly = (q[1] - r.originY) * k;
+        float X = inst.x + lx * cs - ly * sn, Y = inst.y + lx * sn + ly * cs;
+        minX = std::min(minX, X); maxX = std::max(maxX, X);
+        minY = std::min(minY, Y); maxY = std::max(maxY, Y);
+    }
+    int x0 = std::max({ 0, cv.clipX0, (int)std::floor(minX) }), x1 = std::min({ cv.w - 1, cv.clipX1 - 1, (int)std::ceil(maxX) });
+    int y0 = std::max({ 0, cv.clipY0, (int)std::floor(minY) }), y1 = std::min({ cv.h - 1, cv.clipY1 - 1, (int)std::ceil(maxY) });
+    float inv = 1.0f / k;
+    for (int y = y0; y <= y1; ++y) {
+        for (int x = x0; x <= x1; ++x) {
+            float dx = x + 0.5f - inst.x, dy = y + 0.5f - inst.y;
+            int sx = (int)std::floor((dx * cs + dy * sn) * inv + r.originX);
+            int sy = (int)std::floor((-dx * sn + dy * cs) * inv + r.originY);
+            if ((unsigned)sx >= (unsigned)r.canvas.w || (unsigned)sy >= (unsigned)r.canvas.h) continue;
+            Uint32 p = r.canvas.px[(size_t)sy * r.canvas.w + sx];
+            Uint32 a = p >> 24;
+            if (a == 0) continue;
+            SDL_Color c{ (Uint8)(((p >> 16) & 0xFF) * inst.tint.r / 255), (Uint8)(((p >> 8) & 0xFF) * inst.tint.g / 255),
+                         (Uint8)((p & 0xFF) * inst.tint.b / 255), (Uint8)(a * inst.tint.a / 255) };
+            canvasBlend(cv, x, y, c);
+        }
     }
-    return nullptr;
 }
 
-static void renderText(SDL_Renderer* r, TTF_Font* font, const std::string& text, int x, int y, SDL_Color color) {
-    if (!font) return;
-    SDL_Surface* s = TTF_RenderUTF8_Blended(font, text.c_str(), color);
-    if (!s) return;
-    SDL_Texture* t = SDL_CreateTextureFromSurface(r, s);
-    SDL_Rect dst{ x, y, s->w, s->h };
-    SDL_FreeSurface(s);
-    SDL_RenderCopy(r, t, nullptr, &dst);
-    SDL_DestroyTexture(t);
+// Screen area an instance's raster can touch, padding and rounding included.
+static SDL_Rect instanceBounds(const Symbol& sym, const SymbolInstance& inst) {
+    float pad = (kSymbolPad + 2) / symbolRasterScale(sym, symbolScaleBucket(inst.scale));
+    float rad = inst.rotation * 3.14159265f / 180.0f;
+    float cs = std::cos(rad), sn = std::sin(rad);
+    float bx0 = sym.bounds.x - pad, by0 = sym.bounds.y - pad;
+    float bx1 = sym.bounds.x + sym.bounds.w + pad, by1 = sym.bounds.y + sym.bounds.h + pad;
+    float minX = 1e9f, minY = 1e9f, maxX = -1e9f, maxY = -1e9f;
+    const float corners[4][2] = { {bx0, by0}, {bx1, by0}, {bx0, by1}, {bx1, by1} };
+    for (const auto& q : corners) {
+        float lx = q[0] * inst.scale, ly = q[1] * inst.scale;
+        float X = inst.x + lx * cs - ly * sn, Y = inst.y + lx * sn + ly * cs;
+        minX = std::min(minX, X); maxX = std::max(maxX, X);
+        minY = std::min(minY, Y); maxY = std::max(maxY, Y);
+    }
+    int x0 = (int)std::floor(minX) - 1, y0 = (int)std::floor(minY) - 1;
+    return SDL_Rect{ x0, y0, (int)std::ceil(maxX) + 2 - x0, (int)std::ceil(maxY) + 2 - y0 };
 }
 
-static void renderWrappedText(SDL_Renderer* r, TTF_Font* font, const std::string& text, SDL_Rect bounds, SDL_Color color) {
-    if (!font) return;
-    SDL_Surface* s = TTF_RenderUTF8_Blended_Wrapped(font, text.c_str(), color, bounds.w);
-    if (!s) return;
-    SDL_Texture* t = SDL_CreateTextureFromSurface(r, s);
-    SDL_Rect dst{ bounds.x, bounds.y, s->w, s->h };
-    SDL_FreeSurface(s);
-    SDL_RenderCopy(r, t, nullptr, &dst);
-    SDL_DestroyTexture(t);
+using SymbolRasterCache = std::map<std::pair<int, int>, SymbolRaster>;
+
+static void canvasSymbolInstance(Canvas& cv, const std::vector<Symbol>& symbols, const SymbolInstance& inst,
+                                 SymbolRasterCache& cache) {
+    int bucket = symbolScaleBucket(inst.scale);
+    auto key = std::make_pair(inst.symbol, bucket);
+    auto it = cache.find(key);
+    if (it == cache.end()) it = cache.emplace(key, rasterizeSymbol(symbols[inst.symbol], bucket)).first;
+    canvasBlitInstance(cv, it->second, inst);
 }
 
-static bool pointInRect(int x, int y, const SDL_Rect& rect) {
-    return x >= rect.x && x < rect.x + rect.w && y >= rect.y && y < rect.y + rect.h;
+// sx/sy map scene coordinates onto the canvas; instance scales follow their geometric mean.
+static void canvasSymbolInstances(Canvas& cv, const Scene& scene, float sx = 1.0f, float sy = 1.0f) {
+    SymbolRasterCache cache;
+    float k = std::sqrt(sx * sy);
+    for (SymbolInstance inst : scene.instances) {
+        inst.x *= sx; inst.y *= sy; inst.scale *= k;
+        canvasSymbolInstance(cv, scene.symbols, inst, cache);
+    }
 }
 
-static void drawDropShadow(SDL_Renderer* r, SDL_Rect rect, int radius, int spread, SDL_Color color) {
+// Draws the 800x600 scene view stretched over the whole canvas. Shapes are scaled before
+// they are rasterized, so any size comes out sharp with the usual stroke width.
+static void canvasScene(Canvas& cv, const Scene& scene) {
+    float sx = cv.w / 800.0f, sy = cv.h / 600.0f;
+    for (const SceneLayer* l : { &scene.foliage, &scene.trunks }) {
+        for (size_t i = 0; i < l->paths.size(); ++i) {
+            if (sx == 1.0f && sy == 1.0f) { canvasLayerShape(cv, *l, i); continue; }
+            Path p = l->paths[i];
+            for (auto& pt : p) pt = { pt.x * sx, pt.y * sy };
+            canvasShape(cv, p, i < l->colors.size() ? l->colors[i] : SDL_Color{255,255,255,255},
+                        i < l->types.size() ? l->types[i] : ShapeType::Line);
+        }
+    }
+    canvasSymbolInstances(cv, scene, sx, sy);
+}
 
-    for (int i = spread; i >= 1; --i) {
-        SDL_Color c = color; c.a = (Uint8)std::max(10, (color.a * i) / (spread * 2));
-        SDL_Rect rr{ rect.x - i, rect.y - i, rect.w + 2*i, rect.h + 2*i };
-        fillRoundedRect(r, rr, radius + i, c);
+// Same rasters uploaded as textures; instances are then one textured quad each.
+struct SymbolTextureCache {
+    struct Entry {
+        SDL_Texture* texture = nullptr;
+        float originX = 0.0f, originY = 0.0f, scale = 1.0f;
+        int w = 0, h = 0;
+    };
+    std::map<std::pair<int, int>, Entry> entries;
+};
+
+static void destroySymbolTextures(SymbolTextureCache& cache) {
+    for (auto& kv : cache.entries) if (kv.second.texture) SDL_DestroyTexture(kv.second.texture);
+    cache.entries.clear();
+}
+
+static void renderSymbolInstance(SDL_Renderer* renderer, const std::vector<Symbol>& symbols,
+                                 const SymbolInstance& inst, SymbolTextureCache& cache) {
+    int bucket = symbolScaleBucket(inst.scale);
+    auto key = std::make_pair(inst.symbol, bucket);
+    auto it = cache.entries.find(key);
+    if (it == cache.entries.end()) {
+        SymbolRaster r = rasterizeSymbol(symbols[inst.symbol], bucket);
+        SymbolTextureCache::Entry e;
+        e.originX = r.originX; e.originY = r.originY; e.scale = r.scale; e.w = r.canvas.w; e.h = r.canvas.h;
+        SDL_Surface* s = SDL_CreateRGBSurfaceWithFormatFrom(r.canvas.px.data(), r.canvas.w, r.canvas.h, 32, r.canvas.w * 4, SDL_PIXELFORMAT_ARGB8888);
+        if (s) {
+            e.texture = SDL_CreateTextureFromSurface(renderer, s);
+            SDL_FreeSurface(s);
+        }
+        if (e.texture) SDL_SetTextureBlendMode(e.texture, SDL_BLENDMODE_BLEND);
+        it = cache.entries.emplace(key, e).first;
     }
+    const auto& e = it->second;
+    if (!e.texture) return;
+    float k = inst.scale / e.scale;
+    SDL_FRect dst{ inst.x - e.originX * k, inst.y - e.originY * k, e.w * k, e.h * k };
+    SDL_FPoint center{ e.originX * k, e.originY * k };
+    SDL_SetTextureColorMod(e.texture, inst.tint.r, inst.tint.g, inst.tint.b);
+    SDL_SetTextureAlphaMod(e.texture, inst.tint.a);
+    SDL_RenderCopyExF(renderer, e.texture, nullptr, &dst, inst.rotation, &center, SDL_FLIP_NONE);
 }
 
-static void drawUnderline(SDL_Renderer* r, int x, int y, int w, SDL_Color color) {
-    setColor(r, color);
-    SDL_RenderDrawLine(r, x, y, x + w, y);
+static void renderSymbolInstances(SDL_Renderer* renderer, const std::vector<Symbol>& symbols,
+                                  const std::vector<SymbolInstance>& instances, SymbolTextureCache& cache) {
+    for (const auto& inst : instances) renderSymbolInstance(renderer, symbols, inst, cache);
 }
 
-static bool runGuiTerminal(const std::string& basePath) {
-    bool initedVideoHere = false;
-    if (SDL_WasInit(SDL_INIT_VIDEO) == 0) {
-        if (SDL_Init(SDL_INIT_VIDEO) < 0) {
-            std::cerr << "SDL could not initialize! SDL_Error: " << SDL_GetError() << "\n";
-            return false;
+// Where every shape and instance draws. Animation keeps the static ones in a cached layer
+// and each frame repaints only the areas the animated shapes cover, redrawing in stacking
+// order whatever overlaps them, so a shape keeps its place above or below the animated ones.
+struct SceneFootprint {
+    std::vector<SDL_Rect> shapes[2]; // foliage, trunks
+    std::vector<SDL_Rect> instances;
+};
+
+static void measureScene(const Scene& scene, SceneFootprint& fp) {
+    const SceneLayer* layers[2] = { &scene.foliage, &scene.trunks };
+    for (int l = 0; l < 2; ++l) {
+        fp.shapes[l].resize(layers[l]->paths.size());
+        for (size_t i = 0; i < layers[l]->paths.size(); ++i) {
+            fp.shapes[l][i] = drawnBounds(layers[l]->paths[i], i < layers[l]->types.size() ? layers[l]->types[i] : ShapeType::Line);
         }
-        initedVideoHere = true;
     }
-    if (TTF_Init() == -1) {
-        std::cerr << "SDL_ttf could not initialize! TTF_Error: " << TTF_GetError() << "\n";
-        if (initedVideoHere) SDL_Quit();
-        return false;
+    fp.instances.clear();
+    for (const auto& inst : scene.instances) fp.instances.push_back(instanceBounds(scene.symbols[inst.symbol], inst));
+}
+
+// Re-measures the animated shapes and returns the on-screen areas they now cover, with
+// overlapping areas merged so no pixel is repainted twice.
+static std::vector<SDL_Rect> animDamage(const Scene& scene, const AnimTimeline& tl, SceneFootprint& fp, int w, int h) {
+    const SceneLayer* layers[2] = { &scene.foliage, &scene.trunks };
+    const SDL_Rect screen{ 0, 0, w, h };
+    std::vector<SDL_Rect> rects;
+    for (int l = 0; l < 2; ++l) {
+        for (size_t i : tl.animatedShapes[l]) {
+            fp.shapes[l][i] = drawnBounds(layers[l]->paths[i], i < layers[l]->types.size() ? layers[l]->types[i] : ShapeType::Line);
+            SDL_Rect r;
+            if (!SDL_IntersectRect(&fp.shapes[l][i], &screen, &r)) continue;
+            for (size_t k = 0; k < rects.size(); ) {
+                if (!SDL_HasIntersection(&rects[k], &r)) { ++k; continue; }
+                r = unionRect(rects[k], r);
+                rects[k] = rects.back();
+                rects.pop_back();
+                k = 0;
+            }
+            rects.push_back(r);
+        }
+    }
+    return rects;
+}
+
+// Draws in stacking order what touches r, leaving out the animated shapes unless asked;
+// the caller clears and clips to r first.
+static void renderSceneArea(SDL_Renderer* renderer, const Scene& scene, const AnimTimeline& tl, const SceneFootprint& fp,
+                            const SDL_Rect& r, bool animated, SymbolTextureCache& cache) {
+    const SceneLayer* layers[2] = { &scene.foliage, &scene.trunks };
+    for (int l = 0; l < 2; ++l) {
+        for (size_t i = 0; i < layers[l]->paths.size(); ++i) {
+            if ((animated || !animDriven(tl, l, i)) && SDL_HasIntersection(&fp.shapes[l][i], &r)) renderLayerShape(renderer, *layers[l], i);
+        }
+    }
+    for (size_t k = 0; k < scene.instances.size(); ++k) {
+        if (SDL_HasIntersection(&fp.instances[k], &r)) renderSymbolInstance(renderer, scene.symbols, scene.instances[k], cache);
+    }
+}
+
+static void canvasSceneArea(Canvas& cv, const Scene& scene, const AnimTimeline& tl, const SceneFootprint& fp,
+                            const SDL_Rect& r, bool animated, SymbolRasterCache& cache) {
+    const SceneLayer* layers[2] = { &scene.foliage, &scene.trunks };
+    for (int l = 0; l < 2; ++l) {
+        for (size_t i = 0; i < layers[l]->paths.size(); ++i) {
+            if ((animated || !animDriven(tl, l, i)) && SDL_HasIntersection(&fp.shapes[l][i], &r)) canvasLayerShape(cv, *layers[l], i);
+        }
+    }
+    for (size_t k = 0; k < scene.instances.size(); ++k) {
+        if (SDL_HasIntersection(&fp.instances[k], &r)) canvasSymbolInstance(cv, scene.symbols, scene.instances[k], cache);
     }
+}
+
+static Uint64 hashPixels(const std::vector<Uint32>& px) {
+    Uint64 h = 1469598103934665603ull;
+    for (Uint32 v : px) { h ^= v; h *= 1099511628211ull; }
+    return h;
+}
+
+static bool savePng(const Uint32* px, int w, int h, const std::string& filename) {
+    SDL_Surface* s = SDL_CreateRGBSurfaceWithFormatFrom((void*)px, w, h, 32, w * 4, SDL_PIXELFORMAT_ARGB8888);
+    if (!s) return false;
+    bool ok = IMG_SavePNG(s, filename.c_str()) == 0;
+    SDL_FreeSurface(s);
+    return ok;
+}
+
+static std::string frameFileName(int index) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "frame_%05d.png", index);
+    return name;
+}
 
-    SDL_Window* window = SDL_CreateWindow(
-        "Atelier — Terminal",
-        SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-        1000, 700,
-        SDL_WINDOW_SHOWN | SDL_WINDOW_ALLOW_HIGHDPI
-    );
-    if (!window) {
-        std::cerr << "Window could not be created! SDL_Error: " << SDL_GetError() << "\n";
-        TTF_Quit();
-        if (initedVideoHere) SDL_Quit();
+// Renders <fps * duration> frames of a scene's timeline to <outDir>/frame_NNNNN.png.
+// Rasterization runs on one pool and PNG encoding on another; frames are handed over
+// in order through a bounded window so memory does not grow with clip length. A frame
+// identical to its predecessor is not re-encoded but hard-linked to it, and
+// frames.ffconcat lists only the unique frames with their hold durations.
+static bool exportFrames(const std::string& scenePath, const std::string& outDir, double fps, double duration, std::ostream& out) {
+    if (fps <= 0.0 || duration <= 0.0) {
+        out << "export-frames: fps and duration must be positive\n";
         return false;
     }
-    SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-    if (!renderer) {
-        std::cerr << "Renderer could not be created! SDL_Error: " << SDL_GetError() << "\n";
-        SDL_DestroyWindow(window);
-        TTF_Quit();
-        if (initedVideoHere) SDL_Quit();
+    std::error_code ec;
+    std::filesystem::create_directories(outDir, ec);
+    if (ec) {
+        out << "Cannot create " << outDir << ": " << ec.message() << "\n";
         return false;
     }
-    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
-
-    TTF_Font* font14 = tryLoadAnyFont(14);
-    TTF_Font* font16 = tryLoadAnyFont(16);
-    TTF_Font* font20 = tryLoadAnyFont(20);
-    if (!font14 || !font16 || !font20) {
-        std::cerr << "Failed to load a font. Falling back to CLI.\n";
-        if (font14) TTF_CloseFont(font14);
-        if (font16) TTF_CloseFont(font16);
-        if (font20) TTF_CloseFont(font20);
-        SDL_DestroyRenderer(renderer);
-        SDL_DestroyWindow(window);
-        TTF_Quit();
-        SDL_Quit();
+    if (!(IMG_Init(IMG_INIT_PNG) & IMG_INIT_PNG)) {
+        out << "SDL_image could not initialize! SDL_image Error: " << IMG_GetError() << "\n";
         return false;
     }
 
-    Theme theme = makeDarkOceanTheme();
+    Scene scene = loadScene(scenePath);
+    AnimTimeline timeline;
+    bool animated = loadAnimTimeline(scenePath + "/anim.txt", scene, timeline);
+    const int frameCount = std::max(1, (int)std::lround(fps * duration));
+    Uint32 startTicks = SDL_GetTicks();
 
-    SDL_Rect header = { 0, 0, 1000, 72 };
-    SDL_Rect outputPanel = { 40, 100, 920, 460 };
-    SDL_Rect inputPanel = { 40, 580, 920, 62 };
+    const SDL_Color backdrop{8, 12, 18, 255};
+    Canvas base = makeCanvas(800, 600, backdrop);
+    SceneFootprint footprint;
+    measureScene(scene, footprint);
+    SymbolRasterCache baseRasters;
+    canvasSceneArea(base, scene, timeline, footprint, SDL_Rect{ 0, 0, base.w, base.h }, false, baseRasters);
 
-    std::vector<std::string> outputLines;
-    auto appendOutput = [&](const std::string& s) {
-        std::istringstream ss(s);
-        std::string line;
-        while (std::getline(ss, line)) {
-            outputLines.push_back(line);
-        }     
-        if (outputLines.size() > 1000) {
-            outputLines.erase(outputLines.begin(), outputLines.begin() + (outputLines.size() - 1000));
+    struct Frame {
+        int index = 0;
+        Uint64 hash = 0;
+        std::shared_ptr<std::vector<Uint32>> pixels;
+    };
+    unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+    unsigned rasterThreads = hw, encodeThreads = std::max(1u, hw / 2);
+    const int maxInFlight = (int)(rasterThreads + encodeThreads) * 2;
+
+    std::mutex m;
+    std::condition_variable wake;
+    int nextFrame = 0, nextRelease = 0, inFlight = 0;
+    bool rasterDone = false;
+    std::map<int, Frame> pending;
+    std::deque<Frame> encodeQueue;
+    std::shared_ptr<std::vector<Uint32>> lastPixels;
+    Uint64 lastHash = 0;
+    std::vector<int> source(frameCount); // frame -> frame whose PNG it shares
+    int failures = 0, firstFailed = -1; // guarded by m
+    std::string firstError;
+
+    auto rasterWorker = [&]() {
+        Scene local = scene;
+        AnimTimeline tl = timeline;
+        SceneFootprint fp = footprint;
+        SymbolRasterCache rasters;
+        for (;;) {
+            int idx;
+            {
+                std::unique_lock<std::mutex> lk(m);
+                wake.wait(lk, [&]{ return inFlight < maxInFlight || nextFrame >= frameCount; });
+                if (nextFrame >= frameCount) return;
+                idx = nextFrame++;
+                inFlight++;
+            }
+            Canvas frame = base;
+            if (animated) {
+                evaluateTimeline(tl, idx / fps, local);
+                for (const SDL_Rect& r : animDamage(local, tl, fp, frame.w, frame.h)) {
+                    canvasFillRect(frame, r, backdrop);
+                    canvasSetClip(frame, &r);
+                    canvasSceneArea(frame, local, tl, fp, r, true, rasters);
+                }
+                canvasSetClip(frame, nullptr);
+            }
+            Frame f;
+            f.index = idx;
+            f.hash = hashPixels(frame.px);
+            f.pixels = std::make_shared<std::vector<Uint32>>(std::move(frame.px));
+            {
+                std::lock_guard<std::mutex> lk(m);
+                pending.emplace(idx, std::move(f));
+                for (auto it = pending.find(nextRelease); it != pending.end(); it = pending.find(nextRelease)) {
+                    Frame r = std::move(it->second);
+                    pending.erase(it);
+                    if (lastPixels && r.hash == lastHash && *r.pixels == *lastPixels) {
+                        source[r.index] = source[r.index - 1];
+                        inFlight--;
+                    } else {
+                        source[r.index] = r.index;
+                        lastHash = r.hash;
+                        lastPixels = r.pixels;
+                        encodeQueue.push_back(std::move(r));
+                    }
+                    nextRelease++;
+                }
+            }
+            wake.notify_all();
+        }
+    };
+    auto encodeWorker = [&]() {
+        for (;;) {
+            Frame f;
+            {
+                std::unique_lock<std::mutex> lk(m);
+                wake.wait(lk, [&]{ return !encodeQueue.empty() || rasterDone; });
+                if (encodeQueue.empty()) return;
+                f = std::move(encodeQueue.front());
+                encodeQueue.pop_front();
+            }
+            // SDL's error string is per thread, so it is read here
+            bool saved = savePng(f.pixels->data(), base.w, base.h, outDir + "/" + frameFileName(f.index));
+            std::string error = saved ? std::string() : IMG_GetError();
+            f.pixels.reset();
+            {
+                std::lock_guard<std::mutex> lk(m);
+                inFlight--;
+                if (!saved && failures++ == 0) { firstFailed = f.index; firstError = error; }
+            }
+            wake.notify_all();
         }
     };
 
-    appendOutput("Atelier Terminal. Type help for commands.");
+    std::vector<std::thread> rasterPool, encodePool;
+    for (unsigned i = 0; i < encodeThreads; ++i) encodePool.emplace_back(encodeWorker);
+    for (unsigned i = 0; i < rasterThreads; ++i) rasterPool.emplace_back(rasterWorker);
+    for (auto& t : rasterPool) t.join();
+    {
+        std::lock_guard<std::mutex> lk(m);
+        rasterDone = true;
+    }
+    wake.notify_all();
+    for (auto& t : encodePool) t.join();
 
-    std::string inputText;
-    size_t historyIndex = 0;
-    std::vector<std::string> history;
-    bool running = true;
+    if (failures > 0) {
+        out << "export-frames: failed to write " << failures << " frame(s); " << frameFileName(firstFailed) << ": "
+            << firstError << "\n";
+        return false;
+    }
 
-    SDL_StartTextInput();
+    int unique = 0;
+    for (int i = 0; i < frameCount; ++i) {
+        if (source[i] == i) { unique++; continue; }
+        std::string dst = outDir + "/" + frameFileName(i);
+        std::string src = outDir + "/" + frameFileName(source[i]);
+        std::filesystem::remove(dst, ec);
+        std::filesystem::create_hard_link(src, dst, ec);
+        if (ec) std::filesystem::copy_file(src, dst, ec);
+        if (ec) { out << "Cannot write " << dst << ": " << ec.message() << "\n"; return false; }
+    }
 
-    auto executeCommand = [&](const std::string& cmdRaw) {
-        std::string cmd = cmdRaw;
-        if (cmd == "") return;
-        appendOutput(std::string("> ") + cmd);
-        if (cmd == "help") {
-            appendOutput(collectHelpFromJson("/home/user/Atelier_lab/Programs/commands.json"));
-        } else if (cmd == "clear") {
-            outputLines.clear();
-        } else if (cmd == "draw") {
-            SDL_StopTextInput();
-            runViewer(basePath);
-            SDL_StartTextInput();
-        } else if (cmd == "edit") {
-            SDL_StopTextInput();
-            editMode(basePath);
-            SDL_StartTextInput();
-        } else if (cmd == "exit" || cmd == "quit") {
-            running = false;
-        } else {
-            appendOutput("Unknown command. Type 'help'.");
-        }
-    };
+    std::ofstream concat(outDir + "/frames.ffconcat");
+    concat << "ffconcat version 1.0\n";
+    for (int i = 0; i < frameCount; ) {
+        int j = i + 1;
+        while (j < frameCount && source[j] == source[i]) ++j;
+        concat << "file '" << frameFileName(i) << "'\nduration " << (j - i) / fps << "\n";
+        i = j;
+    }
+    // the concat demuxer ignores the last duration unless the file is repeated
+    concat << "file '" << frameFileName(source[frameCount - 1]) << "'\n";
+
+    out << "Exported " << frameCount << " frames (" << unique << " unique) to " << outDir
+        << " in " << (SDL_GetTicks() - startTicks) << " ms\n";
+    return true;
+}
+
+// Procedural forests: a stochastic bracketed L-system (X -> F[+X][-X]FX and variants)
+// interpreted depth-first, so the expanded string is never materialized. Each tree has
+// its own generator derived from (seed, tree index), which keeps the output identical
+// for a given seed no matter how trees are spread over threads. Branch segments go to
+// the trunks layer as lines; the outermost twigs and the leaves go to the foliage layer,
+// which is drawn underneath, so the canopy is not buried under bark.
+struct ForestParams {
+    Uint64 seed = 1;
+    size_t trees = 1;
+    int depth = 6;
+    float angle = 0.44f; // radians
+    int width = 800, height = 600;
+};
+
+// splitmix64; spelled out instead of <random> distributions, whose output varies by library
+struct ForestRng {
+    Uint64 state;
+    Uint64 next() {
+        Uint64 z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+    float uniform(float a, float b) { return a + (b - a) * (float)(next() >> 40) * (1.0f / 16777216.0f); }
+    int below(int n) { return (int)(next() % (Uint64)n); }
+};
+
+template <class Sink>
+static void growLSystem(ForestRng& rng, const ForestParams& fp, float x, float y, float heading, float len, int level, Sink& sink) {
+    static const char* rules[] = { "F[+X][-X]FX", "F[+X]F[-X]X", "F[-X][+X]FX" };
+    if (level == 0) {
+        float rot = rng.uniform(0.0f, 6.2831853f);
+        float shade = rng.uniform(0.75f, 1.15f);
+        sink.leaf(x, y, rot, shade);
+        return;
+    }
+    struct Turtle { float x, y, heading; };
+    Turtle stack[4];
+    Turtle t{x, y, heading};
+    int sp = 0;
+    for (const char* c = rules[rng.below(3)]; *c; ++c) {
+        switch (*c) {
+            case 'F': {
+                float nx = t.x + std::cos(t.heading) * len, ny = t.y - std::sin(t.heading) * len;
+                sink.segment(t.x, t.y, nx, ny, level);
+                t.x = nx; t.y = ny;
+                break;
+            }
+            case '+': t.heading += fp.angle * rng.uniform(0.6f, 1.3f); break;
+            case '-': t.heading -= fp.angle * rng.uniform(0.6f, 1.3f); break;
+            case '[': stack[sp++] = t; break;
+            case ']': t = stack[--sp]; break;
+            case 'X': growLSystem(rng, fp, t.x, t.y, t.heading, len * rng.uniform(0.62f, 0.78f), level - 1, sink); break;
+        }
+    }
+}
+
+template <class Sink>
+static void growTree(const ForestParams& fp, size_t tree, Sink& sink) {
+    ForestRng rng{fp.seed ^ (0xD1B54A32D192ED03ull * (tree + 1))};
+    float x = rng.uniform(10.0f, fp.width - 10.0f);
+    float y = rng.uniform(fp.height * 0.6f, fp.height - 5.0f);
+    float scale = y / fp.height; // trees further down read as closer
+    SDL_Color leafBase{ (Uint8)rng.uniform(30, 90), (Uint8)rng.uniform(110, 190), (Uint8)rng.uniform(30, 80), 255 };
+    sink.begin(leafBase);
+    growLSystem(rng, fp, x, y, 1.5707963f + rng.uniform(-0.08f, 0.08f), 34.0f * scale, fp.depth, sink);
+}
+
+struct ForestCountSink {
+    size_t trunk = 0, foliage = 0;
+    void begin(SDL_Color) {}
+    void segment(float, float, float, float, int level) { if (level > 1) trunk++; else foliage++; }
+    void leaf(float, float, float, float) { foliage++; }
+};
+
+// Writes straight into slots reserved in the scene layers by the counting pass.
+struct ForestWriteSink {
+    SceneLayer& trunks;
+    SceneLayer& foliage;
+    size_t seg, leafIdx;
+    int depth;
+    SDL_Color leafBase{};
+
+    void begin(SDL_Color c) { leafBase = c; }
+    void segment(float x0, float y0, float x1, float y1, int level) {
+        // generated geometry stays on whole pixels, so small libm differences rarely show in the output
+        Path line{ { std::round(x0), std::round(y0) }, { std::round(x1), std::round(y1) } };
+        if (level <= 1) {
+            foliage.paths[leafIdx] = std::move(line);
+            foliage.colors[leafIdx] = SDL_Color{ (Uint8)(leafBase.r * 3 / 4), (Uint8)(leafBase.g * 3 / 4), (Uint8)(leafBase.b * 3 / 4), 255 };
+            foliage.types[leafIdx] = ShapeType::Line;
+            leafIdx++;
+            return;
+        }
+        int k = std::min(40, 12 * (depth - level)); // bark lightens toward the twigs
+        trunks.paths[seg] = std::move(line);
+        trunks.colors[seg] = SDL_Color{ (Uint8)(92 + k), (Uint8)(62 + k), (Uint8)(38 + k / 2), 255 };
+        trunks.types[seg] = ShapeType::Line;
+        seg++;
+    }
+    void leaf(float x, float y, float rot, float shade) {
+        Path tri(3);
+        for (int i = 0; i < 3; ++i) {
+            float a = rot + i * 2.0943951f;
+            tri[i] = { std::round(x + std::cos(a) * 5.0f), std::round(y + std::sin(a) * 5.0f) };
+        }
+        auto ch = [&](Uint8 v) { return (Uint8)std::min(255.0f, v * shade); };
+        foliage.paths[leafIdx] = std::move(tri);
+        foliage.colors[leafIdx] = SDL_Color{ ch(leafBase.r), ch(leafBase.g), ch(leafBase.b), 255 };
+        foliage.types[leafIdx] = ShapeType::Triangle;
+        leafIdx++;
+    }
+};
+
+// Appends fp.trees trees to the scene. Trees are counted in parallel first, so the
+// layers are grown once and each tree is then generated in parallel into its own range.
+static void generateForest(Scene& scene, const ForestParams& fp, size_t& trunkOut, size_t& foliageOut) {
+    std::vector<ForestCountSink> counts(fp.trees);
+    parallelFor(fp.trees, [&](size_t t) { growTree(fp, t, counts[t]); });
+
+    std::vector<size_t> segOffset(fp.trees), leafOffset(fp.trees);
+    size_t segs = scene.trunks.paths.size(), leaves = scene.foliage.paths.size();
+    for (size_t t = 0; t < fp.trees; ++t) {
+        segOffset[t] = segs; leafOffset[t] = leaves;
+        segs += counts[t].trunk; leaves += counts[t].foliage;
+    }
+    trunkOut = segs - scene.trunks.paths.size();
+    foliageOut = leaves - scene.foliage.paths.size();
+
+    auto grow = [](SceneLayer& l, size_t n) {
+        l.colors.resize(l.paths.size(), SDL_Color{255,255,255,255});
+        l.types.resize(l.paths.size(), ShapeType::Line);
+        l.paths.resize(n); l.colors.resize(n); l.types.resize(n);
+    };
+    grow(scene.trunks, segs);
+    grow(scene.foliage, leaves);
+
+    parallelFor(fp.trees, [&](size_t t) {
+        ForestWriteSink sink{ scene.trunks, scene.foliage, segOffset[t], leafOffset[t], fp.depth };
+        growTree(fp, t, sink);
+    });
+}
+
+// Reads "<seed> <trees> [depth] [angle-degrees]" from a[first..]; seed, trees and depth
+// must be whole numbers and angle a number, so a typo is reported instead of growing 0 trees.
+static bool parseForestParams(const std::vector<std::string>& a, size_t first, ForestParams& fp, std::string& err) {
+    auto whole = [&](size_t i, Uint64& v) {
+        const char* s = a[i].c_str();
+        char* end = nullptr;
+        errno = 0;
+        v = std::strtoull(s, &end, 10);
+        if (std::isdigit((unsigned char)*s) && !*end && errno == 0) return true;
+        err = "not a whole number: " + a[i];
+        return false;
+    };
+    Uint64 trees = 0, depth = (Uint64)fp.depth;
+    if (!whole(first, fp.seed) || !whole(first + 1, trees)) return false;
+    fp.trees = (size_t)trees;
+    if (a.size() > first + 2 && !whole(first + 2, depth)) return false;
+    fp.depth = (int)std::max<Uint64>(1, std::min<Uint64>(14, depth));
+    if (a.size() > first + 3) {
+        char* end = nullptr;
+        double deg = std::strtod(a[first + 3].c_str(), &end);
+        if (end == a[first + 3].c_str() || *end) { err = "not a number: " + a[first + 3]; return false; }
+        fp.angle = (float)(deg * 3.14159265 / 180.0);
+    }
+    return true;
+}
+
+// Files whose size and mtime identify a scene's on-disk state.
+static Uint64 sceneStamp(const std::string& dir) {
+    static const char* const files[] = {
+        "paths.txt", "paths.txt.colors", "paths.txt.types", "current.txt", "current.txt.colors",
+        "current.txt.types", "symbols.txt", "instances.txt" };
+    long long s[2 * 8] = {};
+    for (int i = 0; i < 8; ++i) {
+        std::error_code ec;
+        std::filesystem::path p = std::filesystem::path(dir) / files[i];
+        auto mtime = std::filesystem::last_write_time(p, ec);
+        if (ec) continue;
+        s[2 * i] = (long long)mtime.time_since_epoch().count();
+        s[2 * i + 1] = (long long)std::filesystem::file_size(p, ec);
+    }
+    return hashBytes((const char*)s, sizeof(s));
+}
+
+// Application shell: one window, renderer, font cache, symbol texture cache and resident
+// scene shared by the terminal, the viewer and the editor. Modes switch the window's
+// title and size instead of creating their own, and take the scene from here instead of
+// parsing it, so entering one costs no window or parse. The resident scene is re-read
+// only when its files changed on disk since it was loaded or saved from here.
+// Editor snapping. Vertices, segment midpoints and circle centers live in a spatial hash
+// of small cells; segments are also bucketed into every cell they cross, so intersections
+// can be computed near the cursor on demand instead of precomputed for the whole scene.
+// Shapes are inserted and removed one at a time as the editor changes them, and the index
+// stays with the resident scene between editor runs. Entries are matched by geometry, not
+// by shape index, so erasing shapes never invalidates the index.
+enum class SnapKind : Uint8 { None = 0, Grid, Midpoint, Intersection, Center, Vertex };
+
+struct SnapIndex {
+    static constexpr int kCell = 16;
+    struct Pt { float x, y; SnapKind kind; };
+    struct Seg { float x0, y0, x1, y1; };
+    std::unordered_map<Uint64, std::vector<Pt>> points;
+    std::unordered_map<Uint64, std::vector<Seg>> segments;
+};
+
+struct AppShell {
+    SDL_Window* window = nullptr;
+    SDL_Surface* offscreen = nullptr; // headless shells render here instead
+    SDL_Renderer* renderer = nullptr;
+    bool initedVideo = false, initedImg = false, initedTtf = false;
+    std::string fontPath; // first candidate that opened
+    std::map<int, TTF_Font*> fonts;
+    SymbolTextureCache symbolCache;
+    std::string scenePath;
+    Scene scene;
+    Uint64 sceneStamp = 0;
+    bool sceneValid = false;
+    SnapIndex snapIndex; // snap targets of the resident scene's layers
+    bool snapValid = false;
+    bool vsync = false; // presents wait for vblank in the current mode
+};
+
+static bool openAppShell(AppShell& shell, bool headless) {
+    if (shell.renderer) return true;
+    if (!headless && SDL_WasInit(SDL_INIT_VIDEO) == 0) {
+        if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+            std::cerr << "SDL could not initialize! SDL_Error: " << SDL_GetError() << "\n";
+            return false;
+        }
+        shell.initedVideo = true;
+    }
+    if (!(IMG_Init(IMG_INIT_PNG) & IMG_INIT_PNG)) {
+        std::cerr << "SDL_image could not initialize! SDL_image Error: " << IMG_GetError() << "\n";
+    } else {
+        shell.initedImg = true;
+    }
+    if (!TTF_WasInit()) {
+        if (TTF_Init() == -1) std::cerr << "SDL_ttf could not initialize! TTF_Error: " << TTF_GetError() << "\n";
+        else shell.initedTtf = true;
+    }
+    if (headless) {
+        shell.offscreen = SDL_CreateRGBSurfaceWithFormat(0, 800, 600, 32, SDL_PIXELFORMAT_ARGB8888);
+        shell.renderer = shell.offscreen ? SDL_CreateSoftwareRenderer(shell.offscreen) : nullptr;
+        if (!shell.renderer) std::cerr << "Offscreen renderer could not be created! SDL_Error: " << SDL_GetError() << "\n";
+    } else {
+        shell.window = SDL_CreateWindow("Atelier", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 800, 600, SDL_WINDOW_HIDDEN);
+        if (!shell.window) std::cerr << "Window could not be created! SDL_Error: " << SDL_GetError() << "\n";
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+        else shell.renderer = SDL_CreateRenderer(shell.window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_TARGETTEXTURE);
+#else
+        // vsync cannot be switched per mode before 2.0.18, so every mode presents with it
+        else shell.renderer = SDL_CreateRenderer(shell.window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_TARGETTEXTURE | SDL_RENDERER_PRESENTVSYNC);
+#endif
+        if (shell.window && !shell.renderer) std::cerr << "Renderer could not be created! SDL_Error: " << SDL_GetError() << "\n";
+    }
+    return shell.renderer != nullptr;
+}
+
+// Reference-image decoders still running. They are detached when the editor closes, and
+// IMG_Quit must not pull the codecs out from under one.
+static std::atomic<int>& runningImageDecoders() {
+    static std::atomic<int> n{ 0 };
+    return n;
+}
+
+static void closeAppShell(AppShell& shell) {
+    destroySymbolTextures(shell.symbolCache);
+    for (auto& kv : shell.fonts) if (kv.second) TTF_CloseFont(kv.second);
+    shell.fonts.clear();
+    if (shell.renderer) SDL_DestroyRenderer(shell.renderer);
+    if (shell.window) SDL_DestroyWindow(shell.window);
+    if (shell.offscreen) SDL_FreeSurface(shell.offscreen);
+    shell.renderer = nullptr;
+    shell.window = nullptr;
+    shell.offscreen = nullptr;
+    if (shell.initedTtf) TTF_Quit();
+    while (runningImageDecoders() > 0) SDL_Delay(1);
+    if (shell.initedImg) IMG_Quit();
+    if (shell.initedVideo) SDL_Quit();
+    shell.initedTtf = shell.initedImg = shell.initedVideo = false;
+}
+
+// Retitles, resizes and shows the shared window for a mode and resets renderer state a
+// previous mode may have left behind. The terminal animates its caret and presents with
+// vsync; the viewer paces itself and the editor redraws per event, so both run without.
+// shell.vsync tells the vsync modes whether they must pace themselves instead.
+static void enterShellMode(AppShell& shell, const char* title, int w, int h, bool vsync) {
+    SDL_SetRenderTarget(shell.renderer, nullptr);
+    SDL_RenderSetClipRect(shell.renderer, nullptr);
+    SDL_SetRenderDrawBlendMode(shell.renderer, vsync ? SDL_BLENDMODE_BLEND : SDL_BLENDMODE_NONE);
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    SDL_RenderSetVSync(shell.renderer, vsync ? 1 : 0);
+#endif
+    SDL_RendererInfo info;
+    shell.vsync = SDL_GetRendererInfo(shell.renderer, &info) == 0 && (info.flags & SDL_RENDERER_PRESENTVSYNC);
+    if (!shell.window) return;
+    SDL_SetWindowTitle(shell.window, title);
+    int cw = 0, ch = 0;
+    SDL_GetWindowSize(shell.window, &cw, &ch);
+    if (cw != w || ch != h) {
+        SDL_SetWindowSize(shell.window, w, h);
+        SDL_SetWindowPosition(shell.window, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED);
+    }
+    SDL_ShowWindow(shell.window);
+}
+
+// Fonts are opened once per size; the candidate list is probed only until one opens.
+static TTF_Font* shellFont(AppShell& shell, int size) {
+    auto it = shell.fonts.find(size);
+    if (it != shell.fonts.end()) return it->second;
+    TTF_Font* f = nullptr;
+    if (!shell.fontPath.empty()) {
+        f = TTF_OpenFont(shell.fontPath.c_str(), size);
+    } else {
+        const char* candidates[] = {
+            "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf",
+            "/usr/share/fonts/truetype/ubuntu/Ubuntu-R.ttf",
+            "/usr/share/fonts/truetype/freefont/FreeSans.ttf",
+            "/usr/share/fonts/truetype/liberation/LiberationSans-Regular.ttf",
+            "/usr/share/fonts/TTF/DejaVuSans.ttf"
+        };
+        for (const char* path : candidates) {
+            f = TTF_OpenFont(path, size);
+            if (f) { shell.fontPath = path; break; }
+        }
+    }
+    shell.fonts[size] = f;
+    return f;
+}
+
+static Scene& residentScene(AppShell& shell, const std::string& basePath) {
+    Uint64 stamp = sceneStamp(basePath);
+    if (!shell.sceneValid || shell.scenePath != basePath || shell.sceneStamp != stamp) {
+        shell.scene = loadScene(basePath);
+        shell.scenePath = basePath;
+        shell.sceneStamp = stamp;
+        shell.sceneValid = true;
+        destroySymbolTextures(shell.symbolCache); // keyed by symbol index
+        shell.snapIndex = SnapIndex{};
+        shell.snapValid = false;
+    }
+    return shell.scene;
+}
+
+// Live reload for the viewer. The scene directory is watched (inotify on Linux, mtime
+// polling elsewhere); a burst of writes is applied once it has been quiet for
+// kReloadQuietMs. Each path file is compared bytewise with the version last applied,
+// so only the changed run of shapes is parsed and redrawn.
+static constexpr Uint32 kReloadQuietMs = 40;
+static constexpr Uint32 kReloadMaxWaitMs = 250; // a steady stream of writes still shows up
+
+struct SceneWatcher {
+    std::string dir;
+    int fd = -1;
+    std::set<std::string> pending;
+    Uint32 firstTicks = 0, lastTicks = 0;
+    std::map<std::string, std::filesystem::file_time_type> stamps; // polling fallback
+    Uint32 lastPoll = 0;
+};
+
+static bool isSceneFile(const std::string& name) {
+    static const char* names[] = { "paths.txt", "current.txt", "anim.txt", "symbols.txt", "instances.txt",
+                                   "paths.txt.colors", "paths.txt.types", "current.txt.colors", "current.txt.types" };
+    for (const char* n : names) if (name == n) return true;
+    return false;
+}
+
+static void openSceneWatcher(SceneWatcher& w, const std::string& dir) {
+    w.dir = dir;
+#if defined(__linux__)
+    w.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (w.fd >= 0 && inotify_add_watch(w.fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE) < 0) {
+        close(w.fd);
+        w.fd = -1;
+    }
+#endif
+    if (w.fd < 0) {
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+            std::string name = entry.path().filename().string();
+            if (isSceneFile(name)) w.stamps[name] = entry.last_write_time(ec);
+        }
+    }
+}
+
+static void closeSceneWatcher(SceneWatcher& w) {
+#if defined(__linux__)
+    if (w.fd >= 0) close(w.fd);
+#endif
+    w.fd = -1;
+}
+
+// Collects scene files written since the last call; returns true with the burst once it
+// has settled.
+static bool pollSceneWatcher(SceneWatcher& w, std::vector<std::string>& changed) {
+    Uint32 now = SDL_GetTicks();
+    auto note = [&](const std::string& name) {
+        if (!isSceneFile(name)) return;
+        if (w.pending.empty()) w.firstTicks = now;
+        w.pending.insert(name);
+        w.lastTicks = now;
+    };
+#if defined(__linux__)
+    if (w.fd >= 0) {
+        alignas(inotify_event) char buf[4096];
+        ssize_t n;
+        while ((n = read(w.fd, buf, sizeof(buf))) > 0) {
+            for (char* p = buf; p < buf + n; ) {
+                const inotify_event* ev = (const inotify_event*)p;
+                if (ev->len) note(ev->name);
+                p += sizeof(inotify_event) + ev->len;
+            }
+        }
+    }
+#endif
+    if (w.fd < 0 && now - w.lastPoll >= 100) {
+        w.lastPoll = now;
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator(w.dir, ec)) {
+            std::string name = entry.path().filename().string();
+            if (!isSceneFile(name)) continue;
+            auto t = entry.last_write_time(ec);
+            auto it = w.stamps.find(name);
+            if (it == w.stamps.end() || it->second != t) { w.stamps[name] = t; note(name); }
+        }
+    }
+    if (w.pending.empty() || (now - w.lastTicks < kReloadQuietMs && now - w.firstTicks < kReloadMaxWaitMs)) return false;
+    changed.assign(w.pending.begin(), w.pending.end());
+    w.pending.clear();
+    return true;
+}
+
+// What the viewer remembers about a loaded path file: its bytes and where each record
+// starts, so a new version can be compared bytewise and only the changed run parsed.
+struct LiveLayer {
+    std::string file;
+    std::string data;
+    bool compact = false;
+    size_t body = 0;              // offset of the first record
+    std::vector<size_t> starts;   // record offsets relative to body, plus the end of the last
+    std::vector<SDL_Rect> bounds; // drawn area per shape, for partial redraws
+};
+
+// Offset of the first record and the record count from a path file's header.
+static bool pathFileHeader(const std::string& data, bool& compact, size_t& body, size_t& count) {
+    compact = data.size() >= 4 && std::memcmp(data.data(), kCompactMagic, 4) == 0;
+    if (compact) {
+        if (data.size() < 10) return false;
+        VarintReader in{ (const unsigned char*)data.data() + 10, (const unsigned char*)data.data() + data.size() };
+        count = (size_t)in.next();
+        body = data.size() - in.left();
+        return in.ok;
+    }
+    const char* s = data.c_str();
+    size_t i = 0;
+    while (i < data.size() && std::isspace((unsigned char)s[i])) ++i;
+    char* end = nullptr;
+    long n = std::strtol(s + i, &end, 10);
+    if (end == s + i || n < 0) return false;
+    i = end - s;
+    while (i < data.size() && std::isspace((unsigned char)s[i])) ++i;
+    body = i;
+    count = (size_t)n;
+    return true;
+}
+
+// Appends record offsets (relative to body) from pos on, until stopAt or count records.
+// A record runs up to the next record, trailing whitespace included.
+static bool scanPathRecords(const std::string& data, size_t body, bool compact, size_t pos, size_t stopAt,
+                            size_t count, std::vector<size_t>& starts) {
+    const char* s = data.c_str();
+    size_t n = data.size();
+    for (size_t k = 0; k < count && body + pos < stopAt; ++k) {
+        starts.push_back(pos);
+        size_t i = body + pos;
+        if (compact) {
+            VarintReader in{ (const unsigned char*)s + i, (const unsigned char*)s + n };
+            Uint64 points = in.next();
+            for (Uint64 j = 0; in.ok && j < 2 * points; ++j) in.next();
+            if (!in.ok) return false;
+            i = n - in.left();
+        } else {
+            char* end = nullptr;
+            long points = std::strtol(s + i, &end, 10);
+            if (end == s + i) return false;
+            i = end - s;
+            for (long j = 0; j < 2 * points; ++j) {
+                while (i < n && std::isspace((unsigned char)s[i])) ++i;
+                size_t t = i;
+                while (i < n && !std::isspace((unsigned char)s[i])) ++i;
+                if (i == t) return false;
+            }
+            while (i < n && std::isspace((unsigned char)s[i])) ++i;
+        }
+        pos = i - body;
+    }
+    starts.push_back(pos);
+    return true;
+}
+
+static Path parseTextRecord(const char* p) {
+    char* next = nullptr;
+    long points = std::strtol(p, &next, 10);
+    Path path;
+    path.reserve(points > 0 ? (size_t)points : 0);
+    for (long j = 0; j < points; ++j) {
+        float x = std::strtof(next, &next);
+        float y = std::strtof(next, &next);
+        path.push_back({ x, y });
+    }
+    return path;
+}
+
+static void initLiveLayer(LiveLayer& live, const std::string& file, const SceneLayer& layer) {
+    live.file = file;
+    live.starts.clear();
+    size_t count = 0;
+    if (!readWholeFile(file, live.data) || !pathFileHeader(live.data, live.compact, live.body, count)
+        || !scanPathRecords(live.data, live.body, live.compact, 0, live.data.size() + 1, count, live.starts)
+        || live.starts.size() != layer.paths.size() + 1) {
+        live.starts.clear(); // unknown: the first change reloads everything
+    }
+    live.bounds.resize(layer.paths.size());
+    for (size_t i = 0; i < layer.paths.size(); ++i) {
+        live.bounds[i] = drawnBounds(layer.paths[i], i < layer.types.size() ? layer.types[i] : ShapeType::Line);
+    }
+}
+
+static void unionInto(SDL_Rect& dirty, const SDL_Rect& r) {
+    dirty = dirty.w > 0 ? unionRect(dirty, r) : r;
+}
+
+static size_t commonPrefix(const char* a, const char* b, size_t n) {
+    size_t i = 0;
+    for (; i + 4096 <= n && std::memcmp(a + i, b + i, 4096) == 0; i += 4096) {}
+    while (i < n && a[i] == b[i]) ++i;
+    return i;
+}
+
+static size_t commonSuffix(const char* a, size_t na, const char* b, size_t nb, size_t limit) {
+    size_t i = 0;
+    for (; i + 4096 <= limit && std::memcmp(a + na - i - 4096, b + nb - i - 4096, 4096) == 0; i += 4096) {}
+    while (i < limit && a[na - 1 - i] == b[nb - 1 - i]) ++i;
+    return i;
+}
+
+// Quantized position the compact decoder holds after record i - 1: the last point of the
+// nearest non-empty record before i.
+static bool compactRunningPoint(const std::vector<Path>& paths, size_t i, float step, long long& qx, long long& qy) {
+    qx = qy = 0;
+    while (i > 0 && paths[i - 1].empty()) --i;
+    if (i == 0) return true;
+    qx = std::llround(paths[i - 1].back().x / step);
+    qy = std::llround(paths[i - 1].back().y / step);
+    return true;
+}
+
+// Re-reads the path file and splices the changed run of shapes into the layer. The old and
+// new bytes are compared from both ends; records wholly inside the common prefix or suffix
+// are kept, so a typical edit (one shape changed, inserted or removed) parses one shape.
+static bool reloadLivePaths(LiveLayer& live, SceneLayer& layer, SDL_Rect& dirty, bool& countChanged) {
+    std::string data;
+    bool compact = false;
+    size_t body = 0, count = 0;
+    if (!readWholeFile(live.file, data) || !pathFileHeader(data, compact, body, count)) return false; // caught mid-write; the next event retries
+
+    float step = 0.0f;
+    if (compact) {
+        std::memcpy(&step, data.data() + 5, 4);
+        step *= (float)(1 << std::min<int>(16, (Uint8)data[9]));
+    }
+    size_t nOld = layer.paths.size();
+    bool incremental = !live.starts.empty() && compact == live.compact && live.starts.size() == nOld + 1
+        && (!compact || std::memcmp(data.data(), live.data.data(), 10) == 0);
+    size_t pre = 0, suf = nOld;
+    std::vector<size_t> starts;
+    long long shift = 0;
+    if (incremental) {
+        size_t oldLen = live.data.size() - live.body, newLen = data.size() - body;
+        size_t b = commonPrefix(live.data.data() + live.body, data.data() + body, std::min(oldLen, newLen));
+        size_t e = commonSuffix(live.data.data(), live.data.size(), data.data(), data.size(), std::min(oldLen, newLen) - b);
+        pre = std::upper_bound(live.starts.begin() + 1, live.starts.end(), b) - live.starts.begin() - 1;
+        suf = std::upper_bound(live.starts.begin(), live.starts.end() - 1, oldLen - e) - live.starts.begin();
+        suf = std::max(suf, pre);
+        shift = (long long)newLen - (long long)oldLen;
+        starts.assign(live.starts.begin(), live.starts.begin() + pre);
+        size_t stopAt = body + (size_t)((long long)live.starts[suf] + shift);
+        size_t keep = nOld - suf;
+        if (count < pre + keep || !scanPathRecords(data, body, compact, live.starts[pre], stopAt, count - pre - keep, starts)
+            || body + starts.back() != stopAt) {
+            incremental = false;
+        }
+    }
+    if (!incremental) {
+        pre = 0; suf = nOld; shift = 0;
+        starts.clear();
+        if (!scanPathRecords(data, body, compact, 0, data.size() + 1, count, starts) || starts.size() != count + 1) return false;
+    }
+    size_t newEnd = starts.size() - 1; // middle records are [pre, newEnd) in the new file
+
+    std::vector<Path> fresh;
+    fresh.reserve(newEnd - pre);
+    if (compact) {
+        long long qx, qy;
+        compactRunningPoint(layer.paths, pre, step, qx, qy);
+        VarintReader in{ (const unsigned char*)data.data() + body + starts[pre], (const unsigned char*)data.data() + data.size() };
+        for (size_t i = pre; i < newEnd; ++i) {
+            Path p((size_t)in.next());
+            for (auto& pt : p) {
+                qx += unzigzag(in.next());
+                qy += unzigzag(in.next());
+                pt = { (float)qx * step, (float)qy * step };
+            }
+            fresh.push_back(std::move(p));
+        }
+        // kept records are deltas from here, so they only stay valid if it did not move
+        long long ox, oy;
+        compactRunningPoint(layer.paths, suf, step, ox, oy);
+        if (!in.ok || (suf < nOld && (ox != qx || oy != qy))) {
+            live.starts.clear();
+            return reloadLivePaths(live, layer, dirty, countChanged);
+        }
+    } else {
+        for (size_t i = pre; i < newEnd; ++i) fresh.push_back(parseTextRecord(data.c_str() + body + starts[i]));
+    }
+    for (size_t i = suf + 1; i <= nOld; ++i) starts.push_back((size_t)((long long)live.starts[i] + shift));
+
+    layer.colors.resize(nOld, SDL_Color{255,255,255,255});
+    layer.types.resize(nOld, ShapeType::Line);
+    for (size_t i = pre; i < suf; ++i) unionInto(dirty, live.bounds[i]);
+    size_t common = std::min(suf, newEnd) - pre;
+    for (size_t k = 0; k < common; ++k) layer.paths[pre + k] = std::move(fresh[k]);
+    if (newEnd > suf) {
+        layer.paths.insert(layer.paths.begin() + suf, std::make_move_iterator(fresh.begin() + common), std::make_move_iterator(fresh.end()));
+        layer.colors.insert(layer.colors.begin() + suf, newEnd - suf, SDL_Color{255,255,255,255});
+        layer.types.insert(layer.types.begin() + suf, newEnd - suf, ShapeType::Line);
+        live.bounds.insert(live.bounds.begin() + suf, newEnd - suf, SDL_Rect{});
+    } else if (suf > newEnd) {
+        layer.paths.erase(layer.paths.begin() + newEnd, layer.paths.begin() + suf);
+        layer.colors.erase(layer.colors.begin() + newEnd, layer.colors.begin() + suf);
+        layer.types.erase(layer.types.begin() + newEnd, layer.types.begin() + suf);
+        live.bounds.erase(live.bounds.begin() + newEnd, live.bounds.begin() + suf);
+    }
+    for (size_t i = pre; i < newEnd; ++i) {
+        live.bounds[i] = drawnBounds(layer.paths[i], layer.types[i]);
+        unionInto(dirty, live.bounds[i]);
+    }
+    countChanged = countChanged || newEnd != suf;
+    live.data = std::move(data);
+    live.compact = compact;
+    live.body = body;
+    live.starts = std::move(starts);
+    return true;
+}
+
+// Sidecars are one short line per shape, so they are re-read whole and compared.
+static void reloadLiveSidecars(LiveLayer& live, SceneLayer& layer, bool colors, bool types, SDL_Rect& dirty) {
+    size_t n = layer.paths.size();
+    if (colors) {
+        std::vector<SDL_Color> c = readColors(live.file + ".colors", n);
+        c.resize(n, SDL_Color{255,255,255,255});
+        for (size_t i = 0; i < n; ++i) {
+            const SDL_Color& a = c[i];
+            const SDL_Color& b = layer.colors[i];
+            if (a.r != b.r || a.g != b.g || a.b != b.b || a.a != b.a) unionInto(dirty, live.bounds[i]);
+        }
+        layer.colors = std::move(c);
+    }
+    if (types) {
+        std::vector<ShapeType> t = readTypes(live.file + ".types", n);
+        t.resize(n, ShapeType::Line);
+        for (size_t i = 0; i < n; ++i) {
+            if (t[i] == layer.types[i]) continue;
+            unionInto(dirty, live.bounds[i]);
+            live.bounds[i] = drawnBounds(layer.paths[i], t[i]);
+            unionInto(dirty, live.bounds[i]);
+        }
+        layer.types = std::move(t);
+    }
+}
+
+static bool runViewer(AppShell& shell, const std::string& basePath) {
+    if (!openAppShell(shell, false)) return false;
+    Scene& resident = residentScene(shell, basePath);
+
+    // Foliage is hidden in the viewer; it stays behind in the resident scene.
+    Scene scene;
+    scene.trunks = std::move(resident.trunks);
+    scene.symbols = resident.symbols;
+    scene.instances = resident.instances;
+
+    if (scene.foliage.paths.empty() && scene.trunks.paths.empty()) {
+        std::cerr << "Warning: No paths were loaded. Check file format and path.\n";
+    }
+
+    // Tracks are checked against the foliage as loaded, then dropped with it.
+    AnimTimeline timeline;
+    bool animated = loadAnimTimeline(basePath + "/anim.txt", resident.foliage, scene.trunks, timeline);
+    dropAnimFoliage(timeline);
+    // Animation writes into the shapes it drives; their rest state is kept aside so the
+    // resident scene gets it back.
+    std::vector<std::pair<size_t, std::pair<Path, SDL_Color>>> rest;
+    auto saveRest = [&]() {
+        rest.clear();
+        for (size_t i : timeline.animatedShapes[1]) {
+            rest.push_back({ i, { scene.trunks.paths[i], i < scene.trunks.colors.size() ? scene.trunks.colors[i] : SDL_Color{255,255,255,255} } });
+        }
+    };
+    auto restoreRest = [&]() {
+        for (auto& r : rest) {
+            if (r.first >= scene.trunks.paths.size()) continue;
+            scene.trunks.paths[r.first] = r.second.first;
+            if (r.first < scene.trunks.colors.size()) scene.trunks.colors[r.first] = r.second.second;
+        }
+    };
+    saveRest();
+
+    enterShellMode(shell, "Atelier Viewer", 800, 600, false);
+    SDL_Renderer* renderer = shell.renderer;
+    bool running = true;
+    SDL_Rect closeRect{0,0,0,0};
+    SymbolTextureCache& symbolCache = shell.symbolCache;
+    const SDL_Rect screen{ 0, 0, 800, 600 };
+    SceneFootprint footprint;
+    measureScene(scene, footprint);
+    // Repaints one area of the current target; the caller clips to it.
+    auto paintArea = [&](const SDL_Rect& r, bool withAnimated) {
+        SDL_SetRenderDrawColor(renderer, 8, 12, 18, 255);
+        SDL_RenderFillRect(renderer, &r);
+        closeRect = drawWindowHeaderWithClose(renderer, 800);
+        renderSceneArea(renderer, scene, timeline, footprint, r, withAnimated, symbolCache);
+    };
+    // Static shapes and instances are rasterized once; each frame repaints only where the
+    // animated shapes are (see SceneFootprint).
+    SDL_Texture* staticLayer = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, 800, 600);
+    if (staticLayer) {
+        SDL_SetRenderTarget(renderer, staticLayer);
+        paintArea(screen, false);
+        SDL_SetRenderTarget(renderer, nullptr);
+    }
+
+    // Live reload. Foliage is hidden in the viewer (see above), so only trunks are tracked.
+    SceneWatcher watcher;
+    openSceneWatcher(watcher, basePath);
+    LiveLayer liveTrunks;
+    initLiveLayer(liveTrunks, basePath + "/current.txt", scene.trunks);
+    auto redrawRegion = [&](SDL_Rect dirty) {
+        if (!staticLayer) return; // drawn from scratch every frame anyway
+        if (!SDL_IntersectRect(&dirty, &screen, &dirty)) return;
+        SDL_SetRenderTarget(renderer, staticLayer);
+        SDL_RenderSetClipRect(renderer, &dirty);
+        paintArea(dirty, false);
+        SDL_RenderSetClipRect(renderer, nullptr);
+        SDL_SetRenderTarget(renderer, nullptr);
+    };
+    auto applyReload = [&](const std::vector<std::string>& changed) {
+        SDL_Rect dirty{ 0, 0, 0, 0 };
+        bool countChanged = false, full = false;
+        auto has = [&](const char* name) { return std::find(changed.begin(), changed.end(), name) != changed.end(); };
+        if (has("current.txt")) reloadLivePaths(liveTrunks, scene.trunks, dirty, countChanged);
+        if (has("current.txt.colors") || has("current.txt.types")) {
+            reloadLiveSidecars(liveTrunks, scene.trunks, has("current.txt.colors"), has("current.txt.types"), dirty);
+        }
+        if (has("symbols.txt") || has("instances.txt")) {
+            scene.symbols = readSymbols(basePath + "/symbols.txt");
+            scene.instances = readInstances(basePath + "/instances.txt", scene.symbols);
+            destroySymbolTextures(symbolCache);
+            full = true;
+        }
+        // timeline tracks address shapes by index, so it is rebuilt when indices move
+        if (has("anim.txt") || (countChanged && animated)) {
+            timeline = AnimTimeline{};
+            animated = loadAnimTimeline(basePath + "/anim.txt", resident.foliage, scene.trunks, timeline);
+            dropAnimFoliage(timeline);
+            full = true;
+        }
+        measureScene(scene, footprint);
+        if (full) redrawRegion(screen);
+        else if (dirty.w > 0) redrawRegion(dirty);
+    };
+
+    const double step = 1.0 / 60.0;
+    const Uint64 freq = SDL_GetPerformanceFrequency();
+    Uint64 prevCounter = SDL_GetPerformanceCounter();
+    double accumulator = 0.0, simTime = 0.0;
+    if (animated) evaluateTimeline(timeline, simTime, scene);
+    while (running) {
+        SDL_Event e;
+        while (SDL_PollEvent(&e)) {
+            if (e.type == SDL_QUIT) running = false;
+            if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_ESCAPE) running = false;
+            if (e.type == SDL_MOUSEBUTTONDOWN && e.button.button == SDL_BUTTON_LEFT) {
+                int mx = e.button.x, my = e.button.y;
+                if (mx >= closeRect.x && mx < closeRect.x + closeRect.w && my >= closeRect.y && my < closeRect.y + closeRect.h) {
+                    running = false;
+                }
+            }
+        }
+        
+
+        if (animated) {
+            Uint64 now = SDL_GetPerformanceCounter();
+            accumulator = std::min(accumulator + (double)(now - prevCounter) / (double)freq, 0.25);
+            prevCounter = now;
+            bool stepped = false;
+            while (accumulator >= step) { simTime += step; accumulator -= step; stepped = true; }
+            if (stepped) evaluateTimeline(timeline, simTime, scene);
+        }
+
+        std::vector<std::string> changed;
+        if (pollSceneWatcher(watcher, changed)) {
+            restoreRest();
+            applyReload(changed);
+            saveRest();
+            if (animated) evaluateTimeline(timeline, simTime, scene);
+        }
+
+        std::vector<SDL_Rect> damage = animDamage(scene, timeline, footprint, 800, 600);
+        if (staticLayer) {
+            SDL_RenderCopy(renderer, staticLayer, nullptr, nullptr);
+            for (const SDL_Rect& r : damage) {
+                SDL_RenderSetClipRect(renderer, &r);
+                paintArea(r, true);
+            }
+            SDL_RenderSetClipRect(renderer, nullptr);
+        } else {
+            paintArea(screen, true);
+        }
+        SDL_RenderPresent(renderer);
+        SDL_Delay(animated ? (Uint32)std::max(1.0, (step - accumulator) * 1000.0) : 10);
+    }
+
+    closeSceneWatcher(watcher);
+    if (staticLayer) SDL_DestroyTexture(staticLayer);
+    restoreRest();
+    resident.trunks = std::move(scene.trunks);
+    // reloads only covered what the viewer shows
+    if (sceneStamp(basePath) != shell.sceneStamp) shell.sceneValid = false;
+    return true;
+}
+
+static void showHelpFromJson(const std::string& jsonPath) {
+    std::ifstream in(jsonPath);
+    if (!in.is_open()) {
+        std::cerr << "Cannot open commands file: " << jsonPath << "\n";
+        return;
+    }
+    std::string line;
+    std::string currentCommand;
+    std::regex keyRegex("\\s*\"([^\"]+)\"\\s*:");
+    std::regex descRegex("\\s*\"description\"\\s*:\\s*\"([^\"]*)\"");
+    while (std::getline(in, line)) {
+        std::smatch m;
+        if (currentCommand.empty()) {
+            if (std::regex_search(line, m, keyRegex)) {
+                std::string key = m[1].str();
+                if (key != "help" && key != "draw" && key != "edit") {
+                   
+                }
+                currentCommand = key;
+            }
+        } else {
+            if (std::regex_search(line, m, descRegex)) {
+                std::string desc = m[1].str();
+                std::cout << currentCommand << " - " << desc << "\n";
+                currentCommand.clear();
+            }
+          
+            if (line.find('}') != std::string::npos) {
+                currentCommand.clear();
+            }
+        }
+    }
+}
+
+static std::string collectHelpFromJson(const std::string& jsonPath) {
+    std::ifstream in(jsonPath);
+    if (!in.is_open()) {
+        return std::string("Cannot open commands file: ") + jsonPath + "\n";
+    }
+    std::string line;
+    std::string currentCommand;
+    std::regex keyRegex("\\s*\"([^\"]+)\"\\s*:");
+    std::regex descRegex("\\s*\"description\"\\s*:\\s*\"([^\"]*)\"");
+    std::ostringstream out;
+    while (std::getline(in, line)) {
+        std::smatch m;
+        if (currentCommand.empty()) {
+            if (std::regex_search(line, m, keyRegex)) {
+                std::string key = m[1].str();
+                currentCommand = key;
+            }
+        } else {
+            if (std::regex_search(line, m, descRegex)) {
+                std::string desc = m[1].str();
+                out << currentCommand << " - " << desc << "\n";
+                currentCommand.clear();
+            }
+            if (line.find('}') != std::string::npos) {
+                currentCommand.clear();
+            }
+        }
+    }
+    return out.str();
+}
+
+static float distanceSquared(float x1, float y1, float x2, float y2) {
+    float dx = x1 - x2;
+    float dy = y1 - y2;
+    return dx*dx + dy*dy;
+}
+
+static float distancePointToSegmentSquared(float px, float py, float x1, float y1, float x2, float y2) {
+    float vx = x2 - x1;
+    float vy = y2 - y1;
+    float wx = px - x1;
+    float wy = py - y1;
+    float c1 = vx * wx + vy * wy;
+    if (c1 <= 0.0f) return distanceSquared(px, py, x1, y1);
+    float c2 = vx * vx + vy * vy;
+    if (c2 <= c1) return distanceSquared(px, py, x2, y2);
+    float b = c1 / c2;
+    float bx = x1 + b * vx;
+    float by = y1 + b * vy;
+    return distanceSquared(px, py, bx, by);
+}
+
+struct Theme {
+    SDL_Color background;     
+    SDL_Color panel;       
+    SDL_Color panelAccent;    
+    SDL_Color inputBg;        
+    SDL_Color inputBorder;    
+    SDL_Color textPrimary;    
+    SDL_Color textSecondary;  
+    SDL_Color buttonBg;        
+    SDL_Color buttonHover;     
+    SDL_Color cursor;          
+};
+
+static Theme makeDarkOceanTheme() {
+    Theme t{};
+    t.background    = { 5, 9, 14, 255 };        
+    t.panel         = { 14, 22, 35, 210 };     
+    t.panelAccent   = { 18, 28, 44, 235 };      
+    t.inputBg       = { 9, 14, 22, 230 };
+    t.inputBorder   = { 60, 120, 220, 180 };     
+    t.textPrimary   = { 236, 242, 252, 255 };   
+    t.textSecondary = { 160, 176, 200, 255 };
+    t.buttonBg      = { 24, 42, 68, 220 };
+    t.buttonHover   = { 34, 62, 98, 240 };
+    t.cursor        = { 255, 255, 255, 255 };
+    return t;
+}
+
+static void setColor(SDL_Renderer* r, SDL_Color c) {
+    SDL_SetRenderDrawColor(r, c.r, c.g, c.b, c.a);
+}
+
+static void drawFilledCircle(SDL_Renderer* renderer, int cx, int cy, int radius, SDL_Color color); // fwd
+
+static void drawVerticalGradient(SDL_Renderer* r, SDL_Rect rect, SDL_Color top, SDL_Color bottom) {
+    for (int y = 0; y < rect.h; ++y) {
+        float t = rect.h <= 1 ? 0.0f : (float)y / (float)(rect.h - 1);
+        Uint8 rr = (Uint8)((1.0f - t) * top.r + t * bottom.r);
+        Uint8 gg = (Uint8)((1.0f - t) * top.g + t * bottom.g);
+        Uint8 bb = (Uint8)((1.0f - t) * top.b + t * bottom.b);
+        Uint8 aa = (Uint8)((1.0f - t) * top.a + t * bottom.a);
+        SDL_SetRenderDrawColor(r, rr, gg, bb, aa);
+        SDL_RenderDrawLine(r, rect.x, rect.y + y, rect.x + rect.w, rect.y + y);
+    }
+}
+
+static SDL_Rect drawWindowHeaderWithClose(SDL_Renderer* r, int winW) {
+    SDL_Rect header{0, 0, winW, 40};
+    SDL_Color a{ 18, 28, 44, 220 }, b{ 12, 18, 28, 220 };
+    drawVerticalGradient(r, header, a, b);
+    
+    int radius = 8;
+    int cx = winW - 20;
+    int cy = header.y + header.h / 2;
+    drawFilledCircle(r, cx, cy, radius, { 235, 80, 80, 255 });
+
+    SDL_SetRenderDrawColor(r, 250, 230, 230, 230);
+    SDL_RenderDrawLine(r, cx - 3, cy - 3, cx + 3, cy + 3);      
+    SDL_RenderDrawLine(r, cx - 3, cy + 3, cx + 3, cy - 3);
+   
+    SDL_Rect closeRect{ cx - radius - 2, cy - radius - 2, (radius + 2) * 2, (radius + 2) * 2 };
+    return closeRect;
+}
+
+static void drawWindowHeaderWithControls(SDL_Renderer* r, int winW, SDL_Rect& closeRectOut, SDL_Rect& penRectOut) {
+    SDL_Rect header{0, 0, winW, 40};
+    SDL_Color a{ 18, 28, 44, 220 }, b{ 12, 18, 28, 220 };
+    drawVerticalGradient(r, header, a, b);
+    
+    int radius = 8;
+    int cx = winW - 20;
+    int cy = header.y + header.h / 2;
+    drawFilledCircle(r, cx, cy, radius, { 235, 80, 80, 255 });
+    SDL_SetRenderDrawColor(r, 250, 230, 230, 230);
+    SDL_RenderDrawLine(r, cx - 3, cy - 3, cx + 3, cy + 3);
+    SDL_RenderDrawLine(r, cx - 3, cy + 3, cx + 3, cy - 3);
+    closeRectOut = { cx - radius - 2, cy - radius - 2, (radius + 2) * 2, (radius + 2) * 2 };
+
+    int pcx = winW - 50;
+    int pcy = cy;
+    drawFilledCircle(r, pcx, pcy, radius, { 90, 150, 255, 230 });
+
+    SDL_SetRenderDrawColor(r, 20, 30, 60, 255);
+    SDL_RenderDrawLine(r, pcx - 3, pcy + 2, pcx + 3, pcy - 4);
+    SDL_RenderDrawLine(r, pcx - 1, pcy + 2, pcx + 5, pcy - 4);
+    penRectOut = { pcx - radius - 2, pcy - radius - 2, (radius + 2) * 2, (radius + 2) * 2 };
+}
+
+static void fillRoundedRect(SDL_Renderer* r, SDL_Rect rect, int radius, SDL_Color color) {
+    setColor(r, color);
+
+    SDL_Rect body = { rect.x + radius, rect.y, rect.w - 2*radius, rect.h };
+    SDL_RenderFillRect(r, &body);
+
+    SDL_Rect left = { rect.x, rect.y + radius, radius, rect.h - 2*radius };
+    SDL_Rect right = { rect.x + rect.w - radius, rect.y + radius, radius, rect.h - 2*radius };
+    SDL_RenderFillRect(r, &left);
+    SDL_RenderFillRect(r, &right);
+    
+    drawFilledCircle(r, rect.x + radius, rect.y + radius, radius, color);
+    drawFilledCircle(r, rect.x + rect.w - radius - 1, rect.y + radius, radius, color);
+    drawFilledCircle(r, rect.x + radius, rect.y + rect.h - radius - 1, radius, color);
+    drawFilledCircle(r, rect.x + rect.w - radius - 1, rect.y + rect.h - radius - 1, radius, color);
+}
+
+static void drawRectBorder(SDL_Renderer* r, SDL_Rect rect, int radius, SDL_Color color) {
+    setColor(r, color);
+    SDL_RenderDrawLine(r, rect.x + radius, rect.y, rect.x + rect.w - radius, rect.y);
+    SDL_RenderDrawLine(r, rect.x + radius, rect.y + rect.h - 1, rect.x + rect.w - radius, rect.y + rect.h - 1);
+    SDL_RenderDrawLine(r, rect.x, rect.y + radius, rect.x, rect.y + rect.h - radius);
+    SDL_RenderDrawLine(r, rect.x + rect.w - 1, rect.y + radius, rect.x + rect.w - 1, rect.y + rect.h - radius);
+}
+
+static void renderText(SDL_Renderer* r, TTF_Font* font, const std::string& text, int x, int y, SDL_Color color) {
+    if (!font) return;
+    SDL_Surface* s = TTF_RenderUTF8_Blended(font, text.c_str(), color);
+    if (!s) return;
+    SDL_Texture* t = SDL_CreateTextureFromSurface(r, s);
+    SDL_Rect dst{ x, y, s->w, s->h };
+    SDL_FreeSurface(s);
+    SDL_RenderCopy(r, t, nullptr, &dst);
+    SDL_DestroyTexture(t);
+}
+
+static void renderWrappedText(SDL_Renderer* r, TTF_Font* font, const std::string& text, SDL_Rect bounds, SDL_Color color) {
+    if (!font) return;
+    SDL_Surface* s = TTF_RenderUTF8_Blended_Wrapped(font, text.c_str(), color, bounds.w);
+    if (!s) return;
+    SDL_Texture* t = SDL_CreateTextureFromSurface(r, s);
+    SDL_Rect dst{ bounds.x, bounds.y, s->w, s->h };
+    SDL_FreeSurface(s);
+    SDL_RenderCopy(r, t, nullptr, &dst);
+    SDL_DestroyTexture(t);
+}
+
+static bool pointInRect(int x, int y, const SDL_Rect& rect) {
+    return x >= rect.x && x < rect.x + rect.w && y >= rect.y && y < rect.y + rect.h;
+}
+
+static void drawDropShadow(SDL_Renderer* r, SDL_Rect rect, int radius, int spread, SDL_Color color) {
+
+    for (int i = spread; i >= 1; --i) {
+        SDL_Color c = color; c.a = (Uint8)std::max(10, (color.a * i) / (spread * 2));
+        SDL_Rect rr{ rect.x - i, rect.y - i, rect.w + 2*i, rect.h + 2*i };
+        fillRoundedRect(r, rr, radius + i, c);
+    }
+}
+
+static void drawUnderline(SDL_Renderer* r, int x, int y, int w, SDL_Color color) {
+    setColor(r, color);
+    SDL_RenderDrawLine(r, x, y, x + w, y);
+}
+
+static bool runGuiTerminal(AppShell& shell, std::string& basePath) {
+    if (!openAppShell(shell, false)) return false;
+    TTF_Font* font14 = shellFont(shell, 14);
+    TTF_Font* font16 = shellFont(shell, 16);
+    TTF_Font* font20 = shellFont(shell, 20);
+    if (!font14 || !font16 || !font20) {
+        std::cerr << "Failed to load a font. Falling back to CLI.\n";
+        return false;
+    }
+    SDL_Renderer* renderer = shell.renderer;
+    enterShellMode(shell, "Atelier — Terminal", 1000, 700, true);
+
+    Theme theme = makeDarkOceanTheme();
+
+    SDL_Rect header = { 0, 0, 1000, 72 };
+    SDL_Rect outputPanel = { 40, 100, 920, 460 };
+    SDL_Rect inputPanel = { 40, 580, 920, 62 };
+
+    std::vector<std::string> outputLines;
+    auto appendOutput = [&](const std::string& s) {
+        std::istringstream ss(s);
+        std::string line;
+        while (std::getline(ss, line)) {
+            outputLines.push_back(line);
+        }     
+        if (outputLines.size() > 1000) {
+            outputLines.erase(outputLines.begin(), outputLines.begin() + (outputLines.size() - 1000));
+        }
+    };
+
+    appendOutput("Atelier Terminal. Type help for commands.");
+
+    std::string inputText;
+    size_t historyIndex = 0;
+    std::vector<std::string> history;
+    bool running = true;
+
+    SDL_StartTextInput();
+
+    auto executeCommand = [&](const std::string& cmdRaw) {
+        std::string cmd = cmdRaw;
+        if (cmd == "") return;
+        appendOutput(std::string("> ") + cmd);
+        if (cmd == "help") {
+            appendOutput(collectHelpFromJson("/home/user/Atelier_lab/Programs/commands.json"));
+            std::ostringstream tools; printToolUsage(tools); appendOutput(tools.str());
+        } else if (cmd == "clear") {
+            outputLines.clear();
+        } else if (cmd == "draw") {
+            SDL_StopTextInput();
+            runViewer(shell, basePath);
+            enterShellMode(shell, "Atelier — Terminal", 1000, 700, true);
+            SDL_StartTextInput();
+        } else if (cmd == "gallery") {
+            SDL_StopTextInput();
+            if (runGallery(shell, basePath)) appendOutput("Opened " + basePath);
+            enterShellMode(shell, "Atelier — Terminal", 1000, 700, true);
+            SDL_StartTextInput();
+        } else if (cmd == "edit" || cmd.compare(0, 12, "edit record ") == 0) {
+            std::vector<std::string> args = splitCommandLine(cmd);
+            SDL_StopTextInput();
+            editMode(shell, basePath, args.size() == 3 ? args[2] : std::string());
+            enterShellMode(shell, "Atelier — Terminal", 1000, 700, true);
+            SDL_StartTextInput();
+        } else if (cmd == "exit" || cmd == "quit") {
+            running = false;
+        } else if (cmd == "serve" || cmd.compare(0, 6, "serve ") == 0) {
+            appendOutput("serve runs until it is shut down; start it from a shell, not from here.");
+        } else {
+            std::ostringstream toolOut;
+            if (runToolCommand(splitCommandLine(cmd), toolOut) < 0) appendOutput("Unknown command. Type 'help'.");
+            else appendOutput(toolOut.str());
+        }
+    };
+
+    while (running) {
+        // events
+        SDL_Event e;
+        int mx = -1, my = -1;
+        while (SDL_PollEvent(&e)) {
+            if (e.type == SDL_QUIT) running = false;
+            else if (e.type == SDL_TEXTINPUT) {
+                inputText += std::string(e.text.text);
+            } else if (e.type == SDL_KEYDOWN) {
+                if (e.key.keysym.sym == SDLK_BACKSPACE) {
+                    if (!inputText.empty()) inputText.pop_back();
+                } else if (e.key.keysym.sym == SDLK_RETURN || e.key.keysym.sym == SDLK_KP_ENTER) {
+                    history.push_back(inputText);
+                    historyIndex = history.size();
+                    executeCommand(inputText);
+                    inputText.clear();
+                } else if (e.key.keysym.sym == SDLK_UP) {
+                    if (historyIndex > 0) {
+                        historyIndex--;
+                        inputText = history[historyIndex];
+                    }
+                } else if (e.key.keysym.sym == SDLK_DOWN) {
+                    if (historyIndex + 1 < history.size()) {
+                        historyIndex++;
+                        inputText = history[historyIndex];
+                    } else {
+                        historyIndex = history.size();
+                        inputText.clear();
+                    }
+                } else if (e.key.keysym.sym == SDLK_ESCAPE) {
+                    running = false;
+                }
+            }
+        }
+
+        // draw background gradient for more modern depth
+        drawVerticalGradient(renderer, {0, 0, 1000, 700}, { 6, 10, 16, 255 }, { 10, 16, 26, 255 });
+
+        // header bar (glass, minimal)
+        fillRoundedRect(renderer, header, 0, theme.panelAccent);
+        // App mark (small circle) and centered title
+        drawFilledCircle(renderer, 28, header.y + 36, 6, { 90, 160, 255, 200 });
+        drawFilledCircle(renderer, 46, header.y + 36, 6, { 90, 255, 210, 200 });
+        const char* title = "Atelier Terminal";
+        int tw = 0, th = 0; TTF_SizeUTF8(font20, title, &tw, &th);
+        renderText(renderer, font20, title, header.x + (header.w - tw) / 2, header.y + (header.h - th) / 2, theme.textPrimary);
+        drawUnderline(renderer, 40, header.h - 1, 920, { 60, 120, 220, 80 });
+
+        // output panel
+        drawDropShadow(renderer, outputPanel, 16, 8, { 0, 0, 0, 55 });
+        fillRoundedRect(renderer, outputPanel, 16, theme.panel);
+        // clip to output panel when drawing text
+        SDL_Rect clip = outputPanel;
+        SDL_RenderSetClipRect(renderer, &clip);
+        int lineHeight = TTF_FontHeight(font14) + 2;
+        int maxVisible = (outputPanel.h - 24) / lineHeight;
+        int startIdx = (int)outputLines.size() - maxVisible;
+        if (startIdx < 0) startIdx = 0;
+        int y = outputPanel.y + 12;
+        for (size_t i = (size_t)startIdx; i < outputLines.size(); ++i) {
+            renderText(renderer, font14, outputLines[i], outputPanel.x + 16, y, theme.textPrimary);
+            y += lineHeight;
+        }
+        SDL_RenderSetClipRect(renderer, nullptr);
+
+        // input panel
+        drawDropShadow(renderer, inputPanel, 14, 8, { 0, 0, 0, 65 });
+        fillRoundedRect(renderer, inputPanel, 14, theme.inputBg);
+        drawRectBorder(renderer, { inputPanel.x, inputPanel.y, inputPanel.w, inputPanel.h }, 14, { 80, 150, 255, 90 });
+        drawRectBorder(renderer, { inputPanel.x - 1, inputPanel.y - 1, inputPanel.w + 2, inputPanel.h + 2 }, 16, theme.inputBorder);
+        renderText(renderer, font16, inputText.empty() ? std::string("Type a command…") : inputText,
+                   inputPanel.x + 16, inputPanel.y + 16, inputText.empty() ? theme.textSecondary : theme.textPrimary);
+        // caret
+        int textW = 0, textH = 0; TTF_SizeUTF8(font16, inputText.c_str(), &textW, &textH);
+        int caretX = inputPanel.x + 16 + textW, caretW = 2;
+        int caretH = TTF_FontHeight(font16);
+        bool blink = ((SDL_GetTicks() / 500) % 2) == 0;
+        if (blink) { SDL_Rect caret{ caretX, inputPanel.y + 14, caretW, caretH }; setColor(renderer, theme.cursor); SDL_RenderFillRect(renderer, &caret); }
+
+        SDL_RenderPresent(renderer);
+        if (!shell.vsync) SDL_Delay(16); // no vblank to wait on; keep the caret loop near 60 Hz
+    }
+
+    SDL_StopTextInput();
+    return true;
+}
+
+static bool exitCliAfterSDL = false;
+
+// Editor bulk selection. Selected vertices are gathered into contiguous x/y arrays
+// once; translate/rotate/scale compose into one affine matrix that is applied from the
+// gathered originals in a single vectorized pass when an interaction ends. While the
+// mouse moves, only a cached texture of the selection is transformed on the GPU.
+struct Affine2D {
+    float a = 1.0f, b = 0.0f, c = 0.0f, d = 1.0f; // x' = a x + b y + tx, y' = c x + d y + ty
+    float tx = 0.0f, ty = 0.0f;
+};
+
+// m applied after n
+static Affine2D affineCompose(const Affine2D& m, const Affine2D& n) {
+    Affine2D r;
+    r.a = m.a * n.a + m.b * n.c;  r.b = m.a * n.b + m.b * n.d;
+    r.c = m.c * n.a + m.d * n.c;  r.d = m.c * n.b + m.d * n.d;
+    r.tx = m.a * n.tx + m.b * n.ty + m.tx;
+    r.ty = m.c * n.tx + m.d * n.ty + m.ty;
+    return r;
+}
+
+static Affine2D affineAbout(float cx, float cy, float angle, float scale, float dx, float dy) {
+    Affine2D m;
+    m.a = scale * std::cos(angle); m.b = -scale * std::sin(angle);
+    m.c = -m.b;                    m.d = m.a;
+    m.tx = cx + dx - (m.a * cx + m.b * cy);
+    m.ty = cy + dy - (m.c * cx + m.d * cy);
+    return m;
+}
+
+static void affineTransformPoints(const float* sx, const float* sy, float* dx, float* dy, size_t n, const Affine2D& m) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128 a = _mm_set1_ps(m.a), b = _mm_set1_ps(m.b), c = _mm_set1_ps(m.c), d = _mm_set1_ps(m.d);
+    const __m128 tx = _mm_set1_ps(m.tx), ty = _mm_set1_ps(m.ty);
+    for (; i + 4 <= n; i += 4) {
+        __m128 x = _mm_loadu_ps(sx + i), y = _mm_loadu_ps(sy + i);
+        _mm_storeu_ps(dx + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, x), _mm_mul_ps(b, y)), tx));
+        _mm_storeu_ps(dy + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(c, x), _mm_mul_ps(d, y)), ty));
+    }
+#endif
+    for (; i < n; ++i) {
+        float x = sx[i], y = sy[i];
+        dx[i] = m.a * x + m.b * y + m.tx;
+        dy[i] = m.c * x + m.d * y + m.ty;
+    }
+}
+
+struct EditorSelection {
+    struct Ref { int layer; size_t shape; size_t first, count; }; // layer 0 foliage, 1 trunks
+    std::vector<Ref> shapes;
+    std::vector<float> baseX, baseY;  // vertices as selected
+    std::vector<float> curX, curY;    // vertices after `applied`
+    Affine2D applied;                 // base -> current geometry
+    Affine2D preview;                 // current -> what the mouse shows, not yet committed
+    float minX = 0, minY = 0, maxX = 0, maxY = 0;
+    bool empty() const { return shapes.empty(); }
+};
+
+// Scanline fill of a (possibly self-intersecting) polygon, even-odd rule.
+static void fillPolygonMask(std::vector<Uint8>& mask, int w, int h, const std::vector<SDL_Point>& poly) {
+    if (poly.size() < 3) return;
+    std::vector<float> xs;
+    for (int y = 0; y < h; ++y) {
+        float fy = y + 0.5f;
+        xs.clear();
+        for (size_t i = 0, j = poly.size() - 1; i < poly.size(); j = i++) {
+            float y0 = (float)poly[j].y, y1 = (float)poly[i].y;
+            if ((y0 <= fy) == (y1 <= fy)) continue;
+            xs.push_back(poly[j].x + (fy - y0) / (y1 - y0) * (poly[i].x - poly[j].x));
+        }
+        std::sort(xs.begin(), xs.end());
+        for (size_t k = 0; k + 1 < xs.size(); k += 2) {
+            int x0 = std::max(0, (int)std::ceil(xs[k] - 0.5f)), x1 = std::min(w - 1, (int)std::floor(xs[k + 1] - 0.5f));
+            if (x0 <= x1) std::memset(&mask[(size_t)y * w + x0], 1, (size_t)(x1 - x0 + 1));
+        }
+    }
+}
+
+static void updateSelectionBounds(EditorSelection& sel) {
+    sel.minX = sel.minY = 1e30f; sel.maxX = sel.maxY = -1e30f;
+    for (size_t i = 0; i < sel.curX.size(); ++i) {
+        sel.minX = std::min(sel.minX, sel.curX[i]); sel.maxX = std::max(sel.maxX, sel.curX[i]);
+        sel.minY = std::min(sel.minY, sel.curY[i]); sel.maxY = std::max(sel.maxY, sel.curY[i]);
+    }
+}
+
+// Selects every shape whose vertices all fall inside the mask.
+static EditorSelection selectShapesInMask(const std::vector<Uint8>& mask, int w, int h, std::vector<Path>* layers[2]) {
+    EditorSelection sel;
+    for (int l = 0; l < 2; ++l) {
+        const auto& paths = *layers[l];
+        for (size_t i = 0; i < paths.size(); ++i) {
+            const Path& p = paths[i];
+            if (p.empty()) continue;
+            bool inside = true;
+            for (const auto& pt : p) {
+                int px = toPixel(pt.x), py = toPixel(pt.y);
+                if (px < 0 || py < 0 || px >= w || py >= h || !mask[(size_t)py * w + px]) { inside = false; break; }
+            }
+            if (!inside) continue;
+            sel.shapes.push_back({ l, i, sel.baseX.size(), p.size() });
+            for (const auto& pt : p) { sel.baseX.push_back((float)pt.x); sel.baseY.push_back((float)pt.y); }
+        }
+    }
+    sel.curX = sel.baseX;
+    sel.curY = sel.baseY;
+    updateSelectionBounds(sel);
+    return sel;
+}
+
+// Folds the preview into the committed transform and writes the result into the paths.
+static void commitSelectionTransform(EditorSelection& sel, std::vector<Path>* layers[2]) {
+    sel.applied = affineCompose(sel.preview, sel.applied);
+    sel.preview = Affine2D{};
+    affineTransformPoints(sel.baseX.data(), sel.baseY.data(), sel.curX.data(), sel.curY.data(), sel.baseX.size(), sel.applied);
+    for (const auto& ref : sel.shapes) {
+        Path& p = (*layers[ref.layer])[ref.shape];
+        for (size_t k = 0; k < ref.count; ++k) {
+            p[k] = { sel.curX[ref.first + k], sel.curY[ref.first + k] };
+        }
+    }
+    updateSelectionBounds(sel);
+}
+
+struct SnapResult {
+    SnapKind kind = SnapKind::None;
+    float x = 0.0f, y = 0.0f;
+};
+
+static inline Uint64 snapCellKey(int cx, int cy) { return ((Uint64)(Uint32)cx << 32) | (Uint32)cy; }
+static inline int snapCellOf(float v) { return (int)std::floor(v / SnapIndex::kCell); }
+
+// Grid traversal (Amanatides-Woo): visits each cell the segment passes through once.
+template <class Fn>
+static void forEachSnapCellOnSegment(float x0, float y0, float x1, float y1, Fn&& fn) {
+    const float inf = std::numeric_limits<float>::infinity();
+    const float cell = (float)SnapIndex::kCell;
+    int cx = snapCellOf(x0), cy = snapCellOf(y0);
+    int steps = std::abs(snapCellOf(x1) - cx) + std::abs(snapCellOf(y1) - cy);
+    float dx = x1 - x0, dy = y1 - y0;
+    int sx = dx > 0 ? 1 : -1, sy = dy > 0 ? 1 : -1;
+    float tdx = dx != 0 ? std::fabs(cell / dx) : inf, tdy = dy != 0 ? std::fabs(cell / dy) : inf;
+    float tx = dx > 0 ? ((cx + 1) * cell - x0) / dx : dx < 0 ? (cx * cell - x0) / dx : inf;
+    float ty = dy > 0 ? ((cy + 1) * cell - y0) / dy : dy < 0 ? (cy * cell - y0) / dy : inf;
+    fn(cx, cy);
+    for (int i = 0; i < steps; ++i) {
+        if (tx < ty) { tx += tdx; cx += sx; } else { ty += tdy; cy += sy; }
+        fn(cx, cy);
+    }
+}
+
+static void snapEditPoint(SnapIndex& idx, float x, float y, SnapKind kind, bool insert) {
+    Uint64 key = snapCellKey(snapCellOf(x), snapCellOf(y));
+    if (insert) { idx.points[key].push_back({x, y, kind}); return; }
+    auto it = idx.points.find(key);
+    if (it == idx.points.end()) return;
+    auto& v = it->second;
+    for (size_t i = 0; i < v.size(); ++i) {
+        if (v[i].x == x && v[i].y == y && v[i].kind == kind) { v[i] = v.back(); v.pop_back(); break; }
+    }
+    if (v.empty()) idx.points.erase(it);
+}
+
+static void snapEditSegment(SnapIndex& idx, const Point& a, const Point& b, bool insert) {
+    SnapIndex::Seg seg{ (float)a.x, (float)a.y, (float)b.x, (float)b.y };
+    forEachSnapCellOnSegment(seg.x0, seg.y0, seg.x1, seg.y1, [&](int cx, int cy) {
+        Uint64 key = snapCellKey(cx, cy);
+        if (insert) { idx.segments[key].push_back(seg); return; }
+        auto it = idx.segments.find(key);
+        if (it == idx.segments.end()) return;
+        auto& v = it->second;
+        for (size_t i = 0; i < v.size(); ++i) {
+            if (v[i].x0 == seg.x0 && v[i].y0 == seg.y0 && v[i].x1 == seg.x1 && v[i].y1 == seg.y1) { v[i] = v.back(); v.pop_back(); break; }
+        }
+        if (v.empty()) idx.segments.erase(it);
+    });
+    snapEditPoint(idx, (a.x + b.x) * 0.5f, (a.y + b.y) * 0.5f, SnapKind::Midpoint, insert);
+}
+
+// Adds (or, with insert=false, removes) the snap targets of one shape.
+static void snapEditShape(SnapIndex& idx, const Path& p, ShapeType type, bool insert) {
+    if (type == ShapeType::Circle && p.size() >= 2) {
+        snapEditPoint(idx, (p[0].x + p[1].x) * 0.5f, (p[0].y + p[1].y) * 0.5f, SnapKind::Center, insert);
+        return;
+    }
+    for (const auto& pt : p) snapEditPoint(idx, pt.x, pt.y, SnapKind::Vertex, insert);
+    for (size_t i = 1; i < p.size(); ++i) snapEditSegment(idx, p[i-1], p[i], insert);
+    bool closed = (type == ShapeType::Triangle && p.size() >= 3) || (type == ShapeType::Quadrilateral && p.size() >= 4);
+    if (closed) snapEditSegment(idx, p.back(), p.front(), insert);
+}
+
+static bool segmentIntersection(const SnapIndex::Seg& s, const SnapIndex::Seg& t, float& x, float& y) {
+    float rx = s.x1 - s.x0, ry = s.y1 - s.y0, qx = t.x1 - t.x0, qy = t.y1 - t.y0;
+    float den = rx * qy - ry * qx;
+    if (std::fabs(den) < 1e-6f) return false;
+    float wx = t.x0 - s.x0, wy = t.y0 - s.y0;
+    float u = (wx * qy - wy * qx) / den, v = (wx * ry - wy * rx) / den;
+    if (u < 0.0f || u > 1.0f || v < 0.0f || v > 1.0f) return false;
+    x = s.x0 + u * rx; y = s.y0 + u * ry;
+    return true;
+}
+
+// Best snap target within `radius` of (mx, my). Vertices, centers and intersections win
+// over midpoints at equal distance; the grid (gridStep > 0) is used only as a fallback.
+static SnapResult snapQuery(const SnapIndex& idx, float mx, float my, float radius, int gridStep) {
+    SnapResult best;
+    float bestScore = radius * radius;
+    auto consider = [&](float x, float y, SnapKind kind) {
+        float d2 = (x - mx) * (x - mx) + (y - my) * (y - my);
+        float score = kind == SnapKind::Midpoint ? d2 * 2.0f : d2;
+        if (score <= bestScore) { bestScore = score; best.kind = kind; best.x = x; best.y = y; }
+    };
+    int cx0 = snapCellOf(mx - radius), cx1 = snapCellOf(mx + radius);
+    int cy0 = snapCellOf(my - radius), cy1 = snapCellOf(my + radius);
+    std::vector<SnapIndex::Seg> near;
+    for (int cy = cy0; cy <= cy1; ++cy) {
+        for (int cx = cx0; cx <= cx1; ++cx) {
+            Uint64 key = snapCellKey(cx, cy);
+            auto pit = idx.points.find(key);
+            if (pit != idx.points.end()) for (const auto& p : pit->second) consider(p.x, p.y, p.kind);
+            auto sit = idx.segments.find(key);
+            if (sit == idx.segments.end()) continue;
+            for (const auto& sg : sit->second) {
+                if (near.size() >= 64) break;
+                float d2 = distancePointToSegmentSquared(mx, my, sg.x0, sg.y0, sg.x1, sg.y1);
+                if (d2 > radius * radius) continue;
+                bool dup = false;
+                for (const auto& n : near) if (n.x0 == sg.x0 && n.y0 == sg.y0 && n.x1 == sg.x1 && n.y1 == sg.y1) { dup = true; break; }
+                if (!dup) near.push_back(sg);
+            }
+        }
+    }
+    for (size_t i = 0; i < near.size(); ++i) {
+        for (size_t j = i + 1; j < near.size(); ++j) {
+            float x, y;
+            if (segmentIntersection(near[i], near[j], x, y)) consider(x, y, SnapKind::Intersection);
+        }
+    }
+    if (best.kind == SnapKind::None && gridStep > 0) {
+        best.kind = SnapKind::Grid;
+        best.x = std::round(mx / gridStep) * gridStep;
+        best.y = std::round(my / gridStep) * gridStep;
+    }
+    return best;
+}
+
+static void drawSnapMarker(SDL_Renderer* r, const SnapResult& s) {
+    int x = (int)std::lround(s.x), y = (int)std::lround(s.y);
+    SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(r, 255, 200, 60, 235);
+    switch (s.kind) {
+        case SnapKind::Vertex: { SDL_Rect box{ x - 5, y - 5, 11, 11 }; SDL_RenderDrawRect(r, &box); break; }
+        case SnapKind::Midpoint: {
+            SDL_Point tri[4] = { {x, y - 6}, {x + 6, y + 5}, {x - 6, y + 5}, {x, y - 6} };
+            SDL_RenderDrawLines(r, tri, 4);
+            break;
+        }
+        case SnapKind::Center: drawCircleOutline(r, x, y, 6, SDL_Color{255, 200, 60, 235}, 0); break;
+        case SnapKind::Intersection:
+            SDL_RenderDrawLine(r, x - 5, y - 5, x + 5, y + 5);
+            SDL_RenderDrawLine(r, x - 5, y + 5, x + 5, y - 5);
+            break;
+        case SnapKind::Grid:
+            SDL_RenderDrawLine(r, x - 4, y, x + 4, y);
+            SDL_RenderDrawLine(r, x, y - 4, x, y + 4);
+            break;
+        case SnapKind::None: break;
+    }
+}
+
+// Reference image underlay for tracing in the editor. <scene>/reference.txt holds one
+// line, "<image> <x> <y> <scale> <opacity>": the image's top-left corner in scene pixels,
+// scene pixels per image pixel, and 0-255. The image is decoded on a background thread
+// into a mip pyramid (level 0 is the decoded surface itself, each level above halves it).
+// Drawing picks the level closest to one texel per screen pixel and uploads only the
+// tiles it covers, a few per frame; a tile not uploaded yet is stood in for by a coarser
+// resident one. Tile textures live in an LRU capped at kUnderlayBudget bytes.
+static const int kUnderlayTile = 256;
+static const size_t kUnderlayBudget = 96u << 20;
+static const int kUnderlayUploadsPerFrame = 6;
+static const int kUnderlayMaxLevels = 32;
+
+struct UnderlayLevel {
+    int w = 0, h = 0, pitch = 0; // pitch in pixels
+    const Uint32* px = nullptr;  // ARGB8888
+    std::vector<Uint32> own;     // storage for levels above 0
+};
+
+// Shared with the decode thread, which publishes levels in order by bumping ready.
+struct UnderlayImage {
+    SDL_Surface* surface = nullptr;
+    std::array<UnderlayLevel, kUnderlayMaxLevels> levels;
+    std::atomic<int> ready{ 0 };
+    std::atomic<bool> done{ false }, cancel{ false };
+    std::string error; // set before done
+    ~UnderlayImage() { if (surface) SDL_FreeSurface(surface); }
+};
+
+struct Underlay {
+    std::string file; // as written in reference.txt; relative to the scene
+    float x = 0.0f, y = 0.0f, scale = 1.0f;
+    int opacity = 128;
+    bool visible = true, moved = false;
+    std::shared_ptr<UnderlayImage> image; // the decode thread holds its own reference
+    struct Tile {
+        SDL_Texture* texture = nullptr;
+        size_t bytes = 0;
+        std::list<Uint64>::iterator lru;
+    };
+    std::unordered_map<Uint64, Tile> tiles;
+    std::list<Uint64> lru; // most recently drawn first
+    size_t bytes = 0;
+    int drawnReady = 0;    // levels published when last drawn
+    bool deferred = false; // last draw left tiles for later frames
+    bool reported = false;
+};
+
+static bool readReference(const std::string& filename, Underlay& u) {
+    std::ifstream in(filename);
+    std::string line;
+    if (!std::getline(in, line)) return false;
+    std::vector<std::string> f = splitCommandLine(line);
+    if (f.size() != 5) return false;
+    u.file = f[0];
+    u.x = (float)std::atof(f[1].c_str());
+    u.y = (float)std::atof(f[2].c_str());
+    u.scale = (float)std::atof(f[3].c_str());
+    u.opacity = std::max(0, std::min(255, std::atoi(f[4].c_str())));
+    return u.scale > 0.0f;
+}
+
+static bool writeReference(const std::string& filename, const Underlay& u) {
+    std::ofstream out(filename, std::ios::trunc);
+    if (!out.is_open()) return false;
+    out.precision(7);
+    out << '"' << u.file << "\" " << u.x << " " << u.y << " " << u.scale << " " << u.opacity << "\n";
+    return (bool)out;
+}
+
+// Takes ownership of surface (ARGB8888) and publishes level 0, then each coarser level
+// as soon as it is built from the one below (2x2 box filter, edges clamped).
+static void buildUnderlayLevels(UnderlayImage& img, SDL_Surface* surface) {
+    img.surface = surface;
+    UnderlayLevel& base = img.levels[0];
+    base.w = surface->w; base.h = surface->h;
+    base.pitch = surface->pitch / 4;
+    base.px = (const Uint32*)surface->pixels;
+    img.ready.store(1, std::memory_order_release);
+    for (int l = 1; l < kUnderlayMaxLevels && !img.cancel; ++l) {
+        const UnderlayLevel& src = img.levels[l - 1];
+        if (src.w <= kUnderlayTile && src.h <= kUnderlayTile) break;
+        UnderlayLevel& dst = img.levels[l];
+        dst.w = (src.w + 1) / 2; dst.h = (src.h + 1) / 2; dst.pitch = dst.w;
+        dst.own.resize((size_t)dst.w * dst.h);
+        parallelFor((size_t)dst.h, [&](size_t y) {
+            const Uint32* r0 = src.px + (size_t)std::min(2 * (int)y, src.h - 1) * src.pitch;
+            const Uint32* r1 = src.px + (size_t)std::min(2 * (int)y + 1, src.h - 1) * src.pitch;
+            Uint32* out = &dst.own[y * dst.w];
+            for (int x = 0; x < dst.w; ++x) {
+                int x0 = 2 * x, x1 = std::min(2 * x + 1, src.w - 1);
+                Uint32 p[4] = { r0[x0], r0[x1], r1[x0], r1[x1] }, v = 0;
+                for (int k = 0; k < 32; k += 8) {
+                    Uint32 sum = ((p[0] >> k) & 0xFF) + ((p[1] >> k) & 0xFF) + ((p[2] >> k) & 0xFF) + ((p[3] >> k) & 0xFF);
+                    v |= ((sum + 2) / 4) << k;
+                }
+                out[x] = v;
+            }
+        });
+        dst.px = dst.own.data();
+        img.ready.store(l + 1, std::memory_order_release);
+    }
+}
+
+// Rewrites a 32-bit surface with 8-bit channels as ARGB8888 in its own pixels, so a decode
+// never holds two full-size copies. The surface keeps its old format tag; only the level
+// pointers read it from here on. Other layouts return false and are converted by SDL.
+static bool swizzleToArgb(SDL_Surface* s) {
+    const SDL_PixelFormat* f = s->format;
+    if (f->BytesPerPixel != 4 || f->palette || f->Rloss || f->Gloss || f->Bloss || (f->Amask && f->Aloss)) return false;
+    if (SDL_LockSurface(s) != 0) return false;
+    parallelFor((size_t)s->h, [&](size_t y) {
+        Uint32* row = (Uint32*)((Uint8*)s->pixels + y * s->pitch);
+        for (int x = 0; x < s->w; ++x) {
+            Uint32 p = row[x], a = f->Amask ? (p >> f->Ashift) & 0xFF : 0xFF;
+            row[x] = (a << 24) | (((p >> f->Rshift) & 0xFF) << 16) | (((p >> f->Gshift) & 0xFF) << 8) | ((p >> f->Bshift) & 0xFF);
+        }
+    });
+    SDL_UnlockSurface(s);
+    return true;
+}
+
+// The decode runs detached: stopUnderlay only cancels it, and whatever it still publishes
+// goes to an UnderlayImage nobody else holds.
+static void startUnderlay(Underlay& u, const std::string& basePath) {
+    std::filesystem::path file(u.file);
+    if (file.is_relative()) file = std::filesystem::path(basePath) / file;
+    u.image = std::make_shared<UnderlayImage>();
+    std::shared_ptr<UnderlayImage> img = u.image;
+    ++runningImageDecoders();
+    std::thread([img, path = file.string()]() {
+        SDL_Surface* loaded = img->cancel ? nullptr : IMG_Load(path.c_str());
+        if (loaded && loaded->format->format != SDL_PIXELFORMAT_ARGB8888 && !swizzleToArgb(loaded)) {
+            SDL_Surface* converted = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_ARGB8888, 0);
+            SDL_FreeSurface(loaded);
+            loaded = converted;
+        }
+        if (!loaded) img->error = "Cannot load reference image " + path + ": " + IMG_GetError();
+        else buildUnderlayLevels(*img, loaded);
+        img->done = true;
+        --runningImageDecoders();
+    }).detach();
+}
+
+static void stopUnderlay(Underlay& u) {
+    if (u.image) u.image->cancel = true;
+    for (auto& kv : u.tiles) SDL_DestroyTexture(kv.second.texture);
+    u.tiles.clear();
+    u.lru.clear();
+    u.bytes = 0;
+    u.image.reset();
+}
+
+static inline Uint64 underlayTileKey(int level, int tx, int ty) {
+    return ((Uint64)level << 56) | ((Uint64)(Uint32)ty << 28) | (Uint32)tx;
+}
+
+// Resident texture for a tile, uploading it if the frame's upload allowance permits.
+static SDL_Texture* underlayTile(SDL_Renderer* r, Underlay& u, int level, int tx, int ty, int& uploads) {
+    Uint64 key = underlayTileKey(level, tx, ty);
+    auto it = u.tiles.find(key);
+    if (it != u.tiles.end()) {
+        u.lru.splice(u.lru.begin(), u.lru, it->second.lru);
+        return it->second.texture;
+    }
+    if (uploads <= 0) return nullptr;
+    const UnderlayLevel& lv = u.image->levels[level];
+    int w = std::min(kUnderlayTile, lv.w - tx * kUnderlayTile), h = std::min(kUnderlayTile, lv.h - ty * kUnderlayTile);
+    SDL_Texture* t = SDL_CreateTexture(r, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, w, h);
+    if (!t) return nullptr;
+    SDL_UpdateTexture(t, nullptr, lv.px + (size_t)ty * kUnderlayTile * lv.pitch + (size_t)tx * kUnderlayTile, lv.pitch * 4);
+    SDL_SetTextureBlendMode(t, SDL_BLENDMODE_BLEND);
+#if SDL_VERSION_ATLEAST(2, 0, 12)
+    SDL_SetTextureScaleMode(t, SDL_ScaleModeLinear);
+#endif
+    --uploads;
+    u.lru.push_front(key);
+    Underlay::Tile tile;
+    tile.texture = t;
+    tile.bytes = (size_t)w * h * 4;
+    tile.lru = u.lru.begin();
+    u.tiles.emplace(key, tile);
+    u.bytes += tile.bytes;
+    return t;
+}
+
+// Screen span of texel range [a, b) of a level; integer edges so neighbouring tiles abut.
+static inline SDL_Rect underlaySpan(const Underlay& u, float texel, int a0, int b0, int a1, int b1) {
+    int x0 = (int)std::floor(u.x + a0 * texel), y0 = (int)std::floor(u.y + b0 * texel);
+    int x1 = (int)std::floor(u.x + a1 * texel), y1 = (int)std::floor(u.y + b1 * texel);
+    return SDL_Rect{ x0, y0, x1 - x0, y1 - y0 };
+}
+
+static void drawUnderlay(SDL_Renderer* r, Underlay& u, int viewW, int viewH) {
+    u.deferred = false;
+    if (!u.image) return;
+    if (u.image->done && !u.image->error.empty() && !u.reported) {
+        std::cerr << u.image->error << "\n";
+        u.reported = true;
+    }
+    int ready = u.image->ready.load(std::memory_order_acquire);
+    u.drawnReady = ready;
+    if (!u.visible || ready == 0) return;
+    int want = (int)std::floor(std::log2(std::max(1.0f, 1.0f / u.scale)));
+    if (want >= ready && !u.image->done) return; // still building; drawing level 0 zoomed out would thrash
+    int level = std::min(want, ready - 1);
+    const UnderlayLevel& lv = u.image->levels[level];
+    float texel = u.scale * (float)(1 << level); // scene pixels per texel of this level
+    int tilesX = (lv.w + kUnderlayTile - 1) / kUnderlayTile, tilesY = (lv.h + kUnderlayTile - 1) / kUnderlayTile;
+    int tx0 = std::max(0, (int)std::floor(-u.x / texel / kUnderlayTile)), tx1 = std::min(tilesX - 1, (int)std::floor((viewW - u.x) / texel / kUnderlayTile));
+    int ty0 = std::max(0, (int)std::floor(-u.y / texel / kUnderlayTile)), ty1 = std::min(tilesY - 1, (int)std::floor((viewH - u.y) / texel / kUnderlayTile));
+    int uploads = kUnderlayUploadsPerFrame;
+    size_t drawn = 0;
+    for (int ty = ty0; ty <= ty1; ++ty) {
+        for (int tx = tx0; tx <= tx1; ++tx) {
+            int a0 = tx * kUnderlayTile, b0 = ty * kUnderlayTile;
+            SDL_Rect dst = underlaySpan(u, texel, a0, b0, std::min(lv.w, a0 + kUnderlayTile), std::min(lv.h, b0 + kUnderlayTile));
+            if (SDL_Texture* t = underlayTile(r, u, level, tx, ty, uploads)) {
+                SDL_SetTextureAlphaMod(t, (Uint8)u.opacity);
+                SDL_RenderCopy(r, t, nullptr, &dst);
+                ++drawn;
+                continue;
+            }
+            // stand in with the nearest coarser resident tile, clipped to this one
+            u.deferred = true;
+            for (int p = level + 1; p < ready; ++p) {
+                int ptx = tx >> (p - level), pty = ty >> (p - level);
+                auto it = u.tiles.find(underlayTileKey(p, ptx, pty));
+                if (it == u.tiles.end()) continue;
+                const UnderlayLevel& pl = u.image->levels[p];
+                int pa0 = ptx * kUnderlayTile, pb0 = pty * kUnderlayTile;
+                SDL_Rect pdst = underlaySpan(u, u.scale * (float)(1 << p), pa0, pb0, std::min(pl.w, pa0 + kUnderlayTile), std::min(pl.h, pb0 + kUnderlayTile));
+                SDL_RenderSetClipRect(r, &dst);
+                SDL_SetTextureAlphaMod(it->second.texture, (Uint8)u.opacity);
+                SDL_RenderCopy(r, it->second.texture, nullptr, &pdst);
+                SDL_RenderSetClipRect(r, nullptr);
+                u.lru.splice(u.lru.begin(), u.lru, it->second.lru);
+                ++drawn;
+                break;
+            }
+        }
+    }
+    // evict the least recently drawn tiles; the ones drawn this frame sit at the front
+    while (u.bytes > kUnderlayBudget && u.lru.size() > drawn) {
+        auto it = u.tiles.find(u.lru.back());
+        u.bytes -= it->second.bytes;
+        SDL_DestroyTexture(it->second.texture);
+        u.tiles.erase(it);
+        u.lru.pop_back();
+    }
+}
+
+// Whether another frame would show more of the underlay than the last one did.
+static bool underlayNeedsFrame(const Underlay& u) {
+    if (!u.image || !u.visible) return false;
+    return u.deferred || u.image->ready.load(std::memory_order_acquire) != u.drawnReady
+        || (u.image->done && !u.image->error.empty() && !u.reported);
+}
+
+// Geometric constraints between shapes, kept in <scene>/constraints.txt one per line:
+//
+//   coincident <ref> <ref>       the two vertices meet
+//   parallel <ref> <ref>         the two edges stay parallel
+//   length <ref> <px>            the edge keeps its length
+//   tangent <ref> <ref> <mode>   a circle touches a circle (mode 0 outside, 1 the first
+//                                contains the second, 2 the reverse) or the line through
+//                                an edge (mode is the side, 1 or -1)
+//
+// A ref is "<f|t> <shape> <index>": layer, shape, and a vertex or edge index (edge k runs
+// from vertex k to the next, wrapping on triangles and quadrilaterals). Erasing shapes in
+// the editor or with batch takes their constraints along and renumbers the rest; clean and
+// symbol-define do the same for shapes they remove, reshape or move into a symbol. Refs
+// that still do not fit the scene, say after a layer file was edited by hand, are dropped
+// on load.
+//
+// Solving is position-based: each violated constraint moves its vertices along its
+// gradient just far enough to hold (parallel edges are turned instead), pinned vertices
+// stay put, and sweeps repeat until all are within kConstraintEpsilon px. Constraints
+// sharing vertices form a component, and an edit solves only the components it touched,
+// starting from the current positions (the last solution), so a mouse step settles in a
+// sweep or two whatever the drawing's size.
+// Long rigid chains converge slowly this way; a drag caps each step at kConstraintSweeps
+// and settles on release. The caps are sweep counts, not time, so replays stay exact.
+static const float kConstraintEpsilon = 0.05f;
+static const int kConstraintSweeps = 64;        // per drag step
+static const int kConstraintSettleSweeps = 1024; // once the drag ends
+
+enum class ConstraintKind { Coincident, Parallel, Length, Tangent };
+static const char* const kConstraintNames[] = { "coincident", "parallel", "length", "tangent" };
+
+struct ConstraintRef {
+    int layer = 0; // 0 foliage, 1 trunks
+    size_t shape = 0;
+    int index = 0; // vertex or edge
+};
+
+struct Constraint {
+    ConstraintKind kind = ConstraintKind::Coincident;
+    ConstraintRef a, b; // b unused by length
+    float value = 0.0f;
+};
+
+struct ConstraintSet {
+    std::vector<Constraint> list;
+    bool edited = false;
+    // vertex key -> component, and each component's constraints; rebuilt when dirty
+    bool dirty = true;
+    std::unordered_map<Uint64, Uint32> componentOf;
+    std::vector<std::vector<Uint32>> components;
+};
+
+// The scene as the solver sees it; both the editor and batch keep layers in this order.
+struct ConstraintLayers {
+    std::vector<Path>* paths[2];
+    const std::vector<ShapeType>* types[2];
+    bool has(const ConstraintRef& r) const { return r.layer >= 0 && r.layer < 2 && r.shape < paths[r.layer]->size(); }
+    ShapeType type(int l, size_t i) const { return i < types[l]->size() ? (*types[l])[i] : ShapeType::Line; }
+    Point& at(const ConstraintRef& r) const { return (*paths[r.layer])[r.shape][r.index]; }
+};
+
+static inline Uint64 constraintKey(const ConstraintRef& r) {
+    return ((Uint64)r.layer << 62) | ((Uint64)r.shape << 8) | (Uint64)r.index;
+}
+
+static inline ConstraintRef constraintKeyRef(Uint64 key) {
+    return ConstraintRef{ (int)(key >> 62), (size_t)((key >> 8) & ((1ull << 54) - 1)), (int)(key & 0xff) };
+}
+
+static bool readConstraints(const std::string& filename, ConstraintSet& cs) {
+    std::ifstream in(filename);
+    if (!in.is_open()) return false;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream ls(line);
+        std::string kind;
+        if (!(ls >> kind)) continue;
+        Constraint c;
+        int k = 0;
+        while (k < 4 && kind != kConstraintNames[k]) ++k;
+        if (k == 4) continue;
+        c.kind = (ConstraintKind)k;
+        auto ref = [&](ConstraintRef& r) {
+            char layer = 0;
+            if (!(ls >> layer >> r.shape >> r.index) || (layer != 'f' && layer != 't') || r.index < 0 || r.index > 255) return false;
+            r.layer = layer == 't';
+            return true;
+        };
+        bool ok = ref(c.a) && (c.kind == ConstraintKind::Length || ref(c.b));
+        if (c.kind == ConstraintKind::Length || c.kind == ConstraintKind::Tangent) ok = ok && (bool)(ls >> c.value);
+        if (ok) cs.list.push_back(c);
+    }
+    cs.dirty = true;
+    return true;
+}
+
+static bool writeConstraints(const std::string& filename, const ConstraintSet& cs) {
+    if (cs.list.empty()) { std::remove(filename.c_str()); return true; }
+    std::ofstream out(filename, std::ios::trunc);
+    if (!out.is_open()) return false;
+    out.precision(7);
+    auto ref = [&](const ConstraintRef& r) { out << " " << (r.layer ? 't' : 'f') << " " << r.shape << " " << r.index; };
+    for (const Constraint& c : cs.list) {
+        out << kConstraintNames[(int)c.kind];
+        ref(c.a);
+        if (c.kind != ConstraintKind::Length) ref(c.b);
+        if (c.kind == ConstraintKind::Length || c.kind == ConstraintKind::Tangent) out << " " << c.value;
+        out << "\n";
+    }
+    return (bool)out;
+}
+
+// The vertices a constraint reads, in the order constraintResidual expects; false when
+// its refs do not fit the scene.
+static bool constraintVertices(const Constraint& c, const ConstraintLayers& L, ConstraintRef v[4], int& n) {
+    n = 0;
+    auto vertex = [&](const ConstraintRef& r) {
+        if (!L.has(r) || r.index < 0 || (size_t)r.index >= (*L.paths[r.layer])[r.shape].size()) return false;
+        v[n++] = r;
+        return true;
+    };
+    auto edge = [&](const ConstraintRef& r) {
+        if (!L.has(r)) return false;
+        ShapeType t = L.type(r.layer, r.shape);
+        size_t size = (*L.paths[r.layer])[r.shape].size();
+        size_t edges = t == ShapeType::Circle || size < 2 ? 0 : t == ShapeType::Line ? size - 1 : size;
+        if (r.index < 0 || (size_t)r.index >= edges) return false;
+        v[n++] = r;
+        v[n++] = ConstraintRef{ r.layer, r.shape, (int)((r.index + 1) % size) };
+        return true;
+    };
+    auto circle = [&](const ConstraintRef& r) {
+        if (!L.has(r) || L.type(r.layer, r.shape) != ShapeType::Circle || (*L.paths[r.layer])[r.shape].size() < 2) return false;
+        v[n++] = ConstraintRef{ r.layer, r.shape, 0 };
+        v[n++] = ConstraintRef{ r.layer, r.shape, 1 };
+        return true;
+    };
+    bool sameShape = c.a.layer == c.b.layer && c.a.shape == c.b.shape;
+    switch (c.kind) {
+        case ConstraintKind::Coincident: return vertex(c.a) && vertex(c.b) && !(sameShape && c.a.index == c.b.index);
+        case ConstraintKind::Parallel: return edge(c.a) && edge(c.b) && !(sameShape && c.a.index == c.b.index);
+        case ConstraintKind::Length: return edge(c.a);
+        case ConstraintKind::Tangent:
+            if (sameShape || !circle(c.a) || !L.has(c.b)) return false;
+            return L.type(c.b.layer, c.b.shape) == ShapeType::Circle ? circle(c.b) : edge(c.b);
+    }
+    return false;
+}
+
+static void buildConstraintComponents(ConstraintSet& cs, const ConstraintLayers& L) {
+    std::unordered_map<Uint64, Uint32> node;
+    std::vector<Uint32> parent;
+    auto find = [&](Uint32 x) {
+        while (parent[x] != x) x = parent[x] = parent[parent[x]];
+        return x;
+    };
+    std::vector<Uint32> first(cs.list.size(), UINT32_MAX);
+    for (size_t i = 0; i < cs.list.size(); ++i) {
+        ConstraintRef v[4];
+        int n = 0;
+        if (!constraintVertices(cs.list[i], L, v, n)) continue;
+        for (int k = 0; k < n; ++k) {
+            auto ins = node.emplace(constraintKey(v[k]), (Uint32)parent.size());
+            if (ins.second) parent.push_back(ins.first->second);
+            Uint32 x = find(ins.first->second);
+            if (first[i] == UINT32_MAX) first[i] = x;
+            else parent[x] = find(first[i]);
+        }
+    }
+    std::vector<Uint32> id(parent.size(), UINT32_MAX);
+    cs.components.clear();
+    cs.componentOf.clear();
+    for (const auto& kv : node) {
+        Uint32 root = find(kv.second);
+        if (id[root] == UINT32_MAX) { id[root] = (Uint32)cs.components.size(); cs.components.emplace_back(); }
+        cs.componentOf[kv.first] = id[root];
+    }
+    for (size_t i = 0; i < cs.list.size(); ++i) {
+        if (first[i] != UINT32_MAX) cs.components[id[find(first[i])]].push_back((Uint32)i);
+    }
+    cs.dirty = false;
+}
+
+// C(v) for the constraint and its gradient per vertex; err is the violation in pixels.
+static float constraintResidual(const Constraint& c, bool toCircle, Point* const* v, Point* g, float& err) {
+    auto sub = [](const Point& p, const Point& q) { return Point{ p.x - q.x, p.y - q.y }; };
+    auto len = [](const Point& d) { return std::sqrt(d.x * d.x + d.y * d.y); };
+    auto unit = [&](const Point& d) { float l = len(d); return l > 1e-6f ? Point{ d.x / l, d.y / l } : Point{ 1.0f, 0.0f }; };
+    switch (c.kind) {
+    case ConstraintKind::Coincident: {
+        Point d = sub(*v[0], *v[1]);
+        Point u = unit(d);
+        g[0] = u; g[1] = Point{ -u.x, -u.y };
+        return err = len(d);
+    }
+    case ConstraintKind::Length: {
+        Point d = sub(*v[1], *v[0]);
+        Point u = unit(d);
+        g[0] = Point{ -u.x, -u.y }; g[1] = u;
+        float C = len(d) - c.value;
+        err = std::abs(C);
+        return C;
+    }
+    case ConstraintKind::Parallel: {
+        // the angle from the first edge to the second, folded so either direction counts;
+        // solveConstraints turns the edges by it rather than following a gradient, which
+        // would stretch them on large turns (and, on the cross product, collapse them)
+        Point d1 = sub(*v[1], *v[0]), d2 = sub(*v[3], *v[2]);
+        float C = std::atan2(d1.x * d2.y - d1.y * d2.x, d1.x * d2.x + d1.y * d2.y);
+        if (C > 1.5707964f) C -= 3.14159265f;
+        if (C < -1.5707964f) C += 3.14159265f;
+        err = std::abs(C) * std::max(len(d1), len(d2));
+        return C;
+    }
+    case ConstraintKind::Tangent: {
+        Point ca{ (v[0]->x + v[1]->x) * 0.5f, (v[0]->y + v[1]->y) * 0.5f };
+        Point va = unit(sub(*v[1], *v[0]));
+        float ra = len(sub(*v[1], *v[0])) * 0.5f;
+        float C;
+        if (toCircle) {
+            Point cb{ (v[2]->x + v[3]->x) * 0.5f, (v[2]->y + v[3]->y) * 0.5f };
+            Point vb = unit(sub(*v[3], *v[2]));
+            float rb = len(sub(*v[3], *v[2])) * 0.5f;
+            float ka = c.value == 2.0f ? -1.0f : 1.0f, kb = c.value == 1.0f ? -1.0f : 1.0f;
+            Point u = unit(sub(ca, cb));
+            C = len(sub(ca, cb)) - ka * ra - kb * rb;
+            g[0] = Point{ (u.x + ka * va.x) * 0.5f, (u.y + ka * va.y) * 0.5f };
+            g[1] = Point{ (u.x - ka * va.x) * 0.5f, (u.y - ka * va.y) * 0.5f };
+            g[2] = Point{ (-u.x + kb * vb.x) * 0.5f, (-u.y + kb * vb.y) * 0.5f };
+            g[3] = Point{ (-u.x - kb * vb.x) * 0.5f, (-u.y - kb * vb.y) * 0.5f };
+        } else {
+            // signed distance from the center to the edge's line: cross(e, w) / |e|
+            Point e = sub(*v[3], *v[2]), w = sub(ca, *v[2]);
+            float el = std::max(1e-6f, len(e));
+            float sd = (e.x * w.y - e.y * w.x) / el, s = c.value < 0.0f ? -1.0f : 1.0f;
+            Point dc{ -e.y / el, e.x / el };
+            Point dq{ w.y / el - sd * e.x / (el * el), -w.x / el - sd * e.y / (el * el) };
+            Point dp{ -dc.x - dq.x, -dc.y - dq.y };
+            C = s * sd - ra;
+            g[0] = Point{ (s * dc.x + va.x) * 0.5f, (s * dc.y + va.y) * 0.5f };
+            g[1] = Point{ (s * dc.x - va.x) * 0.5f, (s * dc.y - va.y) * 0.5f };
+            g[2] = Point{ s * dp.x, s * dp.y };
+            g[3] = Point{ s * dq.x, s * dq.y };
+        }
+        err = std::abs(C);
+        return C;
+    }
+    }
+    return err = 0.0f;
+}
+
+// Turns edge a-b by angle about its pinned end, or its middle when neither end is pinned.
+static void turnConstraintEdge(Point* a, Point* b, float wa, float wb, float angle) {
+    if (wa == 0.0f && wb == 0.0f) return;
+    Point pivot = wa == 0.0f ? *a : wb == 0.0f ? *b : Point{ (a->x + b->x) * 0.5f, (a->y + b->y) * 0.5f };
+    float c = std::cos(angle), s = std::sin(angle);
+    for (Point* p : { a, b }) {
+        float x = p->x - pivot.x, y = p->y - pivot.y;
+        *p = Point{ pivot.x + c * x - s * y, pivot.y + s * x + c * y };
+    }
+}
+
+// Components holding any of the seed vertices.
+static std::vector<Uint32> constraintComponents(ConstraintSet& cs, const ConstraintLayers& L, const std::vector<Uint64>& seeds) {
+    if (cs.dirty) buildConstraintComponents(cs, L);
+    std::vector<Uint32> comps;
+    for (Uint64 k : seeds) {
+        auto it = cs.componentOf.find(k);
+        if (it != cs.componentOf.end()) comps.push_back(it->second);
+    }
+    std::sort(comps.begin(), comps.end());
+    comps.erase(std::unique(comps.begin(), comps.end()), comps.end());
+    return comps;
+}
+
+// Shapes with a vertex in the seeds' components, as unique (layer, shape) pairs: what a
+// solve from those seeds may move.
+static void constraintComponentShapes(ConstraintSet& cs, const ConstraintLayers& L, const std::vector<Uint64>& seeds,
+                                      std::vector<std::pair<int, size_t>>& shapes) {
+    shapes.clear();
+    if (cs.list.empty()) return;
+    for (Uint32 comp : constraintComponents(cs, L, seeds)) {
+        for (Uint32 ci : cs.components[comp]) {
+            ConstraintRef v[4];
+            int n = 0;
+            constraintVertices(cs.list[ci], L, v, n);
+            for (int k = 0; k < n; ++k) shapes.emplace_back(v[k].layer, v[k].shape);
+        }
+    }
+    std::sort(shapes.begin(), shapes.end());
+    shapes.erase(std::unique(shapes.begin(), shapes.end()), shapes.end());
+}
+
+// Constrained vertices of the shapes chosen(layer, shape) picks.
+static void constrainedVertices(ConstraintSet& cs, const ConstraintLayers& L, const std::function<bool(int, size_t)>& chosen,
+                                std::vector<Uint64>& keys) {
+    keys.clear();
+    if (cs.list.empty()) return;
+    if (cs.dirty) buildConstraintComponents(cs, L);
+    for (const auto& kv : cs.componentOf) {
+        ConstraintRef r = constraintKeyRef(kv.first);
+        if (chosen(r.layer, r.shape)) keys.push_back(kv.first);
+    }
+}
+
+// Re-solves the components holding any of the seed vertices, leaving pinned ones in place.
+// Returns the sweeps it took.
+static int solveConstraints(ConstraintSet& cs, const ConstraintLayers& L, const std::vector<Uint64>& seeds, std::vector<Uint64> pinned,
+                            int maxSweeps = kConstraintSweeps) {
+    if (cs.list.empty()) return 0;
+    std::vector<Uint32> comps = constraintComponents(cs, L, seeds);
+    std::sort(pinned.begin(), pinned.end());
+
+    struct Term { const Constraint* c; bool toCircle; int n; Point* v[4]; float w[4]; };
+    std::vector<Term> terms;
+    for (Uint32 comp : comps) {
+        for (Uint32 ci : cs.components[comp]) {
+            Term t{ &cs.list[ci], false, 0, {}, {} };
+            ConstraintRef refs[4];
+            constraintVertices(*t.c, L, refs, t.n);
+            t.toCircle = t.c->kind == ConstraintKind::Tangent && L.type(t.c->b.layer, t.c->b.shape) == ShapeType::Circle;
+            for (int k = 0; k < t.n; ++k) {
+                t.v[k] = &L.at(refs[k]);
+                t.w[k] = std::binary_search(pinned.begin(), pinned.end(), constraintKey(refs[k])) ? 0.0f : 1.0f;
+            }
+            terms.push_back(t);
+        }
+    }
+    int sweep = 0;
+    while (sweep < maxSweeps) {
+        ++sweep;
+        float worst = 0.0f;
+        for (Term& t : terms) {
+            Point g[4];
+            float err = 0.0f;
+            float C = constraintResidual(*t.c, t.toCircle, t.v, g, err);
+            worst = std::max(worst, err);
+            if (err <= kConstraintEpsilon) continue;
+            if (t.c->kind == ConstraintKind::Parallel) {
+                // each free edge takes its share of the turn toward the other
+                bool free1 = t.w[0] + t.w[1] > 0.0f, free2 = t.w[2] + t.w[3] > 0.0f;
+                float share1 = free1 && free2 ? 0.5f : free1 ? 1.0f : 0.0f;
+                turnConstraintEdge(t.v[0], t.v[1], t.w[0], t.w[1], C * share1);
+                turnConstraintEdge(t.v[2], t.v[3], t.w[2], t.w[3], -C * (free2 ? 1.0f - share1 : 0.0f));
+                continue;
+            }
+            // a vertex read twice (adjacent edges) takes the sum of its gradients
+            for (int i = 0; i < t.n; ++i) {
+                for (int j = 0; j < i; ++j) {
+                    if (t.v[j] == t.v[i]) { g[j].x += g[i].x; g[j].y += g[i].y; g[i] = Point{ 0.0f, 0.0f }; break; }
+                }
+            }
+            float denom = 0.0f;
+            for (int i = 0; i < t.n; ++i) denom += t.w[i] * (g[i].x * g[i].x + g[i].y * g[i].y);
+            if (denom < 1e-12f) continue;
+            float lambda = -C / denom;
+            for (int i = 0; i < t.n; ++i) {
+                t.v[i]->x += t.w[i] * lambda * g[i].x;
+                t.v[i]->y += t.w[i] * lambda * g[i].y;
+            }
+        }
+        if (worst <= kConstraintEpsilon) break;
+    }
+    return sweep;
+}
+
+// Adds c, taking a length or tangent side from the current geometry. keys gets its
+// vertices and held those of its first element, which a solve should keep in place.
+// False if the refs do not make a valid constraint.
+static bool addConstraint(ConstraintSet& cs, const ConstraintLayers& L, Constraint c, std::vector<Uint64>& keys, std::vector<Uint64>& held) {
+    ConstraintRef v[4];
+    int n = 0;
+    if (!constraintVertices(c, L, v, n)) return false;
+    auto dist = [&](const ConstraintRef& p, const ConstraintRef& q) {
+        const Point &a = L.at(p), &b = L.at(q);
+        return std::sqrt((a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y));
+    };
+    if (c.kind == ConstraintKind::Length) c.value = dist(v[0], v[1]);
+    if (c.kind == ConstraintKind::Tangent) {
+        Point* pts[4] = { &L.at(v[0]), &L.at(v[1]), &L.at(v[2]), &L.at(v[3]) };
+        Point g[4];
+        float err = 0.0f, best = 1e30f;
+        bool toCircle = L.type(c.b.layer, c.b.shape) == ShapeType::Circle;
+        for (float mode : toCircle ? std::vector<float>{ 0.0f, 1.0f, 2.0f } : std::vector<float>{ 1.0f, -1.0f }) {
+            Constraint t = c;
+            t.value = mode;
+            constraintResidual(t, toCircle, pts, g, err);
+            if (err < best) { best = err; c.value = mode; }
+        }
+    }
+    cs.list.push_back(c);
+    cs.dirty = true;
+    cs.edited = true;
+    keys.clear();
+    for (int k = 0; k < n; ++k) keys.push_back(constraintKey(v[k]));
+    int first = c.kind == ConstraintKind::Coincident ? 1 : c.kind == ConstraintKind::Length ? 0 : 2;
+    held.assign(keys.begin(), keys.begin() + first);
+    return true;
+}
+
+// Moves the layer's refs to newIndex[shape]; constraints on shapes mapped to kNoShape (gone,
+// or with their vertices renumbered) or past the end of newIndex are dropped.
+static const size_t kNoShape = (size_t)-1;
+
+static void remapConstraintShapes(ConstraintSet& cs, int layer, const std::vector<size_t>& newIndex) {
+    if (cs.list.empty()) return;
+    bool moved = false;
+    auto keep = [&](ConstraintRef& r) {
+        if (r.layer != layer) return true;
+        if (r.shape >= newIndex.size() || newIndex[r.shape] == kNoShape) return false;
+        moved |= newIndex[r.shape] != r.shape;
+        r.shape = newIndex[r.shape];
+        return true;
+    };
+    size_t before = cs.list.size();
+    cs.list.erase(std::remove_if(cs.list.begin(), cs.list.end(), [&](Constraint& c) {
+        bool a = keep(c.a);
+        bool b = c.kind == ConstraintKind::Length || keep(c.b);
+        return !(a && b);
+    }), cs.list.end());
+    cs.edited |= moved || cs.list.size() != before;
+    cs.dirty = true;
+}
+
+// Drops constraints on shapes marked in erased and renumbers the layer's later shapes.
+static void eraseConstraintShapes(ConstraintSet& cs, int layer, const std::vector<char>& erased) {
+    if (cs.list.empty()) return;
+    std::vector<size_t> newIndex(erased.size());
+    for (size_t i = 0, k = 0; i < erased.size(); ++i) newIndex[i] = erased[i] ? kNoShape : k++;
+    remapConstraintShapes(cs, layer, newIndex);
+}
+
+// For tools that rebuild a scene's layers on disk: applies their renumbering to
+// <dir>/constraints.txt. Scenes without constraints are left alone.
+static bool remapSceneConstraints(const std::string& dir, const std::vector<size_t> newIndex[2], std::ostream& out) {
+    ConstraintSet cs;
+    if (!readConstraints(dir + "/constraints.txt", cs)) return true;
+    size_t before = cs.list.size();
+    for (int l = 0; l < 2; ++l) remapConstraintShapes(cs, l, newIndex[l]);
+    if (!cs.edited) return true;
+    if (cs.list.size() != before) out << "Dropped " << before - cs.list.size() << " constraints on changed shapes\n";
+    if (writeConstraints(dir + "/constraints.txt", cs)) return true;
+    out << "Cannot write " << dir << "/constraints.txt\n";
+    return false;
+}
+
+static size_t removeShapeConstraints(ConstraintSet& cs, int layer, size_t shape) {
+    size_t before = cs.list.size();
+    auto on = [&](const ConstraintRef& r) { return r.layer == layer && r.shape == shape; };
+    cs.list.erase(std::remove_if(cs.list.begin(), cs.list.end(), [&](const Constraint& c) {
+        return on(c.a) || (c.kind != ConstraintKind::Length && on(c.b));
+    }), cs.list.end());
+    if (cs.list.size() != before) cs.dirty = cs.edited = true;
+    return before - cs.list.size();
+}
+
+static void dropUnfitConstraints(ConstraintSet& cs, const ConstraintLayers& L, std::ostream& out) {
+    size_t before = cs.list.size();
+    cs.list.erase(std::remove_if(cs.list.begin(), cs.list.end(), [&](const Constraint& c) {
+        ConstraintRef v[4];
+        int n = 0;
+        return !constraintVertices(c, L, v, n);
+    }), cs.list.end());
+    if (cs.list.size() != before) { cs.edited = true; out << "Dropped " << before - cs.list.size() << " constraints that no longer fit the scene\n"; }
+    cs.dirty = true;
+}
+
+// Nearest element within the distance sqrt(best2), which shrinks to the hit's.
+static bool pickConstraintVertex(const ConstraintLayers& L, float x, float y, float& best2, ConstraintRef& out) {
+    bool found = false;
+    for (int l = 0; l < 2; ++l) {
+        const auto& paths = *L.paths[l];
+        for (size_t i = 0; i < paths.size(); ++i) {
+            for (size_t k = 0; k < paths[i].size() && k < 256; ++k) {
+                float d = distanceSquared(x, y, paths[i][k].x, paths[i][k].y);
+                if (d < best2) { best2 = d; out = ConstraintRef{ l, i, (int)k }; found = true; }
+            }
+        }
+    }
+    return found;
+}
+
+static bool pickConstraintEdge(const ConstraintLayers& L, float x, float y, float& best2, ConstraintRef& out) {
+    bool found = false;
+    for (int l = 0; l < 2; ++l) {
+        const auto& paths = *L.paths[l];
+        for (size_t i = 0; i < paths.size(); ++i) {
+            ShapeType t = L.type(l, i);
+            const Path& p = paths[i];
+            if (t == ShapeType::Circle || p.size() < 2) continue;
+            size_t edges = std::min<size_t>(t == ShapeType::Line ? p.size() - 1 : p.size(), 256);
+            for (size_t k = 0; k < edges; ++k) {
+                const Point &a = p[k], &b = p[(k + 1) % p.size()];
+                float d = distancePointToSegmentSquared(x, y, a.x, a.y, b.x, b.y);
+                if (d < best2) { best2 = d; out = ConstraintRef{ l, i, (int)k }; found = true; }
+            }
+        }
+    }
+    return found;
+}
+
+static bool pickConstraintCircle(const ConstraintLayers& L, float x, float y, float& best2, ConstraintRef& out) {
+    bool found = false;
+    for (int l = 0; l < 2; ++l) {
+        const auto& paths = *L.paths[l];
+        for (size_t i = 0; i < paths.size(); ++i) {
+            const Path& p = paths[i];
+            if (L.type(l, i) != ShapeType::Circle || p.size() < 2) continue;
+            float cx = (p[0].x + p[1].x) * 0.5f, cy = (p[0].y + p[1].y) * 0.5f;
+            float r = std::sqrt(distanceSquared(p[0].x, p[0].y, p[1].x, p[1].y)) * 0.5f;
+            float d = std::sqrt(distanceSquared(x, y, cx, cy)) - r;
+            if (d * d < best2) { best2 = d * d; out = ConstraintRef{ l, i, 0 }; found = true; }
+        }
+    }
+    return found;
+}
+
+// A dot on each constrained element (vertex, edge midpoint, circle center) joined by a
+// faint line, colored by kind.
+static void drawConstraints(SDL_Renderer* renderer, const ConstraintSet& cs, const ConstraintLayers& L) {
+    static const SDL_Color colors[] = { {255, 200, 80, 255}, {120, 200, 255, 255}, {200, 140, 255, 255}, {120, 230, 150, 255} };
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    for (const Constraint& c : cs.list) {
+        ConstraintRef v[4];
+        int n = 0;
+        if (!constraintVertices(c, L, v, n)) continue;
+        SDL_Color col = colors[(int)c.kind];
+        auto mid = [&](int k) { const Point &a = L.at(v[k]), &b = L.at(v[k + 1]); return Point{ (a.x + b.x) * 0.5f, (a.y + b.y) * 0.5f }; };
+        Point pa = c.kind == ConstraintKind::Coincident ? L.at(v[0]) : mid(0);
+        Point pb = c.kind == ConstraintKind::Coincident ? L.at(v[1]) : n == 4 ? mid(2) : pa;
+        SDL_SetRenderDrawColor(renderer, col.r, col.g, col.b, 90);
+        SDL_RenderDrawLine(renderer, toPixel(pa.x), toPixel(pa.y), toPixel(pb.x), toPixel(pb.y));
+        drawFilledCircle(renderer, toPixel(pa.x), toPixel(pa.y), 3, col);
+        if (n == 4 || c.kind == ConstraintKind::Coincident) drawFilledCircle(renderer, toPixel(pb.x), toPixel(pb.y), 3, col);
+    }
+}
+
+// Editor input recording. `edit record <file>` writes every event the editor handles
+// with its time (ms since the editor opened) and the modifier state it was read with:
+//
+//   atelier-events 1 <scene-hash>
+//   <ms> key <sym> <mod>          <ms> down|up <button> <x> <y> <mod>
+//   <ms> motion <x> <y> <mod>     <ms> wheel <dy> <mod>
+//   <ms> quit                     <ms> commit
+//   <ms> end <scene-hash>
+//
+// "commit" marks the wheel-scale commit the editor makes once the wheel goes quiet, so a
+// replay applies it at the same point in the stream instead of depending on wall time.
+// `replay-edit` feeds a recording through the same editor loop on an offscreen software
+// renderer and reports how long each event took to handle, redraw included.
+struct EditorEvent {
+    Uint32 time = 0;
+    SDL_Event event{};
+    SDL_Keymod mod = KMOD_NONE;
+    bool commit = false;
+};
+
+struct EditorDriver {
+    std::ofstream* record = nullptr;                  // live session being recorded
+    const std::vector<EditorEvent>* replay = nullptr; // headless: events come from here
+    bool save = true;
+    Uint64 startHash = 0, finalHash = 0;
+    std::map<std::string, std::vector<double>> latency; // replay: microseconds per event, by kind
+};
+
+static const char* editorEventKind(const SDL_Event& e) {
+    switch (e.type) {
+        case SDL_KEYDOWN: return "key";
+        case SDL_MOUSEBUTTONDOWN: return "down";
+        case SDL_MOUSEBUTTONUP: return "up";
+        case SDL_MOUSEMOTION: return "motion";
+        case SDL_MOUSEWHEEL: return "wheel";
+        case SDL_QUIT: return "quit";
+        default: return nullptr;
+    }
+}
+
+static void writeEditorEvent(std::ostream& out, Uint32 ms, const SDL_Event& e, SDL_Keymod mod) {
+    const char* kind = editorEventKind(e);
+    if (!kind) return; // nothing the editor reacts to
+    out << ms << " " << kind;
+    switch (e.type) {
+        case SDL_KEYDOWN: out << " " << e.key.keysym.sym << " " << (int)mod; break;
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP: out << " " << (int)e.button.button << " " << e.button.x << " " << e.button.y << " " << (int)mod; break;
+        case SDL_MOUSEMOTION: out << " " << e.motion.x << " " << e.motion.y << " " << (int)mod; break;
+        case SDL_MOUSEWHEEL: out << " " << e.wheel.y << " " << (int)mod; break;
+        default: break;
+    }
+    out << "\n";
+}
+
+static bool readEditorRecording(const std::string& filename, std::vector<EditorEvent>& events, Uint64& startHash, Uint64& endHash) {
+    std::ifstream in(filename);
+    std::string magic;
+    int version = 0;
+    if (!(in >> magic >> version >> startHash) || magic != "atelier-events" || version != 1) return false;
+    endHash = 0;
+    std::string line;
+    std::getline(in, line);
+    while (std::getline(in, line)) {
+        std::istringstream ls(line);
+        EditorEvent ev;
+        std::string kind;
+        int mod = 0;
+        if (!(ls >> ev.time >> kind)) continue;
+        if (kind == "key") {
+            ev.event.type = SDL_KEYDOWN;
+            ls >> ev.event.key.keysym.sym >> mod;
+        } else if (kind == "down" || kind == "up") {
+            int button = 0;
+            ev.event.type = kind == "down" ? SDL_MOUSEBUTTONDOWN : SDL_MOUSEBUTTONUP;
+            ls >> button >> ev.event.button.x >> ev.event.button.y >> mod;
+            ev.event.button.button = (Uint8)button;
+        } else if (kind == "motion") {
+            ev.event.type = SDL_MOUSEMOTION;
+            ls >> ev.event.motion.x >> ev.event.motion.y >> mod;
+        } else if (kind == "wheel") {
+            ev.event.type = SDL_MOUSEWHEEL;
+            ls >> ev.event.wheel.y >> mod;
+        } else if (kind == "quit") {
+            ev.event.type = SDL_QUIT;
+        } else if (kind == "commit") {
+            ev.commit = true;
+        } else if (kind == "end") {
+            ls >> endHash;
+            break;
+        } else {
+            return false;
+        }
+        if (ls.fail()) return false;
+        ev.mod = (SDL_Keymod)mod;
+        events.push_back(ev);
+    }
+    return true;
+}
+
+static Uint64 hashEditorLayer(Uint64 h, const std::vector<Path>& paths, const std::vector<SDL_Color>& colors, const std::vector<ShapeType>& types) {
+    for (const auto& p : paths) h = (h ^ hashBytes((const char*)p.data(), p.size() * sizeof(Point))) * 0x100000001b3ull;
+    h = (h ^ hashBytes((const char*)colors.data(), colors.size() * sizeof(SDL_Color))) * 0x100000001b3ull;
+    return (h ^ hashBytes((const char*)types.data(), types.size() * sizeof(ShapeType))) * 0x100000001b3ull;
+}
+
+static bool runEditor(AppShell& shell, const std::string& basePath, EditorDriver& io) {
+    bool headless = io.replay != nullptr;
+    if (!openAppShell(shell, headless)) return false;
+    std::string pathsFile   = basePath + "/paths.txt";
+    std::string currentFile = basePath + "/current.txt";
+    // The editor works on the resident scene's layers directly and hands them back on close
+    Scene& resident = residentScene(shell, basePath);
+    auto foliage = std::move(resident.foliage.paths);
+    auto trunks  = std::move(resident.trunks.paths);
+    std::vector<SDL_Color> foliageColors = std::move(resident.foliage.colors);
+    std::vector<SDL_Color> trunksColors  = std::move(resident.trunks.colors);
+    std::vector<ShapeType> foliageTypes = std::move(resident.foliage.types);
+    std::vector<ShapeType> trunksTypes  = std::move(resident.trunks.types);
+    // Symbol instances are shown for reference; they are edited with the symbol-* commands
+    const std::vector<Symbol>& symbols = resident.symbols;
+    const std::vector<SymbolInstance>& instances = resident.instances;
+    SymbolTextureCache& symbolCache = shell.symbolCache;
+    SDL_Color currentDrawColor{255,255,255,255};
+    bool showColorPanel = false;
+    ShapeType currentShape = ShapeType::Line;
+    // Placement state: collect exact number of clicks for chosen shape
+    int placementNeededPoints = 0;  // 0 when idle
+    int placementCollected = 0;
+    Path placementPoints;
+    io.startHash = hashEditorLayer(hashEditorLayer(0, foliage, foliageColors, foliageTypes), trunks, trunksColors, trunksTypes);
+    if (io.record) *io.record << "atelier-events 1 " << io.startHash << "\n";
+
+    enterShellMode(shell, "Atelier Editor", 800, 600, false);
+    SDL_Renderer* renderer = shell.renderer;
+
+    // Reference underlay: R shows/hides it, middle-drag pans it, Ctrl+wheel zooms it about
+    // the cursor, [ and ] change its opacity
+    Underlay underlay;
+    if (readReference(basePath + "/reference.txt", underlay)) startUnderlay(underlay, basePath);
+    bool panningUnderlay = false;
+    int lastMouseX = 400, lastMouseY = 300;
+
+    // Interaction state
+    bool running = true;
+    bool awaitingSecondPoint = false; // legacy; no longer used for placement
+    Point firstPoint {0, 0};
+    bool dragging = false;
+    bool draggingIsFoliage = true;
+    size_t draggingPathIndex = 0;
+    int draggingPointIndex = 0; // 0 or last for two-point paths
+    const float selectRadius2 = 12.0f * 12.0f;
+    // Bulk selection: Alt+drag rubber-band, Alt+Shift+drag lasso; then drag to move,
+    // right-drag to rotate, wheel to scale, Delete to remove, Esc to drop the selection
+    std::vector<Path>* layerPaths[2] = { &foliage, &trunks };
+    EditorSelection selection;
+    bool banding = false, bandLasso = false;
+    std::vector<SDL_Point> bandPoints;
+    bool movingSelection = false, rotatingSelection = false;
+    int selDragX = 0, selDragY = 0;
+    bool wheelPending = false;
+    Uint32 lastWheelTicks = 0;
+    SDL_Texture* restLayer = nullptr; // everything not selected
+    SDL_Texture* selLayer = nullptr;  // selected shapes at their committed positions
+
+    // Snapping for placement and vertex drags: N toggles it, G toggles the 20px grid fallback
+    // The index lives in the shell and is built once per resident scene; edits update it.
+    SnapIndex& snapIndex = shell.snapIndex;
+    bool snapEnabled = true;
+    int snapGrid = 0;
+    SnapResult snapHover;
+    if (!shell.snapValid) {
+        snapIndex = SnapIndex{};
+        for (size_t i = 0; i < foliage.size(); ++i) snapEditShape(snapIndex, foliage[i], i < foliageTypes.size() ? foliageTypes[i] : ShapeType::Line, true);
+        for (size_t i = 0; i < trunks.size(); ++i) snapEditShape(snapIndex, trunks[i], i < trunksTypes.size() ? trunksTypes[i] : ShapeType::Line, true);
+        shell.snapValid = true;
+    }
+    auto snapShape = [&](bool isFoliage, size_t i, bool insert) {
+        const auto& types = isFoliage ? foliageTypes : trunksTypes;
+        snapEditShape(snapIndex, isFoliage ? foliage[i] : trunks[i], i < types.size() ? types[i] : ShapeType::Line, insert);
+    };
+    auto snapSelection = [&](bool insert) {
+        for (const auto& ref : selection.shapes) snapShape(ref.layer == 0, ref.shape, insert);
+    };
+    auto applySnap = [&](Point& pt) {
+        if (!snapEnabled) return;
+        SnapResult r = snapQuery(snapIndex, pt.x, pt.y, 12.0f, snapGrid);
+        if (r.kind != SnapKind::None) pt = { r.x, r.y }; // intersections land between pixels
+    };
+
+    // Constraints: C, P, L or T arms coincident, parallel, length or tangent, and plain clicks
+    // then pick its vertices, edges or circles; X arms removing a clicked shape's constraints
+    // and Esc disarms. Vertex drags and selection edits re-solve whatever they touch.
+    ConstraintSet constraints;
+    ConstraintLayers constraintLayers{ { &foliage, &trunks }, { &foliageTypes, &trunksTypes } };
+    if (readConstraints(basePath + "/constraints.txt", constraints)) dropUnfitConstraints(constraints, constraintLayers, std::cerr);
+    int constraintTool = -1; // a ConstraintKind, 4 to remove, -1 idle
+    std::vector<ConstraintRef> constraintPicks;
+    std::vector<std::pair<int, size_t>> dragComponent; // shapes the vertex drag may move, out of the snap index
+    auto solveAround = [&](const std::vector<Uint64>& seeds, const std::vector<Uint64>& pinned) {
+        std::vector<std::pair<int, size_t>> moved;
+        constraintComponentShapes(constraints, constraintLayers, seeds, moved);
+        for (const auto& s : moved) snapShape(s.first == 0, s.second, false);
+        solveConstraints(constraints, constraintLayers, seeds, pinned);
+        for (const auto& s : moved) snapShape(s.first == 0, s.second, true);
+        return !moved.empty();
+    };
+    // the selection's constrained vertices hold still and the rest of their components follow
+    auto solveSelection = [&]() {
+        if (constraints.list.empty() || selection.empty()) return false;
+        std::vector<char> marks[2] = { std::vector<char>(foliage.size(), 0), std::vector<char>(trunks.size(), 0) };
+        for (const auto& ref : selection.shapes) marks[ref.layer][ref.shape] = 1;
+        std::vector<Uint64> keys;
+        constrainedVertices(constraints, constraintLayers, [&](int l, size_t i) { return marks[l][i] != 0; }, keys);
+        return !keys.empty() && solveAround(keys, keys);
+    };
+    auto endVertexDrag = [&]() {
+        if (!dragging) return;
+        if (!dragComponent.empty()) {
+            Uint64 key = constraintKey(ConstraintRef{ draggingIsFoliage ? 0 : 1, draggingPathIndex, draggingPointIndex });
+            solveConstraints(constraints, constraintLayers, { key }, { key }, kConstraintSettleSweeps);
+        }
+        snapShape(draggingIsFoliage, draggingPathIndex, true);
+        for (const auto& s : dragComponent) {
+            if (s.first != (draggingIsFoliage ? 0 : 1) || s.second != draggingPathIndex) snapShape(s.first == 0, s.second, true);
+        }
+        dragComponent.clear();
+        dragging = false;
+    };
+    // The last full redraw is kept so hover feedback is a copy plus a marker
+    SDL_Texture* frameCache = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, 800, 600);
+    auto presentFrame = [&]() {
+        if (frameCache) SDL_RenderCopy(renderer, frameCache, nullptr, nullptr);
+        if (snapHover.kind != SnapKind::None) drawSnapMarker(renderer, snapHover);
+        SDL_RenderPresent(renderer);
+    };
+
+    auto renderIntoLayer = [&](SDL_Texture*& tex, bool selected) {
+        if (!tex) {
+            tex = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, 800, 600);
+            if (!tex) return;
+            SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_BLEND);
+        }
+        std::vector<char> marks[2] = { std::vector<char>(foliage.size(), 0), std::vector<char>(trunks.size(), 0) };
+        for (const auto& ref : selection.shapes) marks[ref.layer][ref.shape] = 1;
+        SDL_SetRenderTarget(renderer, tex);
+        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+        SDL_RenderClear(renderer);
+        for (size_t i = 0; i < foliage.size(); ++i) {
+            if (marks[0][i] != (char)selected) continue;
+            renderShape(renderer, foliage[i], i < foliageColors.size() ? foliageColors[i] : SDL_Color{255,255,255,255},
+                        i < foliageTypes.size() ? foliageTypes[i] : ShapeType::Line);
+        }
+        for (size_t i = 0; i < trunks.size(); ++i) {
+            if (marks[1][i] != (char)selected) continue;
+            renderShape(renderer, trunks[i], i < trunksColors.size() ? trunksColors[i] : SDL_Color{255,255,255,255},
+                        i < trunksTypes.size() ? trunksTypes[i] : ShapeType::Line);
+        }
+        if (!selected) renderSymbolInstances(renderer, symbols, instances, symbolCache);
+        SDL_SetRenderTarget(renderer, nullptr);
+    };
+    auto commitSelection = [&]() {
+        snapSelection(false);
+        commitSelectionTransform(selection, layerPaths);
+        snapSelection(true);
+        wheelPending = false;
+        if (solveSelection()) renderIntoLayer(restLayer, false);
+        renderIntoLayer(selLayer, true);
+    };
+    auto dropSelection = [&]() {
+        if (wheelPending || movingSelection || rotatingSelection) {
+            snapSelection(false);
+            commitSelectionTransform(selection, layerPaths);
+            snapSelection(true);
+            solveSelection();
+        }
+        selection = EditorSelection{};
+        banding = movingSelection = rotatingSelection = wheelPending = false;
+        if (restLayer) { SDL_DestroyTexture(restLayer); restLayer = nullptr; }
+        if (selLayer) { SDL_DestroyTexture(selLayer); selLayer = nullptr; }
+    };
+
+    auto redraw = [&]() {
+        if (frameCache) SDL_SetRenderTarget(renderer, frameCache);
+        SDL_SetRenderDrawColor(renderer, 8, 12, 18, 255);
+        SDL_RenderClear(renderer);
+        drawUnderlay(renderer, underlay, 800, 600);
+        // header with close + pen
+        SDL_Rect closeRect, penRect; drawWindowHeaderWithControls(renderer, 800, closeRect, penRect);
+        // content
+        if ((banding || !selection.empty()) && restLayer) {
+            SDL_RenderCopy(renderer, restLayer, nullptr, nullptr);
+            if (selLayer && !selection.empty()) {
+                // the texture holds the committed geometry; the preview is a similarity transform of it
+                const Affine2D& m = selection.preview;
+                float scale = std::sqrt(m.a * m.a + m.c * m.c);
+                SDL_FRect dst{ m.tx, m.ty, 800.0f * scale, 600.0f * scale };
+                SDL_FPoint pivot{ 0.0f, 0.0f };
+                SDL_RenderCopyExF(renderer, selLayer, nullptr, &dst, std::atan2(m.c, m.a) * 180.0 / 3.14159265, &pivot, SDL_FLIP_NONE);
+                float cx[4] = { selection.minX - 4, selection.maxX + 4, selection.maxX + 4, selection.minX - 4 };
+                float cy[4] = { selection.minY - 4, selection.minY - 4, selection.maxY + 4, selection.maxY + 4 };
+                SDL_Point box[5];
+                for (int k = 0; k < 4; ++k) {
+                    box[k] = { (int)std::lround(m.a * cx[k] + m.b * cy[k] + m.tx), (int)std::lround(m.c * cx[k] + m.d * cy[k] + m.ty) };
+                }
+                box[4] = box[0];
+                SDL_SetRenderDrawColor(renderer, 90, 150, 255, 200);
+                SDL_RenderDrawLines(renderer, box, 5);
+            }
+        } else {
+            renderStaticSceneColored(renderer, foliage, foliageColors, foliageTypes, trunks, trunksColors, trunksTypes);
+            renderSymbolInstances(renderer, symbols, instances, symbolCache);
+        }
+        if (!constraints.list.empty()) drawConstraints(renderer, constraints, constraintLayers);
+        if (constraintTool >= 0) {
+            static const char* const hints[] = { "Coincident: click two vertices", "Parallel: click two edges", "Length: click an edge",
+                                                 "Tangent: click a circle, then a circle or an edge", "Remove constraints: click a shape" };
+            renderText(renderer, shellFont(shell, 14), hints[constraintTool], 16, 12, {236,242,252,255});
+            for (const ConstraintRef& r : constraintPicks) {
+                const Path& p = (*constraintLayers.paths[r.layer])[r.shape];
+                Point a = p[r.index], b = constraintTool == 0 ? a : p[(r.index + 1) % p.size()];
+                drawFilledCircle(renderer, toPixel((a.x + b.x) * 0.5f), toPixel((a.y + b.y) * 0.5f), 5, {255, 255, 255, 220});
+            }
+        }
+        if (banding && bandPoints.size() >= 2) {
+            SDL_SetRenderDrawColor(renderer, 90, 150, 255, 220);
+            if (bandLasso) {
+                SDL_RenderDrawLines(renderer, bandPoints.data(), (int)bandPoints.size());
+            } else {
+                SDL_Rect band{ std::min(bandPoints.front().x, bandPoints.back().x), std::min(bandPoints.front().y, bandPoints.back().y),
+                               std::abs(bandPoints.back().x - bandPoints.front().x), std::abs(bandPoints.back().y - bandPoints.front().y) };
+                SDL_RenderDrawRect(renderer, &band);
+            }
+        }
+        // color panel (if shown)
+        if (showColorPanel) {
+            SDL_Rect panel{800 - 220, 50, 200, 500};
+            drawDropShadow(renderer, panel, 12, 6, {0,0,0,60});
+            fillRoundedRect(renderer, panel, 12, {14, 22, 35, 230});
+            // small close button in panel header
+            SDL_Rect panelClose{ panel.x + panel.w - 24, panel.y + 8, 12, 12 };
+            drawFilledCircle(renderer, panelClose.x + 6, panelClose.y + 6, 6, {235,80,80,255});
+            // simple color wheel: rows of hues + alpha slider approximation
+            int cx = panel.x + panel.w/2; int cy = panel.y + 130; int rad = 80;
+            // wheel by sampling angle and radius bands
+            for (int rr = rad; rr >= rad-20; --rr) {
+                for (int a = 0; a < 360; ++a) {
+                    float t = a / 60.0f; int sector = (int)std::floor(t); float f = t - sector; float p = 0, q = 1 - f, s = f;
+                    float r=1,g=0,b=0;
+                    switch (sector % 6) {
+                        case 0: r=1; g=s; b=0; break;
+                        case 1: r=q; g=1; b=0; break;
+                        case 2: r=0; g=1; b=s; break;
+                        case 3: r=0; g=q; b=1; break;
+                        case 4: r=s; g=0; b=1; break;
+                        case 5: r=1; g=0; b=q; break;
+                    }
+                    int x = cx + (int)std::round(std::cos(a * 3.1415926f / 180.0f) * rr);
+                    int y = cy + (int)std::round(std::sin(a * 3.1415926f / 180.0f) * rr);
+                    SDL_SetRenderDrawColor(renderer, (Uint8)(r*255), (Uint8)(g*255), (Uint8)(b*255), 255);
+                    SDL_RenderDrawPoint(renderer, x, y);
+                }
+            }
+            // current color swatch
+            SDL_Rect sw{ panel.x + 20, panel.y + 260, panel.w - 40, 30 };
+            fillRoundedRect(renderer, sw, 6, currentDrawColor);
+            drawRectBorder(renderer, sw, 6, {255,255,255,100});
+            // shape selectors
+            TTF_Font* panelFont = shellFont(shell, 14);
+            auto drawShapeBtn = [&](const char* label, int y, bool active) {
+                SDL_Rect r{ panel.x + 20, y, panel.w - 40, 28 };
+                fillRoundedRect(renderer, r, 6, active ? SDL_Color{34, 62, 98, 240} : SDL_Color{24, 42, 68, 220});
+                renderText(renderer, panelFont, label, r.x + 10, r.y + 6, {236,242,252,255});
+                return r;
+            };
+            SDL_Rect btnLine = drawShapeBtn("Line", panel.y + 310, currentShape == ShapeType::Line);
+            SDL_Rect btnCircle = drawShapeBtn("Circle", panel.y + 344, currentShape == ShapeType::Circle);
+            SDL_Rect btnTriangle = drawShapeBtn("Triangle", panel.y + 378, currentShape == ShapeType::Triangle);
+            SDL_Rect btnQuad = drawShapeBtn("Quadrilateral", panel.y + 412, currentShape == ShapeType::Quadrilateral);
+
+            // store for hit testing via static variables captured by redraw scope
+            // we can't store state from redraw alone; handled in event section
+        }
+        // Indicate placement in progress: show last placed point
+        if (placementCollected > 0 && !placementPoints.empty()) {
+            Point lp = placementPoints.back();
+            drawFilledCircle(renderer, toPixel(lp.x), toPixel(lp.y), 4, {255, 255, 255, 200});
+        }
+        if (frameCache) SDL_SetRenderTarget(renderer, nullptr);
+        presentFrame();
+    };
+
+    redraw();
+
+    // Events come from SDL (and are recorded when asked) or from a replay. A replay times
+    // each event from its delivery to the next call, which covers every early continue.
+    Uint32 openTicks = SDL_GetTicks();
+    size_t replayPos = 0;
+    SDL_Keymod replayMod = KMOD_NONE;
+    const char* timedKind = nullptr;
+    Uint64 timedStart = 0;
+    auto modState = [&]() { return headless ? replayMod : SDL_GetModState(); };
+    auto endTiming = [&]() {
+        if (!timedKind) return;
+        double us = (double)(SDL_GetPerformanceCounter() - timedStart) * 1e6 / (double)SDL_GetPerformanceFrequency();
+        io.latency[timedKind].push_back(us);
+        timedKind = nullptr;
+    };
+    auto nextEvent = [&](SDL_Event& e) {
+        endTiming();
+        if (!headless) {
+            if (!SDL_PollEvent(&e)) return false;
+            if (io.record) writeEditorEvent(*io.record, SDL_GetTicks() - openTicks, e, SDL_GetModState());
+            return true;
+        }
+        while (replayPos < io.replay->size()) {
+            const EditorEvent& ev = (*io.replay)[replayPos++];
+            replayMod = ev.mod;
+            timedStart = SDL_GetPerformanceCounter();
+            if (ev.commit) {
+                timedKind = "commit";
+                if (wheelPending) { commitSelection(); redraw(); }
+                endTiming();
+                continue;
+            }
+            timedKind = editorEventKind(ev.event);
+            e = ev.event;
+            return true;
+        }
+        running = false;
+        return false;
+    };
+
+    while (running) {
+        SDL_Event e;
+        while (nextEvent(e)) {
+            if (e.type == SDL_QUIT) {
+                running = false;
+            } else if (e.type == SDL_KEYDOWN) {
+                bool shiftHeld = (modState() & KMOD_SHIFT) != 0;
+                if (e.key.keysym.sym == SDLK_ESCAPE) {
+                    // Cancel current interaction
+                    awaitingSecondPoint = false;
+                    endVertexDrag();
+                    constraintTool = -1;
+                    constraintPicks.clear();
+                    dropSelection();
+                    redraw();
+                } else if (e.key.keysym.sym == SDLK_DELETE && !selection.empty()) {
+                    std::vector<char> marks[2] = { std::vector<char>(foliage.size(), 0), std::vector<char>(trunks.size(), 0) };
+                    for (const auto& ref : selection.shapes) marks[ref.layer][ref.shape] = 1;
+                    auto eraseMarked = [](std::vector<Path>& paths, std::vector<SDL_Color>& colors, std::vector<ShapeType>& types, const std::vector<char>& mark) {
+                        size_t w = 0;
+                        for (size_t i = 0; i < paths.size(); ++i) {
+                            if (mark[i]) continue;
+                            if (w != i) {
+                                paths[w] = std::move(paths[i]);
+                                if (i < colors.size()) colors[w] = colors[i];
+                                if (i < types.size()) types[w] = types[i];
+                            }
+                            w++;
+                        }
+                        paths.resize(w);
+                        colors.resize(std::min(colors.size(), w));
+                        types.resize(std::min(types.size(), w));
+                    };
+                    snapSelection(false);
+                    eraseMarked(foliage, foliageColors, foliageTypes, marks[0]);
+                    eraseMarked(trunks, trunksColors, trunksTypes, marks[1]);
+                    eraseConstraintShapes(constraints, 0, marks[0]);
+                    eraseConstraintShapes(constraints, 1, marks[1]);
+                    selection = EditorSelection{};
+                    dropSelection();
+                    redraw();
+                } else if (shiftHeld && (e.key.keysym.sym == SDLK_d)) {
+                    if (!headless) exitCliAfterSDL = true;
+                } else if (e.key.keysym.sym == SDLK_n) {
+                    snapEnabled = !snapEnabled;
+                    snapHover = SnapResult{};
+                    presentFrame();
+                } else if (e.key.keysym.sym == SDLK_g) {
+                    snapGrid = snapGrid ? 0 : 20;
+                } else if (e.key.keysym.sym == SDLK_c || e.key.keysym.sym == SDLK_p || e.key.keysym.sym == SDLK_l
+                           || e.key.keysym.sym == SDLK_t || e.key.keysym.sym == SDLK_x) {
+                    SDL_Keycode k = e.key.keysym.sym;
+                    constraintTool = k == SDLK_c ? 0 : k == SDLK_p ? 1 : k == SDLK_l ? 2 : k == SDLK_t ? 3 : 4;
+                    constraintPicks.clear();
+                    redraw();
+                } else if (e.key.keysym.sym == SDLK_r && underlay.image) {
+                    underlay.visible = !underlay.visible;
+                    redraw();
+                } else if ((e.key.keysym.sym == SDLK_LEFTBRACKET || e.key.keysym.sym == SDLK_RIGHTBRACKET) && underlay.image) {
+                    underlay.opacity = std::max(0, std::min(255, underlay.opacity + (e.key.keysym.sym == SDLK_RIGHTBRACKET ? 32 : -32)));
+                    underlay.moved = true;
+                    redraw();
+                }
+            } else if (e.type == SDL_MOUSEBUTTONDOWN && e.button.button == SDL_BUTTON_LEFT) {
+                int mx = e.button.x;
+                int my = e.button.y;
+                // header controls hit test (top-right)
+                SDL_Rect closeRect, penRect; drawWindowHeaderWithControls(renderer, 800, closeRect, penRect);
+                if (mx >= closeRect.x && mx < closeRect.x + closeRect.w && my >= closeRect.y && my < closeRect.y + closeRect.h) {
+                    running = false;
+                    break;
+                }
+                if (mx >= penRect.x && mx < penRect.x + penRect.w && my >= penRect.y && my < penRect.y + penRect.h) {
+                    showColorPanel = !showColorPanel;
+                    redraw();
+                    continue;
+                }
+                if (showColorPanel) {
+                    SDL_Rect panel{800 - 220, 50, 200, 500};
+                    SDL_Rect panelClose{ panel.x + panel.w - 24, panel.y + 8, 12, 12 };
+                    int pcx = panelClose.x + 6, pcy = panelClose.y + 6;
+                    // close color panel
+                    int dx = mx - pcx, dy = my - pcy; if (dx*dx + dy*dy <= 6*6) { showColorPanel = false; redraw(); continue; }
+                    // pick color from wheel edge bands
+                    int cx = panel.x + panel.w/2; int cy = panel.y + 130; int rad = 80;
+                    int dxw = mx - cx, dyw = my - cy; float dist = std::sqrt((float)(dxw*dxw + dyw*dyw));
+                    if (dist <= rad && dist >= rad-20) {
+                        float ang = std::atan2((float)dyw, (float)dxw); if (ang < 0) ang += 2.0f * 3.1415926f;
+                        float deg = ang * 180.0f / 3.1415926f; float t = deg / 60.0f; int sector = (int)std::floor(t); float f = t - sector; float q = 1 - f, s = f;
+                        float rr=1, gg=0, bb=0;
+                        switch (sector % 6) {
+                            case 0: rr=1; gg=s; bb=0; break;
+                            case 1: rr=q; gg=1; bb=0; break;
+                            case 2: rr=0; gg=1; bb=s; break;
+                            case 3: rr=0; gg=q; bb=1; break;
+                            case 4: rr=s; gg=0; bb=1; break;
+                            case 5: rr=1; gg=0; bb=q; break;
+                        }
+                        currentDrawColor = SDL_Color{ (Uint8)(rr*255), (Uint8)(gg*255), (Uint8)(bb*255), 255 };
+                        redraw();
+                        continue;
+                    }
+                    // shape selection hit test
+                    auto inside = [&](SDL_Rect r){ return mx >= r.x && mx < r.x + r.w && my >= r.y && my < r.y + r.h; };
+                    SDL_Rect btnLine{ panel.x + 20, panel.y + 310, panel.w - 40, 28 };
+                    SDL_Rect btnCircle{ panel.x + 20, panel.y + 344, panel.w - 40, 28 };
+                    SDL_Rect btnTriangle{ panel.x + 20, panel.y + 378, panel.w - 40, 28 };
+                    SDL_Rect btnQuad{ panel.x + 20, panel.y + 412, panel.w - 40, 28 };
+                    if (inside(btnLine)) { currentShape = ShapeType::Line; placementPoints.clear(); placementCollected = 0; placementNeededPoints = 0; redraw(); continue; }
+                    if (inside(btnCircle)) { currentShape = ShapeType::Circle; placementPoints.clear(); placementCollected = 0; placementNeededPoints = 0; redraw(); continue; }
+                    if (inside(btnTriangle)) { currentShape = ShapeType::Triangle; placementPoints.clear(); placementCollected = 0; placementNeededPoints = 0; redraw(); continue; }
+                    if (inside(btnQuad)) { currentShape = ShapeType::Quadrilateral; placementPoints.clear(); placementCollected = 0; placementNeededPoints = 0; redraw(); continue; }
+                }
+                bool shiftHeld = (modState() & KMOD_SHIFT) != 0;
+                bool ctrlHeld  = (modState() & KMOD_CTRL)  != 0;
+                bool altHeld   = (modState() & KMOD_ALT)   != 0;
+
+                if (constraintTool >= 0 && !shiftHeld && !ctrlHeld && !altHeld) {
+                    if (!selection.empty()) dropSelection();
+                    const ConstraintLayers& L = constraintLayers;
+                    float best2 = 14.0f * 14.0f, fx = (float)mx, fy = (float)my;
+                    ConstraintRef hit;
+                    bool found = false;
+                    switch (constraintTool) {
+                        case 0: found = pickConstraintVertex(L, fx, fy, best2, hit); break;
+                        case 1: case 2: found = pickConstraintEdge(L, fx, fy, best2, hit); break;
+                        case 3:
+                            found = pickConstraintCircle(L, fx, fy, best2, hit);
+                            if (!constraintPicks.empty()) found = pickConstraintEdge(L, fx, fy, best2, hit) || found;
+                            break;
+                        default:
+                            found = pickConstraintCircle(L, fx, fy, best2, hit);
+                            found = pickConstraintEdge(L, fx, fy, best2, hit) || found;
+                            break;
+                    }
+                    if (found && constraintTool == 4) {
+                        removeShapeConstraints(constraints, hit.layer, hit.shape);
+                    } else if (found) {
+                        constraintPicks.push_back(hit);
+                        if (constraintPicks.size() == (constraintTool == 2 ? 1u : 2u)) {
+                            Constraint c;
+                            c.kind = (ConstraintKind)constraintTool;
+                            c.a = constraintPicks[0];
+                            if (constraintPicks.size() > 1) c.b = constraintPicks[1];
+                            std::vector<Uint64> keys, held;
+                            if (addConstraint(constraints, constraintLayers, c, keys, held)) solveAround(keys, held);
+                            constraintPicks.clear();
+                        }
+                    }
+                    redraw();
+                    continue;
+                }
+                if (altHeld) {
+                    dropSelection();
+                    banding = true;
+                    bandLasso = shiftHeld;
+                    bandPoints.assign(1, SDL_Point{mx, my});
+                    renderIntoLayer(restLayer, false);
+                    redraw();
+                    continue;
+                }
+                if (!selection.empty()) {
+                    if (wheelPending) commitSelection();
+                    bool insideSel = mx >= selection.minX - 6 && mx <= selection.maxX + 6 && my >= selection.minY - 6 && my <= selection.maxY + 6;
+                    if (!shiftHeld && !ctrlHeld && insideSel) {
+                        movingSelection = true;
+                        selDragX = mx; selDragY = my;
+                        continue;
+                    }
+                    // any other click ends the selection; a plain one does nothing else
+                    dropSelection();
+                    redraw();
+                    if (!shiftHeld && !ctrlHeld) continue;
+                }
+
+                // Ctrl+Shift+Click: delete nearest shape (line/circle/polygon)
+                if (ctrlHeld && shiftHeld) {
+                    const float tolerance2 = 14.0f * 14.0f; // clickable radius
+                    float bestMetric = 1e12f;
+                    bool bestIsFoliage = true;
+                    size_t bestIndex = (size_t)-1;
+                    auto scoreLine = [&](const Path& p){ return distancePointToSegmentSquared(mx, my, p[0].x, p[0].y, p[1].x, p[1].y); };
+                    auto scoreCircle = [&](const Path& p){
+                        float cx = (p[0].x + p[1].x) * 0.5f; float cy = (p[0].y + p[1].y) * 0.5f;
+                        float R = std::sqrt((p[0].x-p[1].x)*(p[0].x-p[1].x) + (p[0].y-p[1].y)*(p[0].y-p[1].y)) / 2.0f;
+                        float d = std::sqrt((mx-cx)*(mx-cx) + (my-cy)*(my-cy));
+                        float diff = std::fabs(d - R);
+                        return diff*diff;
+                    };
+                    auto scorePoly = [&](const Path& p){
+                        float best = 1e12f;
+                        for (size_t i = 1; i < p.size(); ++i) {
+                            best = std::min(best, distancePointToSegmentSquared(mx, my, p[i-1].x, p[i-1].y, p[i].x, p[i].y));
+                        }
+                        best = std::min(best, distancePointToSegmentSquared(mx, my, p.back().x, p.back().y, p.front().x, p.front().y));
+                        return best;
+                    };
+                    auto consider = [&](const std::vector<Path>& vec, const std::vector<ShapeType>& types, bool isFoliage){
+                        for (size_t i = 0; i < vec.size(); ++i) {
+                            float s = 1e12f;
+                            ShapeType t = (i < types.size() ? types[i] : ShapeType::Line);
+                            const Path& p = vec[i];
+                            if (t == ShapeType::Line && p.size() >= 2) s = scoreLine(p);
+                            else if (t == ShapeType::Circle && p.size() >= 2) s = scoreCircle(p);
+                            else if (t == ShapeType::Triangle && p.size() >= 3) s = scorePoly(p);
+                            else if (t == ShapeType::Quadrilateral && p.size() >= 4) s = scorePoly(p);
+                            else if (p.size() >= 2) s = scoreLine(p);
+                            if (s < bestMetric) { bestMetric = s; bestIsFoliage = isFoliage; bestIndex = i; }
+                        }
+                    };
+                    consider(foliage, foliageTypes, true);
+                    consider(trunks, trunksTypes, false);
+                    if (bestIndex != (size_t)-1 && bestMetric <= tolerance2) {
+                        snapShape(bestIsFoliage, bestIndex, false);
+                        if (!constraints.list.empty()) {
+                            std::vector<char> erased((bestIsFoliage ? foliage : trunks).size(), 0);
+                            erased[bestIndex] = 1;
+                            eraseConstraintShapes(constraints, bestIsFoliage ? 0 : 1, erased);
+                        }
+                        if (bestIsFoliage) {
+                            foliage.erase(foliage.begin() + bestIndex);
+                            if (bestIndex < foliageColors.size()) foliageColors.erase(foliageColors.begin() + bestIndex);
+                            if (bestIndex < foliageTypes.size()) foliageTypes.erase(foliageTypes.begin() + bestIndex);
+                        } else {
+                            trunks.erase(trunks.begin() + bestIndex);
+                            if (bestIndex < trunksColors.size()) trunksColors.erase(trunksColors.begin() + bestIndex);
+                            if (bestIndex < trunksTypes.size()) trunksTypes.erase(trunksTypes.begin() + bestIndex);
+                        }
+                        redraw();
+                        continue;
+                    }
+                    // Ctrl+Shift was pressed but nothing matched; do not create anything on this click
+                    continue;
+                }
+
+                if (shiftHeld) {
+                    // initialize placement state if idle
+                    if (placementNeededPoints == 0) {
+                        placementPoints.clear();
+                        placementCollected = 0;
+                        switch (currentShape) {
+                            case ShapeType::Line: placementNeededPoints = 2; break;
+                            case ShapeType::Circle: placementNeededPoints = 2; break;
+                            case ShapeType::Triangle: placementNeededPoints = 3; break;
+                            case ShapeType::Quadrilateral: placementNeededPoints = 4; break;
+                        }
+                    }
+                    Point placed{ (float)mx, (float)my };
+                    applySnap(placed);
+                    placementPoints.push_back(placed);
+                    placementCollected++;
+                    if (placementCollected >= placementNeededPoints) {
+                        // finalize shape
+                        Path p = placementPoints;
+                        trunks.push_back(p);
+                        trunksColors.push_back(currentDrawColor);
+                        trunksTypes.push_back(currentShape);
+                        snapShape(false, trunks.size() - 1, true);
+                        // reset placement
+                        placementPoints.clear();
+                        placementCollected = 0;
+                        placementNeededPoints = 0;
+                    }
+                    redraw();
+                } else if (ctrlHeld) {
+                    // Pick the nearest vertex of a two-point path, triangle or quadrilateral. A
+                    // drag whose mouse-up never arrived is ended first, so its shapes go back
+                    // into the snap index.
+                    endVertexDrag();
+                    float bestDist2 = 1e9f;
+                    bool found = false;
+                    auto pickVertex = [&](const std::vector<Path>& paths, const std::vector<ShapeType>& types, bool isFoliage) {
+                        for (size_t i = 0; i < paths.size(); ++i) {
+                            const auto& path = paths[i];
+                            ShapeType t = i < types.size() ? types[i] : ShapeType::Line;
+                            bool polygon = (t == ShapeType::Triangle && path.size() == 3) || (t == ShapeType::Quadrilateral && path.size() == 4);
+                            if (path.size() != 2 && !polygon) continue;
+                            for (size_t k = 0; k < path.size(); ++k) {
+                                float d = distanceSquared(mx, my, path[k].x, path[k].y);
+                                if (d < bestDist2 && d <= selectRadius2) {
+                                    bestDist2 = d; dragging = true; draggingIsFoliage = isFoliage; draggingPathIndex = i; draggingPointIndex = (int)k; found = true;
+                                }
+                            }
+                        }
+                    };
+                    pickVertex(foliage, foliageTypes, true);
+                    pickVertex(trunks, trunksTypes, false);
+                    if (!found) dragging = false;
+                    else {
+                        // the dragged shape must not snap to itself, nor to what its constraints move
+                        snapShape(draggingIsFoliage, draggingPathIndex, false);
+                        int layer = draggingIsFoliage ? 0 : 1;
+                        Uint64 key = constraintKey(ConstraintRef{ layer, draggingPathIndex, draggingPointIndex });
+                        constraintComponentShapes(constraints, constraintLayers, { key }, dragComponent);
+                        for (const auto& s : dragComponent) {
+                            if (s.first != layer || s.second != draggingPathIndex) snapShape(s.first == 0, s.second, false);
+                        }
+                    }
+                }
+            } else if (e.type == SDL_MOUSEBUTTONDOWN && e.button.button == SDL_BUTTON_MIDDLE && underlay.image && underlay.visible) {
+                panningUnderlay = true;
+                lastMouseX = e.button.x; lastMouseY = e.button.y;
+            } else if (e.type == SDL_MOUSEBUTTONUP && e.button.button == SDL_BUTTON_MIDDLE) {
+                panningUnderlay = false;
+            } else if (e.type == SDL_MOUSEWHEEL && (modState() & KMOD_CTRL) && underlay.image && underlay.visible) {
+                float k = std::pow(1.25f, (float)e.wheel.y);
+                underlay.x = lastMouseX + (underlay.x - lastMouseX) * k;
+                underlay.y = lastMouseY + (underlay.y - lastMouseY) * k;
+                underlay.scale *= k;
+                underlay.moved = true;
+                redraw();
+            } else if (e.type == SDL_MOUSEBUTTONDOWN && e.button.button == SDL_BUTTON_RIGHT && !selection.empty()) {
+                if (wheelPending) commitSelection();
+                rotatingSelection = true;
+                selDragX = e.button.x; selDragY = e.button.y;
+            } else if (e.type == SDL_MOUSEWHEEL && !selection.empty() && !movingSelection && !rotatingSelection) {
+                // scale about the previewed center; committed once the wheel goes quiet
+                const Affine2D& m = selection.preview;
+                float cx = (selection.minX + selection.maxX) / 2.0f, cy = (selection.minY + selection.maxY) / 2.0f;
+                float pcx = m.a * cx + m.b * cy + m.tx, pcy = m.c * cx + m.d * cy + m.ty;
+                selection.preview = affineCompose(affineAbout(pcx, pcy, 0.0f, std::pow(1.1f, (float)e.wheel.y), 0.0f, 0.0f), m);
+                wheelPending = true;
+                lastWheelTicks = SDL_GetTicks();
+                redraw();
+            } else if (e.type == SDL_MOUSEMOTION) {
+                int prevX = lastMouseX, prevY = lastMouseY;
+                lastMouseX = e.motion.x; lastMouseY = e.motion.y;
+                if (panningUnderlay) {
+                    underlay.x += (float)(e.motion.x - prevX);
+                    underlay.y += (float)(e.motion.y - prevY);
+                    underlay.moved = true;
+                    redraw();
+                } else if (banding) {
+                    if (!bandLasso) bandPoints.resize(1);
+                    bandPoints.push_back(SDL_Point{ e.motion.x, e.motion.y });
+                    redraw();
+                } else if (movingSelection) {
+                    selection.preview = affineAbout(0.0f, 0.0f, 0.0f, 1.0f, (float)(e.motion.x - selDragX), (float)(e.motion.y - selDragY));
+                    redraw();
+                } else if (rotatingSelection) {
+                    float cx = (selection.minX + selection.maxX) / 2.0f, cy = (selection.minY + selection.maxY) / 2.0f;
+                    float angle = std::atan2(e.motion.y - cy, e.motion.x - cx) - std::atan2(selDragY - cy, selDragX - cx);
+                    selection.preview = affineAbout(cx, cy, angle, 1.0f, 0.0f, 0.0f);
+                    redraw();
+                } else if (dragging) {
+                    Point to{ (float)e.motion.x, (float)e.motion.y };
+                    applySnap(to);
+                    (draggingIsFoliage ? foliage : trunks)[draggingPathIndex][draggingPointIndex] = to;
+                    if (!dragComponent.empty()) {
+                        Uint64 key = constraintKey(ConstraintRef{ draggingIsFoliage ? 0 : 1, draggingPathIndex, draggingPointIndex });
+                        solveConstraints(constraints, constraintLayers, { key }, { key });
+                    }
+                    redraw();
+                } else if (snapEnabled) {
+                    SnapResult r = snapQuery(snapIndex, (float)e.motion.x, (float)e.motion.y, 12.0f, snapGrid);
+                    if (r.kind != snapHover.kind || r.x != snapHover.x || r.y != snapHover.y) {
+                        snapHover = r;
+                        if (frameCache) presentFrame(); else redraw();
+                    }
+                }
+            } else if (e.type == SDL_MOUSEBUTTONUP && e.button.button == SDL_BUTTON_LEFT) {
+                endVertexDrag();
+                if (banding) {
+                    banding = false;
+                    std::vector<Uint8> mask(800 * 600, 0);
+                    if (bandLasso) {
+                        fillPolygonMask(mask, 800, 600, bandPoints);
+                    } else if (bandPoints.size() >= 2) {
+                        SDL_Point a = bandPoints.front(), b = bandPoints.back();
+                        fillPolygonMask(mask, 800, 600, { a, SDL_Point{b.x, a.y}, b, SDL_Point{a.x, b.y} });
+                    }
+                    selection = selectShapesInMask(mask, 800, 600, layerPaths);
+                    if (selection.empty()) dropSelection();
+                    else { renderIntoLayer(restLayer, false); renderIntoLayer(selLayer, true); }
+                    redraw();
+                } else if (movingSelection) {
+                    movingSelection = false;
+                    commitSelection();
+                    redraw();
+                }
+            } else if (e.type == SDL_MOUSEBUTTONUP && e.button.button == SDL_BUTTON_RIGHT && rotatingSelection) {
+                rotatingSelection = false;
+                commitSelection();
+                redraw();
+            }
+        }
+        endTiming();
+        if (headless) continue;
+        if (underlayNeedsFrame(underlay)) redraw();
+        if (wheelPending && SDL_GetTicks() - lastWheelTicks > 250) {
+            if (io.record) *io.record << SDL_GetTicks() - openTicks << " commit\n";
+            commitSelection();
+            redraw();
+        }
+        SDL_Delay(8);
+    }
+
+    dropSelection();
+    if (dragging) shell.snapValid = false; // the dragged shapes are out of the index
+    io.finalHash = hashEditorLayer(hashEditorLayer(0, foliage, foliageColors, foliageTypes), trunks, trunksColors, trunksTypes);
+    if (io.record) *io.record << SDL_GetTicks() - openTicks << " end " << io.finalHash << "\n";
+
+    // Save edits on close
+    bool saved = false;
+    if (io.save) {
+        saved = writePaths(pathsFile, foliage);
+        saved = writePaths(currentFile, trunks) && saved;
+        saved = writeColors(pathsFile + ".colors", foliageColors) && saved;
+        saved = writeColors(currentFile + ".colors", trunksColors) && saved;
+        saved = writeTypes(pathsFile + ".types", foliageTypes) && saved;
+        saved = writeTypes(currentFile + ".types", trunksTypes) && saved;
+    }
+    resident.foliage = SceneLayer{ std::move(foliage), std::move(foliageColors), std::move(foliageTypes) };
+    resident.trunks = SceneLayer{ std::move(trunks), std::move(trunksColors), std::move(trunksTypes) };
+    // what was just written is what is resident; anything else means re-reading next time
+    if (saved) shell.sceneStamp = sceneStamp(basePath);
+    else shell.sceneValid = false;
+
+    stopUnderlay(underlay);
+    if (underlay.moved && io.save) writeReference(basePath + "/reference.txt", underlay);
+    if (constraints.edited && io.save) writeConstraints(basePath + "/constraints.txt", constraints);
+    if (frameCache) SDL_DestroyTexture(frameCache);
+    return true;
+}
+
+static void editMode(AppShell& shell, const std::string& basePath, const std::string& recordFile) {
+    EditorDriver io;
+    std::ofstream record;
+    if (!recordFile.empty()) {
+        record.open(recordFile, std::ios::trunc);
+        if (!record.is_open()) { std::cerr << "Cannot write " << recordFile << "\n"; return; }
+        io.record = &record;
+    }
+    runEditor(shell, basePath, io);
+}
+
+// Percentile of an ascending sample list (nearest rank).
+static double latencyPercentile(const std::vector<double>& sorted, double q) {
+    if (sorted.empty()) return 0.0;
+    size_t i = (size_t)std::ceil(q * (double)sorted.size());
+    return sorted[std::min(sorted.size() - 1, i > 0 ? i - 1 : 0)];
+}
+
+// Replays a recording headless and reports per-event latency and the resulting scene hash.
+// The scene on disk is only rewritten when save is set.
+static bool replayEdit(const std::string& basePath, const std::string& recording, bool save, std::ostream& out) {
+    std::vector<EditorEvent> events;
+    Uint64 recordedStart = 0, recordedEnd = 0;
+    if (!readEditorRecording(recording, events, recordedStart, recordedEnd)) {
+        out << "Not an editor recording: " << recording << "\n";
+        return false;
+    }
+    AppShell shell;
+    EditorDriver io;
+    io.replay = &events;
+    io.save = save;
+    Uint32 startTicks = SDL_GetTicks();
+    bool ran = runEditor(shell, basePath, io);
+    Uint32 elapsed = SDL_GetTicks() - startTicks;
+    closeAppShell(shell);
+    if (!ran) return false;
+    if (io.startHash != recordedStart) out << "warning: the scene differs from the one the recording started from\n";
+
+    static const double edges[] = { 50, 100, 250, 500, 1000, 2000, 4000, 8000, 16000, 33000 };
+    const size_t nEdges = sizeof(edges) / sizeof(edges[0]);
+    out << "Replayed " << events.size() << " events in " << elapsed << " ms\n";
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-8s %7s %9s %9s %9s %9s %9s\n", "event", "count", "mean-us", "p50-us", "p95-us", "p99-us", "max-us");
+    out << line;
+    std::vector<size_t> histogram(nEdges + 1, 0);
+    for (auto& kv : io.latency) {
+        std::vector<double>& v = kv.second;
+        std::sort(v.begin(), v.end());
+        double sum = 0.0;
+        for (double us : v) {
+            sum += us;
+            histogram[std::upper_bound(edges, edges + nEdges, us) - edges]++;
+        }
+        std::snprintf(line, sizeof(line), "%-8s %7zu %9.0f %9.0f %9.0f %9.0f %9.0f\n", kv.first.c_str(), v.size(), sum / (double)v.size(),
+                      latencyPercentile(v, 0.50), latencyPercentile(v, 0.95), latencyPercentile(v, 0.99), v.back());
+        out << line;
+    }
+    out << "Histogram (us):";
+    for (size_t b = 0; b <= nEdges; ++b) {
+        if (histogram[b] == 0) continue;
+        out << "  " << (b < nEdges ? "<" + std::to_string((int)edges[b]) : ">=" + std::to_string((int)edges[nEdges - 1])) << ": " << histogram[b];
+    }
+    out << "\nScene hash: " << io.finalHash;
+    if (recordedEnd != 0) out << (recordedEnd == io.finalHash ? " (matches the recording)" : " (recording ended at a different scene)");
+    out << "\n";
+    return recordedEnd == 0 || recordedEnd == io.finalHash;
+}
+
+// Geometry analysis behind analyze/clean. Segments come from line paths and polygon edges;
+// circles only take part in the degenerate and duplicate checks.
+struct GeomShape {
+    SceneLayer* layer;
+    size_t index;
+    bool drop = false;
+    bool reshaped = false; // vertices renumbered; constraints on it cannot follow
+};
+
+// The sweep runs on 1/16 px fixed point so its predicates stay exact.
+struct SweepVertex {
+    int x, y;
+    size_t src; // index of the path point it came from
+};
+
+static constexpr float kSweepScale = 16.0f;
+static constexpr long kSweepLimit = 1 << 22; // |coordinate| bound (262144 px) keeping predicates in 128 bits
+
+struct SweepSegment {
+    SweepVertex a, b; // a precedes b in sweep order (x, then y)
+    int shape;        // index into the GeomShape list
+    int edge;         // edge index along the fixed-point path
+    int edges;        // edge count of the shape, for adjacency
+    bool closed;
+};
+
+// Consecutive repeated points removed; closed shapes also lose a repeated closing point.
+static Path compactPath(const Path& p, bool closed) {
+    Path out;
+    out.reserve(p.size());
+    for (const Point& pt : p) {
+        if (out.empty() || out.back().x != pt.x || out.back().y != pt.y) out.push_back(pt);
+    }
+    if (closed && out.size() > 1 && out.front().x == out.back().x && out.front().y == out.back().y) out.pop_back();
+    return out;
+}
+
+static size_t shapePointCount(ShapeType t) {
+    return t == ShapeType::Circle ? 2 : t == ShapeType::Triangle ? 3 : t == ShapeType::Quadrilateral ? 4 : 2;
+}
+
+// Shapes that draw nothing or a single dot: too few points, or all points coincide.
+static bool isDegenerateShape(const Path& p, ShapeType t) {
+    if (p.size() < shapePointCount(t)) return true;
+    size_t n = t == ShapeType::Line ? p.size() : shapePointCount(t);
+    for (size_t i = 1; i < n; ++i) {
+        if (p[i].x != p[0].x || p[i].y != p[0].y) return false;
+    }
+    return true;
+}
+
+static bool pathLess(const Path& a, const Path& b) {
+    return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end(),
+        [](const Point& l, const Point& r) { return l.x != r.x ? l.x < r.x : l.y < r.y; });
+}
+
+// Orientation-free form of a shape, so a reversed line, a circle given by its other
+// diameter end or a polygon starting at another corner hash alike.
+static Path canonicalShape(const Path& p, ShapeType t) {
+    size_t n = t == ShapeType::Line ? p.size() : std::min(p.size(), shapePointCount(t));
+    Path q;
+    q.reserve(n);
+    for (size_t i = 0; i < n; ++i) q.push_back({ p[i].x + 0.0f, p[i].y + 0.0f }); // + 0 folds -0 into 0
+    if (t == ShapeType::Line) {
+        q = compactPath(q, false);
+        Path r(q.rbegin(), q.rend());
+        return pathLess(r, q) ? r : q;
+    }
+    if (t == ShapeType::Circle) {
+        if (q.size() == 2 && pathLess(Path{ q[1] }, Path{ q[0] })) std::swap(q[0], q[1]);
+        return q;
+    }
+    Path best = q, cand(q.size());
+    for (int dir = 0; dir < 2; ++dir) {
+        for (size_t start = 0; start < q.size(); ++start) {
+            for (size_t i = 0; i < q.size(); ++i) {
+                size_t k = dir == 0 ? (start + i) % q.size() : (start + q.size() - i) % q.size();
+                cand[i] = q[k];
+            }
+            if (pathLess(cand, best)) best = cand;
+        }
+    }
+    return best;
+}
+
+static inline Uint64 pointBitsKey(Point p) {
+    Uint32 x, y;
+    float fx = p.x + 0.0f, fy = p.y + 0.0f;
+    std::memcpy(&x, &fx, 4);
+    std::memcpy(&y, &fy, 4);
+    return ((Uint64)x << 32) | y;
+}
+
+static Uint64 hashShape(const Path& canonical, ShapeType t) {
+    Uint64 h = 1469598103934665603ull ^ (Uint64)t;
+    for (const Point& pt : canonical) { h ^= pointBitsKey(pt); h *= 1099511628211ull; }
+    return h;
+}
+
+static SDL_Color geomColor(const GeomShape& s) {
+    return s.index < s.layer->colors.size() ? s.layer->colors[s.index] : SDL_Color{255,255,255,255};
+}
+
+static ShapeType geomType(const GeomShape& s) {
+    return s.index < s.layer->types.size() ? s.layer->types[s.index] : ShapeType::Line;
+}
+
+// True when some orientation of b (reversed line, swapped circle ends, polygon rotated or
+// mirrored) puts each of its points within tolerance of the matching point of a, per axis.
+static bool shapesWithin(const Path& a, const Path& b, ShapeType t, float tolerance) {
+    if (a.size() != b.size() || a.empty()) return false;
+    size_t n = a.size();
+    bool cyclic = t == ShapeType::Triangle || t == ShapeType::Quadrilateral;
+    for (int dir = 0; dir < 2; ++dir) {
+        for (size_t start = 0; start < (cyclic ? n : 1); ++start) {
+            bool ok = true;
+            for (size_t i = 0; i < n && ok; ++i) {
+                size_t k = dir == 0 ? (start + i) % n : cyclic ? (start + n - i) % n : n - 1 - i;
+                ok = std::fabs(a[i].x - b[k].x) <= tolerance && std::fabs(a[i].y - b[k].y) <= tolerance;
+            }
+            if (ok) return true;
+        }
+    }
+    return false;
+}
+
+// Marks every shape hidden by a later copy that is opaque or has the same color, so
+// dropping the earlier copy leaves the picture unchanged. Tolerance 0 matches identical
+// canonical geometry through its hash; above 0 every point may be off by up to tolerance,
+// and candidates come from the centroid's grid cell and its eight neighbours, since
+// centroids of such shapes lie at most one cell apart. Returns the number of shapes marked.
+static size_t markDuplicateShapes(std::vector<GeomShape>& shapes, float tolerance) {
+    struct Kept { size_t shape; Path canonical; };
+    std::unordered_map<Uint64, std::vector<Kept>> seen;
+    seen.reserve(shapes.size());
+    auto cellKey = [](long long cx, long long cy) { return ((Uint64)(Uint32)cx << 32) | (Uint32)cy; };
+    size_t marked = 0;
+    for (size_t i = shapes.size(); i-- > 0;) {
+        GeomShape& s = shapes[i];
+        if (s.drop) continue;
+        ShapeType t = geomType(s);
+        Path c = canonicalShape(s.layer->paths[s.index], t);
+        SDL_Color col = geomColor(s);
+        auto hides = [&](const Kept& k) {
+            const GeomShape& later = shapes[k.shape];
+            if (geomType(later) != t || k.canonical.size() != c.size()) return false;
+            if (tolerance > 0.0f ? !shapesWithin(c, k.canonical, t, tolerance)
+                                 : pathLess(k.canonical, c) || pathLess(c, k.canonical)) return false;
+            SDL_Color lc = geomColor(later);
+            return lc.a == 255 || (lc.r == col.r && lc.g == col.g && lc.b == col.b && lc.a == col.a);
+        };
+        bool hidden = false;
+        Uint64 key;
+        if (tolerance > 0.0f) {
+            double sx = 0.0, sy = 0.0;
+            for (const Point& pt : c) { sx += pt.x; sy += pt.y; }
+            long long cx = c.empty() ? 0 : (long long)std::floor(sx / c.size() / tolerance);
+            long long cy = c.empty() ? 0 : (long long)std::floor(sy / c.size() / tolerance);
+            key = cellKey(cx, cy);
+            for (long long dx = -1; dx <= 1 && !hidden; ++dx) {
+                for (long long dy = -1; dy <= 1 && !hidden; ++dy) {
+                    auto it = seen.find(cellKey(cx + dx, cy + dy));
+                    if (it == seen.end()) continue;
+                    for (const Kept& k : it->second) if (hides(k)) { hidden = true; break; }
+                }
+            }
+        } else {
+            key = hashShape(c, t);
+            auto it = seen.find(key);
+            if (it != seen.end()) for (const Kept& k : it->second) if (hides(k)) { hidden = true; break; }
+        }
+        if (hidden) { s.drop = true; ++marked; continue; }
+        seen[key].push_back({ i, std::move(c) });
+    }
+    return marked;
+}
+
+// Fixed-point copy of a path with points that coincide at that resolution merged.
+static std::vector<SweepVertex> sweepVertices(const Path& p, bool closed) {
+    std::vector<SweepVertex> v;
+    v.reserve(p.size());
+    for (size_t k = 0; k < p.size(); ++k) {
+        auto fixed = [](float c) { return (int)std::max(-kSweepLimit, std::min(kSweepLimit, std::lround(c * kSweepScale))); };
+        SweepVertex q{ fixed(p[k].x), fixed(p[k].y), k };
+        if (v.empty() || v.back().x != q.x || v.back().y != q.y) v.push_back(q);
+    }
+    if (closed && v.size() > 1 && v.front().x == v.back().x && v.front().y == v.back().y) v.pop_back();
+    return v;
+}
+
+static std::vector<SweepSegment> collectSweepSegments(const std::vector<GeomShape>& shapes, size_t& zeroLength) {
+    std::vector<SweepSegment> segs;
+    zeroLength = 0;
+    for (size_t i = 0; i < shapes.size(); ++i) {
+        const GeomShape& s = shapes[i];
+        if (s.drop) continue;
+        ShapeType t = geomType(s);
+        if (t == ShapeType::Circle) continue;
+        const Path& raw = s.layer->paths[s.index];
+        bool closed = t != ShapeType::Line;
+        Path p = raw;
+        if (closed && p.size() > shapePointCount(t)) p.resize(shapePointCount(t));
+        for (size_t k = 0; k + 1 < p.size(); ++k) zeroLength += p[k].x == p[k + 1].x && p[k].y == p[k + 1].y;
+        std::vector<SweepVertex> v = sweepVertices(p, closed);
+        if (v.size() < 2) continue;
+        int edges = (int)(closed && v.size() > 2 ? v.size() : v.size() - 1);
+        for (int e = 0; e < edges; ++e) {
+            SweepVertex a = v[e], b = v[(e + 1) % v.size()];
+            if (b.x < a.x || (b.x == a.x && b.y < a.y)) std::swap(a, b);
+            segs.push_back({ a, b, (int)i, e, edges, closed && v.size() > 2 });
+        }
+    }
+    return segs;
+}
+
+// Events are points (x / d, y / d) in fixed point: endpoints have d = 1 and crossings the
+// determinant of their two segments, so no predicate of the sweep ever rounds. Within
+// kSweepLimit the numerators stay below 2^71 and every product compared below 2^118.
+using SweepWide = __int128;
+
+struct SweepPoint { SweepWide x, y; long long d; };
+
+static inline int sweepSign(SweepWide v) { return (v > 0) - (v < 0); }
+
+// Sweep order: by x, then by y.
+static inline int sweepCompare(const SweepPoint& a, const SweepPoint& b) {
+    int c = sweepSign(a.x * b.d - b.x * a.d);
+    return c != 0 ? c : sweepSign(a.y * b.d - b.y * a.d);
+}
+
+static inline bool sweepAt(const SweepVertex& v, const SweepPoint& p) {
+    return (SweepWide)v.x * p.d == p.x && (SweepWide)v.y * p.d == p.y;
+}
+
+static bool sweepCrossPoint(const SweepSegment& s, const SweepSegment& t, SweepPoint& c) {
+    long long rx = s.b.x - s.a.x, ry = s.b.y - s.a.y;
+    long long qx = t.b.x - t.a.x, qy = t.b.y - t.a.y;
+    long long d = rx * qy - ry * qx;
+    if (d == 0) return false; // parallel; collinear overlaps surface at their endpoints
+    long long wx = t.a.x - s.a.x, wy = t.a.y - s.a.y;
+    long long tn = wx * qy - wy * qx;
+    long long un = wx * ry - wy * rx;
+    if (d < 0) { d = -d; tn = -tn; un = -un; }
+    if (tn < 0 || tn > d || un < 0 || un > d) return false;
+    c = { (SweepWide)s.a.x * d + (SweepWide)tn * rx, (SweepWide)s.a.y * d + (SweepWide)tn * ry, d };
+    return true;
+}
+
+struct SweepResult {
+    size_t points = 0;    // distinct points where shapes meet (shared path vertices excluded)
+    size_t crossings = 0; // of those, points lying inside at least one segment
+    std::vector<std::pair<int, SweepPoint>> splits; // segment, interior point
+};
+
+// Bentley–Ottmann sweep (left to right) over segments sorted by their left endpoint.
+// The status holds the segments cut by the sweep line ordered by height; only
+// neighbours in it are tested, giving O((n + k) log n) for k intersection points.
+struct SweepStatusOrder {
+    static constexpr int kProbe = -1; // stands for the event point itself
+    const std::vector<SweepSegment>* segs;
+    const SweepPoint* at;
+    // Height of s on the sweep line as num / (den * at->d), den > 0; a vertical segment
+    // counts at the event's height, clamped to its ends.
+    void height(int s, SweepWide& num, long long& den) const {
+        den = 1;
+        if (s == kProbe) { num = at->y; return; }
+        const SweepSegment& g = (*segs)[s];
+        if (g.a.x == g.b.x) {
+            num = std::min(std::max(at->y, (SweepWide)g.a.y * at->d), (SweepWide)g.b.y * at->d);
+            return;
+        }
+        den = g.b.x - g.a.x;
+        num = (SweepWide)g.a.y * den * at->d + (at->x - (SweepWide)g.a.x * at->d) * (g.b.y - g.a.y);
+    }
+    bool through(int s) const {
+        SweepWide num;
+        long long den;
+        height(s, num, den);
+        return num == at->y * den;
+    }
+    bool operator()(int l, int r) const {
+        SweepWide nl, nr;
+        long long dl, dr;
+        height(l, nl, dl);
+        height(r, nr, dr);
+        SweepWide c = nl * dr - nr * dl;
+        if (c != 0) return c < 0;
+        // through the same point: the probe first, then just right of it, steepest on top
+        if (l == kProbe || r == kProbe) return l == kProbe && r != kProbe;
+        const SweepSegment& u = (*segs)[l];
+        const SweepSegment& v = (*segs)[r];
+        long long slope = (long long)(u.b.y - u.a.y) * (v.b.x - v.a.x) - (long long)(v.b.y - v.a.y) * (u.b.x - u.a.x);
+        if (slope != 0) return slope < 0; // x spans are >= 0, so a vertical segment is steepest
+        return l < r;
+    }
+};
+
+// Shapes meet at the point unless the only contact is two neighbouring edges of one path
+// sharing their common vertex.
+static bool sweepShapesMeet(const std::vector<SweepSegment>& segs, const std::vector<int>& at, const SweepPoint& p) {
+    if (at.size() > 32) return true;
+    auto endsAt = [&](const SweepSegment& g) { return sweepAt(g.a, p) || sweepAt(g.b, p); };
+    for (size_t i = 0; i < at.size(); ++i) {
+        for (size_t j = i + 1; j < at.size(); ++j) {
+            const SweepSegment& u = segs[at[i]];
+            const SweepSegment& v = segs[at[j]];
+            if (u.shape != v.shape) return true;
+            int gap = std::abs(u.edge - v.edge);
+            bool adjacent = gap == 1 || (u.closed && gap == u.edges - 1);
+            if (!adjacent || !endsAt(u) || !endsAt(v)) return true;
+        }
+    }
+    return false;
+}
+
+static SweepResult sweepIntersections(const std::vector<SweepSegment>& segs, bool wantSplits) {
+    struct Event { SweepPoint p; int seg; }; // seg >= 0: left endpoint of seg
+    struct Later {
+        bool operator()(const Event& a, const Event& b) const { return sweepCompare(a.p, b.p) > 0; }
+    };
+    // endpoints are known up front and sorted once; only crossings go through the heap
+    std::vector<Event> endpoints;
+    endpoints.reserve(segs.size() * 2);
+    for (size_t i = 0; i < segs.size(); ++i) {
+        const SweepSegment& g = segs[i];
+        endpoints.push_back({ { g.a.x, g.a.y, 1 }, (int)i });
+        endpoints.push_back({ { g.b.x, g.b.y, 1 }, -1 });
+    }
+    std::sort(endpoints.begin(), endpoints.end(), [](const Event& a, const Event& b) { return Later{}(b, a); });
+    std::priority_queue<Event, std::vector<Event>, Later> crossings;
+    size_t nextEndpoint = 0;
+
+    SweepResult res;
+    SweepPoint p{ 0, 0, 1 };
+    SweepStatusOrder order{ &segs, &p };
+    std::set<int, SweepStatusOrder> status(order);
+    auto probe = [&]() { return status.lower_bound(SweepStatusOrder::kProbe); };
+    auto findEvent = [&](int lo, int hi) {
+        SweepPoint c;
+        if (sweepCrossPoint(segs[lo], segs[hi], c) && sweepCompare(c, p) > 0) crossings.push({ c, -1 });
+    };
+
+    std::vector<int> upper, passing, meeting;
+    while (nextEndpoint < endpoints.size() || !crossings.empty()) {
+        if (crossings.empty() || (nextEndpoint < endpoints.size() && !Later{}(endpoints[nextEndpoint], crossings.top()))) {
+            p = endpoints[nextEndpoint].p;
+        } else {
+            p = crossings.top().p;
+        }
+        upper.clear();
+        for (; nextEndpoint < endpoints.size() && sweepCompare(endpoints[nextEndpoint].p, p) == 0; ++nextEndpoint) {
+            if (endpoints[nextEndpoint].seg >= 0) upper.push_back(endpoints[nextEndpoint].seg);
+        }
+        while (!crossings.empty() && sweepCompare(crossings.top().p, p) == 0) crossings.pop();
+        // segments ending at p or passing through it sit together in the status
+        auto first = probe(), last = first;
+        passing.clear();
+        meeting = upper;
+        for (; last != status.end() && order.through(*last); ++last) {
+            meeting.push_back(*last);
+            if (!sweepAt(segs[*last].b, p)) passing.push_back(*last);
+        }
+        if (meeting.size() > 1 && sweepShapesMeet(segs, meeting, p)) {
+            ++res.points;
+            if (!passing.empty()) ++res.crossings;
+            if (wantSplits) for (int s : passing) res.splits.push_back({ s, p });
+        }
+        status.erase(first, last);
+        for (int s : upper) status.insert(s);
+        for (int s : passing) status.insert(s);
+
+        auto lo = probe();
+        if (upper.empty() && passing.empty()) {
+            if (lo != status.begin() && lo != status.end()) findEvent(*std::prev(lo), *lo);
+            continue;
+        }
+        auto hi = lo;
+        while (hi != status.end() && order.through(*hi)) ++hi;
+        if (lo != status.begin()) findEvent(*std::prev(lo), *lo);
+        if (hi != status.end()) findEvent(*std::prev(hi), *hi);
+    }
+    return res;
+}
+
+// Reference for the sweep: every pair of segments tested directly, O(n^2). Matches
+// sweepIntersections' counts when each segment is its own shape.
+static SweepResult bruteIntersections(const std::vector<SweepSegment>& segs) {
+    auto gcd = [](SweepWide a, SweepWide b) {
+        if (a < 0) a = -a;
+        if (b < 0) b = -b;
+        while (b != 0) { SweepWide r = a % b; a = b; b = r; }
+        return a;
+    };
+    std::map<std::array<SweepWide, 3>, bool> found; // reduced point -> inside some segment
+    auto add = [&](const SweepPoint& p, const SweepSegment& s, const SweepSegment& t) {
+        SweepWide g = gcd(gcd(p.x, p.y), p.d);
+        bool inside = (!sweepAt(s.a, p) && !sweepAt(s.b, p)) || (!sweepAt(t.a, p) && !sweepAt(t.b, p));
+        found[{ p.x / g, p.y / g, (SweepWide)p.d / g }] |= inside;
+    };
+    auto onSegment = [](const SweepVertex& v, const SweepSegment& s) { // v known to be collinear
+        return std::min(s.a.x, s.b.x) <= v.x && v.x <= std::max(s.a.x, s.b.x) && std::min(s.a.y, s.b.y) <= v.y && v.y <= std::max(s.a.y, s.b.y);
+    };
+    for (size_t i = 0; i < segs.size(); ++i) {
+        for (size_t j = i + 1; j < segs.size(); ++j) {
+            const SweepSegment& s = segs[i];
+            const SweepSegment& t = segs[j];
+            SweepPoint c;
+            if (sweepCrossPoint(s, t, c)) { add(c, s, t); continue; }
+            long long rx = s.b.x - s.a.x, ry = s.b.y - s.a.y;
+            if (rx * (t.b.y - t.a.y) - ry * (t.b.x - t.a.x) != 0) continue;           // crossing outside both
+            if (rx * (long long)(t.a.y - s.a.y) - ry * (long long)(t.a.x - s.a.x) != 0) continue; // parallel apart
+            for (const SweepVertex& v : { t.a, t.b }) if (onSegment(v, s)) add({ v.x, v.y, 1 }, s, t);
+            for (const SweepVertex& v : { s.a, s.b }) if (onSegment(v, t)) add({ v.x, v.y, 1 }, s, t);
+        }
+    }
+    SweepResult res;
+    res.points = found.size();
+    for (const auto& f : found) res.crossings += f.second;
+    return res;
+}
+
+// check-sweep: runs the sweep and the pairwise reference on random segments, half over the
+// 800 px canvas and half on a 16 x 16 grid (shared endpoints, collinear overlaps), plus
+// cases the sweep once got wrong. Returns false on any disagreement.
+static bool checkSweep(int trials, int count, unsigned seed, std::ostream& out) {
+    auto segment = [](int shape, SweepVertex a, SweepVertex b) {
+        if (b.x < a.x || (b.x == a.x && b.y < a.y)) std::swap(a, b);
+        return SweepSegment{ a, b, shape, 0, 1, false };
+    };
+    size_t failed = 0, points = 0;
+    auto compare = [&](const std::vector<SweepSegment>& segs, const std::string& what) {
+        SweepResult fast = sweepIntersections(segs, false), slow = bruteIntersections(segs);
+        points += slow.points;
+        if (fast.points == slow.points && fast.crossings == slow.crossings) return;
+        if (++failed <= 5) {
+            out << what << ": sweep " << fast.points << " points, " << fast.crossings << " crossings; pairs "
+                << slow.points << " points, " << slow.crossings << " crossings\n";
+        }
+    };
+    // a near-vertical segment whose height at the crossing was off by more than the old tolerance
+    compare({ segment(0, { 2815, 213, 0 }, { 7203, 4848, 0 }), segment(1, { 7511, 1250, 0 }, { 7513, 10237, 0 }),
+              segment(2, { 1384, 3014, 0 }, { 12425, 10739, 0 }) }, "near-vertical case");
+    std::mt19937 rng(seed);
+    for (int trial = 0; trial < trials; ++trial) {
+        std::uniform_int_distribution<int> coord(0, trial % 2 == 0 ? 12799 : 15);
+        std::vector<SweepSegment> segs;
+        while ((int)segs.size() < count) {
+            SweepVertex a{ coord(rng), coord(rng), 0 }, b{ coord(rng), coord(rng), 0 };
+            if (a.x != b.x || a.y != b.y) segs.push_back(segment((int)segs.size(), a, b));
+        }
+        compare(segs, "trial " + std::to_string(trial));
+    }
+    out << "Sweep checked on " << trials + 1 << " cases (" << points << " points): " << failed << " disagreed\n";
+    return failed == 0;
+}
+
+// Joins line paths of one color whose ends meet, where exactly two path ends share the point.
+static size_t mergeConnectedLines(std::vector<GeomShape>& shapes) {
+    std::unordered_map<Uint64, std::vector<std::pair<size_t, int>>> ends; // point -> (shape, 0 front / 1 back)
+    auto key = pointBitsKey;
+    auto usable = [&](const GeomShape& s) {
+        return !s.drop && geomType(s) == ShapeType::Line && s.layer->paths[s.index].size() >= 2;
+    };
+    for (size_t i = 0; i < shapes.size(); ++i) {
+        if (!usable(shapes[i])) continue;
+        const Path& p = shapes[i].layer->paths[shapes[i].index];
+        ends[key(p.front())].push_back({ i, 0 });
+        ends[key(p.back())].push_back({ i, 1 });
+    }
+    std::vector<char> used(shapes.size(), 0);
+    size_t merged = 0;
+    for (size_t i = 0; i < shapes.size(); ++i) {
+        if (used[i] || !usable(shapes[i])) continue;
+        used[i] = 1;
+        GeomShape& s = shapes[i];
+        SDL_Color c = geomColor(s);
+        Path chain = s.layer->paths[s.index];
+        auto partner = [&](Point at) -> std::pair<size_t, int> {
+            auto it = ends.find(key(at));
+            if (it == ends.end() || it->second.size() != 2) return { (size_t)-1, 0 };
+            for (auto& e : it->second) {
+                const GeomShape& o = shapes[e.first];
+                SDL_Color oc = geomColor(o);
+                if (!used[e.first] && o.layer == s.layer && oc.r == c.r && oc.g == c.g && oc.b == c.b && oc.a == c.a) return e;
+            }
+            return { (size_t)-1, 0 };
+        };
+        for (int side = 0; side < 2; ++side) {
+            if (side == 1) std::reverse(chain.begin(), chain.end());
+            for (auto e = partner(chain.back()); e.first != (size_t)-1; e = partner(chain.back())) {
+                used[e.first] = 1;
+                shapes[e.first].drop = true;
+                ++merged;
+                const Path& next = shapes[e.first].layer->paths[shapes[e.first].index];
+                if (e.second == 0) chain.insert(chain.end(), next.begin() + 1, next.end());
+                else chain.insert(chain.end(), next.rbegin() + 1, next.rend());
+            }
+        }
+        std::reverse(chain.begin(), chain.end()); // back to the first path's direction
+        if (chain.size() != s.layer->paths[s.index].size()) s.reshaped = true;
+        s.layer->paths[s.index] = std::move(chain);
+    }
+    return merged;
+}
+
+// Cuts line paths at interior intersection points; the pieces keep the color and replace
+// the path in place. Polygon edges are not cut, only counted.
+static size_t splitLinesAtCrossings(std::vector<GeomShape>& shapes, const std::vector<SweepSegment>& segs,
+                                    const SweepResult& sweep, std::vector<std::vector<Path>>& pieces) {
+    std::unordered_map<int, std::vector<std::pair<int, Point>>> cuts; // shape -> (edge, point)
+    for (const auto& sp : sweep.splits) {
+        const SweepSegment& g = segs[sp.first];
+        if (geomType(shapes[g.shape]) != ShapeType::Line) continue;
+        double x = (double)sp.second.x / (double)sp.second.d, y = (double)sp.second.y / (double)sp.second.d;
+        cuts[g.shape].push_back({ g.edge, Point{ (float)(x / kSweepScale), (float)(y / kSweepScale) } });
+    }
+    pieces.assign(shapes.size(), {});
+    size_t added = 0;
+    for (auto& entry : cuts) {
+        GeomShape& s = shapes[entry.first];
+        const Path& p = s.layer->paths[s.index];
+        std::vector<SweepVertex> v = sweepVertices(p, false);
+        auto& list = entry.second;
+        auto dist2 = [](Point a, Point b) { float dx = a.x - b.x, dy = a.y - b.y; return dx * dx + dy * dy; };
+        std::sort(list.begin(), list.end(), [&](const std::pair<int, Point>& l, const std::pair<int, Point>& r) {
+            if (l.first != r.first) return l.first < r.first;
+            return dist2(p[v[l.first].src], l.second) < dist2(p[v[r.first].src], r.second);
+        });
+        std::vector<Path>& out = pieces[entry.first];
+        Path cur{ p[0] };
+        auto append = [&](Point pt) { if (cur.back().x != pt.x || cur.back().y != pt.y) cur.push_back(pt); };
+        size_t k = 0;
+        for (size_t e = 0; e + 1 < v.size(); ++e) {
+            for (; k < list.size() && list[k].first == (int)e; ++k) {
+                append(list[k].second);
+                if (cur.size() >= 2) { out.push_back(std::move(cur)); cur = Path{ list[k].second }; }
+            }
+            for (size_t j = v[e].src + 1; j <= v[e + 1].src; ++j) append(p[j]);
+        }
+        for (size_t j = v.back().src + 1; j < p.size(); ++j) append(p[j]);
+        if (cur.size() >= 2) out.push_back(std::move(cur));
+        if (out.size() > 1) added += out.size() - 1;
+        else out.clear();
+    }
+    return added;
+}
+
+struct CleanOptions {
+    bool degenerate = false;
+    bool duplicates = false;
+    float nearPx = 0.0f; // > 0: also treat shapes whose points are all within this many px as duplicates
+    bool merge = false;
+    bool split = false;
+};
+
+static std::vector<GeomShape> listGeomShapes(Scene& scene) {
+    std::vector<GeomShape> shapes;
+    shapes.reserve(scene.foliage.paths.size() + scene.trunks.paths.size());
+    for (SceneLayer* layer : { &scene.foliage, &scene.trunks }) {
+        for (size_t i = 0; i < layer->paths.size(); ++i) shapes.push_back({ layer, i });
+    }
+    return shapes;
+}
+
+static bool analyzeScene(const std::string& basePath, float nearPx, std::ostream& out) {
+    Uint32 startTicks = SDL_GetTicks();
+    Scene scene = loadScene(basePath);
+    std::vector<GeomShape> shapes = listGeomShapes(scene);
+    if (shapes.empty()) { out << "No shapes in " << basePath << "\n"; return false; }
+    size_t degenerate[4] = { 0, 0, 0, 0 };
+    for (GeomShape& s : shapes) {
+        ShapeType t = geomType(s);
+        if (isDegenerateShape(s.layer->paths[s.index], t)) { ++degenerate[(int)t]; s.drop = true; }
+    }
+    size_t exact = markDuplicateShapes(shapes, 0.0f);
+    size_t nearDup = nearPx > 0.0f ? markDuplicateShapes(shapes, nearPx) : 0;
+    for (GeomShape& s : shapes) s.drop = false;
+    size_t zeroLength = 0;
+    std::vector<SweepSegment> segs = collectSweepSegments(shapes, zeroLength);
+    SweepResult sweep = sweepIntersections(segs, false);
+    out << "Shapes: " << shapes.size() << " (" << scene.foliage.paths.size() << " foliage, " << scene.trunks.paths.size() << " trunks)\n"
+        << "Segments: " << segs.size() << ", zero-length: " << zeroLength << "\n"
+        << "Degenerate: " << degenerate[0] << " lines, " << degenerate[1] << " circles, "
+        << degenerate[2] + degenerate[3] << " polygons\n"
+        << "Duplicates: " << exact << " exact";
+    if (nearPx > 0.0f) out << ", " << nearDup << " more within " << nearPx << " px";
+    out << "\nIntersections: " << sweep.points << " points, " << sweep.crossings << " crossing a segment interior\n"
+        << "Analyzed in " << (SDL_GetTicks() - startTicks) << " ms\n";
+    return true;
+}
+
+static bool cleanScene(const std::string& basePath, const CleanOptions& opt, std::ostream& out) {
+    Uint32 startTicks = SDL_GetTicks();
+    Scene scene = loadScene(basePath);
+    std::vector<GeomShape> shapes = listGeomShapes(scene);
+    size_t dropped = 0, compacted = 0, dupes = 0, merged = 0, added = 0;
+    if (opt.degenerate) {
+        for (GeomShape& s : shapes) {
+            Path& p = s.layer->paths[s.index];
+            ShapeType t = geomType(s);
+            if (isDegenerateShape(p, t)) { s.drop = true; ++dropped; continue; }
+            if (t == ShapeType::Line) {
+                size_t before = p.size();
+                p = compactPath(p, false);
+                compacted += before - p.size();
+                s.reshaped |= p.size() != before;
+            }
+        }
+    }
+    if (opt.duplicates) {
+        dupes = markDuplicateShapes(shapes, 0.0f);
+        if (opt.nearPx > 0.0f) dupes += markDuplicateShapes(shapes, opt.nearPx);
+    }
+    if (opt.merge) merged = mergeConnectedLines(shapes);
+    std::vector<std::vector<Path>> pieces;
+    if (opt.split) {
+        size_t zeroLength = 0;
+        std::vector<SweepSegment> segs = collectSweepSegments(shapes, zeroLength);
+        added = splitLinesAtCrossings(shapes, segs, sweepIntersections(segs, true), pieces);
+    }
+
+    // rebuild both layers in draw order
+    for (SceneLayer* layer : { &scene.foliage, &scene.trunks }) {
+        layer->colors.resize(layer->paths.size(), SDL_Color{255,255,255,255});
+        layer->types.resize(layer->paths.size(), ShapeType::Line);
+    }
+    SceneLayer rebuilt[2];
+    std::vector<size_t> newIndex[2]; // for constraints.txt; shapes list foliage then trunks
+    for (size_t i = 0; i < shapes.size(); ++i) {
+        const GeomShape& s = shapes[i];
+        int l = s.layer == &scene.trunks ? 1 : 0;
+        SceneLayer& dst = rebuilt[l];
+        bool cut = !s.drop && !pieces.empty() && !pieces[i].empty();
+        newIndex[l].push_back(s.drop || s.reshaped || cut ? kNoShape : dst.paths.size());
+        if (s.drop) continue;
+        size_t copies = cut ? pieces[i].size() : 1;
+        for (size_t k = 0; k < copies; ++k) {
+            dst.paths.push_back(cut ? std::move(pieces[i][k]) : std::move(s.layer->paths[s.index]));
+            dst.colors.push_back(s.layer->colors[s.index]);
+            dst.types.push_back(s.layer->types[s.index]);
+        }
+    }
+    scene.foliage = std::move(rebuilt[0]);
+    scene.trunks = std::move(rebuilt[1]);
+    if (!saveScene(basePath, scene)) { out << "Cannot write scene " << basePath << "\n"; return false; }
+    if (!remapSceneConstraints(basePath, newIndex, out)) return false;
+    out << "Removed " << dropped << " degenerate shapes, " << compacted << " repeated points, " << dupes << " duplicates; merged "
+        << merged << " lines; split added " << added << " pieces; " << (scene.foliage.paths.size() + scene.trunks.paths.size())
+        << " shapes left in " << (SDL_GetTicks() - startTicks) << " ms\n";
+    return true;
+}
+
+static std::vector<std::string> splitCommandLine(const std::string& line) {
+    std::vector<std::string> args;
+    std::string cur;
+    bool quoted = false, any = false;
+    for (char c : line) {
+        if (c == '"') { quoted = !quoted; any = true; continue; }
+        if (!quoted && std::isspace((unsigned char)c)) {
+            if (any) { args.push_back(cur); cur.clear(); any = false; }
+            continue;
+        }
+        cur += c; any = true;
+    }
+    if (any) args.push_back(cur);
+    return args;
+}
+
+// Moves every shape lying fully inside the rectangle into a new symbol whose origin is
+// the rectangle's center, and places one instance there so the drawing looks the same.
+// newIndex receives where each layer shape went (kNoShape: into the symbol), for constraints.
+static bool defineSymbol(Scene& scene, const std::string& name, SDL_Rect area, std::vector<size_t> newIndex[2], std::ostream& out) {
+    // symbols.txt and instances.txt store names as whitespace-separated tokens
+    if (name.empty() || std::any_of(name.begin(), name.end(), [](char c) { return std::isspace((unsigned char)c) || std::iscntrl((unsigned char)c); })) {
+        out << "Symbol names cannot be empty or contain spaces\n";
+        return false;
+    }
+    if (findSymbol(scene.symbols, name) >= 0) { out << "Symbol " << name << " already exists\n"; return false; }
+    Symbol sym;
+    sym.name = name;
+    int ox = area.x + area.w / 2, oy = area.y + area.h / 2;
+    for (int l = 0; l < 2; ++l) {
+        SceneLayer* layer = l == 0 ? &scene.foliage : &scene.trunks;
+        SceneLayer kept;
+        newIndex[l].clear();
+        for (size_t i = 0; i < layer->paths.size(); ++i) {
+            SDL_Color c = i < layer->colors.size() ? layer->colors[i] : SDL_Color{255,255,255,255};
+            ShapeType t = i < layer->types.size() ? layer->types[i] : ShapeType::Line;
+            SDL_Rect b = shapeBounds(layer->paths[i], t);
+            bool inside = b.x >= area.x && b.y >= area.y && b.x + b.w <= area.x + area.w && b.y + b.h <= area.y + area.h;
+            SceneLayer& dst = inside ? sym.shapes : kept;
+            newIndex[l].push_back(inside ? kNoShape : kept.paths.size());
+            Path p = std::move(layer->paths[i]);
+            if (inside) for (auto& pt : p) { pt.x -= ox; pt.y -= oy; }
+            dst.paths.push_back(std::move(p));
+            dst.colors.push_back(c);
+            dst.types.push_back(t);
+        }
+        *layer = std::move(kept);
+    }
+    if (sym.shapes.paths.empty()) { out << "No shapes inside the rectangle\n"; return false; }
+    updateSymbolBounds(sym);
+    out << "Symbol " << name << ": " << sym.shapes.paths.size() << " shapes\n";
+    scene.symbols.push_back(std::move(sym));
+    SymbolInstance inst;
+    inst.symbol = (int)scene.symbols.size() - 1;
+    inst.x = (float)ox; inst.y = (float)oy;
+    scene.instances.push_back(inst);
+    return true;
+}
+
+static bool parseHexColor(const std::string& hex, SDL_Color& out) {
+    if (hex.size() != 6 && hex.size() != 8) return false;
+    char* end = nullptr;
+    unsigned long v = std::strtoul(hex.c_str(), &end, 16);
+    if (*end) return false;
+    if (hex.size() == 6) v = (v << 8) | 0xFF;
+    out = SDL_Color{ (Uint8)(v >> 24), (Uint8)(v >> 16), (Uint8)(v >> 8), (Uint8)v };
+    return true;
+}
+
+// Rewrites both layer files compactly (step = 2 * tolerance), or back to text when step is 0.
+static bool compactScene(const std::string& basePath, float step, std::ostream& out) {
+    bool ok = true;
+    for (const char* name : { "/paths.txt", "/current.txt" }) {
+        std::string file = basePath + name;
+        std::error_code ec;
+        if (!std::filesystem::exists(file, ec)) continue;
+        auto before = std::filesystem::file_size(file, ec);
+        std::vector<Path> paths = readPaths(file);
+        bool written = step > 0.0f ? writeCompactPaths(file, paths, step) : false;
+        if (step <= 0.0f) {
+            std::filesystem::remove(file, ec); // writePaths keeps an existing file's format
+            written = writePaths(file, paths);
+        }
+        if (!written) { ok = false; continue; }
+        out << file << ": " << before << " -> " << std::filesystem::file_size(file, ec) << " bytes\n";
+    }
+    return ok;
+}
+
+// Studio packs: a whole Art/ subtree in one file.
+//   "ATPK" version | zlib blocks | zlib index | u64 index offset, u64 index size,
+//   u64 index raw size, "ATPK"
+// Index (varints): blocks {offset, compressed, raw}, chunks {block, offset, size},
+// files {path, size, chunk count, chunk ids}. Files are cut into chunks of at most
+// kPackChunk bytes and a chunk is stored once however many files contain it. The new
+// chunks of one directory (one image) share a block, so after the index is read an image
+// costs one seek and one inflate; only content it shares with earlier images adds more.
+static const char kPackMagic[4] = { 'A', 'T', 'P', 'K' };
+static constexpr size_t kPackChunk = 1 << 20;
+
+struct PackBlock { Uint64 offset, compressed, raw; };
+struct PackChunk { Uint32 block; Uint64 offset, size; };
+struct PackFile { std::string path; Uint64 size; std::vector<Uint32> chunks; };
+
+struct PackIndex {
+    std::vector<PackBlock> blocks;
+    std::vector<PackChunk> chunks;
+    std::vector<PackFile> files;
+};
+
+static void putU64(std::string& out, Uint64 v) {
+    for (int i = 0; i < 8; ++i) out += (char)(v >> (8 * i));
+}
+
+static Uint64 getU64(const unsigned char* p) {
+    Uint64 v = 0;
+    for (int i = 0; i < 8; ++i) v |= (Uint64)p[i] << (8 * i);
+    return v;
+}
+
+static bool zlibCompress(const std::string& raw, std::string& out) {
+    uLongf size = compressBound((uLong)raw.size());
+    out.resize(size);
+    if (compress2((Bytef*)&out[0], &size, (const Bytef*)raw.data(), (uLong)raw.size(), 6) != Z_OK) return false;
+    out.resize(size);
+    return true;
+}
+
+// Deflate cannot expand data by more than about 1032:1, so a larger raw size is corrupt
+// and is refused before anything is allocated for it.
+static constexpr Uint64 kMaxInflateRatio = 1032;
+
+static bool zlibInflate(const std::string& packed, Uint64 rawSize, std::string& out) {
+    if (rawSize > (Uint64)packed.size() * kMaxInflateRatio + 64) return false;
+    out.resize((size_t)rawSize);
+    uLongf size = (uLongf)rawSize;
+    if (uncompress((Bytef*)&out[0], &size, (const Bytef*)packed.data(), (uLong)packed.size()) != Z_OK) return false;
+    return size == rawSize;
+}
+
+static std::string encodePackIndex(const PackIndex& idx) {
+    std::string out;
+    putVarint(out, idx.blocks.size());
+    for (const auto& b : idx.blocks) { putVarint(out, b.offset); putVarint(out, b.compressed); putVarint(out, b.raw); }
+    putVarint(out, idx.chunks.size());
+    for (const auto& c : idx.chunks) { putVarint(out, c.block); putVarint(out, c.offset); putVarint(out, c.size); }
+    putVarint(out, idx.files.size());
+    for (const auto& f : idx.files) {
+        putVarint(out, f.path.size());
+        out += f.path;
+        putVarint(out, f.size);
+        putVarint(out, f.chunks.size());
+        for (Uint32 c : f.chunks) putVarint(out, c);
+    }
+    return out;
+}
+
+// Every block must lie within [5, dataEnd) of the archive, every chunk within its block's
+// raw bytes and every file's size must equal the sum of its chunks.
+static bool decodePackIndex(const std::string& data, Uint64 dataEnd, PackIndex& idx) {
+    VarintReader in{ (const unsigned char*)data.data(), (const unsigned char*)data.data() + data.size() };
+    auto count = [&]() { Uint64 n = in.next(); return in.ok && n <= in.left() ? (size_t)n : (in.ok = false, (size_t)0); };
+    idx.blocks.resize(count());
+    for (auto& b : idx.blocks) {
+        b.offset = in.next(); b.compressed = in.next(); b.raw = in.next();
+        if (b.offset < 5 || b.offset > dataEnd || b.compressed > dataEnd - b.offset ||
+            b.raw > b.compressed * kMaxInflateRatio + 64) in.ok = false;
+    }
+    idx.chunks.resize(count());
+    for (auto& c : idx.chunks) {
+        c.block = (Uint32)in.next(); c.offset = in.next(); c.size = in.next();
+        if (c.block >= idx.blocks.size() || c.size > idx.blocks[c.block].raw || c.offset > idx.blocks[c.block].raw - c.size) in.ok = false;
+    }
+    idx.files.resize(count());
+    for (auto& f : idx.files) {
+        size_t len = count();
+        if (!in.ok) return false;
+        f.path.assign((const char*)in.p, len);
+        in.p += len;
+        f.size = in.next();
+        f.chunks.resize(count());
+        Uint64 total = 0;
+        for (auto& c : f.chunks) {
+            c = (Uint32)in.next();
+            if (c >= idx.chunks.size()) { in.ok = false; break; }
+            total += idx.chunks[c].size;
+        }
+        if (total != f.size) in.ok = false;
+    }
+    return in.ok;
+}
+
+static Uint64 streamSize(std::ifstream& in) {
+    in.seekg(0, std::ios::end);
+    std::streamoff end = in.tellg();
+    return end < 0 ? 0 : (Uint64)end;
+}
+
+static bool readPackIndex(std::ifstream& in, PackIndex& idx) {
+    unsigned char foot[28];
+    Uint64 fileSize = streamSize(in);
+    if (fileSize < 5 + sizeof(foot)) return false;
+    in.seekg(-(std::streamoff)sizeof(foot), std::ios::end);
+    if (!in.read((char*)foot, sizeof(foot)) || std::memcmp(foot + 24, kPackMagic, 4) != 0) return false;
+    Uint64 at = getU64(foot), size = getU64(foot + 8), dataEnd = fileSize - sizeof(foot);
+    if (at < 5 || at > dataEnd || size > dataEnd - at) return false;
+    std::string packed((size_t)size, '\0'), raw;
+    in.seekg((std::streamoff)at, std::ios::beg);
+    if (!in.read(&packed[0], (std::streamsize)packed.size())) return false;
+    return zlibInflate(packed, getU64(foot + 16), raw) && decodePackIndex(raw, at, idx);
+}
+
+static bool readPackBlock(std::ifstream& in, const PackBlock& b, std::string& raw) {
+    Uint64 fileSize = streamSize(in);
+    if (b.offset > fileSize || b.compressed > fileSize - b.offset) return false;
+    std::string packed((size_t)b.compressed, '\0');
+    in.seekg((std::streamoff)b.offset, std::ios::beg);
+    if (!in.read(&packed[0], (std::streamsize)packed.size())) return false;
+    return zlibInflate(packed, b.raw, raw);
+}
+
+static bool readFileRange(const std::string& file, Uint64 offset, Uint64 size, std::string& out) {
+    std::ifstream in(file, std::ios::binary);
+    if (!in.is_open()) return false;
+    Uint64 fileSize = streamSize(in);
+    if (offset > fileSize || size > fileSize - offset) return false;
+    out.resize((size_t)size);
+    in.seekg((std::streamoff)offset, std::ios::beg);
+    return (bool)in.read(&out[0], (std::streamsize)size);
+}
+
+// Packs every regular file under root. Directories are deduplicated and compressed in
+// batches: chunk lookup runs in order (so the archive is deterministic), then the batch's
+// blocks are deflated in parallel and appended in order.
+static bool packStudio(const std::string& root, const std::string& archive, std::ostream& out) {
+    namespace fs = std::filesystem;
+    Uint32 startTicks = SDL_GetTicks();
+    std::error_code ec;
+    std::map<std::string, std::vector<std::string>> dirs; // relative directory -> files, sorted
+    for (fs::recursive_directory_iterator it(root, ec), end; !ec && it != end; it.increment(ec)) {
+        if (!it->is_regular_file(ec)) continue;
+        fs::path rel = fs::relative(it->path(), root, ec);
+        dirs[rel.parent_path().generic_string()].push_back(rel.generic_string());
+    }
+    if (ec) { out << "Cannot scan " << root << ": " << ec.message() << "\n"; return false; }
+    for (auto& d : dirs) std::sort(d.second.begin(), d.second.end());
+
+    std::ofstream file(archive, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) { out << "Cannot write " << archive << "\n"; return false; }
+    std::string header(kPackMagic, 4);
+    header += (char)1;
+    file.write(header.data(), (std::streamsize)header.size());
+    Uint64 offset = header.size();
+
+    PackIndex idx;
+    struct Source { std::string file; Uint64 offset; };
+    std::vector<Source> sources; // where each chunk came from, to verify hash matches
+    std::unordered_map<Uint64, std::vector<Uint32>> byHash;
+    struct Pending { std::string raw, packed; };
+    std::vector<Pending> batch;
+    Uint64 rawTotal = 0, dedupBytes = 0;
+    bool ok = true;
+
+    auto flush = [&]() {
+        std::atomic<bool> packedOk{ true };
+        parallelFor(batch.size(), [&](size_t i) { if (!zlibCompress(batch[i].raw, batch[i].packed)) packedOk = false; });
+        if (!packedOk) ok = false;
+        for (auto& b : batch) {
+            idx.blocks.push_back({ offset, b.packed.size(), b.raw.size() });
+            file.write(b.packed.data(), (std::streamsize)b.packed.size());
+            offset += b.packed.size();
+        }
+        batch.clear();
+    };
+
+    std::string data, other;
+    for (const auto& d : dirs) {
+        Pending blk;
+        Uint32 blockId = (Uint32)(idx.blocks.size() + batch.size());
+        for (const auto& rel : d.second) {
+            std::string path = root + "/" + rel;
+            if (!readWholeFile(path, data)) { out << "Cannot read " << path << "\n"; ok = false; continue; }
+            PackFile pf{ rel, data.size(), {} };
+            rawTotal += data.size();
+            for (size_t at = 0; at < data.size(); at += kPackChunk) {
+                size_t n = std::min(kPackChunk, data.size() - at);
+                auto& candidates = byHash[hashBytes(data.data() + at, n)];
+                Uint32 found = (Uint32)-1;
+                for (Uint32 c : candidates) {
+                    if (idx.chunks[c].size != n) continue;
+                    const PackChunk& ch = idx.chunks[c];
+                    bool same = ch.block == blockId
+                        ? std::memcmp(blk.raw.data() + ch.offset, data.data() + at, n) == 0
+                        : readFileRange(sources[c].file, sources[c].offset, n, other) && std::memcmp(other.data(), data.data() + at, n) == 0;
+                    if (same) { found = c; break; }
+                }
+                if (found == (Uint32)-1) {
+                    found = (Uint32)idx.chunks.size();
+                    idx.chunks.push_back({ blockId, blk.raw.size(), n });
+                    sources.push_back({ path, at });
+                    candidates.push_back(found);
+                    blk.raw.append(data, at, n);
+                } else {
+                    dedupBytes += n;
+                }
+                pf.chunks.push_back(found);
+            }
+            idx.files.push_back(std::move(pf));
+        }
+        if (blk.raw.empty()) continue; // everything here was already stored
+        Uint64 batchBytes = blk.raw.size();
+        for (const auto& b : batch) batchBytes += b.raw.size();
+        batch.push_back(std::move(blk));
+        if (batch.size() >= 64 || batchBytes >= (64u << 20)) flush();
+    }
+    flush();
+
+    std::string raw = encodePackIndex(idx), packed;
+    if (!zlibCompress(raw, packed)) ok = false;
+    std::string footer;
+    putU64(footer, offset);
+    putU64(footer, packed.size());
+    putU64(footer, raw.size());
+    footer.append(kPackMagic, 4);
+    file.write(packed.data(), (std::streamsize)packed.size());
+    file.write(footer.data(), (std::streamsize)footer.size());
+    file.close();
+    if (!file || !ok) { out << "Failed writing " << archive << "\n"; return false; }
+    out << "Packed " << idx.files.size() << " files in " << dirs.size() << " directories: " << rawTotal << " -> "
+        << (offset + packed.size() + footer.size()) << " bytes (" << dedupBytes << " deduplicated, "
+        << idx.chunks.size() << " unique chunks) in " << (SDL_GetTicks() - startTicks) << " ms\n";
+    return true;
+}
+
+// Extracts the files under prefix (a file, an image directory, or everything when empty).
+// Files are grouped by the block holding their first chunk and groups inflate in parallel.
+static bool unpackStudio(const std::string& archive, const std::string& outDir, const std::string& prefix, std::ostream& out) {
+    Uint32 startTicks = SDL_GetTicks();
+    PackIndex idx;
+    {
+        std::ifstream in(archive, std::ios::binary);
+        if (!in.is_open() || !readPackIndex(in, idx)) { out << "Not a studio pack: " << archive << "\n"; return false; }
+    }
+    // Refuse the whole archive if any entry would land outside outDir: absolute paths,
+    // ".." components, or anything whose normalized form climbs out.
+    namespace fs = std::filesystem;
+    fs::path root = fs::path(outDir).lexically_normal();
+    for (const auto& f : idx.files) {
+        fs::path rel(f.path);
+        bool safe = !f.path.empty() && !rel.has_root_name() && !rel.has_root_directory();
+        for (const fs::path& part : rel) if (part == "..") safe = false;
+        fs::path inside = (root / rel).lexically_normal().lexically_relative(root);
+        if (!safe || inside.empty() || inside == "." || *inside.begin() == "..") {
+            out << "Unsafe path in " << archive << ": " << f.path << "\n";
+            return false;
+        }
+    }
+    std::string want = prefix;
+    while (!want.empty() && want.back() == '/') want.pop_back();
+    std::map<Uint32, std::vector<const PackFile*>> byBlock;
+    size_t selected = 0;
+    for (const auto& f : idx.files) {
+        bool match = want.empty() || f.path == want || (f.path.size() > want.size() && f.path.compare(0, want.size(), want) == 0 && f.path[want.size()] == '/');
+        if (!match) continue;
+        byBlock[f.chunks.empty() ? (Uint32)-1 : idx.chunks[f.chunks[0]].block].push_back(&f);
+        ++selected;
+    }
+    if (selected == 0) { out << "Nothing in " << archive << " matches " << prefix << "\n"; return false; }
+
+    std::vector<std::pair<Uint32, std::vector<const PackFile*>>> groups(byBlock.begin(), byBlock.end());
+    std::atomic<bool> ok{ true };
+    std::atomic<Uint64> written{ 0 };
+    parallelFor(groups.size(), [&](size_t g) {
+        std::ifstream in(archive, std::ios::binary);
+        std::unordered_map<Uint32, std::string> blocks; // this group's block plus any it borrows from
+        std::string content;
+        for (const PackFile* f : groups[g].second) {
+            content.clear();
+            content.reserve((size_t)f->size);
+            for (Uint32 c : f->chunks) {
+                const PackChunk& ch = idx.chunks[c];
+                auto it = blocks.find(ch.block);
+                if (it == blocks.end()) {
+                    it = blocks.emplace(ch.block, std::string()).first;
+                    if (!readPackBlock(in, idx.blocks[ch.block], it->second)) { ok = false; return; }
+                }
+                content.append(it->second, (size_t)ch.offset, (size_t)ch.size);
+            }
+            std::filesystem::path dst = std::filesystem::path(outDir) / f->path;
+            std::error_code ec;
+            std::filesystem::create_directories(dst.parent_path(), ec);
+            std::ofstream o(dst, std::ios::binary | std::ios::trunc);
+            if (!o.write(content.data(), (std::streamsize)content.size())) { ok = false; return; }
+            written += content.size();
+        }
+    });
+    if (!ok) { out << "Failed extracting from " << archive << "\n"; return false; }
+    out << "Unpacked " << selected << " files (" << written.load() << " bytes) in " << (SDL_GetTicks() - startTicks) << " ms\n";
+    return true;
+}
+
+// Render daemon: `serve <socket> [scenes] [threads]` keeps parsed scenes in memory so that
+// thumbnails, stats and hit tests skip process startup and parsing. Clients connect to
+// the Unix socket and send one request per line; every reply is one line starting with
+// "ok" or "error", and a render reply is followed by the PNG bytes. Scene paths resolve
+// inside the directory serve was started in; the daemon never writes files.
+//
+//   render <scene> <w> <h>          ok <bytes> + PNG
+//   stats <scene>                   ok foliage=<n> trunks=<n> symbols=<n> instances=<n> points=<n> bounds=<x,y,w,h>
+//   hit <scene> <x> <y> [radius]    ok <foliage|trunks> <index> <type>  |  ok instance <index> <symbol>  |  ok none
+//   status                          ok scenes=<n> hits=<n> misses=<n>
+//   shutdown                        ok
+//
+// Scenes live in an LRU keyed by directory and the size and mtime of every scene file,
+// so an edit on disk is picked up by the next request. Each cached scene also keeps its
+// 800x600 raster and the PNGs encoded from it, one per requested size. Renders show the
+// static scene; animated shapes sit at their rest positions.
+static const int kServeWidth = 800, kServeHeight = 600;
+static const size_t kServePngSizes = 4; // encoded sizes kept per scene
+
+struct ServeScene {
+    std::string dir;
+    Uint64 stamp = 0;
+    std::once_flag loaded;
+    Scene scene;
+    size_t points = 0;
+    SDL_Rect bounds{0, 0, 0, 0};
+    std::mutex m; // guards raster and pngs
+    std::shared_ptr<const Canvas> raster;
+    std::deque<std::pair<std::pair<int, int>, std::shared_ptr<const std::string>>> pngs; // most recent first
+};
+
+struct ServeCache {
+    std::filesystem::path root; // canonical; scenes outside it are refused
+    size_t capacity = 8;
+    std::mutex m;
+    std::list<std::string> order; // most recent first
+    std::unordered_map<std::string, std::pair<std::list<std::string>::iterator, std::shared_ptr<ServeScene>>> entries;
+    Uint64 hits = 0, misses = 0;
+};
+
+// Returns the cached scene for dir, loading it on first use. Concurrent requests for the
+// same scene wait on one load; an evicted scene stays alive until its last request ends.
+static std::shared_ptr<ServeScene> serveLookup(ServeCache& cache, const std::string& path) {
+    std::error_code ec;
+    std::filesystem::path canon = std::filesystem::weakly_canonical(cache.root / path, ec);
+    std::filesystem::path inside = canon.lexically_relative(cache.root);
+    if (ec || inside.empty() || *inside.begin() == "..") return nullptr;
+    std::string dir = canon.string();
+    if (!std::filesystem::is_directory(dir, ec)) return nullptr;
+    Uint64 stamp = sceneStamp(dir);
+    std::shared_ptr<ServeScene> entry;
+    {
+        std::lock_guard<std::mutex> lk(cache.m);
+        auto it = cache.entries.find(dir);
+        if (it != cache.entries.end() && it->second.second->stamp == stamp) {
+            cache.order.splice(cache.order.begin(), cache.order, it->second.first);
+            cache.hits++;
+            entry = it->second.second;
+        } else {
+            if (it != cache.entries.end()) {
+                cache.order.erase(it->second.first);
+                cache.entries.erase(it);
+            }
+            cache.misses++;
+            entry = std::make_shared<ServeScene>();
+            entry->dir = dir;
+            entry->stamp = stamp;
+            cache.order.push_front(dir);
+            cache.entries[dir] = { cache.order.begin(), entry };
+            while (cache.order.size() > cache.capacity) {
+                cache.entries.erase(cache.order.back());
+                cache.order.pop_back();
+            }
+        }
+    }
+    std::call_once(entry->loaded, [&]() {
+        entry->scene = loadScene(entry->dir);
+        bool any = false;
+        for (const SceneLayer* l : { &entry->scene.foliage, &entry->scene.trunks }) {
+            for (size_t i = 0; i < l->paths.size(); ++i) {
+                entry->points += l->paths[i].size();
+                if (l->paths[i].empty()) continue;
+                SDL_Rect r = shapeBounds(l->paths[i], i < l->types.size() ? l->types[i] : ShapeType::Line);
+                entry->bounds = any ? unionRect(entry->bounds, r) : r;
+                any = true;
+            }
+        }
+    });
+    return entry;
+}
+
+// Minimal in-memory PNG writer (8-bit RGBA, Sub filter) so replies need no temporary file.
+static void putPngChunk(std::string& out, const char* type, const std::string& data) {
+    Uint32 n = (Uint32)data.size();
+    const unsigned char len[4] = { (unsigned char)(n >> 24), (unsigned char)(n >> 16), (unsigned char)(n >> 8), (unsigned char)n };
+    out.append((const char*)len, 4);
+    size_t at = out.size();
+    out.append(type, 4);
+    out += data;
+    uLong crc = crc32(0L, (const Bytef*)out.data() + at, (uInt)(out.size() - at));
+    const unsigned char c[4] = { (unsigned char)(crc >> 24), (unsigned char)(crc >> 16), (unsigned char)(crc >> 8), (unsigned char)crc };
+    out.append((const char*)c, 4);
+}
+
+static bool encodePng(const Canvas& cv, std::string& out) {
+    std::string raw;
+    raw.reserve((size_t)cv.h * (cv.w * 4 + 1));
+    for (int y = 0; y < cv.h; ++y) {
+        raw += '\1';
+        unsigned char prev[4] = { 0, 0, 0, 0 };
+        for (int x = 0; x < cv.w; ++x) {
+            Uint32 p = cv.px[(size_t)y * cv.w + x];
+            const unsigned char rgba[4] = { (unsigned char)(p >> 16), (unsigned char)(p >> 8), (unsigned char)p, (unsigned char)(p >> 24) };
+            for (int k = 0; k < 4; ++k) raw += (char)(unsigned char)(rgba[k] - prev[k]);
+            std::memcpy(prev, rgba, 4);
+        }
+    }
+    std::string packed;
+    if (!zlibCompress(raw, packed)) return false;
+    std::string ihdr(13, '\0');
+    for (int k = 0; k < 4; ++k) {
+        ihdr[k] = (char)((Uint32)cv.w >> (24 - 8 * k));
+        ihdr[4 + k] = (char)((Uint32)cv.h >> (24 - 8 * k));
+    }
+    ihdr[8] = 8;  // bit depth
+    ihdr[9] = 6;  // RGBA
+    out.assign("\x89PNG\r\n\x1a\n", 8);
+    putPngChunk(out, "IHDR", ihdr);
+    putPngChunk(out, "IDAT", packed);
+    putPngChunk(out, "IEND", std::string());
+    return true;
+}
+
+// Box-filters (or, when enlarging, repeats) the source into a w x h canvas.
+static Canvas resampleCanvas(const Canvas& src, int w, int h) {
+    Canvas dst = makeCanvas(w, h, SDL_Color{0, 0, 0, 0});
+    for (int y = 0; y < h; ++y) {
+        int sy0 = (int)((Sint64)y * src.h / h), sy1 = std::max(sy0 + 1, (int)((Sint64)(y + 1) * src.h / h));
+        for (int x = 0; x < w; ++x) {
+            int sx0 = (int)((Sint64)x * src.w / w), sx1 = std::max(sx0 + 1, (int)((Sint64)(x + 1) * src.w / w));
+            Uint32 sum[4] = { 0, 0, 0, 0 };
+            for (int sy = sy0; sy < sy1; ++sy) {
+                for (int sx = sx0; sx < sx1; ++sx) {
+                    Uint32 p = src.px[(size_t)sy * src.w + sx];
+                    for (int k = 0; k < 4; ++k) sum[k] += (p >> (8 * k)) & 0xFF;
+                }
+            }
+            Uint32 n = (Uint32)((sy1 - sy0) * (sx1 - sx0)), v = 0;
+            for (int k = 0; k < 4; ++k) v |= ((sum[k] + n / 2) / n) << (8 * k);
+            dst.px[(size_t)y * w + x] = v;
+        }
+    }
+    return dst;
+}
+
+static std::shared_ptr<const std::string> serveRender(ServeScene& s, int w, int h) {
+    std::shared_ptr<const Canvas> raster;
+    {
+        std::lock_guard<std::mutex> lk(s.m);
+        for (auto it = s.pngs.begin(); it != s.pngs.end(); ++it) {
+            if (it->first != std::make_pair(w, h)) continue;
+            auto png = it->second;
+            s.pngs.erase(it);
+            s.pngs.emplace_front(std::make_pair(w, h), png);
+            return png;
+        }
+        if (!s.raster) {
+            auto cv = std::make_shared<Canvas>(makeCanvas(kServeWidth, kServeHeight, SDL_Color{8, 12, 18, 255}));
+            canvasScene(*cv, s.scene);
+            s.raster = cv;
+        }
+        raster = s.raster;
+    }
+    auto png = std::make_shared<std::string>();
+    bool ok = (w == raster->w && h == raster->h) ? encodePng(*raster, *png) : encodePng(resampleCanvas(*raster, w, h), *png);
+    if (!ok) return nullptr;
+    std::lock_guard<std::mutex> lk(s.m);
+    s.pngs.emplace_front(std::make_pair(w, h), png);
+    if (s.pngs.size() > kServePngSizes) s.pngs.pop_back();
+    return png;
+}
+
+// Distance from (x, y) to a shape's stroke.
+static float shapeStrokeDistance(const Path& p, ShapeType t, float x, float y) {
+    if (p.empty()) return std::numeric_limits<float>::max();
+    if (t == ShapeType::Circle && p.size() >= 2) {
+        float cx = (p[0].x + p[1].x) * 0.5f, cy = (p[0].y + p[1].y) * 0.5f;
+        float r = std::sqrt(distanceSquared(p[0].x, p[0].y, p[1].x, p[1].y)) * 0.5f;
+        return std::fabs(std::sqrt(distanceSquared(x, y, cx, cy)) - r);
+    }
+    float best = distanceSquared(x, y, p[0].x, p[0].y);
+    for (size_t i = 1; i < p.size(); ++i) {
+        best = std::min(best, distancePointToSegmentSquared(x, y, p[i-1].x, p[i-1].y, p[i].x, p[i].y));
+    }
+    bool closed = (t == ShapeType::Triangle && p.size() >= 3) || (t == ShapeType::Quadrilateral && p.size() >= 4);
+    if (closed) best = std::min(best, distancePointToSegmentSquared(x, y, p.back().x, p.back().y, p[0].x, p[0].y));
+    return std::sqrt(best);
+}
+
+static const char* shapeTypeName(ShapeType t) {
+    switch (t) {
+        case ShapeType::Circle: return "circle";
+        case ShapeType::Triangle: return "triangle";
+        case ShapeType::Quadrilateral: return "quadrilateral";
+        default: return "line";
+    }
+}
+
+// Topmost shape within radius of (x, y), in drawing order: instances over trunks over foliage.
+static std::string serveHitTest(const Scene& scene, float x, float y, float radius) {
+    for (size_t i = scene.instances.size(); i-- > 0; ) {
+        const SymbolInstance& inst = scene.instances[i];
+        const Symbol& sym = scene.symbols[inst.symbol];
+        float rad = inst.rotation * 3.14159265f / 180.0f;
+        float cs = std::cos(rad), sn = std::sin(rad);
+        float dx = x - inst.x, dy = y - inst.y;
+        float lx = (dx * cs + dy * sn) / inst.scale, ly = (-dx * sn + dy * cs) / inst.scale;
+        for (size_t k = 0; k < sym.shapes.paths.size(); ++k) {
+            if (shapeStrokeDistance(sym.shapes.paths[k], sym.shapes.types[k], lx, ly) <= radius / inst.scale) {
+                return "ok instance " + std::to_string(i) + " " + sym.name;
+            }
+        }
+    }
+    const std::pair<const char*, const SceneLayer*> layers[2] = { { "trunks", &scene.trunks }, { "foliage", &scene.foliage } };
+    for (const auto& l : layers) {
+        for (size_t i = l.second->paths.size(); i-- > 0; ) {
+            ShapeType t = i < l.second->types.size() ? l.second->types[i] : ShapeType::Line;
+            if (shapeStrokeDistance(l.second->paths[i], t, x, y) <= radius) {
+                return std::string("ok ") + l.first + " " + std::to_string(i) + " " + shapeTypeName(t);
+            }
+        }
+    }
+    return "ok none";
+}
+
+#if !defined(_WIN32)
+static bool sendAll(int fd, const char* data, size_t n) {
+    while (n > 0) {
+        ssize_t k = ::send(fd, data, n, 0);
+        if (k < 0 && errno == EINTR) continue;
+        if (k <= 0) return false;
+        data += k; n -= (size_t)k;
+    }
+    return true;
+}
+
+struct ServeState {
+    ServeCache cache;
+    int listenFd = -1;
+    std::atomic<bool> stop{ false };
+    std::mutex m;
+    std::condition_variable wake;
+    std::deque<int> queue;  // accepted, not yet picked up
+    std::set<int> clients;  // connections being served
+    std::mutex logMutex;
+};
+
+// Handles one request line; returns false when the connection should close.
+static bool serveRequest(ServeState& st, int fd, const std::string& line, std::ostream& log) {
+    Uint32 startTicks = SDL_GetTicks();
+    std::vector<std::string> args = splitCommandLine(line);
+    if (args.empty()) return true;
+    std::string reply;
+    std::shared_ptr<const std::string> payload;
+    const std::string& cmd = args[0];
+    if (cmd == "status") {
+        std::lock_guard<std::mutex> lk(st.cache.m);
+        reply = "ok scenes=" + std::to_string(st.cache.entries.size()) + " hits=" + std::to_string(st.cache.hits)
+              + " misses=" + std::to_string(st.cache.misses);
+    } else if (cmd == "shutdown") {
+        reply = "ok";
+        st.stop = true;
+    } else if ((cmd == "render" && args.size() == 4) || (cmd == "stats" && args.size() == 2)
+               || (cmd == "hit" && (args.size() == 4 || args.size() == 5))) {
+        std::shared_ptr<ServeScene> s = serveLookup(st.cache, args[1]);
+        if (!s) {
+            reply = "error no scene " + args[1];
+        } else if (cmd == "render") {
+            int w = std::atoi(args[2].c_str()), h = std::atoi(args[3].c_str());
+            if (w < 1 || h < 1 || w > 8192 || h > 8192) {
+                reply = "error bad size";
+            } else if (!(payload = serveRender(*s, w, h))) {
+                reply = "error encode failed";
+            } else {
+                reply = "ok " + std::to_string(payload->size());
+            }
+        } else if (cmd == "stats") {
+            const SDL_Rect& b = s->bounds;
+            reply = "ok foliage=" + std::to_string(s->scene.foliage.paths.size()) + " trunks=" + std::to_string(s->scene.trunks.paths.size())
+                  + " symbols=" + std::to_string(s->scene.symbols.size()) + " instances=" + std::to_string(s->scene.instances.size())
+                  + " points=" + std::to_string(s->points) + " bounds=" + std::to_string(b.x) + "," + std::to_string(b.y)
+                  + "," + std::to_string(b.w) + "," + std::to_string(b.h);
+        } else {
+            float radius = args.size() > 4 ? (float)std::atof(args[4].c_str()) : 3.0f;
+            reply = serveHitTest(s->scene, (float)std::atof(args[2].c_str()), (float)std::atof(args[3].c_str()), std::max(0.0f, radius));
+        }
+    } else {
+        reply = "error bad request";
+    }
+    reply += '\n';
+    bool ok = sendAll(fd, reply.data(), reply.size()) && (!payload || sendAll(fd, payload->data(), payload->size()));
+    {
+        std::lock_guard<std::mutex> lk(st.logMutex);
+        log << cmd << (args.size() > 1 ? " " + args[1] : std::string()) << ": " << reply.substr(0, std::min<size_t>(reply.size() - 1, 60))
+            << " (" << (SDL_GetTicks() - startTicks) << " ms)\n" << std::flush;
+    }
+    return ok && !st.stop;
+}
+
+static void serveConnection(ServeState& st, int fd, std::ostream& log) {
+    std::string buf;
+    char chunk[4096];
+    bool open = true;
+    while (open) {
+        ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        buf.append(chunk, (size_t)n);
+        size_t start = 0;
+        for (size_t nl; open && (nl = buf.find('\n', start)) != std::string::npos; start = nl + 1) {
+            std::string line = buf.substr(start, nl - start);
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            open = serveRequest(st, fd, line, log);
+        }
+        buf.erase(0, start);
+        if (buf.size() > 65536) break; // no newline in sight; not a client of ours
+    }
+}
+
+static void stopServing(ServeState& st) {
+    std::lock_guard<std::mutex> lk(st.m);
+    ::shutdown(st.listenFd, SHUT_RDWR);
+    for (int fd : st.clients) ::shutdown(fd, SHUT_RDWR);
+    st.wake.notify_all();
+}
+#endif
+
+static bool serveStudio(const std::string& socketPath, size_t capacity, unsigned threads, std::ostream& out) {
+#if defined(_WIN32)
+    (void)socketPath; (void)capacity; (void)threads;
+    out << "serve: Unix domain sockets are not available on this platform\n";
+    return false;
+#else
+    sockaddr_un addr{};
+    if (socketPath.size() >= sizeof(addr.sun_path)) { out << "serve: socket path too long\n"; return false; }
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, socketPath.c_str(), socketPath.size() + 1);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    int probe = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe >= 0 && ::connect(probe, (sockaddr*)&addr, sizeof(addr)) == 0) {
+        ::close(probe);
+        out << "serve: " << socketPath << " is already being served\n";
+        return false;
+    }
+    if (probe >= 0) ::close(probe);
+    ::unlink(socketPath.c_str()); // stale socket from a daemon that did not exit cleanly
+
+    ServeState st;
+    std::error_code ec;
+    st.cache.root = std::filesystem::canonical(std::filesystem::current_path(ec), ec);
+    if (ec) { out << "serve: cannot resolve the working directory: " << ec.message() << "\n"; return false; }
+    st.cache.capacity = std::max<size_t>(1, capacity);
+    st.listenFd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (st.listenFd < 0 || ::bind(st.listenFd, (sockaddr*)&addr, sizeof(addr)) != 0 || ::listen(st.listenFd, 64) != 0) {
+        out << "serve: cannot listen on " << socketPath << ": " << std::strerror(errno) << "\n";
+        if (st.listenFd >= 0) ::close(st.listenFd);
+        return false;
+    }
+    out << "Serving " << st.cache.root.string() << " on " << socketPath << " (" << st.cache.capacity << " scenes, " << threads << " workers)\n" << std::flush;
+
+    std::vector<std::thread> pool;
+    for (unsigned i = 0; i < threads; ++i) {
+        pool.emplace_back([&]() {
+            for (;;) {
+                int fd;
+                {
+                    std::unique_lock<std::mutex> lk(st.m);
+                    st.wake.wait(lk, [&]{ return !st.queue.empty() || st.stop; });
+                    if (st.stop) return;
+                    fd = st.queue.front();
+                    st.queue.pop_front();
+                    st.clients.insert(fd);
+                }
+                serveConnection(st, fd, out);
+                {
+                    std::lock_guard<std::mutex> lk(st.m);
+                    st.clients.erase(fd);
+                }
+                ::close(fd);
+                if (st.stop) stopServing(st);
+            }
+        });
+    }
+    while (!st.stop) {
+        int fd = ::accept(st.listenFd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;
+        }
+        std::lock_guard<std::mutex> lk(st.m);
+        st.queue.push_back(fd);
+        st.wake.notify_one();
+    }
+    st.stop = true;
+    stopServing(st);
+    for (auto& t : pool) t.join();
+    for (int fd : st.queue) ::close(fd);
+    ::close(st.listenFd);
+    ::unlink(socketPath.c_str());
+    out << "Stopped serving " << socketPath << " (" << st.cache.hits << " cache hits, " << st.cache.misses << " misses)\n";
+    return true;
+#endif
+}
+
+// Auto-tracing: a bitmap becomes closed polylines, one per region outline. Pixels are
+// reduced to a few classes (an Otsu luminance threshold for two, median cut otherwise);
+// the most common class is the paper and is not traced. Outlines follow pixel edges
+// with 4-connectivity, so at a diagonal touch each pixel keeps its own outline. Tiles
+// are traced in parallel and a contour stops where its next edge belongs to another
+// tile; since every edge has exactly one successor, the pieces are joined afterwards by
+// edge id with no gaps or doubled points along the seams. Points sit on edge midpoints,
+// which turns pixel staircases into diagonals before Douglas-Peucker simplification.
+static constexpr int kTraceTile = 512;
+static constexpr int kTraceBand = 64;
+static constexpr int kTraceMaxColors = 16;
+static const int kTraceSideX[4] = { 0, -1, 0, 1 }; // top, left, bottom, right
+static const int kTraceSideY[4] = { -1, 0, 1, 0 };
+
+struct TraceOptions {
+    int colors = 2;
+    float tolerance = 1.0f;  // simplification, px
+    size_t minEdges = 12;    // shorter outlines are specks
+};
+
+struct TraceGrid {
+    int w = 0, h = 0, pitch = 0;
+    const Uint32* px = nullptr;
+    std::vector<Uint8> cls;
+    std::vector<Uint8> seen; // traced sides, one bit per side
+    int background = 0;
+    bool in(int x, int y, int c) const {
+        return x >= 0 && y >= 0 && x < w && y < h && cls[(size_t)y * w + x] == c;
+    }
+};
+
+// An outline piece within one tile; edge ids are pixel * 4 + side.
+struct TraceChain {
+    Uint64 first = 0, next = 0;
+    Path points;
+    Uint64 sum[3] = { 0, 0, 0 };
+};
+
+static inline Uint32 traceLuma(Uint32 c) {
+    return (((c >> 16) & 0xFF) * 77 + ((c >> 8) & 0xFF) * 150 + (c & 0xFF) * 29) >> 8;
+}
+
+static inline Uint32 traceBin(Uint32 c) { return ((c >> 9) & 0x7C00) | ((c >> 6) & 0x3E0) | ((c >> 3) & 0x1F); }
+
+template <typename Key>
+static std::vector<Uint64> traceHistogram(const TraceGrid& g, size_t bins, Key key) {
+    size_t bands = (size_t)(g.h + kTraceBand - 1) / kTraceBand;
+    std::vector<std::vector<Uint64>> part(bands);
+    parallelFor(bands, [&](size_t b) {
+        part[b].assign(bins, 0);
+        int y1 = std::min(g.h, (int)(b + 1) * kTraceBand);
+        for (int y = (int)b * kTraceBand; y < y1; ++y) {
+            const Uint32* row = g.px + (size_t)y * g.pitch;
+            for (int x = 0; x < g.w; ++x) ++part[b][key(row[x])];
+        }
+    });
+    std::vector<Uint64> hist(bins, 0);
+    for (const auto& p : part) for (size_t i = 0; i < bins; ++i) hist[i] += p[i];
+    return hist;
+}
+
+template <typename Key>
+static void classifyTrace(TraceGrid& g, const std::vector<Uint8>& lut, Key key) {
+    g.cls.resize((size_t)g.w * g.h);
+    parallelFor((size_t)g.h, [&](size_t y) {
+        const Uint32* row = g.px + y * g.pitch;
+        Uint8* out = &g.cls[y * g.w];
+        for (int x = 0; x < g.w; ++x) out[x] = lut[key(row[x])];
+    });
+}
+
+static void thresholdTrace(TraceGrid& g) {
+    std::vector<Uint64> hist = traceHistogram(g, 256, traceLuma);
+    double total = 0, sumAll = 0;
+    for (int i = 0; i < 256; ++i) { total += (double)hist[i]; sumAll += (double)i * hist[i]; }
+    double wB = 0, sumB = 0, best = -1;
+    int threshold = 127;
+    for (int t = 0; t < 256; ++t) {
+        wB += (double)hist[t]; sumB += (double)t * hist[t];
+        double wF = total - wB;
+        if (wB == 0 || wF == 0) continue;
+        double d = sumB / wB - (sumAll - sumB) / wF, between = wB * wF * d * d;
+        if (between > best) { best = between; threshold = t; }
+    }
+    std::vector<Uint8> lut(256);
+    for (int i = 0; i < 256; ++i) lut[i] = i > threshold ? 0 : 1;
+    classifyTrace(g, lut, traceLuma);
+}
+
+// Median cut over a 5-5-5 histogram: split the box with the most pixels times widest
+// channel at its weighted median until there are enough boxes, then map every bin to
+// the nearest box mean.
+static void quantizeTrace(TraceGrid& g, int colors) {
+    std::vector<Uint64> hist = traceHistogram(g, 32768, traceBin);
+    auto channel = [](Uint32 bin, int c) { return (int)(bin >> (10 - 5 * c)) & 31; };
+    std::vector<Uint32> entries;
+    for (Uint32 b = 0; b < 32768; ++b) if (hist[b]) entries.push_back(b);
+    struct Box { size_t begin, end; Uint64 count; int axis, range; };
+    auto measure = [&](size_t begin, size_t end) {
+        Box box{ begin, end, 0, 0, -1 };
+        for (int c = 0; c < 3; ++c) {
+            int lo = 31, hi = 0;
+            for (size_t i = begin; i < end; ++i) { lo = std::min(lo, channel(entries[i], c)); hi = std::max(hi, channel(entries[i], c)); }
+            if (hi - lo > box.range) { box.range = hi - lo; box.axis = c; }
+        }
+        for (size_t i = begin; i < end; ++i) box.count += hist[entries[i]];
+        return box;
+    };
+    std::vector<Box> boxes;
+    if (!entries.empty()) boxes.push_back(measure(0, entries.size()));
+    while ((int)boxes.size() < colors) {
+        size_t pick = boxes.size();
+        double bestScore = 0;
+        for (size_t i = 0; i < boxes.size(); ++i) {
+            double score = (double)boxes[i].count * boxes[i].range;
+            if (boxes[i].end - boxes[i].begin > 1 && score > bestScore) { bestScore = score; pick = i; }
+        }
+        if (pick == boxes.size()) break;
+        Box box = boxes[pick];
+        std::sort(entries.begin() + box.begin, entries.begin() + box.end,
+                  [&](Uint32 a, Uint32 b) { return channel(a, box.axis) < channel(b, box.axis); });
+        Uint64 half = box.count / 2, run = 0;
+        size_t mid = box.begin;
+        while (mid < box.end - 1 && (run += hist[entries[mid]]) < half) ++mid;
+        mid = std::max(mid + 1, box.begin + 1);
+        boxes[pick] = measure(box.begin, mid);
+        boxes.push_back(measure(mid, box.end));
+    }
+    std::vector<float> mean(boxes.size() * 3, 0.0f);
+    for (size_t k = 0; k < boxes.size(); ++k) {
+        for (size_t i = boxes[k].begin; i < boxes[k].end; ++i) {
+            for (int c = 0; c < 3; ++c) mean[k * 3 + c] += (float)hist[entries[i]] * channel(entries[i], c);
+        }
+        for (int c = 0; c < 3; ++c) mean[k * 3 + c] /= (float)std::max<Uint64>(1, boxes[k].count);
+    }
+    std::vector<Uint8> lut(32768, 0);
+    for (Uint32 b = 0; b < 32768; ++b) {
+        float bestD = 1e30f;
+        for (size_t k = 0; k < boxes.size(); ++k) {
+            float d = 0;
+            for (int c = 0; c < 3; ++c) { float v = channel(b, c) - mean[k * 3 + c]; d += v * v; }
+            if (d < bestD) { bestD = d; lut[b] = (Uint8)k; }
+        }
+    }
+    classifyTrace(g, lut, traceBin);
+}
+
+static int traceBackground(const TraceGrid& g) {
+    std::vector<Uint64> count(256, 0);
+    for (Uint8 c : g.cls) ++count[c];
+    return (int)(std::max_element(count.begin(), count.end()) - count.begin());
+}
+
+// Successor of side s of pixel (x, y) in an outline of class c: around the same pixel
+// if that side is open, else across to the diagonal pixel if it is in the class, else
+// straight on along the neighbour.
+static inline void traceNext(const TraceGrid& g, int c, int& x, int& y, int& s) {
+    int s1 = (s + 1) & 3;
+    int nx = x + kTraceSideX[s1], ny = y + kTraceSideY[s1];
+    if (!g.in(nx, ny, c)) { s = s1; return; }
+    int dx = nx + kTraceSideX[s], dy = ny + kTraceSideY[s];
+    if (g.in(dx, dy, c)) { x = dx; y = dy; s = (s + 3) & 3; return; }
+    x = nx; y = ny;
+}
+
+static void traceTile(TraceGrid& g, int x0, int y0, std::vector<TraceChain>& chains) {
+    int x1 = std::min(g.w, x0 + kTraceTile), y1 = std::min(g.h, y0 + kTraceTile);
+    auto edgeId = [&](int x, int y, int s) { return ((Uint64)y * g.w + x) * 4 + s; };
+    for (int y = y0; y < y1; ++y) {
+        for (int x = x0; x < x1; ++x) {
+            int c = g.cls[(size_t)y * g.w + x];
+            if (c == g.background) continue;
+            for (int s = 0; s < 4; ++s) {
+                if ((g.seen[(size_t)y * g.w + x] >> s) & 1) continue;
+                if (g.in(x + kTraceSideX[s], y + kTraceSideY[s], c)) continue;
+                TraceChain ch;
+                ch.first = edgeId(x, y, s);
+                int cx = x, cy = y, cs = s;
+                for (;;) {
+                    g.seen[(size_t)cy * g.w + cx] |= (Uint8)(1 << cs);
+                    ch.points.push_back(Point{ cx + 0.5f + 0.5f * kTraceSideX[cs], cy + 0.5f + 0.5f * kTraceSideY[cs] });
+                    Uint32 p = g.px[(size_t)cy * g.pitch + cx];
+                    ch.sum[0] += (p >> 16) & 0xFF; ch.sum[1] += (p >> 8) & 0xFF; ch.sum[2] += p & 0xFF;
+                    traceNext(g, c, cx, cy, cs);
+                    if (cx < x0 || cy < y0 || cx >= x1 || cy >= y1 || ((g.seen[(size_t)cy * g.w + cx] >> cs) & 1)) {
+                        ch.next = edgeId(cx, cy, cs);
+                        break;
+                    }
+                }
+                chains.push_back(std::move(ch));
+            }
+        }
+    }
+}
+
+// Douglas-Peucker on a closed outline, split at the point farthest from the first.
+static Path simplifyClosedPath(const Path& p, float tolerance) {
+    size_t n = p.size();
+    if (n < 4) return p;
+    size_t far = 0;
+    float farD = -1.0f;
+    for (size_t i = 1; i < n; ++i) {
+        float d = distanceSquared(p[0].x, p[0].y, p[i].x, p[i].y);
+        if (d > farD) { farD = d; far = i; }
+    }
+    std::vector<char> keep(n + 1, 0);
+    keep[0] = keep[far] = keep[n] = 1;
+    float tol2 = tolerance * tolerance;
+    std::vector<std::pair<size_t, size_t>> stack{ { 0, far }, { far, n } };
+    while (!stack.empty()) {
+        auto [a, b] = stack.back();
+        stack.pop_back();
+        const Point& pa = p[a % n];
+        const Point& pb = p[b % n];
+        size_t split = 0;
+        float worst = tol2;
+        for (size_t i = a + 1; i < b; ++i) {
+            float d = distancePointToSegmentSquared(p[i].x, p[i].y, pa.x, pa.y, pb.x, pb.y);
+            if (d > worst) { worst = d; split = i; }
+        }
+        if (!split) continue;
+        keep[split] = 1;
+        stack.push_back({ a, split });
+        stack.push_back({ split, b });
+    }
+    Path out;
+    for (size_t i = 0; i <= n; ++i) if (keep[i]) out.push_back(p[i % n]);
+    return out;
+}
+
+static bool autotraceImage(const std::string& image, const std::string& basePath, const TraceOptions& opt, std::ostream& out) {
+    Uint32 startTicks = SDL_GetTicks();
+    SDL_Surface* loaded = IMG_Load(image.c_str());
+    if (loaded && loaded->format->format != SDL_PIXELFORMAT_ARGB8888) {
+        SDL_Surface* converted = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_ARGB8888, 0);
+        SDL_FreeSurface(loaded);
+        loaded = converted;
+    }
+    if (!loaded) { out << "Cannot load " << image << ": " << IMG_GetError() << "\n"; return false; }
+
+    TraceGrid g;
+    g.w = loaded->w; g.h = loaded->h; g.pitch = loaded->pitch / 4;
+    g.px = (const Uint32*)loaded->pixels;
+    // Transparent areas count as paper: composite onto white.
+    parallelFor((size_t)g.h, [&](size_t y) {
+        Uint32* row = (Uint32*)loaded->pixels + y * g.pitch;
+        for (int x = 0; x < g.w; ++x) {
+            Uint32 p = row[x], a = p >> 24, v = 0xFF000000u;
+            if (a == 255) continue;
+            for (int k = 0; k < 24; k += 8) v |= ((((p >> k) & 0xFF) * a + 255 * (255 - a) + 127) / 255) << k;
+            row[x] = v;
+        }
+    });
+    if (opt.colors <= 2) thresholdTrace(g);
+    else quantizeTrace(g, opt.colors);
+    g.background = traceBackground(g);
+    g.seen.assign((size_t)g.w * g.h, 0);
+    Uint32 classifyTicks = SDL_GetTicks();
+
+    int tilesX = (g.w + kTraceTile - 1) / kTraceTile, tilesY = (g.h + kTraceTile - 1) / kTraceTile;
+    std::vector<std::vector<TraceChain>> tileChains((size_t)tilesX * tilesY);
+    parallelFor(tileChains.size(), [&](size_t t) {
+        traceTile(g, (int)(t % tilesX) * kTraceTile, (int)(t / tilesX) * kTraceTile, tileChains[t]);
+    });
+
+    std::vector<TraceChain> chains;
+    for (auto& tc : tileChains) for (auto& ch : tc) chains.push_back(std::move(ch));
+    tileChains.clear();
+    std::unordered_map<Uint64, size_t> byFirst;
+    byFirst.reserve(chains.size());
+    for (size_t i = 0; i < chains.size(); ++i) byFirst[chains[i].first] = i;
+    std::vector<TraceChain> loops;
+    std::vector<char> joined(chains.size(), 0);
+    for (size_t i = 0; i < chains.size(); ++i) {
+        if (joined[i]) continue;
+        TraceChain loop;
+        for (size_t j = i; !joined[j]; ) {
+            joined[j] = 1;
+            TraceChain& ch = chains[j];
+            loop.points.insert(loop.points.end(), ch.points.begin(), ch.points.end());
+            for (int c = 0; c < 3; ++c) loop.sum[c] += ch.sum[c];
+            Path().swap(ch.points);
+            auto it = byFirst.find(ch.next);
+            if (it == byFirst.end()) break;
+            j = it->second;
+        }
+        if (loop.points.size() >= opt.minEdges) loops.push_back(std::move(loop));
+    }
+    size_t stitched = chains.size();
+    chains.clear();
+    SDL_FreeSurface(loaded);
+
+    std::vector<Path> shapes(loops.size());
+    // Start each outline at its top-left point so the result does not depend on tiling.
+    parallelFor(loops.size(), [&](size_t i) {
+        Path& p = loops[i].points;
+        auto first = std::min_element(p.begin(), p.end(), [](const Point& a, const Point& b) {
+            return a.y < b.y || (a.y == b.y && a.x < b.x);
+        });
+        std::rotate(p.begin(), first, p.end());
+        shapes[i] = simplifyClosedPath(p, opt.tolerance);
+    });
+
+    Scene scene = loadScene(basePath);
+    SceneLayer& layer = scene.trunks;
+    layer.colors.resize(layer.paths.size(), SDL_Color{255,255,255,255});
+    layer.types.resize(layer.paths.size(), ShapeType::Line);
+    size_t added = 0, points = 0;
+    for (size_t i = 0; i < loops.size(); ++i) {
+        if (shapes[i].size() < 4) continue; // closed, so at least a triangle plus its first point again
+        double n = (double)loops[i].points.size();
+        SDL_Color c{ (Uint8)(loops[i].sum[0] / n + 0.5), (Uint8)(loops[i].sum[1] / n + 0.5), (Uint8)(loops[i].sum[2] / n + 0.5), 255 };
+        points += shapes[i].size();
+        layer.paths.push_back(std::move(shapes[i]));
+        layer.colors.push_back(c);
+        layer.types.push_back(ShapeType::Line);
+        ++added;
+    }
+    if (!saveScene(basePath, scene)) { out << "Cannot write scene " << basePath << "\n"; return false; }
+    out << "Traced " << g.w << "x" << g.h << " into " << added << " outlines (" << points << " points, "
+        << tilesX * tilesY << " tiles, " << stitched << " pieces) in " << (SDL_GetTicks() - startTicks)
+        << " ms (" << (classifyTicks - startTicks) << " ms decoding and classifying)\n";
+    return true;
+}
+
+// Gallery browser over Art/ (studios, galleries, images). A directory holding
+// paths.txt or current.txt, or with no subdirectories, is an image and opens as the
+// scene; any other directory is browsed into. Only rows on screen (plus a little
+// prefetch) are decoded: each frame the visible cells without a thumbnail replace the
+// loader's wish list, so cells scrolled past are never decoded. Workers IMG_Load and
+// shrink off the main thread; the main thread only uploads, and thumbnails stay in a
+// path-keyed texture LRU so going back up a level shows the previous grid at once.
+static constexpr int kGalleryThumb = 144;
+static constexpr int kGalleryCellW = 168, kGalleryCellH = 192;
+static constexpr int kGalleryPrefetchRows = 2;
+static constexpr size_t kGalleryBudget = 64u << 20;
+
+struct GalleryResult {
+    std::string path;
+    Canvas thumb; // empty when the directory has no thumbnail
+};
+
+struct GalleryLoader {
+    std::mutex m;
+    std::condition_variable wake;
+    std::vector<std::string> wanted; // taken from the back
+    std::set<std::string> inFlight;
+    std::vector<GalleryResult> done;
+    bool stop = false;
+    std::vector<std::thread> workers;
+};
+
+struct GalleryCell {
+    SDL_Texture* thumb = nullptr;
+    SDL_Texture* label = nullptr;
+    int w = 0, h = 0, labelW = 0, labelH = 0;
+    size_t bytes = 0;
+    std::list<std::string>::iterator lru;
+};
+
+struct Gallery {
+    std::string root, dir;
+    std::vector<std::string> names; // subdirectories of dir
+    std::unordered_map<std::string, GalleryCell> cells;
+    std::list<std::string> lru; // most recently drawn first
+    size_t bytes = 0;
+    int scroll = 0;
+    size_t selected = 0;
+};
+
+static bool decodeGalleryThumb(const std::string& dir, Canvas& out) {
+    for (const char* name : { "thumbnail.png", "thumbnail.jpeg", "thumbnail.jpg" }) {
+        std::string file = dir + "/" + name;
+        std::error_code ec;
+        if (!std::filesystem::exists(file, ec)) continue;
+        SDL_Surface* s = IMG_Load(file.c_str());
+        if (s && s->format->format != SDL_PIXELFORMAT_ARGB8888) {
+            SDL_Surface* converted = SDL_ConvertSurfaceFormat(s, SDL_PIXELFORMAT_ARGB8888, 0);
+            SDL_FreeSurface(s);
+            s = converted;
+        }
+        if (!s) continue;
+        Canvas src;
+        src.w = s->w; src.h = s->h;
+        src.px.resize((size_t)s->w * s->h);
+        for (int y = 0; y < s->h; ++y) std::memcpy(&src.px[(size_t)y * s->w], (const char*)s->pixels + (size_t)y * s->pitch, (size_t)s->w * 4);
+        SDL_FreeSurface(s);
+        if (src.w <= 0 || src.h <= 0) continue;
+        float k = std::min(1.0f, (float)kGalleryThumb / std::max(src.w, src.h));
+        out = resampleCanvas(src, std::max(1, (int)(src.w * k)), std::max(1, (int)(src.h * k)));
+        return true;
+    }
+    return false;
+}
+
+static void startGalleryLoader(GalleryLoader& l) {
+    unsigned n = std::max(1u, std::min(4u, std::thread::hardware_concurrency() - 1));
+    for (unsigned i = 0; i < n; ++i) {
+        l.workers.emplace_back([&l]() {
+            std::unique_lock<std::mutex> lk(l.m);
+            for (;;) {
+                l.wake.wait(lk, [&]() { return l.stop || !l.wanted.empty(); });
+                if (l.stop) return;
+                std::string path = std::move(l.wanted.back());
+                l.wanted.pop_back();
+                l.inFlight.insert(path);
+                lk.unlock();
+                GalleryResult res;
+                res.path = path;
+                decodeGalleryThumb(path, res.thumb);
+                lk.lock();
+                l.inFlight.erase(path);
+                l.done.push_back(std::move(res));
+            }
+        });
+    }
+}
+
+static void stopGalleryLoader(GalleryLoader& l) {
+    {
+        std::lock_guard<std::mutex> lk(l.m);
+        l.stop = true;
+    }
+    l.wake.notify_all();
+    for (auto& t : l.workers) t.join();
+    l.workers.clear();
+}
+
+static std::string galleryRoot(const std::string& basePath) {
+    std::error_code ec;
+    std::filesystem::path p = std::filesystem::absolute(basePath, ec);
+    for (std::filesystem::path q = p; !q.empty() && q != q.root_path(); q = q.parent_path()) {
+        if (q.filename() == "Art") return q.string();
+    }
+    if (std::filesystem::is_directory("Art", ec)) return std::filesystem::absolute("Art", ec).string();
+    return p.parent_path().string();
+}
+
+static bool isSceneDir(const std::string& dir) {
+    std::error_code ec;
+    if (std::filesystem::exists(dir + "/paths.txt", ec) || std::filesystem::exists(dir + "/current.txt", ec)) return true;
+    for (std::filesystem::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->is_directory(ec)) return false;
+    }
+    return true;
+}
+
+static void listGallery(Gallery& g, const std::string& dir) {
+    g.dir = dir;
+    g.names.clear();
+    std::error_code ec;
+    for (std::filesystem::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        std::string name = it->path().filename().string();
+        if (name.empty() || name[0] == '.' || !it->is_directory(ec)) continue;
+        g.names.push_back(std::move(name));
+    }
+    std::sort(g.names.begin(), g.names.end());
+    g.scroll = 0;
+    g.selected = 0;
+}
+
+static void selectGalleryName(Gallery& g, const std::string& name) {
+    auto it = std::lower_bound(g.names.begin(), g.names.end(), name);
+    if (it != g.names.end() && *it == name) g.selected = (size_t)(it - g.names.begin());
+}
+
+static void dropGalleryCell(Gallery& g, std::unordered_map<std::string, GalleryCell>::iterator it) {
+    if (it->second.thumb) SDL_DestroyTexture(it->second.thumb);
+    if (it->second.label) SDL_DestroyTexture(it->second.label);
+    g.bytes -= it->second.bytes;
+    g.lru.erase(it->second.lru);
+    g.cells.erase(it);
+}
+
+static GalleryCell& galleryCell(Gallery& g, const std::string& path) {
+    auto it = g.cells.find(path);
+    if (it != g.cells.end()) {
+        g.lru.splice(g.lru.begin(), g.lru, it->second.lru);
+        return it->second;
+    }
+    g.lru.push_front(path);
+    GalleryCell& c = g.cells[path];
+    c.lru = g.lru.begin();
+    return c;
+}
+
+static void uploadGalleryThumb(SDL_Renderer* r, Gallery& g, const GalleryResult& res) {
+    GalleryCell& c = galleryCell(g, res.path);
+    if (c.thumb) return;
+    if (res.thumb.px.empty()) { // remembered so it is not decoded again
+        if (!c.bytes) { c.bytes = 64; g.bytes += 64; }
+        return;
+    }
+    c.thumb = SDL_CreateTexture(r, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, res.thumb.w, res.thumb.h);
+    if (!c.thumb) return;
+    SDL_UpdateTexture(c.thumb, nullptr, res.thumb.px.data(), res.thumb.w * 4);
+    SDL_SetTextureBlendMode(c.thumb, SDL_BLENDMODE_BLEND);
+    c.w = res.thumb.w; c.h = res.thumb.h;
+    c.bytes += (size_t)c.w * c.h * 4;
+    g.bytes += (size_t)c.w * c.h * 4;
+}
+
+// Label texture, shortened with an ellipsis to fit the cell.
+static void galleryLabel(SDL_Renderer* r, TTF_Font* font, Gallery& g, GalleryCell& c, const std::string& name, SDL_Color color) {
+    if (c.label || !font) return;
+    static const std::string ellipsis = "\xE2\x80\xA6";
+    std::string text = name;
+    int w = 0, h = 0;
+    TTF_SizeUTF8(font, text.c_str(), &w, &h);
+    if (w > kGalleryCellW - 16) {
+        while (!text.empty()) {
+            // drop one whole character: its continuation bytes, then its lead byte
+            while (!text.empty() && ((unsigned char)text.back() & 0xC0) == 0x80) text.pop_back();
+            if (!text.empty()) text.pop_back();
+            TTF_SizeUTF8(font, (text + ellipsis).c_str(), &w, &h);
+            if (w <= kGalleryCellW - 16) break;
+        }
+        text += ellipsis;
+    }
+    SDL_Surface* s = TTF_RenderUTF8_Blended(font, text.c_str(), color);
+    if (!s) return;
+    c.label = SDL_CreateTextureFromSurface(r, s);
+    c.labelW = s->w; c.labelH = s->h;
+    c.bytes += (size_t)s->w * s->h * 4;
+    g.bytes += (size_t)s->w * s->h * 4;
+    SDL_FreeSurface(s);
+}
+
+static bool runGallery(AppShell& shell, std::string& basePath) {
+    if (!openAppShell(shell, false)) return false;
+    TTF_Font* font14 = shellFont(shell, 14);
+    TTF_Font* font16 = shellFont(shell, 16);
+    SDL_Renderer* r = shell.renderer;
+    enterShellMode(shell, "Atelier — Gallery", 1000, 700, true);
+    Theme theme = makeDarkOceanTheme();
+
+    Gallery g;
+    g.root = galleryRoot(basePath);
+    std::error_code ec;
+    std::filesystem::path current = std::filesystem::absolute(basePath, ec);
+    std::string parent = current.parent_path().string();
+    bool inside = parent.compare(0, g.root.size(), g.root) == 0 && (parent.size() == g.root.size() || parent[g.root.size()] == '/');
+    listGallery(g, inside ? parent : g.root);
+    if (inside) selectGalleryName(g, current.filename().string());
+    bool reveal = true; // scroll the selection into view on the next frame
+
+    GalleryLoader loader;
+    startGalleryLoader(loader);
+    bool picked = false, running = true;
+    while (running) {
+        int winW = 1000, winH = 700;
+        SDL_GetRendererOutputSize(r, &winW, &winH);
+        SDL_Rect grid{ 16, 48, std::max(kGalleryCellW, winW - 32), std::max(kGalleryCellH, winH - 56) };
+        int cols = std::max(1, grid.w / kGalleryCellW);
+        int rows = (int)((g.names.size() + cols - 1) / cols);
+        int maxScroll = std::max(0, rows * kGalleryCellH - grid.h);
+        grid.x += (grid.w - cols * kGalleryCellW) / 2;
+
+        auto openSelected = [&]() {
+            if (g.names.empty()) return;
+            std::string path = g.dir + "/" + g.names[g.selected];
+            if (isSceneDir(path)) {
+                basePath = path;
+                picked = true;
+                running = false;
+                return;
+            }
+            listGallery(g, path);
+            reveal = true;
+        };
+        auto goUp = [&]() {
+            if (g.dir.size() <= g.root.size()) return;
+            std::filesystem::path d(g.dir);
+            listGallery(g, d.parent_path().string());
+            selectGalleryName(g, d.filename().string());
+            reveal = true;
+        };
+        auto cellAt = [&](int x, int y, size_t& index) {
+            if (x < grid.x || y < grid.y || x >= grid.x + cols * kGalleryCellW || y >= grid.y + grid.h) return false;
+            size_t i = (size_t)((y - grid.y + g.scroll) / kGalleryCellH) * cols + (size_t)((x - grid.x) / kGalleryCellW);
+            if (i >= g.names.size()) return false;
+            index = i;
+            return true;
+        };
 
-    while (running) {
-        // events
         SDL_Event e;
-        int mx = -1, my = -1;
         while (SDL_PollEvent(&e)) {
             if (e.type == SDL_QUIT) running = false;
-            else if (e.type == SDL_TEXTINPUT) {
-                inputText += std::string(e.text.text);
+            else if (e.type == SDL_MOUSEWHEEL) g.scroll -= e.wheel.y * kGalleryCellH / 3;
+            else if (e.type == SDL_MOUSEBUTTONDOWN && e.button.button == SDL_BUTTON_LEFT) {
+                SDL_Rect closeRect{ winW - 30, 10, 20, 20 };
+                size_t i = 0;
+                if (pointInRect(e.button.x, e.button.y, closeRect)) running = false;
+                else if (cellAt(e.button.x, e.button.y, i)) {
+                    g.selected = i;
+                    if (e.button.clicks >= 2) openSelected();
+                }
             } else if (e.type == SDL_KEYDOWN) {
-                if (e.key.keysym.sym == SDLK_BACKSPACE) {
-                    if (!inputText.empty()) inputText.pop_back();
-                } else if (e.key.keysym.sym == SDLK_RETURN || e.key.keysym.sym == SDLK_KP_ENTER) {
-                    history.push_back(inputText);
-                    historyIndex = history.size();
-                    executeCommand(inputText);
-                    inputText.clear();
-                } else if (e.key.keysym.sym == SDLK_UP) {
-                    if (historyIndex > 0) {
-                        historyIndex--;
-                        inputText = history[historyIndex];
-                    }
-                } else if (e.key.keysym.sym == SDLK_DOWN) {
-                    if (historyIndex + 1 < history.size()) {
-                        historyIndex++;
-                        inputText = history[historyIndex];
-                    } else {
-                        historyIndex = history.size();
-                        inputText.clear();
-                    }
-                } else if (e.key.keysym.sym == SDLK_ESCAPE) {
-                    running = false;
+                SDL_Keycode k = e.key.keysym.sym;
+                size_t n = g.names.size(), step = (size_t)cols * std::max(1, grid.h / kGalleryCellH);
+                if (k == SDLK_ESCAPE) running = false;
+                else if (k == SDLK_RETURN || k == SDLK_KP_ENTER) openSelected();
+                else if (k == SDLK_BACKSPACE) goUp();
+                else if (n == 0) continue;
+                else if (k == SDLK_LEFT && g.selected > 0) --g.selected;
+                else if (k == SDLK_RIGHT && g.selected + 1 < n) ++g.selected;
+                else if (k == SDLK_UP && g.selected >= (size_t)cols) g.selected -= cols;
+                else if (k == SDLK_DOWN && g.selected + cols < n) g.selected += cols;
+                else if (k == SDLK_PAGEUP) g.selected -= std::min(g.selected, step);
+                else if (k == SDLK_PAGEDOWN) g.selected = std::min(n - 1, g.selected + step);
+                else if (k == SDLK_HOME) g.selected = 0;
+                else if (k == SDLK_END) g.selected = n - 1;
+                else continue;
+                reveal = true;
+            }
+        }
+        if (!running) break;
+        rows = (int)((g.names.size() + cols - 1) / cols);
+        maxScroll = std::max(0, rows * kGalleryCellH - grid.h);
+        if (reveal && !g.names.empty()) {
+            int top = (int)(g.selected / cols) * kGalleryCellH;
+            if (top < g.scroll) g.scroll = top;
+            if (top + kGalleryCellH > g.scroll + grid.h) g.scroll = top + kGalleryCellH - grid.h;
+            reveal = false;
+        }
+        g.scroll = std::max(0, std::min(maxScroll, g.scroll));
+
+        // Uploads finished decodes, then asks for what is on screen and still missing:
+        // visible rows first (top-left first), then the prefetch rows around them.
+        std::vector<GalleryResult> finished;
+        std::vector<std::string> wanted;
+        int firstRow = g.scroll / kGalleryCellH, lastRow = (g.scroll + grid.h - 1) / kGalleryCellH;
+        {
+            std::lock_guard<std::mutex> lk(loader.m);
+            finished.swap(loader.done);
+            auto want = [&](int row) {
+                if (row < 0 || row >= rows) return;
+                for (size_t i = std::min(g.names.size(), (size_t)(row + 1) * cols); i-- > (size_t)row * cols; ) {
+                    std::string path = g.dir + "/" + g.names[i];
+                    if (!g.cells.count(path) && !loader.inFlight.count(path)) wanted.push_back(std::move(path));
+                }
+            };
+            for (int d = kGalleryPrefetchRows; d >= 1; --d) { want(lastRow + d); want(firstRow - d); }
+            for (int row = lastRow; row >= firstRow; --row) want(row);
+            loader.wanted = wanted;
+        }
+        if (!wanted.empty()) loader.wake.notify_all();
+        for (const GalleryResult& res : finished) uploadGalleryThumb(r, g, res);
+
+        drawVerticalGradient(r, { 0, 0, winW, winH }, { 6, 10, 16, 255 }, { 10, 16, 26, 255 });
+        SDL_RenderSetClipRect(r, &grid);
+        for (int row = firstRow; row <= lastRow && row < rows; ++row) {
+            for (int col = 0; col < cols; ++col) {
+                size_t i = (size_t)row * cols + col;
+                if (i >= g.names.size()) break;
+                SDL_Rect cell{ grid.x + col * kGalleryCellW + 6, grid.y + row * kGalleryCellH - g.scroll + 6, kGalleryCellW - 12, kGalleryCellH - 12 };
+                fillRoundedRect(r, cell, 10, i == g.selected ? theme.panelAccent : theme.panel);
+                if (i == g.selected) drawRectBorder(r, cell, 10, theme.inputBorder);
+                std::string path = g.dir + "/" + g.names[i];
+                auto it = g.cells.find(path);
+                if (it == g.cells.end()) continue; // still decoding
+                GalleryCell& c = galleryCell(g, path);
+                if (c.thumb) {
+                    SDL_Rect dst{ cell.x + (cell.w - c.w) / 2, cell.y + 6 + (kGalleryThumb - c.h) / 2, c.w, c.h };
+                    SDL_RenderCopy(r, c.thumb, nullptr, &dst);
+                } else {
+                    SDL_Rect slot{ cell.x + (cell.w - kGalleryThumb) / 2 + 16, cell.y + 22, kGalleryThumb - 32, kGalleryThumb - 32 };
+                    drawRectBorder(r, slot, 8, theme.textSecondary);
+                }
+                galleryLabel(r, font14, g, c, g.names[i], theme.textPrimary);
+                if (c.label) {
+                    SDL_Rect dst{ cell.x + (cell.w - c.labelW) / 2, cell.y + cell.h - c.labelH - 6, c.labelW, c.labelH };
+                    SDL_RenderCopy(r, c.label, nullptr, &dst);
+                }
+            }
+        }
+        SDL_RenderSetClipRect(r, nullptr);
+        while (g.bytes > kGalleryBudget && !g.lru.empty()) dropGalleryCell(g, g.cells.find(g.lru.back()));
+
+        drawWindowHeaderWithClose(r, winW);
+        std::string where = g.dir.size() > g.root.size() ? g.dir.substr(g.root.size() + 1) : std::string("Art");
+        renderText(r, font16, where + "  (" + std::to_string(g.names.size()) + ")", 16, 10, theme.textPrimary);
+        if (g.names.empty()) renderText(r, font16, "Nothing here. Backspace goes up.", grid.x + 8, grid.y + 16, theme.textSecondary);
+        SDL_RenderPresent(r);
+        if (!shell.vsync) SDL_Delay(16);
+    }
+    stopGalleryLoader(loader);
+    while (!g.cells.empty()) dropGalleryCell(g, g.cells.begin());
+    if (picked) {
+        std::ofstream cwd(".cwd");
+        if (cwd) cwd << basePath << "\n"; // the next launch opens the same image
+    }
+    return picked;
+}
+
+// SVG export. The document is written front to back through a 1 MiB buffer with no
+// element tree. Numbers are formatted by hand to at most three decimals. Consecutive
+// shapes of one color share a <g stroke>.
+// Strokes are 5 px and round-capped, like the 2 px radius brush the renderers use.
+// A color used by a single shape goes on the element instead. Symbols become <defs>
+// groups placed with <use>. A tint becomes a color-matrix filter.
+static constexpr size_t kSvgBuffer = 1 << 20;
+
+struct SvgWriter {
+    std::ofstream file;
+    std::string buf;
+    Uint64 written = 0;
+    SvgWriter& operator<<(const char* s) { buf += s; return *this; }
+    void flushIfFull() { if (buf.size() >= kSvgBuffer) flush(); }
+    void flush() { file.write(buf.data(), (std::streamsize)buf.size()); written += buf.size(); buf.clear(); }
+};
+
+static void svgNumber(std::string& out, double v) {
+    long long q = std::llround(v * 1000.0);
+    if (q < 0) { out += '-'; q = -q; }
+    char digits[24];
+    int n = 0;
+    long long whole = q / 1000;
+    do { digits[n++] = (char)('0' + whole % 10); whole /= 10; } while (whole);
+    while (n) out += digits[--n];
+    int frac = (int)(q % 1000);
+    if (!frac) return;
+    out += '.';
+    for (int d = 100; frac; d /= 10) { out += (char)('0' + frac / d); frac %= d; }
+}
+
+static void svgColor(std::string& out, const char* attr, SDL_Color c) {
+    static const char hex[] = "0123456789abcdef";
+    out += ' '; out += attr; out += "=\"#";
+    for (Uint8 v : { c.r, c.g, c.b }) { out += hex[v >> 4]; out += hex[v & 15]; }
+    out += '"';
+    if (c.a != 255) {
+        out += ' '; out += attr; out += "-opacity=\"";
+        svgNumber(out, c.a / 255.0);
+        out += '"';
+    }
+}
+
+static void svgShape(std::string& out, const Path& p, ShapeType t, const std::string& extra) {
+    if (t == ShapeType::Circle && p.size() >= 2) {
+        out += "<circle cx=\""; svgNumber(out, (p[0].x + p[1].x) * 0.5);
+        out += "\" cy=\""; svgNumber(out, (p[0].y + p[1].y) * 0.5);
+        out += "\" r=\""; svgNumber(out, std::hypot(p[0].x - p[1].x, p[0].y - p[1].y) * 0.5);
+        out += '"'; out += extra; out += "/>";
+        return;
+    }
+    if (p.size() < 2) return;
+    bool closed = (t == ShapeType::Triangle && p.size() >= 3) || (t == ShapeType::Quadrilateral && p.size() >= 4);
+    out += "<path d=\"M";
+    for (size_t i = 0; i < p.size(); ++i) {
+        if (i) out += ' ';
+        svgNumber(out, p[i].x); out += ' '; svgNumber(out, p[i].y);
+    }
+    if (closed) out += 'Z';
+    out += '"'; out += extra; out += "/>";
+}
+
+static void svgLayer(SvgWriter& w, const SceneLayer& layer, const char* extra) {
+    auto colorOf = [&](size_t i) { return i < layer.colors.size() ? layer.colors[i] : SDL_Color{255,255,255,255}; };
+    auto same = [](SDL_Color a, SDL_Color b) { return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a; };
+    bool open = false;
+    std::string attrs;
+    for (size_t i = 0; i < layer.paths.size(); ++i) {
+        SDL_Color c = colorOf(i);
+        ShapeType t = i < layer.types.size() ? layer.types[i] : ShapeType::Line;
+        if (!open || !same(c, colorOf(i - 1))) {
+            if (open) w << "</g>\n";
+            open = i + 1 < layer.paths.size() && same(c, colorOf(i + 1));
+            attrs.clear();
+            if (open) {
+                w << "<g";
+                svgColor(w.buf, "stroke", c);
+                w << ">";
+            } else {
+                svgColor(attrs, "stroke", c);
+            }
+            attrs += extra;
+        }
+        svgShape(w.buf, layer.paths[i], t, attrs);
+        if (!open) w << "\n";
+        w.flushIfFull();
+    }
+    if (open) w << "</g>\n";
+}
+
+static bool exportSvg(const std::string& basePath, const std::string& outFile, std::ostream& out) {
+    Uint32 startTicks = SDL_GetTicks();
+    Scene scene = loadScene(basePath);
+    Uint32 loadedTicks = SDL_GetTicks();
+    SvgWriter w;
+    w.file.open(outFile, std::ios::binary | std::ios::trunc);
+    if (!w.file) { out << "Cannot write " << outFile << "\n"; return false; }
+    w.buf.reserve(kSvgBuffer + 4096);
+
+    // The 800x600 canvas the renderers use, grown to whatever the drawing covers.
+    SDL_Rect box{0, 0, 800, 600};
+    size_t shapes = 0;
+    for (const SceneLayer* l : { &scene.foliage, &scene.trunks }) {
+        for (size_t i = 0; i < l->paths.size(); ++i) {
+            SDL_Rect b = shapeBounds(l->paths[i], i < l->types.size() ? l->types[i] : ShapeType::Line);
+            if (!l->paths[i].empty()) box = unionRect(box, SDL_Rect{ b.x - 3, b.y - 3, b.w + 6, b.h + 6 });
+        }
+        shapes += l->paths.size();
+    }
+    for (const SymbolInstance& inst : scene.instances) {
+        const SDL_Rect& b = scene.symbols[inst.symbol].bounds;
+        float reach = inst.scale * std::hypot((float)std::max(std::abs(b.x), std::abs(b.x + b.w)), (float)std::max(std::abs(b.y), std::abs(b.y + b.h))) + 3.0f;
+        box = unionRect(box, SDL_Rect{ (int)std::floor(inst.x - reach), (int)std::floor(inst.y - reach), (int)std::ceil(2 * reach), (int)std::ceil(2 * reach) });
+    }
+
+    w << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<svg xmlns=\"http://www.w3.org/2000/svg\" "
+         "xmlns:xlink=\"http://www.w3.org/1999/xlink\" viewBox=\"";
+    svgNumber(w.buf, box.x); w << " "; svgNumber(w.buf, box.y); w << " ";
+    svgNumber(w.buf, box.w); w << " "; svgNumber(w.buf, box.h);
+    w << "\" width=\""; svgNumber(w.buf, box.w); w << "\" height=\""; svgNumber(w.buf, box.h);
+    w << "\" fill=\"none\" stroke-width=\"5\" stroke-linecap=\"round\" stroke-linejoin=\"round\">\n";
+
+    std::map<Uint32, int> tints;
+    for (const SymbolInstance& inst : scene.instances) {
+        Uint32 key = ((Uint32)inst.tint.r << 24) | ((Uint32)inst.tint.g << 16) | ((Uint32)inst.tint.b << 8) | inst.tint.a;
+        if (key != 0xFFFFFFFFu) tints.emplace(key, (int)tints.size());
+    }
+    if (!scene.instances.empty()) {
+        w << "<defs>\n";
+        for (size_t s = 0; s < scene.symbols.size(); ++s) {
+            w << "<g id=\"sym" << std::to_string(s).c_str() << "\">\n";
+            svgLayer(w, scene.symbols[s].shapes, " vector-effect=\"non-scaling-stroke\"");
+            w << "</g>\n";
+        }
+        for (const auto& kv : tints) {
+            w << "<filter id=\"tint" << std::to_string(kv.second).c_str() << "\" color-interpolation-filters=\"sRGB\">"
+                 "<feColorMatrix type=\"matrix\" values=\"";
+            for (int c = 0; c < 4; ++c) {
+                for (int k = 0; k < 5; ++k) {
+                    if (c || k) w << " ";
+                    if (k == c) svgNumber(w.buf, ((kv.first >> (24 - 8 * c)) & 0xFF) / 255.0);
+                    else w << "0";
                 }
             }
+            w << "\"/></filter>\n";
+        }
+        w << "</defs>\n";
+    }
+
+    svgLayer(w, scene.foliage, "");
+    svgLayer(w, scene.trunks, "");
+    for (const SymbolInstance& inst : scene.instances) {
+        w << "<use xlink:href=\"#sym" << std::to_string(inst.symbol).c_str() << "\" transform=\"translate(";
+        svgNumber(w.buf, inst.x); w << " "; svgNumber(w.buf, inst.y); w << ")";
+        if (inst.rotation != 0.0f) { w << " rotate("; svgNumber(w.buf, inst.rotation); w << ")"; }
+        if (inst.scale != 1.0f) { w << " scale("; svgNumber(w.buf, inst.scale); w << ")"; }
+        w << "\"";
+        Uint32 key = ((Uint32)inst.tint.r << 24) | ((Uint32)inst.tint.g << 16) | ((Uint32)inst.tint.b << 8) | inst.tint.a;
+        auto it = tints.find(key);
+        if (it != tints.end()) w << " filter=\"url(#tint" << std::to_string(it->second).c_str() << ")\"";
+        w << "/>\n";
+        w.flushIfFull();
+    }
+    w << "</svg>\n";
+    w.flush();
+    w.file.close();
+    if (!w.file) { out << "Cannot write " << outFile << "\n"; return false; }
+    out << "Exported " << shapes << " shapes and " << scene.instances.size() << " instances to " << outFile
+        << " (" << w.written << " bytes) in " << (SDL_GetTicks() - startTicks) << " ms, "
+        << (loadedTicks - startTicks) << " of them reading the scene\n";
+    return true;
+}
+
+// SVG import. The file is read in 1 MiB chunks and scanned one tag at a time. Only the
+// unfinished tail of the buffer is kept, so memory grows with the largest single element
+// and not with the file. <svg>, <g> and <a> carry an inherited style and transform.
+// <defs>, <symbol> and the like are skipped since they draw nothing themselves. Curves
+// are flattened after transforming their control points, which map affinely, so the
+// tolerance holds in scene pixels. Bezier segment counts come from Wang's formula and
+// arc steps from the sagitta. Shapes take their stroke color, or their fill when
+// unstroked: scenes only draw outlines.
+static constexpr size_t kSvgReadChunk = 1 << 20;
+
+struct SvgStyle {
+    Affine2D m;
+    SDL_Color stroke{0, 0, 0, 255}, fill{0, 0, 0, 255};
+    bool hasStroke = false, hasFill = true;
+    float opacity = 1.0f, strokeOpacity = 1.0f, fillOpacity = 1.0f;
+};
+
+using SvgAttrs = std::vector<std::pair<std::string_view, std::string_view>>;
+
+struct SvgImport {
+    SceneLayer& layer;
+    float tolerance = 0.25f;
+    size_t shapes = 0, points = 0, skipped = 0;
+    SDL_Color color{0, 0, 0, 255}; // of the element being read
+};
+
+static inline bool svgSpace(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == ','; }
+
+// Hand-rolled float parsing: SVG numbers run together ("1.5.5", "-1-2", "1e-3.5").
+static bool svgNextNumber(const char*& p, const char* e, float& v) {
+    while (p < e && svgSpace(*p)) ++p;
+    const char* s = p;
+    bool neg = false;
+    if (p < e && (*p == '-' || *p == '+')) neg = *p++ == '-';
+    Uint64 mant = 0;
+    int exp10 = 0, digits = 0;
+    for (; p < e && *p >= '0' && *p <= '9'; ++p, ++digits) {
+        if (mant < 100000000000000000ull) mant = mant * 10 + (Uint64)(*p - '0'); else ++exp10;
+    }
+    if (p < e && *p == '.') {
+        for (++p; p < e && *p >= '0' && *p <= '9'; ++p, ++digits) {
+            if (mant < 100000000000000000ull) { mant = mant * 10 + (Uint64)(*p - '0'); --exp10; }
+        }
+    }
+    if (!digits) { p = s; return false; }
+    if (p + 1 < e && (*p == 'e' || *p == 'E') && (p[1] == '-' || p[1] == '+' || (p[1] >= '0' && p[1] <= '9'))) {
+        const char* q = p + 1;
+        bool eneg = false;
+        if (*q == '-' || *q == '+') eneg = *q++ == '-';
+        int x = 0;
+        if (q < e && *q >= '0' && *q <= '9') {
+            for (; q < e && *q >= '0' && *q <= '9'; ++q) x = std::min(x * 10 + (*q - '0'), 1000);
+            exp10 += eneg ? -x : x;
+            p = q;
+        }
+    }
+    static const double pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+                                    1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18 };
+    double d = (double)mant;
+    if (exp10 >= -18 && exp10 <= 18) d = exp10 < 0 ? d / pow10[-exp10] : d * pow10[exp10];
+    else d *= std::pow(10.0, exp10);
+    v = (float)(neg ? -d : d);
+    return true;
+}
+
+static bool svgNextFlag(const char*& p, const char* e, bool& flag) {
+    while (p < e && svgSpace(*p)) ++p;
+    if (p == e || (*p != '0' && *p != '1')) return false;
+    flag = *p++ == '1';
+    return true;
+}
+
+static float svgLength(std::string_view v, float fallback = 0.0f) {
+    const char* p = v.data();
+    float f;
+    return svgNextNumber(p, v.data() + v.size(), f) ? f : fallback;
+}
+
+static std::string_view svgTrim(std::string_view v) {
+    while (!v.empty() && (v.front() == ' ' || v.front() == '\t' || v.front() == '\n' || v.front() == '\r')) v.remove_prefix(1);
+    while (!v.empty() && (v.back() == ' ' || v.back() == '\t' || v.back() == '\n' || v.back() == '\r')) v.remove_suffix(1);
+    return v;
+}
+
+// "none" clears; unknown paints (gradients, currentColor) keep the element visible in gray.
+static void svgPaint(std::string_view v, SDL_Color& c, bool& has) {
+    static const std::pair<const char*, Uint32> named[] = {
+        { "black", 0x000000 }, { "white", 0xFFFFFF }, { "red", 0xFF0000 }, { "green", 0x008000 },
+        { "blue", 0x0000FF }, { "yellow", 0xFFFF00 }, { "cyan", 0x00FFFF }, { "aqua", 0x00FFFF },
+        { "magenta", 0xFF00FF }, { "fuchsia", 0xFF00FF }, { "gray", 0x808080 }, { "grey", 0x808080 },
+        { "silver", 0xC0C0C0 }, { "maroon", 0x800000 }, { "olive", 0x808000 }, { "lime", 0x00FF00 },
+        { "teal", 0x008080 }, { "navy", 0x000080 }, { "purple", 0x800080 }, { "orange", 0xFFA500 },
+        { "brown", 0xA52A2A }, { "pink", 0xFFC0CB } };
+    v = svgTrim(v);
+    if (v.empty() || v == "inherit") return;
+    has = v != "none";
+    if (!has) return;
+    if (v[0] == '#') {
+        std::string hex(v.substr(1));
+        if (hex.size() == 3) hex = { hex[0], hex[0], hex[1], hex[1], hex[2], hex[2] };
+        if (!parseHexColor(hex, c)) c = SDL_Color{128, 128, 128, 255};
+        c.a = 255;
+        return;
+    }
+    if (v.compare(0, 4, "rgb(") == 0) {
+        const char* p = v.data() + 4;
+        const char* e = v.data() + v.size();
+        float ch[3] = { 0, 0, 0 };
+        for (float& x : ch) {
+            svgNextNumber(p, e, x);
+            while (p < e && *p == ' ') ++p;
+            if (p < e && *p == '%') { x *= 2.55f; ++p; }
         }
+        c = SDL_Color{ (Uint8)std::max(0.0f, std::min(255.0f, ch[0])), (Uint8)std::max(0.0f, std::min(255.0f, ch[1])),
+                       (Uint8)std::max(0.0f, std::min(255.0f, ch[2])), 255 };
+        return;
+    }
+    for (const auto& n : named) {
+        if (v == n.first) { c = SDL_Color{ (Uint8)(n.second >> 16), (Uint8)(n.second >> 8), (Uint8)n.second, 255 }; return; }
+    }
+    c = SDL_Color{128, 128, 128, 255};
+}
 
-        // draw background gradient for more modern depth
-        drawVerticalGradient(renderer, {0, 0, 1000, 700}, { 6, 10, 16, 255 }, { 10, 16, 26, 255 });
+// Parses transform="..." and applies it inside m (the list reads outermost first).
+static void svgTransform(std::string_view v, Affine2D& m) {
+    const char* p = v.data();
+    const char* e = p + v.size();
+    while (p < e) {
+        while (p < e && (svgSpace(*p))) ++p;
+        const char* name = p;
+        while (p < e && *p != '(') ++p;
+        std::string_view fn = svgTrim(std::string_view(name, (size_t)(p - name)));
+        if (p == e) break;
+        ++p;
+        float a[6] = { 0, 0, 0, 0, 0, 0 };
+        int n = 0;
+        while (n < 6 && svgNextNumber(p, e, a[n])) ++n;
+        while (p < e && *p != ')') ++p;
+        if (p < e) ++p;
+        Affine2D t;
+        if (fn == "matrix" && n == 6) { t.a = a[0]; t.c = a[1]; t.b = a[2]; t.d = a[3]; t.tx = a[4]; t.ty = a[5]; }
+        else if (fn == "translate" && n >= 1) { t.tx = a[0]; t.ty = n > 1 ? a[1] : 0.0f; }
+        else if (fn == "scale" && n >= 1) { t.a = a[0]; t.d = n > 1 ? a[1] : a[0]; }
+        else if (fn == "rotate" && n >= 1) t = affineAbout(n >= 3 ? a[1] : 0.0f, n >= 3 ? a[2] : 0.0f, a[0] * 3.14159265f / 180.0f, 1.0f, 0.0f, 0.0f);
+        else if (fn == "skewX" && n == 1) t.b = std::tan(a[0] * 3.14159265f / 180.0f);
+        else if (fn == "skewY" && n == 1) t.c = std::tan(a[0] * 3.14159265f / 180.0f);
+        m = affineCompose(m, t);
+    }
+}
 
-        // header bar (glass, minimal)
-        fillRoundedRect(renderer, header, 0, theme.panelAccent);
-        // App mark (small circle) and centered title
-        drawFilledCircle(renderer, 28, header.y + 36, 6, { 90, 160, 255, 200 });
-        drawFilledCircle(renderer, 46, header.y + 36, 6, { 90, 255, 210, 200 });
-        const char* title = "Atelier Terminal";
-        int tw = 0, th = 0; TTF_SizeUTF8(font20, title, &tw, &th);
-        renderText(renderer, font20, title, header.x + (header.w - tw) / 2, header.y + (header.h - th) / 2, theme.textPrimary);
-        drawUnderline(renderer, 40, header.h - 1, 920, { 60, 120, 220, 80 });
+static void svgApplyStyle(std::string_view name, std::string_view v, SvgStyle& s) {
+    if (name == "stroke") svgPaint(v, s.stroke, s.hasStroke);
+    else if (name == "fill") svgPaint(v, s.fill, s.hasFill);
+    else if (name == "opacity") s.opacity *= svgLength(v, 1.0f);
+    else if (name == "stroke-opacity") s.strokeOpacity = svgLength(v, 1.0f);
+    else if (name == "fill-opacity") s.fillOpacity = svgLength(v, 1.0f);
+}
 
-        // output panel
-        drawDropShadow(renderer, outputPanel, 16, 8, { 0, 0, 0, 55 });
-        fillRoundedRect(renderer, outputPanel, 16, theme.panel);
-        // clip to output panel when drawing text
-        SDL_Rect clip = outputPanel;
-        SDL_RenderSetClipRect(renderer, &clip);
-        int lineHeight = TTF_FontHeight(font14) + 2;
-        int maxVisible = (outputPanel.h - 24) / lineHeight;
-        int startIdx = (int)outputLines.size() - maxVisible;
-        if (startIdx < 0) startIdx = 0;
-        int y = outputPanel.y + 12;
-        for (size_t i = (size_t)startIdx; i < outputLines.size(); ++i) {
-            renderText(renderer, font14, outputLines[i], outputPanel.x + 16, y, theme.textPrimary);
-            y += lineHeight;
+static void svgStyleAttrs(const SvgAttrs& attrs, SvgStyle& s) {
+    for (const auto& kv : attrs) {
+        if (kv.first == "transform") svgTransform(kv.second, s.m);
+        else if (kv.first == "style") {
+            std::string_view css = kv.second;
+            while (!css.empty()) {
+                size_t semi = css.find(';');
+                std::string_view decl = css.substr(0, semi);
+                size_t colon = decl.find(':');
+                if (colon != std::string_view::npos) svgApplyStyle(svgTrim(decl.substr(0, colon)), decl.substr(colon + 1), s);
+                if (semi == std::string_view::npos) break;
+                css.remove_prefix(semi + 1);
+            }
+        } else {
+            svgApplyStyle(kv.first, kv.second, s);
         }
-        SDL_RenderSetClipRect(renderer, nullptr);
+    }
+}
 
-        // input panel
-        drawDropShadow(renderer, inputPanel, 14, 8, { 0, 0, 0, 65 });
-        fillRoundedRect(renderer, inputPanel, 14, theme.inputBg);
-        drawRectBorder(renderer, { inputPanel.x, inputPanel.y, inputPanel.w, inputPanel.h }, 14, { 80, 150, 255, 90 });
-        drawRectBorder(renderer, { inputPanel.x - 1, inputPanel.y - 1, inputPanel.w + 2, inputPanel.h + 2 }, 16, theme.inputBorder);
-        renderText(renderer, font16, inputText.empty() ? std::string("Type a command…") : inputText,
-                   inputPanel.x + 16, inputPanel.y + 16, inputText.empty() ? theme.textSecondary : theme.textPrimary);
-        // caret
-        int textW = 0, textH = 0; TTF_SizeUTF8(font16, inputText.c_str(), &textW, &textH);
-        int caretX = inputPanel.x + 16 + textW, caretW = 2;
-        int caretH = TTF_FontHeight(font16);
-        bool blink = ((SDL_GetTicks() / 500) % 2) == 0;
-        if (blink) { SDL_Rect caret{ caretX, inputPanel.y + 14, caretW, caretH }; setColor(renderer, theme.cursor); SDL_RenderFillRect(renderer, &caret); }
+static inline Point svgMap(const Affine2D& m, float x, float y) { return Point{ m.a * x + m.b * y + m.tx, m.c * x + m.d * y + m.ty }; }
 
-        SDL_RenderPresent(renderer);
+static void svgEmit(SvgImport& im, Path&& p, ShapeType t) {
+    p = compactPath(p, false);
+    if (p.size() < 2) { ++im.skipped; return; }
+    im.points += p.size();
+    im.layer.paths.push_back(std::move(p));
+    im.layer.colors.push_back(im.color);
+    im.layer.types.push_back(t);
+    ++im.shapes;
+}
+
+// A closed run of 3 or 4 straight edges becomes a Triangle or Quadrilateral.
+static void svgEmitPolygon(SvgImport& im, Path&& p, bool closed, bool curved) {
+    Path q = compactPath(p, closed);
+    if (closed && !curved && (q.size() == 3 || q.size() == 4)) {
+        ShapeType t = q.size() == 3 ? ShapeType::Triangle : ShapeType::Quadrilateral;
+        svgEmit(im, std::move(q), t);
+        return;
     }
+    if (closed && !p.empty() && (p.back().x != p.front().x || p.back().y != p.front().y)) p.push_back(p.front());
+    svgEmit(im, std::move(p), ShapeType::Line);
+}
 
-    SDL_StopTextInput();
-    TTF_CloseFont(font14);
-    TTF_CloseFont(font16);
-    TTF_CloseFont(font20);
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
-    TTF_Quit();
-    if (initedVideoHere) SDL_Quit();
-    return true;
+static void svgFlattenQuad(Path& out, Point p0, Point p1, Point p2, float tol) {
+    float dd = std::hypot(p0.x - 2 * p1.x + p2.x, p0.y - 2 * p1.y + p2.y);
+    int n = std::max(1, std::min(1000, (int)std::ceil(std::sqrt(0.25f * dd / tol))));
+    for (int i = 1; i <= n; ++i) {
+        float t = (float)i / n, u = 1 - t;
+        out.push_back(Point{ u * u * p0.x + 2 * u * t * p1.x + t * t * p2.x, u * u * p0.y + 2 * u * t * p1.y + t * t * p2.y });
+    }
 }
 
-static bool exitCliAfterSDL = false;
+static void svgFlattenCubic(Path& out, Point p0, Point p1, Point p2, Point p3, float tol) {
+    float dd = std::max(std::hypot(p0.x - 2 * p1.x + p2.x, p0.y - 2 * p1.y + p2.y),
+                        std::hypot(p1.x - 2 * p2.x + p3.x, p1.y - 2 * p2.y + p3.y));
+    int n = std::max(1, std::min(1000, (int)std::ceil(std::sqrt(0.75f * dd / tol))));
+    for (int i = 1; i <= n; ++i) {
+        float t = (float)i / n, u = 1 - t;
+        float a = u * u * u, b = 3 * u * u * t, c = 3 * u * t * t, d = t * t * t;
+        out.push_back(Point{ a * p0.x + b * p1.x + c * p2.x + d * p3.x, a * p0.y + b * p1.y + c * p2.y + d * p3.y });
+    }
+}
 
-static void editMode(const std::string& basePath) {
-    std::string pathsFile   = basePath + "/paths.txt";
-    std::string currentFile = basePath + "/current.txt";
-    auto foliage = readPaths(pathsFile);
-    auto trunks  = readPaths(currentFile);
-    // Load per-path colors (defaults to white if file missing/short)
-    std::vector<SDL_Color> foliageColors = readColors(pathsFile + ".colors", foliage.size());
-    std::vector<SDL_Color> trunksColors  = readColors(currentFile + ".colors", trunks.size());
-    // Load per-path types
-    std::vector<ShapeType> foliageTypes = readTypes(pathsFile + ".types", foliage.size());
-    std::vector<ShapeType> trunksTypes  = readTypes(currentFile + ".types", trunks.size());
-    SDL_Color currentDrawColor{255,255,255,255};
-    bool showColorPanel = false;
-    ShapeType currentShape = ShapeType::Line;
-    // Placement state: collect exact number of clicks for chosen shape
-    int placementNeededPoints = 0;  // 0 when idle
-    int placementCollected = 0;
-    Path placementPoints;
+// Elliptical arc from (x0, y0) in user space (SVG implementation notes, F.6.5).
+static void svgFlattenArc(Path& out, const Affine2D& m, float x0, float y0, float rx, float ry, float phiDeg,
+                          bool large, bool sweep, float x1, float y1, float tol) {
+    rx = std::abs(rx); ry = std::abs(ry);
+    if (rx == 0 || ry == 0 || (x0 == x1 && y0 == y1)) { out.push_back(svgMap(m, x1, y1)); return; }
+    double phi = phiDeg * 3.14159265358979 / 180.0, cs = std::cos(phi), sn = std::sin(phi);
+    double dx = (x0 - x1) / 2.0, dy = (y0 - y1) / 2.0;
+    double px = cs * dx + sn * dy, py = -sn * dx + cs * dy;
+    double lambda = px * px / ((double)rx * rx) + py * py / ((double)ry * ry);
+    if (lambda > 1) { rx *= (float)std::sqrt(lambda); ry *= (float)std::sqrt(lambda); }
+    double rx2 = (double)rx * rx, ry2 = (double)ry * ry;
+    double num = rx2 * ry2 - rx2 * py * py - ry2 * px * px, den = rx2 * py * py + ry2 * px * px;
+    double k = std::sqrt(std::max(0.0, num / den)) * (large == sweep ? -1 : 1);
+    double cxp = k * rx * py / ry, cyp = -k * ry * px / rx;
+    double cx = cs * cxp - sn * cyp + (x0 + x1) / 2.0, cy = sn * cxp + cs * cyp + (y0 + y1) / 2.0;
+    double t0 = std::atan2((py - cyp) / ry, (px - cxp) / rx);
+    double dt = std::atan2((-py - cyp) / ry, (-px - cxp) / rx) - t0;
+    if (sweep && dt < 0) dt += 2 * 3.14159265358979;
+    if (!sweep && dt > 0) dt -= 2 * 3.14159265358979;
+    double scale = std::sqrt(std::max(std::abs(m.a * m.d - m.b * m.c), 1e-12f));
+    double r = std::max(rx, ry) * std::max(scale, (double)std::max(std::hypot(m.a, m.c), std::hypot(m.b, m.d)));
+    double step = r > tol ? 2 * std::acos(1 - tol / r) : 3.14159265358979 / 2;
+    int n = std::max(1, std::min(10000, (int)std::ceil(std::abs(dt) / step)));
+    for (int i = 1; i <= n; ++i) {
+        double t = t0 + dt * i / n;
+        double ex = rx * std::cos(t), ey = ry * std::sin(t);
+        out.push_back(svgMap(m, (float)(cx + cs * ex - sn * ey), (float)(cy + sn * ex + cs * ey)));
+    }
+}
+
+static void svgPathData(SvgImport& im, const Affine2D& m, std::string_view d) {
+    const char* p = d.data();
+    const char* e = p + d.size();
+    Path cur;
+    bool curved = false;
+    float x = 0, y = 0, sx = 0, sy = 0, cx = 0, cy = 0; // pen, subpath start, last control point
+    char cmd = 0, prev = 0;
+    auto flush = [&](bool closed) {
+        if (cur.size() >= 2) svgEmitPolygon(im, std::move(cur), closed, curved);
+        cur.clear();
+        curved = false;
+    };
+    for (;;) {
+        while (p < e && svgSpace(*p)) ++p;
+        if (p == e) break;
+        if ((*p >= 'A' && *p <= 'Z') || (*p >= 'a' && *p <= 'z')) {
+            cmd = *p++;
+            if (cmd == 'Z' || cmd == 'z') {
+                flush(true);
+                x = sx; y = sy;
+                prev = cmd;
+                continue;
+            }
+        } else if (!cmd || cmd == 'Z' || cmd == 'z') {
+            break; // numbers with no command to repeat
+        }
+        bool rel = cmd >= 'a';
+        float ox = rel ? x : 0, oy = rel ? y : 0;
+        float a[7];
+        auto nums = [&](int n) {
+            for (int i = 0; i < n; ++i) if (!svgNextNumber(p, e, a[i])) return false;
+            return true;
+        };
+        char c = (char)(cmd & ~0x20);
+        if (c == 'M') {
+            if (!nums(2)) break;
+            flush(false);
+            x = sx = a[0] + ox; y = sy = a[1] + oy;
+            cur.push_back(svgMap(m, x, y));
+            cmd = rel ? 'l' : 'L'; // further pairs are implicit lineto
+        } else if (c == 'L' || c == 'H' || c == 'V') {
+            if (!nums(c == 'L' ? 2 : 1)) break;
+            if (cur.empty()) cur.push_back(svgMap(m, x, y));
+            if (c == 'L') { x = a[0] + ox; y = a[1] + oy; }
+            else if (c == 'H') x = a[0] + ox;
+            else y = a[0] + oy;
+            cur.push_back(svgMap(m, x, y));
+        } else if (c == 'C' || c == 'S') {
+            if (!nums(c == 'C' ? 6 : 4)) break;
+            if (cur.empty()) cur.push_back(svgMap(m, x, y));
+            float x1, y1;
+            if (c == 'C') { x1 = a[0] + ox; y1 = a[1] + oy; a[0] = a[2]; a[1] = a[3]; a[2] = a[4]; a[3] = a[5]; }
+            else if ((prev & ~0x20) == 'C' || (prev & ~0x20) == 'S') { x1 = 2 * x - cx; y1 = 2 * y - cy; }
+            else { x1 = x; y1 = y; }
+            cx = a[0] + ox; cy = a[1] + oy;
+            float x3 = a[2] + ox, y3 = a[3] + oy;
+            svgFlattenCubic(cur, svgMap(m, x, y), svgMap(m, x1, y1), svgMap(m, cx, cy), svgMap(m, x3, y3), im.tolerance);
+            x = x3; y = y3;
+            curved = true;
+        } else if (c == 'Q' || c == 'T') {
+            if (!nums(c == 'Q' ? 4 : 2)) break;
+            if (cur.empty()) cur.push_back(svgMap(m, x, y));
+            if (c == 'Q') { cx = a[0] + ox; cy = a[1] + oy; a[0] = a[2]; a[1] = a[3]; }
+            else if ((prev & ~0x20) == 'Q' || (prev & ~0x20) == 'T') { cx = 2 * x - cx; cy = 2 * y - cy; }
+            else { cx = x; cy = y; }
+            float x2 = a[0] + ox, y2 = a[1] + oy;
+            svgFlattenQuad(cur, svgMap(m, x, y), svgMap(m, cx, cy), svgMap(m, x2, y2), im.tolerance);
+            x = x2; y = y2;
+            curved = true;
+        } else if (c == 'A') {
+            bool large = false, sweep = false;
+            if (!nums(3) || !svgNextFlag(p, e, large) || !svgNextFlag(p, e, sweep) || !svgNextNumber(p, e, a[5]) || !svgNextNumber(p, e, a[6])) break;
+            if (cur.empty()) cur.push_back(svgMap(m, x, y));
+            float x2 = a[5] + ox, y2 = a[6] + oy;
+            svgFlattenArc(cur, m, x, y, a[0], a[1], a[2], large, sweep, x2, y2, im.tolerance);
+            x = x2; y = y2;
+            curved = true;
+        } else {
+            break; // unknown command: keep what was read
+        }
+        prev = cmd;
+    }
+    flush(false);
+}
 
-    bool initedVideoHere = false;
-    if (SDL_WasInit(SDL_INIT_VIDEO) == 0) {
-    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
-        std::cerr << "SDL could not initialize! SDL_Error: " << SDL_GetError() << "\n";
+static void svgPointList(std::string_view v, const Affine2D& m, Path& out) {
+    const char* p = v.data();
+    const char* e = p + v.size();
+    float x, y;
+    while (svgNextNumber(p, e, x) && svgNextNumber(p, e, y)) out.push_back(svgMap(m, x, y));
+}
+
+static void svgEllipse(SvgImport& im, const Affine2D& m, float cx, float cy, float rx, float ry) {
+    if (rx <= 0 || ry <= 0) { ++im.skipped; return; }
+    bool similar = rx == ry && std::abs(m.a - m.d) < 1e-6f && std::abs(m.b + m.c) < 1e-6f;
+    if (similar) {
+        Point c = svgMap(m, cx, cy);
+        float r = rx * std::hypot(m.a, m.c);
+        svgEmit(im, Path{ Point{ c.x - r, c.y }, Point{ c.x + r, c.y } }, ShapeType::Circle);
         return;
     }
-        initedVideoHere = true;
+    Path p{ svgMap(m, cx + rx, cy) };
+    svgFlattenArc(p, m, cx + rx, cy, rx, ry, 0, false, true, cx - rx, cy, im.tolerance);
+    svgFlattenArc(p, m, cx - rx, cy, rx, ry, 0, false, true, cx + rx, cy, im.tolerance);
+    svgEmit(im, std::move(p), ShapeType::Line);
+}
+
+static std::string_view svgAttr(const SvgAttrs& attrs, std::string_view name) {
+    for (const auto& kv : attrs) if (kv.first == name) return kv.second;
+    return std::string_view();
+}
+
+static void svgElement(SvgImport& im, std::string_view name, const SvgAttrs& attrs, const SvgStyle& s) {
+    bool stroke = s.hasStroke;
+    if (!stroke && !s.hasFill) { ++im.skipped; return; }
+    SDL_Color c = stroke ? s.stroke : s.fill;
+    float alpha = s.opacity * (stroke ? s.strokeOpacity : s.fillOpacity);
+    c.a = (Uint8)std::lround(std::max(0.0f, std::min(1.0f, alpha)) * 255.0f);
+    im.color = c;
+    auto num = [&](const char* a) { return svgLength(svgAttr(attrs, a)); };
+    const Affine2D& m = s.m;
+    if (name == "path") {
+        svgPathData(im, m, svgAttr(attrs, "d"));
+    } else if (name == "line") {
+        svgEmit(im, Path{ svgMap(m, num("x1"), num("y1")), svgMap(m, num("x2"), num("y2")) }, ShapeType::Line);
+    } else if (name == "polyline" || name == "polygon") {
+        Path p;
+        svgPointList(svgAttr(attrs, "points"), m, p);
+        svgEmitPolygon(im, std::move(p), name == "polygon", false);
+    } else if (name == "rect") {
+        float x = num("x"), y = num("y"), w = num("width"), h = num("height");
+        if (w <= 0 || h <= 0) { ++im.skipped; return; }
+        svgEmit(im, Path{ svgMap(m, x, y), svgMap(m, x + w, y), svgMap(m, x + w, y + h), svgMap(m, x, y + h) }, ShapeType::Quadrilateral);
+    } else if (name == "circle") {
+        svgEllipse(im, m, num("cx"), num("cy"), num("r"), num("r"));
+    } else if (name == "ellipse") {
+        svgEllipse(im, m, num("cx"), num("cy"), num("rx"), num("ry"));
     }
-    bool initedImgHere = false;
-    if (!(IMG_Init(IMG_INIT_PNG) & IMG_INIT_PNG)) {
-    if (!(IMG_Init(IMG_INIT_PNG) & IMG_INIT_PNG)) {
-        std::cerr << "SDL_image could not initialize! SDL_image Error: " << IMG_GetError() << "\n";
-            if (initedVideoHere) SDL_Quit();
-        return;
+}
+
+static bool importSvg(const std::string& file, const std::string& basePath, float tolerance, std::ostream& out) {
+    Uint32 startTicks = SDL_GetTicks();
+    std::ifstream in(file, std::ios::binary);
+    if (!in) { out << "Cannot open " << file << "\n"; return false; }
+    Scene scene = loadScene(basePath);
+    SceneLayer& layer = scene.trunks;
+    layer.colors.resize(layer.paths.size(), SDL_Color{255,255,255,255});
+    layer.types.resize(layer.paths.size(), ShapeType::Line);
+    SvgImport im{ layer };
+    im.tolerance = std::max(0.01f, tolerance);
+
+    std::vector<SvgStyle> styles(1);
+    int skipDepth = 0; // inside <defs> and other non-drawing containers
+    SvgAttrs attrs;
+    std::string buf;
+    size_t pos = 0, scan = 0; // scan: how far the open tag has been searched for its end
+    char quote = 0;
+    Uint64 bytes = 0;
+    bool eof = false;
+    for (;;) {
+        if (pos >= buf.size() || (scan && scan >= buf.size())) {
+            if (eof) break;
+            buf.erase(0, pos);
+            if (scan) scan -= pos;
+            pos = 0;
+            size_t have = buf.size();
+            buf.resize(have + kSvgReadChunk);
+            in.read(&buf[have], (std::streamsize)kSvgReadChunk);
+            size_t got = (size_t)in.gcount();
+            buf.resize(have + got);
+            bytes += got;
+            if (!got) eof = true;
+            continue;
+        }
+        if (!scan) {
+            size_t lt = buf.find('<', pos);
+            if (lt == std::string::npos) { pos = buf.size(); continue; }
+            pos = lt;
+            scan = lt + 1;
+            quote = 0;
+        }
+        // Find the end of the construct starting at pos.
+        size_t end = std::string::npos;
+        const char* b = buf.data();
+        if (buf.size() - pos < 9 && !eof) { scan = buf.size(); continue; } // need enough to spot <!-- or <![CDATA[
+        bool comment = buf.compare(pos, 4, "<!--") == 0;
+        if (comment || buf.compare(pos, 9, "<![CDATA[") == 0) {
+            size_t from = std::max(scan, pos + (comment ? 4 : 9));
+            size_t f = buf.find(comment ? "-->" : "]]>", from > pos + 11 ? from - 2 : from);
+            if (f != std::string::npos) end = f + 2;
+        } else {
+            for (size_t i = scan; i < buf.size(); ++i) {
+                char ch = b[i];
+                if (quote) { if (ch == quote) quote = 0; }
+                else if (ch == '"' || ch == '\'') quote = ch;
+                else if (ch == '>') { end = i; break; }
+            }
+        }
+        if (end == std::string::npos) { scan = buf.size(); continue; }
+        std::string_view tag(b + pos + 1, end - pos - 1);
+        pos = end + 1;
+        scan = 0;
+        if (tag.empty() || tag[0] == '!' || tag[0] == '?') continue;
+
+        bool closing = tag[0] == '/';
+        bool selfClosing = tag.back() == '/';
+        if (closing) tag.remove_prefix(1);
+        if (selfClosing) tag.remove_suffix(1);
+        size_t n = 0;
+        while (n < tag.size() && !std::isspace((unsigned char)tag[n])) ++n;
+        std::string_view name = tag.substr(0, n);
+        if (size_t colon = name.find(':'); colon != std::string_view::npos) name.remove_prefix(colon + 1);
+        if (closing) {
+            if (skipDepth) --skipDepth;
+            else if (styles.size() > 1) styles.pop_back();
+            continue;
+        }
+        if (skipDepth) { if (!selfClosing) ++skipDepth; continue; }
+        static const char* const hidden[] = { "defs", "symbol", "clipPath", "mask", "pattern", "marker", "linearGradient",
+                                              "radialGradient", "filter", "style", "script", "title", "desc", "metadata", "text" };
+        if (std::any_of(std::begin(hidden), std::end(hidden), [&](const char* h) { return name == h; })) {
+            if (!selfClosing) ++skipDepth;
+            continue;
         }
-        initedImgHere = true;
+
+        attrs.clear();
+        for (size_t i = n; i < tag.size(); ) {
+            while (i < tag.size() && std::isspace((unsigned char)tag[i])) ++i;
+            size_t k = i;
+            while (i < tag.size() && tag[i] != '=' && !std::isspace((unsigned char)tag[i])) ++i;
+            std::string_view key = tag.substr(k, i - k);
+            while (i < tag.size() && std::isspace((unsigned char)tag[i])) ++i;
+            if (i >= tag.size() || tag[i] != '=') { if (key.empty()) ++i; continue; }
+            ++i;
+            while (i < tag.size() && std::isspace((unsigned char)tag[i])) ++i;
+            if (i >= tag.size() || (tag[i] != '"' && tag[i] != '\'')) continue;
+            char q = tag[i++];
+            size_t v = i;
+            while (i < tag.size() && tag[i] != q) ++i;
+            attrs.emplace_back(key, tag.substr(v, i - v));
+            ++i;
+        }
+        SvgStyle s = styles.back();
+        svgStyleAttrs(attrs, s);
+        svgElement(im, name, attrs, s);
+        if (!selfClosing) styles.push_back(s);
     }
-    SDL_Window* window = SDL_CreateWindow("Atelier Editor",
-        SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-        800, 600, SDL_WINDOW_SHOWN);
-    if (!window) {
-        std::cerr << "Window could not be created! SDL_Error: " << SDL_GetError() << "\n";
-        IMG_Quit();
-        SDL_Quit();
-        return;
+
+    if (!saveScene(basePath, scene)) { out << "Cannot write scene " << basePath << "\n"; return false; }
+    out << "Imported " << im.shapes << " shapes (" << im.points << " points) from " << bytes << " bytes of " << file
+        << " in " << (SDL_GetTicks() - startTicks) << " ms";
+    if (im.skipped) out << "; skipped " << im.skipped << " empty or invisible";
+    out << "\n";
+    return true;
+}
+
+// Batch scripts: one command per line or separated by ';'; lines starting with '#' are comments.
+//   select|add [foliage|trunks] [type=<line|circle|triangle|quadrilateral>]
+//              [color=#rrggbb[~tolerance]] [region=x,y,w,h]
+//   recolor #rrggbb[aa] | translate dx dy | rotate deg [cx cy] | scale s [cx cy] | delete
+//   generate forest <seed> <trees> [depth] [angle-deg] | render <file.png> [w h] | save | count
+// select replaces the selection and add extends it; with no filters select takes every
+// shape, which is also the selection before the first select. A region holds the shapes
+// whose points all lie inside it, as the editor's lasso. Rotate and scale pivot on the
+// selection's bounds center unless given one. generate selects what it grew. render
+// rasterizes the 800x600 view directly at w x h; relative paths land in the scene
+// directory and {scene} expands to its name. The script is parsed once, then each scene
+// runs it on its own worker; nothing is written unless the script says save.
+enum class BatchOpKind { Select, Add, Recolor, Translate, Rotate, Scale, Delete, Generate, Render, Save, Count };
+
+struct BatchFilter {
+    int layer = -1, type = -1; // -1: any
+    bool hasColor = false, hasRegion = false;
+    SDL_Color color{0, 0, 0, 255};
+    int colorTolerance = 0;
+    float x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+};
+
+struct BatchOp {
+    BatchOpKind kind = BatchOpKind::Count;
+    int line = 0;
+    BatchFilter filter;
+    SDL_Color color{0, 0, 0, 255};
+    float v[3] = { 0, 0, 0 };
+    bool pivot = false;
+    ForestParams forest;
+    std::string file;
+    int w = kServeWidth, h = kServeHeight;
+};
+
+static bool parseBatchFilter(const std::vector<std::string>& args, BatchFilter& f, std::string& err) {
+    for (size_t i = 1; i < args.size(); ++i) {
+        const std::string& a = args[i];
+        if (a == "foliage" || a == "trunks") f.layer = a == "trunks";
+        else if (a == "all") {}
+        else if (a.compare(0, 5, "type=") == 0) {
+            std::string t = a.substr(5);
+            if (t == "quad") t = "quadrilateral";
+            for (int k = 0; k < 4; ++k) if (t == shapeTypeName((ShapeType)k)) f.type = k;
+            if (f.type < 0) { err = "unknown shape type " + t; return false; }
+        } else if (a.compare(0, 6, "color=") == 0) {
+            std::string c = a.substr(6);
+            size_t tilde = c.find('~');
+            if (tilde != std::string::npos) { f.colorTolerance = std::max(0, std::atoi(c.c_str() + tilde + 1)); c.resize(tilde); }
+            if (!c.empty() && c[0] == '#') c.erase(0, 1);
+            if (!parseHexColor(c, f.color)) { err = "bad color " + a.substr(6); return false; }
+            f.hasColor = true;
+        } else if (a.compare(0, 7, "region=") == 0) {
+            float r[4];
+            if (std::sscanf(a.c_str() + 7, "%f,%f,%f,%f", &r[0], &r[1], &r[2], &r[3]) != 4 || r[2] < 0 || r[3] < 0) {
+                err = "region wants x,y,w,h"; return false;
+            }
+            f.hasRegion = true;
+            f.x0 = r[0]; f.y0 = r[1]; f.x1 = r[0] + r[2]; f.y1 = r[1] + r[3];
+        } else {
+            err = "unknown filter " + a; return false;
+        }
     }
-    SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
-    if (!renderer) {
-        std::cerr << "Renderer could not be created! SDL_Error: " << SDL_GetError() << "\n";
-        SDL_DestroyWindow(window);
-        IMG_Quit();
-        SDL_Quit();
-        return;
+    return true;
+}
+
+// Splits on newlines and on ';' outside quotes.
+static std::vector<std::string> splitBatchLines(const std::string& text) {
+    std::vector<std::string> lines(1);
+    bool quoted = false;
+    for (char c : text) {
+        if (c == '"') quoted = !quoted;
+        if (c == '\n' || (c == ';' && !quoted)) { lines.emplace_back(); if (c == '\n') quoted = false; continue; }
+        lines.back() += c;
     }
+    return lines;
+}
 
-    // Interaction state
-    bool running = true;
-    bool awaitingSecondPoint = false; // legacy; no longer used for placement
-    Point firstPoint {0, 0};
-    bool dragging = false;
-    bool draggingIsFoliage = true;
-    size_t draggingPathIndex = 0;
-    int draggingPointIndex = 0; // 0 or last for two-point paths
-    const float selectRadius2 = 12.0f * 12.0f;
+static bool parseBatchScript(const std::string& text, std::vector<BatchOp>& ops, std::ostream& out) {
+    std::vector<std::string> lines = splitBatchLines(text);
+    for (size_t n = 0; n < lines.size(); ++n) {
+        std::vector<std::string> a = splitCommandLine(lines[n]);
+        if (a.empty() || a[0][0] == '#') continue;
+        BatchOp op;
+        op.line = (int)n + 1;
+        std::string err;
+        const std::string& c = a[0];
+        auto argc = [&](size_t lo, size_t hi) {
+            if (a.size() >= lo && a.size() <= hi) return true;
+            err = c + " takes " + (lo == hi ? std::to_string(lo - 1) : std::to_string(lo - 1) + "-" + std::to_string(hi - 1)) + " arguments";
+            return false;
+        };
+        auto num = [&](size_t i) { return (float)std::atof(a[i].c_str()); };
+        bool ok = true;
+        if (c == "select" || c == "add") {
+            op.kind = c == "select" ? BatchOpKind::Select : BatchOpKind::Add;
+            ok = parseBatchFilter(a, op.filter, err);
+        } else if (c == "recolor") {
+            op.kind = BatchOpKind::Recolor;
+            std::string hex = a.size() > 1 && !a[1].empty() && a[1][0] == '#' ? a[1].substr(1) : a.size() > 1 ? a[1] : "";
+            ok = argc(2, 2) && (parseHexColor(hex, op.color) || (err = "bad color " + a[1], false));
+        } else if (c == "translate") {
+            op.kind = BatchOpKind::Translate;
+            if ((ok = argc(3, 3))) { op.v[0] = num(1); op.v[1] = num(2); }
+        } else if (c == "rotate" || c == "scale") {
+            op.kind = c == "rotate" ? BatchOpKind::Rotate : BatchOpKind::Scale;
+            ok = argc(2, 4) && (a.size() != 3 || (err = c + " wants both pivot coordinates", false));
+            if (ok) {
+                op.v[0] = num(1);
+                if (op.kind == BatchOpKind::Rotate) op.v[0] *= 3.14159265f / 180.0f;
+                else if (op.v[0] <= 0.0f) { ok = false; err = "scale must be positive"; }
+                if (a.size() == 4) { op.pivot = true; op.v[1] = num(2); op.v[2] = num(3); }
+            }
+        } else if (c == "delete" || c == "save" || c == "count") {
+            op.kind = c == "delete" ? BatchOpKind::Delete : c == "save" ? BatchOpKind::Save : BatchOpKind::Count;
+            ok = argc(1, 1);
+        } else if (c == "generate") {
+            op.kind = BatchOpKind::Generate;
+            ok = argc(4, 6) && (a[1] == "forest" || (err = "can only generate forest", false))
+                 && parseForestParams(a, 2, op.forest, err);
+        } else if (c == "render") {
+            op.kind = BatchOpKind::Render;
+            ok = argc(2, 4) && (a.size() != 3 || (err = "render wants both width and height", false));
+            if (ok) {
+                op.file = a[1];
+                if (a.size() == 4) { op.w = std::atoi(a[2].c_str()); op.h = std::atoi(a[3].c_str()); }
+                if (op.w <= 0 || op.h <= 0 || op.w > 16384 || op.h > 16384) { ok = false; err = "bad render size"; }
+            }
+        } else {
+            ok = false;
+            err = "unknown command " + c;
+        }
+        if (!ok) { out << "Line " << op.line << ": " << err << "\n"; return false; }
+        ops.push_back(op);
+    }
+    return true;
+}
 
-    auto redraw = [&]() {
-        SDL_SetRenderDrawColor(renderer, 8, 12, 18, 255);
-        SDL_RenderClear(renderer);
-        // header with close + pen
-        SDL_Rect closeRect, penRect; drawWindowHeaderWithControls(renderer, 800, closeRect, penRect);
-        // content
-        renderStaticSceneColored(renderer, foliage, foliageColors, foliageTypes, trunks, trunksColors, trunksTypes);
-        // color panel (if shown)
-        if (showColorPanel) {
-            SDL_Rect panel{800 - 220, 50, 200, 500};
-            drawDropShadow(renderer, panel, 12, 6, {0,0,0,60});
-            fillRoundedRect(renderer, panel, 12, {14, 22, 35, 230});
-            // small close button in panel header
-            SDL_Rect panelClose{ panel.x + panel.w - 24, panel.y + 8, 12, 12 };
-            drawFilledCircle(renderer, panelClose.x + 6, panelClose.y + 6, 6, {235,80,80,255});
-            // simple color wheel: rows of hues + alpha slider approximation
-            int cx = panel.x + panel.w/2; int cy = panel.y + 130; int rad = 80;
-            // wheel by sampling angle and radius bands
-            for (int rr = rad; rr >= rad-20; --rr) {
-                for (int a = 0; a < 360; ++a) {
-                    float t = a / 60.0f; int sector = (int)std::floor(t); float f = t - sector; float p = 0, q = 1 - f, s = f;
-                    float r=1,g=0,b=0;
-                    switch (sector % 6) {
-                        case 0: r=1; g=s; b=0; break;
-                        case 1: r=q; g=1; b=0; break;
-                        case 2: r=0; g=1; b=s; break;
-                        case 3: r=0; g=q; b=1; break;
-                        case 4: r=s; g=0; b=1; break;
-                        case 5: r=1; g=0; b=q; break;
+static bool batchMatches(const BatchFilter& f, const SceneLayer& l, size_t i) {
+    if (f.type >= 0 && (int)l.types[i] != f.type) return false;
+    if (f.hasColor) {
+        const SDL_Color& c = l.colors[i];
+        int d = std::max({ std::abs(c.r - f.color.r), std::abs(c.g - f.color.g), std::abs(c.b - f.color.b) });
+        if (d > f.colorTolerance) return false;
+    }
+    if (f.hasRegion) {
+        const Path& p = l.paths[i];
+        if (p.empty()) return false;
+        for (const Point& pt : p) {
+            if (pt.x < f.x0 || pt.y < f.y0 || pt.x > f.x1 || pt.y > f.y1) return false;
+        }
+    }
+    return true;
+}
+
+// Runs ops on one scene directory; messages go to out, prefixed with the scene.
+static bool runBatchScene(const std::vector<BatchOp>& ops, const std::string& dir, std::ostream& out) {
+    Uint32 startTicks = SDL_GetTicks();
+    Scene scene = loadScene(dir);
+    SceneLayer* layers[2] = { &scene.foliage, &scene.trunks };
+    std::vector<Uint8> sel[2];
+    for (int l = 0; l < 2; ++l) {
+        layers[l]->colors.resize(layers[l]->paths.size(), SDL_Color{255,255,255,255});
+        layers[l]->types.resize(layers[l]->paths.size(), ShapeType::Line);
+        sel[l].assign(layers[l]->paths.size(), 1); // no select yet: the whole scene
+    }
+    std::string name = std::filesystem::path(dir).filename().string();
+    // constraints renumber on delete and pull their other shapes along after a transform
+    ConstraintSet constraints;
+    ConstraintLayers constraintLayers{ { &scene.foliage.paths, &scene.trunks.paths }, { &scene.foliage.types, &scene.trunks.types } };
+    if (readConstraints(dir + "/constraints.txt", constraints)) dropUnfitConstraints(constraints, constraintLayers, out);
+    auto selected = [&]() {
+        size_t n = 0;
+        for (int l = 0; l < 2; ++l) n += (size_t)std::count(sel[l].begin(), sel[l].end(), 1);
+        return n;
+    };
+    auto transform = [&](const Affine2D& m) {
+        for (int l = 0; l < 2; ++l) {
+            for (size_t i = 0; i < sel[l].size(); ++i) {
+                if (!sel[l][i]) continue;
+                for (Point& pt : layers[l]->paths[i]) {
+                    float x = pt.x, y = pt.y;
+                    pt.x = m.a * x + m.b * y + m.tx;
+                    pt.y = m.c * x + m.d * y + m.ty;
+                }
+            }
+        }
+        std::vector<Uint64> keys;
+        constrainedVertices(constraints, constraintLayers, [&](int l, size_t i) { return sel[l][i] != 0; }, keys);
+        if (!keys.empty()) solveConstraints(constraints, constraintLayers, keys, keys, kConstraintSettleSweeps);
+    };
+    bool ok = true;
+    for (const BatchOp& op : ops) {
+        switch (op.kind) {
+        case BatchOpKind::Select:
+        case BatchOpKind::Add:
+            for (int l = 0; l < 2; ++l) {
+                bool layerOk = op.filter.layer < 0 || op.filter.layer == l;
+                for (size_t i = 0; i < sel[l].size(); ++i) {
+                    if (op.kind == BatchOpKind::Add && sel[l][i]) continue;
+                    sel[l][i] = layerOk && batchMatches(op.filter, *layers[l], i);
+                }
+            }
+            break;
+        case BatchOpKind::Recolor:
+            for (int l = 0; l < 2; ++l) {
+                for (size_t i = 0; i < sel[l].size(); ++i) if (sel[l][i]) layers[l]->colors[i] = op.color;
+            }
+            break;
+        case BatchOpKind::Translate: {
+            Affine2D m;
+            m.tx = op.v[0]; m.ty = op.v[1];
+            transform(m);
+            break;
+        }
+        case BatchOpKind::Rotate:
+        case BatchOpKind::Scale: {
+            float cx = op.v[1], cy = op.v[2];
+            if (!op.pivot) {
+                SDL_Rect b{0, 0, 0, 0};
+                bool any = false;
+                for (int l = 0; l < 2; ++l) {
+                    for (size_t i = 0; i < sel[l].size(); ++i) {
+                        if (!sel[l][i] || layers[l]->paths[i].empty()) continue;
+                        SDL_Rect r = shapeBounds(layers[l]->paths[i], layers[l]->types[i]);
+                        b = any ? unionRect(b, r) : r;
+                        any = true;
                     }
-                    int x = cx + (int)std::round(std::cos(a * 3.1415926f / 180.0f) * rr);
-                    int y = cy + (int)std::round(std::sin(a * 3.1415926f / 180.0f) * rr);
-                    SDL_SetRenderDrawColor(renderer, (Uint8)(r*255), (Uint8)(g*255), (Uint8)(b*255), 255);
-                    SDL_RenderDrawPoint(renderer, x, y);
                 }
+                cx = b.x + b.w * 0.5f; cy = b.y + b.h * 0.5f;
             }
-            // current color swatch
-            SDL_Rect sw{ panel.x + 20, panel.y + 260, panel.w - 40, 30 };
-            fillRoundedRect(renderer, sw, 6, currentDrawColor);
-            drawRectBorder(renderer, sw, 6, {255,255,255,100});
-            // shape selectors
-            TTF_Font* panelFont = tryLoadAnyFont(14);
-            auto drawShapeBtn = [&](const char* label, int y, bool active) {
-                SDL_Rect r{ panel.x + 20, y, panel.w - 40, 28 };
-                fillRoundedRect(renderer, r, 6, active ? SDL_Color{34, 62, 98, 240} : SDL_Color{24, 42, 68, 220});
-                renderText(renderer, panelFont, label, r.x + 10, r.y + 6, {236,242,252,255});
-                return r;
-            };
-            SDL_Rect btnLine = drawShapeBtn("Line", panel.y + 310, currentShape == ShapeType::Line);
-            SDL_Rect btnCircle = drawShapeBtn("Circle", panel.y + 344, currentShape == ShapeType::Circle);
-            SDL_Rect btnTriangle = drawShapeBtn("Triangle", panel.y + 378, currentShape == ShapeType::Triangle);
-            SDL_Rect btnQuad = drawShapeBtn("Quadrilateral", panel.y + 412, currentShape == ShapeType::Quadrilateral);
-            if (panelFont) TTF_CloseFont(panelFont);
+            bool rotate = op.kind == BatchOpKind::Rotate;
+            transform(affineAbout(cx, cy, rotate ? op.v[0] : 0.0f, rotate ? 1.0f : op.v[0], 0.0f, 0.0f));
+            break;
+        }
+        case BatchOpKind::Delete: {
+            size_t removed = 0;
+            for (int l = 0; l < 2; ++l) {
+                SceneLayer& L = *layers[l];
+                size_t k = 0;
+                for (size_t i = 0; i < L.paths.size(); ++i) {
+                    if (sel[l][i]) continue;
+                    if (k != i) { L.paths[k] = std::move(L.paths[i]); L.colors[k] = L.colors[i]; L.types[k] = L.types[i]; }
+                    ++k;
+                }
+                removed += L.paths.size() - k;
+                L.paths.resize(k); L.colors.resize(k); L.types.resize(k);
+                eraseConstraintShapes(constraints, l, std::vector<char>(sel[l].begin(), sel[l].end()));
+                sel[l].assign(k, 0);
+            }
+            out << name << ": deleted " << removed << " shapes\n";
+            break;
+        }
+        case BatchOpKind::Generate: {
+            size_t before[2] = { scene.foliage.paths.size(), scene.trunks.paths.size() };
+            size_t trunk = 0, foliage = 0;
+            generateForest(scene, op.forest, trunk, foliage);
+            for (int l = 0; l < 2; ++l) {
+                sel[l].assign(layers[l]->paths.size(), 0);
+                std::fill(sel[l].begin() + before[l], sel[l].end(), 1);
+            }
+            out << name << ": generated " << trunk << " trunk and " << foliage << " foliage shapes\n";
+            break;
+        }
+        case BatchOpKind::Render: {
+            std::string file = op.file;
+            for (size_t at; (at = file.find("{scene}")) != std::string::npos; ) file.replace(at, 7, name);
+            if (std::filesystem::path(file).is_relative()) file = dir + "/" + file;
+            Canvas cv = makeCanvas(op.w, op.h, SDL_Color{8, 12, 18, 255});
+            canvasScene(cv, scene);
+            std::string png;
+            bool encoded = encodePng(cv, png);
+            std::ofstream f(file, std::ios::binary);
+            if (!encoded || !f.write(png.data(), (std::streamsize)png.size())) {
+                out << name << ": line " << op.line << ": cannot write " << file << "\n";
+                ok = false;
+            }
+            break;
+        }
+        case BatchOpKind::Save:
+            if (!saveScene(dir, scene)) { out << name << ": line " << op.line << ": cannot write scene\n"; ok = false; }
+            else if (constraints.edited && !writeConstraints(dir + "/constraints.txt", constraints)) { out << name << ": cannot write constraints\n"; ok = false; }
+            else constraints.edited = false;
+            break;
+        case BatchOpKind::Count:
+            out << name << ": " << selected() << " shapes selected\n";
+            break;
+        }
+        if (!ok) break;
+    }
+    out << name << ": " << (ok ? "done" : "stopped") << " in " << (SDL_GetTicks() - startTicks) << " ms\n";
+    return ok;
+}
 
-            // store for hit testing via static variables captured by redraw scope
-            // we can't store state from redraw alone; handled in event section
+// '*' and '?' wildcards, with backtracking to the last '*'.
+static bool wildcardMatch(const char* pat, const char* s) {
+    const char* star = nullptr;
+    const char* resume = nullptr;
+    while (*s) {
+        if (*pat == '*') { star = pat++; resume = s; }
+        else if (*pat == '?' || *pat == *s) { ++pat; ++s; }
+        else if (star) { pat = star + 1; s = ++resume; }
+        else return false;
+    }
+    while (*pat == '*') ++pat;
+    return !*pat;
+}
+
+// Scene directories named by a target: a scene, a directory of scenes (searched
+// recursively), or a pattern with * and ? in any path component.
+static void expandBatchTarget(const std::string& target, std::vector<std::string>& dirs) {
+    std::error_code ec;
+    if (target.find_first_of("*?") == std::string::npos) {
+        if (!std::filesystem::is_directory(target, ec)) return;
+        if (isSceneDir(target)) { dirs.push_back(target); return; }
+        for (std::filesystem::recursive_directory_iterator it(target, ec), end; !ec && it != end; it.increment(ec)) {
+            std::string name = it->path().filename().string();
+            if (!name.empty() && name[0] == '.') { if (it->is_directory(ec)) it.disable_recursion_pending(); continue; }
+            if (it->is_directory(ec) && isSceneDir(it->path().string())) { dirs.push_back(it->path().string()); it.disable_recursion_pending(); }
         }
-        // Indicate placement in progress: show last placed point
-        if (placementCollected > 0 && !placementPoints.empty()) {
-            Point lp = placementPoints.back();
-            drawFilledCircle(renderer, lp.x, lp.y, 4, {255, 255, 255, 200});
+        return;
+    }
+    std::vector<std::string> parts, matches{ target[0] == '/' ? "/" : "" };
+    std::stringstream ss(target);
+    for (std::string p; std::getline(ss, p, '/'); ) if (!p.empty()) parts.push_back(p);
+    for (const std::string& part : parts) {
+        std::vector<std::string> next;
+        for (const std::string& m : matches) {
+            std::string prefix = m.empty() ? "" : m == "/" ? "/" : m + "/";
+            if (part.find_first_of("*?") == std::string::npos) { next.push_back(prefix + part); continue; }
+            for (std::filesystem::directory_iterator it(m.empty() ? "." : m, ec), end; !ec && it != end; it.increment(ec)) {
+                std::string name = it->path().filename().string();
+                if ((name[0] != '.' || part[0] == '.') && wildcardMatch(part.c_str(), name.c_str())) next.push_back(prefix + name);
+            }
+        }
+        std::sort(next.begin(), next.end());
+        matches.swap(next);
+    }
+    for (const std::string& m : matches) expandBatchTarget(m, dirs);
+}
+
+// Runs a batch script (a file, or the script text itself) over every target scene.
+static bool runBatch(const std::string& script, const std::vector<std::string>& targets, std::ostream& out) {
+    std::string text;
+    std::error_code ec;
+    if (std::filesystem::is_regular_file(script, ec)) {
+        if (!readWholeFile(script, text)) { out << "Cannot read " << script << "\n"; return false; }
+    } else {
+        text = script;
+    }
+    std::vector<BatchOp> ops;
+    if (!parseBatchScript(text, ops, out)) return false;
+    if (ops.empty()) { out << "Empty script\n"; return false; }
+
+    std::vector<std::string> dirs;
+    for (const std::string& t : targets) expandBatchTarget(t, dirs);
+    std::sort(dirs.begin(), dirs.end());
+    dirs.erase(std::unique(dirs.begin(), dirs.end()), dirs.end());
+    if (dirs.empty()) { out << "No scenes match\n"; return false; }
+
+    Uint32 startTicks = SDL_GetTicks();
+    std::vector<std::string> logs(dirs.size());
+    std::vector<Uint8> results(dirs.size());
+    parallelFor(dirs.size(), [&](size_t i) {
+        std::ostringstream log;
+        results[i] = runBatchScene(ops, dirs[i], log);
+        logs[i] = log.str();
+    });
+    size_t failed = 0;
+    for (size_t i = 0; i < dirs.size(); ++i) { out << logs[i]; failed += !results[i]; }
+    out << "Ran " << ops.size() << " commands over " << dirs.size() << " scenes in " << (SDL_GetTicks() - startTicks) << " ms";
+    if (failed) out << "; " << failed << " failed";
+    out << "\n";
+    return failed == 0;
+}
+
+// Art index: <root>/.atelier-index describes every studio, gallery and image under the
+// root, so find answers from the index instead of a walk over description.txt files.
+//   "ATIX" version | entries | terms | postings | descriptions |
+//   u64 terms offset, u64 postings offset, u64 descriptions offset, "ATIX"
+// entries (varints): count, then {path, kind, stamp, mtime (zigzag), shape counts by
+// type, bounds x y w h (zigzag), colors {rgb, permille}, description size}
+// terms (varints): count, then {word, posting count, postings size}
+// Entries are sorted by path and terms by word; the postings (delta-coded entry ids) and
+// descriptions follow in that order. Words come from each entry's path and description.
+// find reads only entries and terms, without copying their strings, then the postings of
+// the words it asks for, and the descriptions only to check phrases. index walks the
+// tree once and re-reads only directories whose files' names, sizes and mtimes hash to a
+// different stamp than stored; other entries are copied over. Shape statistics cover the
+// two layers, not symbol instances.
+static const char kIndexMagic[4] = { 'A', 'T', 'I', 'X' };
+static const char* const kIndexFile = ".atelier-index";
+static constexpr int kIndexColors = 4;          // dominant colors kept per image
+static constexpr Uint32 kIndexColorShare = 100; // permille of shapes a color needs for color~
+
+enum class ArtKind { Studio, Gallery, Image };
+static const char* const kArtKindNames[] = { "studio", "gallery", "image" };
+
+struct ArtColor { Uint32 rgb, share; }; // share in permille of the image's shapes
+
+// Strings are views into the index file's buffers, or into the refresh building it.
+struct ArtEntry {
+    std::string_view path; // relative to the root, '/'-separated
+    ArtKind kind = ArtKind::Image;
+    Uint64 stamp = 0;
+    long long mtime = 0; // newest file, seconds since the Unix epoch
+    Uint64 counts[4] = {}; // by ShapeType
+    SDL_Rect bounds{0, 0, 0, 0};
+    ArtColor colors[kIndexColors] = {};
+    int colorCount = 0;
+    std::string_view description; // empty until loadArtDescriptions when read from a file
+    Uint64 descriptionSize = 0;
+};
+
+struct ArtTerm { std::string_view word; size_t count = 0; Uint64 offset = 0, size = 0; };
+
+struct ArtIndex {
+    std::string file, head, text; // head holds entries and terms, text the descriptions
+    std::vector<ArtEntry> entries;
+    std::vector<ArtTerm> terms;
+    Uint64 descriptionsAt = 0;
+    bool descriptions = false;
+};
+
+// Words are runs of letters, digits and UTF-8 bytes; the index keeps them lowercased.
+static void artSpans(std::string_view text, std::vector<std::string_view>& spans) {
+    size_t start = 0;
+    for (size_t i = 0; i <= text.size(); ++i) {
+        unsigned char c = i < text.size() ? (unsigned char)text[i] : ' ';
+        if (std::isalnum(c) || c >= 0x80) continue;
+        if (i > start) spans.push_back(text.substr(start, i - start));
+        start = i + 1;
+    }
+}
+
+static void artWords(std::string_view text, std::vector<std::string>& words) {
+    std::vector<std::string_view> spans;
+    artSpans(text, spans);
+    for (std::string_view s : spans) {
+        std::string w(s);
+        for (char& c : w) c = (char)std::tolower((unsigned char)c);
+        words.push_back(std::move(w));
+    }
+}
+
+static std::string encodeArtIndex(const std::vector<ArtEntry>& entries) {
+    std::string out(kIndexMagic, 4), postings, text;
+    out += (char)1;
+    putVarint(out, entries.size());
+    std::map<std::string, std::vector<Uint32>> ids;
+    std::vector<std::string> words;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const ArtEntry& e = entries[i];
+        putVarint(out, e.path.size());
+        out += e.path;
+        putVarint(out, (Uint64)e.kind);
+        putVarint(out, e.stamp);
+        putVarint(out, zigzag(e.mtime));
+        for (Uint64 c : e.counts) putVarint(out, c);
+        for (int v : { e.bounds.x, e.bounds.y, e.bounds.w, e.bounds.h }) putVarint(out, zigzag(v));
+        putVarint(out, e.colorCount);
+        for (int k = 0; k < e.colorCount; ++k) { putVarint(out, e.colors[k].rgb); putVarint(out, e.colors[k].share); }
+        putVarint(out, e.description.size());
+        text += e.description;
+        words.clear();
+        artWords(e.path, words);
+        artWords(e.description, words);
+        for (const std::string& w : words) {
+            std::vector<Uint32>& p = ids[w];
+            if (p.empty() || p.back() != i) p.push_back((Uint32)i);
         }
-        SDL_RenderPresent(renderer);
+    }
+    Uint64 termsAt = out.size();
+    putVarint(out, ids.size());
+    for (const auto& t : ids) {
+        putVarint(out, t.first.size());
+        out += t.first;
+        size_t start = postings.size();
+        Uint32 prev = 0;
+        for (Uint32 id : t.second) { putVarint(postings, id - prev); prev = id; }
+        putVarint(out, t.second.size());
+        putVarint(out, postings.size() - start);
+    }
+    Uint64 postingsAt = out.size();
+    out += postings;
+    Uint64 descriptionsAt = out.size();
+    out += text;
+    putU64(out, termsAt);
+    putU64(out, postingsAt);
+    putU64(out, descriptionsAt);
+    out.append(kIndexMagic, 4);
+    return out;
+}
+
+// Reads entries and terms; postings and descriptions stay on disk until asked for.
+static bool readArtIndex(const std::string& file, ArtIndex& idx) {
+    std::ifstream in(file, std::ios::binary);
+    unsigned char foot[28];
+    in.seekg(0, std::ios::end);
+    Uint64 size = in ? (Uint64)in.tellg() : 0;
+    if (size < 5 + sizeof(foot)) return false;
+    in.seekg(-(std::streamoff)sizeof(foot), std::ios::end);
+    if (!in.read((char*)foot, sizeof(foot)) || std::memcmp(foot + 24, kIndexMagic, 4) != 0) return false;
+    Uint64 termsAt = getU64(foot), postingsAt = getU64(foot + 8), descriptionsAt = getU64(foot + 16);
+    if (termsAt < 5 || termsAt > postingsAt || postingsAt > descriptionsAt || descriptionsAt > size - sizeof(foot)) return false;
+    idx.head.assign((size_t)postingsAt, '\0');
+    in.seekg(0, std::ios::beg);
+    if (!in.read(&idx.head[0], (std::streamsize)postingsAt) || std::memcmp(idx.head.data(), kIndexMagic, 4) != 0 || idx.head[4] != 1) return false;
+
+    const unsigned char* p = (const unsigned char*)idx.head.data();
+    VarintReader r{ p + 5, p + termsAt };
+    auto count = [&]() { Uint64 n = r.next(); return r.ok && n <= r.left() ? (size_t)n : (r.ok = false, (size_t)0); };
+    auto text = [&]() {
+        size_t len = count();
+        std::string_view s((const char*)r.p, len);
+        r.p += len;
+        return s;
     };
+    Uint64 descriptions = 0;
+    idx.entries.resize(count());
+    for (ArtEntry& e : idx.entries) {
+        e.path = text();
+        Uint64 kind = r.next();
+        e.kind = kind <= 2 ? (ArtKind)kind : (r.ok = false, ArtKind::Image);
+        e.stamp = r.next();
+        e.mtime = unzigzag(r.next());
+        for (Uint64& c : e.counts) c = r.next();
+        for (int* v : { &e.bounds.x, &e.bounds.y, &e.bounds.w, &e.bounds.h }) *v = (int)unzigzag(r.next());
+        Uint64 colors = r.next();
+        e.colorCount = (int)std::min<Uint64>(colors, kIndexColors);
+        if (colors > (Uint64)kIndexColors) r.ok = false;
+        for (int k = 0; k < e.colorCount; ++k) { e.colors[k].rgb = (Uint32)r.next(); e.colors[k].share = (Uint32)r.next(); }
+        e.descriptionSize = r.next();
+        descriptions += e.descriptionSize;
+        if (!r.ok) return false;
+    }
+    if (descriptions != size - sizeof(foot) - descriptionsAt) return false;
+    r = VarintReader{ p + termsAt, p + postingsAt };
+    Uint64 postings = postingsAt;
+    idx.terms.resize(count());
+    for (ArtTerm& t : idx.terms) {
+        t.word = text();
+        Uint64 n = r.next();
+        t.size = r.next();
+        if (n > t.size) return false; // every posting takes at least one byte
+        t.count = (size_t)n;
+        t.offset = postings;
+        postings += t.size;
+        if (!r.ok || postings > descriptionsAt) return false;
+    }
+    idx.file = file;
+    idx.descriptionsAt = descriptionsAt;
+    idx.descriptions = false;
+    return r.ok;
+}
 
-    redraw();
+static bool loadArtDescriptions(ArtIndex& idx) {
+    if (idx.descriptions) return true;
+    Uint64 total = 0;
+    for (const ArtEntry& e : idx.entries) total += e.descriptionSize;
+    if (total && !readFileRange(idx.file, idx.descriptionsAt, total, idx.text)) return false;
+    size_t at = 0;
+    for (ArtEntry& e : idx.entries) {
+        e.description = std::string_view(idx.text).substr(at, (size_t)e.descriptionSize);
+        at += (size_t)e.descriptionSize;
+    }
+    idx.descriptions = true;
+    return true;
+}
 
-    while (running) {
-        SDL_Event e;
-        while (SDL_PollEvent(&e)) {
-            if (e.type == SDL_QUIT) {
-                running = false;
-            } else if (e.type == SDL_KEYDOWN) {
-                bool shiftHeld = (SDL_GetModState() & KMOD_SHIFT) != 0;
-                if (e.key.keysym.sym == SDLK_ESCAPE) {
-                    // Cancel current interaction
-                    awaitingSecondPoint = false;
-                    dragging = false;
-                    redraw();
-                } else if (shiftHeld && (e.key.keysym.sym == SDLK_d)) {
-                    exitCliAfterSDL = true;
-                }
-            } else if (e.type == SDL_MOUSEBUTTONDOWN && e.button.button == SDL_BUTTON_LEFT) {
-                int mx = e.button.x;
-                int my = e.button.y;
-                // header controls hit test (top-right)
-                SDL_Rect closeRect, penRect; drawWindowHeaderWithControls(renderer, 800, closeRect, penRect);
-                if (mx >= closeRect.x && mx < closeRect.x + closeRect.w && my >= closeRect.y && my < closeRect.y + closeRect.h) {
-                    running = false;
-                    break;
-                }
-                if (mx >= penRect.x && mx < penRect.x + penRect.w && my >= penRect.y && my < penRect.y + penRect.h) {
-                    showColorPanel = !showColorPanel;
-                    redraw();
-                    continue;
-                }
-                if (showColorPanel) {
-                    SDL_Rect panel{800 - 220, 50, 200, 500};
-                    SDL_Rect panelClose{ panel.x + panel.w - 24, panel.y + 8, 12, 12 };
-                    int pcx = panelClose.x + 6, pcy = panelClose.y + 6;
-                    // close color panel
-                    int dx = mx - pcx, dy = my - pcy; if (dx*dx + dy*dy <= 6*6) { showColorPanel = false; redraw(); continue; }
-                    // pick color from wheel edge bands
-                    int cx = panel.x + panel.w/2; int cy = panel.y + 130; int rad = 80;
-                    int dxw = mx - cx, dyw = my - cy; float dist = std::sqrt((float)(dxw*dxw + dyw*dyw));
-                    if (dist <= rad && dist >= rad-20) {
-                        float ang = std::atan2((float)dyw, (float)dxw); if (ang < 0) ang += 2.0f * 3.1415926f;
-                        float deg = ang * 180.0f / 3.1415926f; float t = deg / 60.0f; int sector = (int)std::floor(t); float f = t - sector; float q = 1 - f, s = f;
-                        float rr=1, gg=0, bb=0;
-                        switch (sector % 6) {
-                            case 0: rr=1; gg=s; bb=0; break;
-                            case 1: rr=q; gg=1; bb=0; break;
-                            case 2: rr=0; gg=1; bb=s; break;
-                            case 3: rr=0; gg=q; bb=1; break;
-                            case 4: rr=s; gg=0; bb=1; break;
-                            case 5: rr=1; gg=0; bb=q; break;
-                        }
-                        currentDrawColor = SDL_Color{ (Uint8)(rr*255), (Uint8)(gg*255), (Uint8)(bb*255), 255 };
-                        redraw();
-                        continue;
-                    }
-                    // shape selection hit test
-                    auto inside = [&](SDL_Rect r){ return mx >= r.x && mx < r.x + r.w && my >= r.y && my < r.y + r.h; };
-                    SDL_Rect btnLine{ panel.x + 20, panel.y + 310, panel.w - 40, 28 };
-                    SDL_Rect btnCircle{ panel.x + 20, panel.y + 344, panel.w - 40, 28 };
-                    SDL_Rect btnTriangle{ panel.x + 20, panel.y + 378, panel.w - 40, 28 };
-                    SDL_Rect btnQuad{ panel.x + 20, panel.y + 412, panel.w - 40, 28 };
-                    if (inside(btnLine)) { currentShape = ShapeType::Line; placementPoints.clear(); placementCollected = 0; placementNeededPoints = 0; redraw(); continue; }
-                    if (inside(btnCircle)) { currentShape = ShapeType::Circle; placementPoints.clear(); placementCollected = 0; placementNeededPoints = 0; redraw(); continue; }
-                    if (inside(btnTriangle)) { currentShape = ShapeType::Triangle; placementPoints.clear(); placementCollected = 0; placementNeededPoints = 0; redraw(); continue; }
-                    if (inside(btnQuad)) { currentShape = ShapeType::Quadrilateral; placementPoints.clear(); placementCollected = 0; placementNeededPoints = 0; redraw(); continue; }
-                }
-                bool shiftHeld = (SDL_GetModState() & KMOD_SHIFT) != 0;
-                bool ctrlHeld  = (SDL_GetModState() & KMOD_CTRL)  != 0;
+// Entry ids of one term, ascending.
+static std::vector<Uint32> artPostings(const ArtIndex& idx, const ArtTerm& t) {
+    std::string data;
+    std::vector<Uint32> ids;
+    if (!readFileRange(idx.file, t.offset, t.size, data)) return ids;
+    VarintReader in{ (const unsigned char*)data.data(), (const unsigned char*)data.data() + data.size() };
+    ids.reserve(t.count);
+    Uint64 id = 0;
+    for (size_t k = 0; k < t.count; ++k) {
+        id += in.next();
+        if (!in.ok || id >= idx.entries.size()) break;
+        ids.push_back((Uint32)id);
+    }
+    return ids;
+}
 
-                // Ctrl+Shift+Click: delete nearest shape (line/circle/polygon)
-                if (ctrlHeld && shiftHeld) {
-                    const float tolerance2 = 14.0f * 14.0f; // clickable radius
-                    float bestMetric = 1e12f;
-                    bool bestIsFoliage = true;
-                    size_t bestIndex = (size_t)-1;
-                    auto scoreLine = [&](const Path& p){ return distancePointToSegmentSquared(mx, my, p[0].x, p[0].y, p[1].x, p[1].y); };
-                    auto scoreCircle = [&](const Path& p){
-                        int cx = (p[0].x + p[1].x)/2; int cy = (p[0].y + p[1].y)/2;
-                        float R = std::sqrt((float)((p[0].x-p[1].x)*(p[0].x-p[1].x) + (p[0].y-p[1].y)*(p[0].y-p[1].y))) / 2.0f;
-                        float d = std::sqrt((float)((mx-cx)*(mx-cx) + (my-cy)*(my-cy)));
-                        float diff = std::fabs(d - R);
-                        return diff*diff;
-                    };
-                    auto scorePoly = [&](const Path& p){
-                        float best = 1e12f;
-                        for (size_t i = 1; i < p.size(); ++i) {
-                            best = std::min(best, distancePointToSegmentSquared(mx, my, p[i-1].x, p[i-1].y, p[i].x, p[i].y));
-                        }
-                        best = std::min(best, distancePointToSegmentSquared(mx, my, p.back().x, p.back().y, p.front().x, p.front().y));
-                        return best;
-                    };
-                    auto consider = [&](const std::vector<Path>& vec, const std::vector<ShapeType>& types, bool isFoliage){
-                        for (size_t i = 0; i < vec.size(); ++i) {
-                            float s = 1e12f;
-                            ShapeType t = (i < types.size() ? types[i] : ShapeType::Line);
-                            const Path& p = vec[i];
-                            if (t == ShapeType::Line && p.size() >= 2) s = scoreLine(p);
-                            else if (t == ShapeType::Circle && p.size() >= 2) s = scoreCircle(p);
-                            else if (t == ShapeType::Triangle && p.size() >= 3) s = scorePoly(p);
-                            else if (t == ShapeType::Quadrilateral && p.size() >= 4) s = scorePoly(p);
-                            else if (p.size() >= 2) s = scoreLine(p);
-                            if (s < bestMetric) { bestMetric = s; bestIsFoliage = isFoliage; bestIndex = i; }
-                        }
-                    };
-                    consider(foliage, foliageTypes, true);
-                    consider(trunks, trunksTypes, false);
-                    if (bestIndex != (size_t)-1 && bestMetric <= tolerance2) {
-                        if (bestIsFoliage) {
-                            foliage.erase(foliage.begin() + bestIndex);
-                            if (bestIndex < foliageColors.size()) foliageColors.erase(foliageColors.begin() + bestIndex);
-                            if (bestIndex < foliageTypes.size()) foliageTypes.erase(foliageTypes.begin() + bestIndex);
-                        } else {
-                            trunks.erase(trunks.begin() + bestIndex);
-                            if (bestIndex < trunksColors.size()) trunksColors.erase(trunksColors.begin() + bestIndex);
-                            if (bestIndex < trunksTypes.size()) trunksTypes.erase(trunksTypes.begin() + bestIndex);
-                        }
-                        redraw();
-                        continue;
-                    }
-                    // Ctrl+Shift was pressed but nothing matched; do not create anything on this click
-                    continue;
-                }
+static long long artUnixTime(std::filesystem::file_time_type t) {
+    auto sys = std::chrono::system_clock::now() + (t - std::filesystem::file_time_type::clock::now());
+    return (long long)std::chrono::duration_cast<std::chrono::seconds>(sys.time_since_epoch()).count();
+}
 
-                if (shiftHeld) {
-                    // initialize placement state if idle
-                    if (placementNeededPoints == 0) {
-                        placementPoints.clear();
-                        placementCollected = 0;
-                        switch (currentShape) {
-                            case ShapeType::Line: placementNeededPoints = 2; break;
-                            case ShapeType::Circle: placementNeededPoints = 2; break;
-                            case ShapeType::Triangle: placementNeededPoints = 3; break;
-                            case ShapeType::Quadrilateral: placementNeededPoints = 4; break;
-                        }
-                    }
-                    placementPoints.push_back({mx, my});
-                    placementCollected++;
-                    if (placementCollected >= placementNeededPoints) {
-                        // finalize shape
-                        Path p = placementPoints;
-                        trunks.push_back(p);
-                        trunksColors.push_back(currentDrawColor);
-                        trunksTypes.push_back(currentShape);
-                        // reset placement
-                        placementPoints.clear();
-                        placementCollected = 0;
-                        placementNeededPoints = 0;
-                    }
-                    redraw();
-                } else if (ctrlHeld) {
-                    // Try to pick nearest endpoint among two-point paths
-                    float bestDist2 = 1e9f;
-                    bool found = false;
-                    // foliage
-                    for (size_t i = 0; i < foliage.size(); ++i) {
-                        const auto& path = foliage[i];
-                        if (path.size() == 2) {
-                            float d0 = distanceSquared(mx, my, path[0].x, path[0].y);
-                            float d1 = distanceSquared(mx, my, path[1].x, path[1].y);
-                            if (d0 < bestDist2 && d0 <= selectRadius2) { bestDist2 = d0; dragging = true; draggingIsFoliage = true; draggingPathIndex = i; draggingPointIndex = 0; found = true; }
-                            if (d1 < bestDist2 && d1 <= selectRadius2) { bestDist2 = d1; dragging = true; draggingIsFoliage = true; draggingPathIndex = i; draggingPointIndex = 1; found = true; }
-                        }
-                    }
-                    // trunks
-                    for (size_t i = 0; i < trunks.size(); ++i) {
-                        const auto& path = trunks[i];
-                        if (path.size() == 2) {
-                            float d0 = distanceSquared(mx, my, path[0].x, path[0].y);
-                            float d1 = distanceSquared(mx, my, path[1].x, path[1].y);
-                            if (d0 < bestDist2 && d0 <= selectRadius2) { bestDist2 = d0; dragging = true; draggingIsFoliage = false; draggingPathIndex = i; draggingPointIndex = 0; found = true; }
-                            if (d1 < bestDist2 && d1 <= selectRadius2) { bestDist2 = d1; dragging = true; draggingIsFoliage = false; draggingPathIndex = i; draggingPointIndex = 1; found = true; }
-                        }
-                    }
-                    if (!found) dragging = false;
-                }
-            } else if (e.type == SDL_MOUSEMOTION) {
-                if (dragging) {
-                    int mx = e.motion.x;
-                    int my = e.motion.y;
-                    if (draggingIsFoliage) {
-                        if (draggingPointIndex == 0) foliage[draggingPathIndex][0] = {mx, my};
-                        else foliage[draggingPathIndex][1] = {mx, my};
-                    } else {
-                        // move nearest endpoint on the selected path
-                        if (trunksTypes.size() > draggingPathIndex) {
-                            ShapeType t = trunksTypes[draggingPathIndex];
-                            if (t == ShapeType::Triangle && trunks[draggingPathIndex].size() >= 3) {
-                                // move whichever vertex is closest among 3
-                                int idx = 0; float best = 1e9f;
-                                for (int k = 0; k < 3; ++k) {
-                                    float d = distanceSquared(mx, my, trunks[draggingPathIndex][k].x, trunks[draggingPathIndex][k].y);
-                                    if (d < best) { best = d; idx = k; }
-                                }
-                                trunks[draggingPathIndex][idx] = {mx, my};
-                            } else if (t == ShapeType::Quadrilateral && trunks[draggingPathIndex].size() >= 4) {
-                                int idx = 0; float best = 1e9f;
-                                for (int k = 0; k < 4; ++k) {
-                                    float d = distanceSquared(mx, my, trunks[draggingPathIndex][k].x, trunks[draggingPathIndex][k].y);
-                                    if (d < best) { best = d; idx = k; }
-                                }
-                                trunks[draggingPathIndex][idx] = {mx, my};
-                            } else {
-                                if (draggingPointIndex == 0) trunks[draggingPathIndex][0] = {mx, my};
-                                else trunks[draggingPathIndex][1] = {mx, my};
-                            }
-                    } else {
-                        if (draggingPointIndex == 0) trunks[draggingPathIndex][0] = {mx, my};
-                        else trunks[draggingPathIndex][1] = {mx, my};
-                        }
-                    }
-                    redraw();
-                }
-            } else if (e.type == SDL_MOUSEBUTTONUP && e.button.button == SDL_BUTTON_LEFT) {
-                dragging = false;
+// Lists the tree below root into found, keeping the path strings in names. A directory
+// holding paths.txt or current.txt, or with no subdirectories, is an image (as in the
+// gallery); the root's children are studios and deeper directories galleries. Each
+// stamp hashes the directory's file names, sizes and mtimes and its subdirectory names,
+// which is everything the directory's own mtime (folded into newest) can reflect.
+static void walkArt(const std::filesystem::path& root, const std::string& rel, int depth,
+                    std::deque<std::string>& names, std::vector<ArtEntry>& found) {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    fs::path dir = rel.empty() ? root : root / rel;
+    std::vector<std::string> subdirs, files;
+    bool scene = false;
+    long long newest = artUnixTime(fs::last_write_time(dir, ec));
+    for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        std::string name = it->path().filename().string();
+        if (name.empty() || name[0] == '.') continue;
+        std::error_code fe;
+        if (it->is_directory(fe)) { subdirs.push_back(name); continue; }
+        if (!it->is_regular_file(fe)) continue;
+        if (name == "paths.txt" || name == "current.txt") scene = true;
+        auto t = it->last_write_time(fe);
+        Uint64 size = it->file_size(fe);
+        newest = std::max(newest, artUnixTime(t));
+        files.push_back(name + '\n' + std::to_string(size) + '\n' + std::to_string((long long)t.time_since_epoch().count()));
+    }
+    bool image = scene || subdirs.empty();
+    std::sort(subdirs.begin(), subdirs.end());
+    if (!rel.empty()) {
+        std::sort(files.begin(), files.end());
+        std::string key;
+        for (const std::string& f : files) { key += f; key += '\n'; }
+        for (const std::string& s : subdirs) { key += s; key += "/\n"; }
+        names.push_back(rel);
+        ArtEntry e;
+        e.path = names.back();
+        e.kind = image ? ArtKind::Image : depth == 1 ? ArtKind::Studio : ArtKind::Gallery;
+        e.stamp = hashBytes(key.data(), key.size());
+        e.mtime = newest;
+        found.push_back(e);
+        if (image) return;
+    }
+    for (const std::string& s : subdirs) walkArt(root, rel.empty() ? s : rel + "/" + s, depth + 1, names, found);
+}
+
+// Reads an entry's description into text and, for images, its shape counts, bounds and
+// dominant colors (shapes binned at 4 bits per channel, each bin reported as its mean).
+static void scanArtEntry(const std::string& dir, ArtEntry& e, std::string& text) {
+    readWholeFile(dir + "/description.txt", text);
+    e.description = text;
+    if (e.kind != ArtKind::Image) return;
+    struct Bin { Uint64 n = 0, r = 0, g = 0, b = 0; };
+    std::vector<Bin> bins(4096);
+    Uint64 total = 0;
+    for (const char* name : { "/paths.txt", "/current.txt" }) {
+        std::error_code ec;
+        if (!std::filesystem::exists(dir + name, ec)) continue;
+        SceneLayer l = readLayer(dir + name);
+        for (size_t i = 0; i < l.paths.size(); ++i) {
+            e.counts[(int)l.types[i]]++;
+            e.bounds = unionRect(e.bounds, shapeBounds(l.paths[i], l.types[i]));
+            const SDL_Color& c = l.colors[i];
+            Bin& b = bins[(c.r >> 4) << 8 | (c.g >> 4) << 4 | c.b >> 4];
+            b.n++; b.r += c.r; b.g += c.g; b.b += c.b;
+            ++total;
+        }
+    }
+    std::vector<Uint32> order;
+    for (Uint32 k = 0; k < bins.size(); ++k) if (bins[k].n) order.push_back(k);
+    size_t keep = std::min<size_t>(order.size(), kIndexColors);
+    std::partial_sort(order.begin(), order.begin() + keep, order.end(),
+                      [&](Uint32 a, Uint32 b) { return bins[a].n != bins[b].n ? bins[a].n > bins[b].n : a < b; });
+    for (size_t k = 0; k < keep; ++k) {
+        const Bin& b = bins[order[k]];
+        Uint32 rgb = (Uint32)(b.r / b.n) << 16 | (Uint32)(b.g / b.n) << 8 | (Uint32)(b.b / b.n);
+        e.colors[e.colorCount++] = { rgb, (Uint32)(b.n * 1000 / total) };
+    }
+}
+
+// Brings root's index up to date with the tree and writes it (via a temporary file, so
+// a concurrent find reads either index whole).
+static bool refreshArtIndex(const std::string& root, std::ostream& out) {
+    Uint32 startTicks = SDL_GetTicks();
+    std::error_code ec;
+    if (!std::filesystem::is_directory(root, ec)) { out << "Not a directory: " << root << "\n"; return false; }
+    std::string file = root + "/" + kIndexFile;
+    ArtIndex old;
+    if (!readArtIndex(file, old) || !loadArtDescriptions(old)) old.entries.clear();
+    std::deque<std::string> names;
+    std::vector<ArtEntry> entries;
+    walkArt(root, std::string(), 0, names, entries);
+    std::sort(entries.begin(), entries.end(), [](const ArtEntry& a, const ArtEntry& b) { return a.path < b.path; });
+    std::vector<size_t> stale;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        ArtEntry& e = entries[i];
+        auto it = std::lower_bound(old.entries.begin(), old.entries.end(), e.path,
+                                   [](const ArtEntry& o, std::string_view p) { return o.path < p; });
+        if (it != old.entries.end() && it->path == e.path && it->stamp == e.stamp && it->kind == e.kind) e = *it;
+        else stale.push_back(i);
+    }
+    std::vector<std::string> texts(stale.size());
+    parallelFor(stale.size(), [&](size_t k) {
+        ArtEntry& e = entries[stale[k]];
+        scanArtEntry(root + "/" + std::string(e.path), e, texts[k]);
+    });
+
+    std::string data = encodeArtIndex(entries), tmp = file + ".tmp";
+    {
+        std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+        if (!f.is_open() || !f.write(data.data(), (std::streamsize)data.size())) { out << "Cannot write " << tmp << "\n"; return false; }
+    }
+    std::filesystem::rename(tmp, file, ec);
+    if (ec) { out << "Cannot write " << file << ": " << ec.message() << "\n"; return false; }
+    out << "Indexed " << entries.size() << " entries under " << root << " (" << stale.size() << " re-read) in "
+        << (SDL_GetTicks() - startTicks) << " ms\n";
+    return true;
+}
+
+// Names color~ accepts, by hue, saturation and value.
+static const char* const kArtColorNames[] = {
+    "black", "gray", "white", "red", "orange", "brown", "yellow", "green", "cyan", "blue", "purple", "pink" };
+
+static int artColorName(Uint32 rgb) {
+    int r = (rgb >> 16) & 0xFF, g = (rgb >> 8) & 0xFF, b = rgb & 0xFF;
+    int hi = std::max({ r, g, b }), lo = std::min({ r, g, b });
+    if (hi < 48) return 0;
+    if (hi - lo < hi / 5) return hi > 216 ? 2 : 1;
+    float d = (float)(hi - lo), h;
+    if (hi == r) h = std::fmod((g - b) / d + 6.0f, 6.0f);
+    else if (hi == g) h = (b - r) / d + 2.0f;
+    else h = (r - g) / d + 4.0f;
+    h *= 60.0f;
+    if (h < 15.0f || h >= 345.0f) return 3;
+    if (h < 45.0f) return hi < 160 ? 5 : 4;
+    if (h < 70.0f) return 6;
+    if (h < 165.0f) return 7;
+    if (h < 195.0f) return 8;
+    if (h < 255.0f) return 9;
+    if (h < 290.0f) return 10;
+    return 11;
+}
+
+// find queries; every term must hold.
+//   word | word* (prefix) | "several words" (adjacent, in order) - path or description
+//   lines|circles|triangles|quads|shapes|width|height|age <op> n, op one of < <= = >= >
+//     (age in days since the newest file changed; the others apply to images only)
+//   color~<name>|#rrggbb[~tolerance] - one of the image's dominant colors
+//   kind=studio|gallery|image | in=<path> (entries under it)
+struct ArtRange { int field; std::string op; double value; };
+struct ArtColorTerm { int name = -1; SDL_Color color{0, 0, 0, 255}; int tolerance = 48; };
+
+struct ArtQuery {
+    std::vector<std::vector<std::string>> phrases;
+    std::vector<ArtRange> ranges;
+    std::vector<ArtColorTerm> colors;
+    int kind = -1;
+    std::string under;
+};
+
+static const char* const kArtFields[] = { "lines", "circles", "triangles", "quads", "shapes", "width", "height", "age" };
+
+static bool parseArtQuery(const std::vector<std::string>& args, ArtQuery& q, std::ostream& out) {
+    for (const std::string& a : args) {
+        size_t op = a.find_first_of("<>=~");
+        std::string key = op == std::string::npos ? std::string() : a.substr(0, op);
+        int field = -1;
+        for (int k = 0; k < 8; ++k) if (key == kArtFields[k]) field = k;
+        if (key == "quadrilaterals") field = 3;
+        if (field >= 0) {
+            ArtRange r{ field, std::string(1, a[op]), 0.0 };
+            if (op + 1 < a.size() && a[op + 1] == '=' && a[op] != '=') r.op += '=';
+            const char* num = a.c_str() + op + r.op.size();
+            char* end = nullptr;
+            r.value = std::strtod(num, &end);
+            if (r.op == "~" || end == num || *end) { out << "Bad range " << a << "\n"; return false; }
+            q.ranges.push_back(r);
+        } else if (!key.empty() && (a[op] == '<' || a[op] == '>')) {
+            out << "Unknown field " << key << "\n";
+            return false;
+        } else if (key == "color" && a[op] == '~') {
+            ArtColorTerm c;
+            std::string v = a.substr(op + 1);
+            size_t tilde = v.find('~');
+            if (tilde != std::string::npos) { c.tolerance = std::max(0, std::atoi(v.c_str() + tilde + 1)); v.resize(tilde); }
+            for (int k = 0; k < 12; ++k) if (v == kArtColorNames[k]) c.name = k;
+            if (c.name < 0 && !(v.size() == 7 && v[0] == '#' && parseHexColor(v.substr(1), c.color))) {
+                out << "Bad color " << v << " (a name like red, or #rrggbb)\n";
+                return false;
             }
+            q.colors.push_back(c);
+        } else if (key == "kind" && a[op] == '=') {
+            for (int k = 0; k < 3; ++k) if (a.compare(op + 1, std::string::npos, kArtKindNames[k]) == 0) q.kind = k;
+            if (q.kind < 0) { out << "Bad kind " << a.substr(op + 1) << "\n"; return false; }
+        } else if (key == "in" && a[op] == '=') {
+            q.under = a.substr(op + 1);
+            while (!q.under.empty() && q.under.back() == '/') q.under.pop_back();
+        } else {
+            std::vector<std::string> words;
+            artWords(a, words);
+            if (!words.empty() && a.back() == '*') words.back() += '*';
+            if (words.empty()) { out << "Nothing to search for in " << a << "\n"; return false; }
+            q.phrases.push_back(std::move(words));
         }
-        SDL_Delay(8);
     }
+    return true;
+}
 
-    // Save edits on close
-    writePaths(pathsFile, foliage);
-    writePaths(currentFile, trunks);
-    writeColors(pathsFile + ".colors", foliageColors);
-    writeColors(currentFile + ".colors", trunksColors);
-    writeTypes(pathsFile + ".types", foliageTypes);
-    writeTypes(currentFile + ".types", trunksTypes);
+// word as it appears in the text against a lowercased query term (word* for a prefix).
+static bool artWordMatches(std::string_view word, const std::string& term) {
+    bool prefix = !term.empty() && term.back() == '*';
+    size_t n = term.size() - prefix;
+    if (prefix ? word.size() < n : word.size() != n) return false;
+    for (size_t i = 0; i < n; ++i) if ((char)std::tolower((unsigned char)word[i]) != term[i]) return false;
+    return true;
+}
+
+static bool artMatches(const ArtQuery& q, const ArtEntry& e, long long now, std::vector<std::string_view>& spans) {
+    if (q.kind >= 0 && (int)e.kind != q.kind) return false;
+    if (!q.under.empty() && (e.path.compare(0, q.under.size(), q.under) != 0 ||
+                             (e.path.size() > q.under.size() && e.path[q.under.size()] != '/'))) return false;
+    for (const ArtRange& r : q.ranges) {
+        double v;
+        if (r.field == 7) v = (double)(now - e.mtime) / 86400.0;
+        else if (e.kind != ArtKind::Image) return false;
+        else if (r.field < 4) v = (double)e.counts[r.field];
+        else if (r.field == 4) v = (double)(e.counts[0] + e.counts[1] + e.counts[2] + e.counts[3]);
+        else v = r.field == 5 ? e.bounds.w : e.bounds.h;
+        bool ok = r.op == "<" ? v < r.value : r.op == "<=" ? v <= r.value : r.op == ">" ? v > r.value
+                : r.op == ">=" ? v >= r.value : v == r.value;
+        if (!ok) return false;
+    }
+    for (const ArtColorTerm& c : q.colors) {
+        bool any = false;
+        for (int k = 0; k < e.colorCount && !any; ++k) {
+            const ArtColor& ec = e.colors[k];
+            if (ec.share < kIndexColorShare) continue;
+            int r = (ec.rgb >> 16) & 0xFF, g = (ec.rgb >> 8) & 0xFF, b = ec.rgb & 0xFF;
+            if (c.name >= 0) any = artColorName(ec.rgb) == c.name;
+            else any = std::max({ std::abs(r - c.color.r), std::abs(g - c.color.g), std::abs(b - c.color.b) }) <= c.tolerance;
+        }
+        if (!any) return false;
+    }
+    for (const auto& phrase : q.phrases) {
+        if (phrase.size() < 2) continue; // single words are decided by their postings
+        bool found = false;
+        for (std::string_view text : { e.path, e.description }) {
+            spans.clear();
+            artSpans(text, spans);
+            for (size_t i = 0; i + phrase.size() <= spans.size() && !found; ++i) {
+                found = true;
+                for (size_t k = 0; k < phrase.size() && found; ++k) found = artWordMatches(spans[i + k], phrase[k]);
+            }
+        }
+        if (!found) return false;
+    }
+    return true;
+}
+
+// Entries whose words include term (or, for word*, any word it prefixes).
+static std::vector<Uint32> artTermIds(const ArtIndex& idx, const std::string& term) {
+    bool prefix = !term.empty() && term.back() == '*';
+    std::string_view key(term.data(), term.size() - prefix);
+    auto it = std::lower_bound(idx.terms.begin(), idx.terms.end(), key, [](const ArtTerm& t, std::string_view k) { return t.word < k; });
+    std::vector<Uint32> ids;
+    for (; it != idx.terms.end() && (prefix ? it->word.compare(0, key.size(), key) == 0 : it->word == key); ++it) {
+        std::vector<Uint32> p = artPostings(idx, *it);
+        ids.insert(ids.end(), p.begin(), p.end());
+        if (!prefix) break;
+    }
+    if (prefix) {
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    }
+    return ids;
+}
+
+// Runs a query against root's index, building the index first if there is none; run
+// index after edits to bring it up to date.
+static bool findArt(const std::string& root, const std::vector<std::string>& args, std::ostream& out) {
+    Uint32 startTicks = SDL_GetTicks();
+    ArtQuery q;
+    if (!parseArtQuery(args, q, out)) return false;
+    ArtIndex idx;
+    std::string file = root + "/" + kIndexFile;
+    if (!readArtIndex(file, idx)) {
+        if (!refreshArtIndex(root, out)) return false;
+        startTicks = SDL_GetTicks();
+        if (!readArtIndex(file, idx)) { out << "Cannot read " << file << "\n"; return false; }
+    }
+
+    // Words narrow the candidates through their postings, rarest first.
+    std::vector<std::vector<Uint32>> lists;
+    for (const auto& phrase : q.phrases) for (const std::string& w : phrase) lists.push_back(artTermIds(idx, w));
+    std::sort(lists.begin(), lists.end(), [](const std::vector<Uint32>& a, const std::vector<Uint32>& b) { return a.size() < b.size(); });
+    std::vector<Uint32> ids;
+    if (lists.empty()) {
+        ids.resize(idx.entries.size());
+        for (size_t i = 0; i < ids.size(); ++i) ids[i] = (Uint32)i;
+    } else {
+        ids = lists[0];
+        for (size_t k = 1; k < lists.size() && !ids.empty(); ++k) {
+            std::vector<Uint32> both;
+            std::set_intersection(ids.begin(), ids.end(), lists[k].begin(), lists[k].end(), std::back_inserter(both));
+            ids.swap(both);
+        }
+    }
+    bool phrases = std::any_of(q.phrases.begin(), q.phrases.end(), [](const std::vector<std::string>& p) { return p.size() > 1; });
+    if (phrases && !ids.empty() && !loadArtDescriptions(idx)) { out << "Cannot read " << file << "\n"; return false; }
+    long long now = (long long)std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    size_t matches = 0;
+    std::vector<std::string_view> spans;
+    for (Uint32 id : ids) {
+        const ArtEntry& e = idx.entries[id];
+        if (!artMatches(q, e, now, spans)) continue;
+        ++matches;
+        out << e.path << "  " << kArtKindNames[(int)e.kind];
+        if (e.kind == ArtKind::Image) {
+            out << ", " << (e.counts[0] + e.counts[1] + e.counts[2] + e.counts[3]) << " shapes, "
+                << e.bounds.w << "x" << e.bounds.h;
+        }
+        out << "\n";
+    }
+    out << matches << " of " << idx.entries.size() << " entries in " << (SDL_GetTicks() - startTicks) << " ms\n";
+    return true;
+}
+
+static void printToolUsage(std::ostream& out) {
+    out << "Tools:\n"
+        << "  export-frames <scene> <dir> <fps> <duration>\n"
+        << "  export-svg <scene> <out.svg>\n"
+        << "  import-svg <file.svg> <scene> [tolerance-px]\n"
+        << "  generate-forest <scene> <seed> <trees> [depth] [angle-degrees]\n"
+        << "  symbol-define <scene> <name> <x> <y> <w> <h>\n"
+        << "  symbol-place <scene> <name> <x> <y> [rotation] [scale] [RRGGBB[AA]]\n"
+        << "  analyze <scene> [near-px]\n"
+        << "  check-sweep [trials] [segments] [seed]\n"
+        << "  clean <scene> [degenerate] [duplicates] [near=<px>] [merge] [split]\n"
+        << "  compact <scene> [tolerance-px | text]\n"
+        << "  pack <dir> <archive>\n"
+        << "  unpack <archive> <dir> [path]\n"
+        << "  serve <socket> [scenes] [threads]\n"
+        << "  replay-edit <scene> <recording> [save]\n"
+        << "  reference <scene> <image | none> [x] [y] [scale] [opacity]\n"
+        << "  autotrace <image> <scene> [colors] [tolerance-px] [min-edges]\n"
+        << "  batch <script | \"commands\"> <scene | dir | glob>...\n"
+        << "  index [dir]\n"
+        << "  find [root=<dir>] <word | \"phrase\" | circles>100 | color~red | kind=image | in=path>...\n";
+}
 
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
-    if (initedImgHere) IMG_Quit();
-    if (initedVideoHere) SDL_Quit();
+// Headless commands shared by both terminals and the process command line.
+// Returns -1 if args[0] is not a tool, otherwise an exit status.
+static int runToolCommand(const std::vector<std::string>& args, std::ostream& out) {
+    if (args.empty()) return -1;
+    const std::string& cmd = args[0];
+    if (cmd == "export-frames") {
+        if (args.size() != 5) { printToolUsage(out); return 1; }
+        return exportFrames(args[1], args[2], std::atof(args[3].c_str()), std::atof(args[4].c_str()), out) ? 0 : 1;
+    }
+    if (cmd == "export-svg") {
+        if (args.size() != 3) { printToolUsage(out); return 1; }
+        return exportSvg(args[1], args[2], out) ? 0 : 1;
+    }
+    if (cmd == "import-svg") {
+        if (args.size() < 3 || args.size() > 4) { printToolUsage(out); return 1; }
+        float tolerance = args.size() > 3 ? (float)std::atof(args[3].c_str()) : 0.25f;
+        return importSvg(args[1], args[2], tolerance, out) ? 0 : 1;
+    }
+    if (cmd == "generate-forest") {
+        if (args.size() < 4 || args.size() > 6) { printToolUsage(out); return 1; }
+        ForestParams fp;
+        std::string err;
+        if (!parseForestParams(args, 2, fp, err)) { out << err << "\n"; printToolUsage(out); return 1; }
+        Uint32 startTicks = SDL_GetTicks();
+        Scene scene = loadScene(args[1]);
+        size_t trunk = 0, foliage = 0;
+        generateForest(scene, fp, trunk, foliage);
+        if (!saveScene(args[1], scene)) { out << "Cannot write scene " << args[1] << "\n"; return 1; }
+        out << "Generated " << fp.trees << " trees: " << trunk << " trunk shapes, " << foliage
+            << " foliage shapes in " << (SDL_GetTicks() - startTicks) << " ms\n";
+        return 0;
+    }
+    if (cmd == "symbol-define") {
+        if (args.size() != 7) { printToolUsage(out); return 1; }
+        Scene scene = loadScene(args[1]);
+        SDL_Rect area{ std::atoi(args[3].c_str()), std::atoi(args[4].c_str()), std::atoi(args[5].c_str()), std::atoi(args[6].c_str()) };
+        std::vector<size_t> newIndex[2];
+        if (!defineSymbol(scene, args[2], area, newIndex, out)) return 1;
+        if (!saveScene(args[1], scene)) return 1;
+        return remapSceneConstraints(args[1], newIndex, out) ? 0 : 1;
+    }
+    if (cmd == "symbol-place") {
+        if (args.size() < 5 || args.size() > 8) { printToolUsage(out); return 1; }
+        Scene scene = loadScene(args[1]);
+        SymbolInstance inst;
+        inst.symbol = findSymbol(scene.symbols, args[2]);
+        if (inst.symbol < 0) { out << "Unknown symbol " << args[2] << "\n"; return 1; }
+        inst.x = (float)std::atof(args[3].c_str());
+        inst.y = (float)std::atof(args[4].c_str());
+        if (args.size() > 5) inst.rotation = (float)std::atof(args[5].c_str());
+        if (args.size() > 6) inst.scale = (float)std::atof(args[6].c_str());
+        if (args.size() > 7 && !parseHexColor(args[7], inst.tint)) { out << "Bad color " << args[7] << "\n"; return 1; }
+        if (inst.scale <= 0.0f) { out << "Scale must be positive\n"; return 1; }
+        scene.instances.push_back(inst);
+        return saveScene(args[1], scene) ? 0 : 1;
+    }
+    if (cmd == "analyze") {
+        if (args.size() < 2 || args.size() > 3) { printToolUsage(out); return 1; }
+        return analyzeScene(args[1], args.size() > 2 ? (float)std::atof(args[2].c_str()) : 0.0f, out) ? 0 : 1;
+    }
+    if (cmd == "check-sweep") {
+        if (args.size() > 4) { printToolUsage(out); return 1; }
+        int trials = args.size() > 1 ? std::atoi(args[1].c_str()) : 1000;
+        int segments = args.size() > 2 ? std::atoi(args[2].c_str()) : 50;
+        unsigned seed = args.size() > 3 ? (unsigned)std::strtoul(args[3].c_str(), nullptr, 10) : 1;
+        if (trials < 0 || segments < 2) { printToolUsage(out); return 1; }
+        return checkSweep(trials, segments, seed, out) ? 0 : 1;
+    }
+    if (cmd == "clean") {
+        if (args.size() < 2) { printToolUsage(out); return 1; }
+        CleanOptions opt;
+        for (size_t i = 2; i < args.size(); ++i) {
+            const std::string& a = args[i];
+            if (a == "degenerate") opt.degenerate = true;
+            else if (a == "duplicates") opt.duplicates = true;
+            else if (a.compare(0, 5, "near=") == 0) { opt.nearPx = (float)std::atof(a.c_str() + 5); opt.duplicates = true; }
+            else if (a == "merge") opt.merge = true;
+            else if (a == "split") opt.split = true;
+            else { out << "Unknown clean option " << a << "\n"; return 1; }
+        }
+        if (args.size() == 2) opt.degenerate = opt.duplicates = true;
+        return cleanScene(args[1], opt, out) ? 0 : 1;
+    }
+    if (cmd == "compact") {
+        if (args.size() < 2 || args.size() > 3) { printToolUsage(out); return 1; }
+        float step = kDefaultCompactStep;
+        if (args.size() > 2) step = args[2] == "text" ? 0.0f : 2.0f * (float)std::atof(args[2].c_str());
+        if (args.size() > 2 && args[2] != "text" && step <= 0.0f) { out << "Tolerance must be positive\n"; return 1; }
+        return compactScene(args[1], step, out) ? 0 : 1;
+    }
+    if (cmd == "pack") {
+        if (args.size() != 3) { printToolUsage(out); return 1; }
+        return packStudio(args[1], args[2], out) ? 0 : 1;
+    }
+    if (cmd == "unpack") {
+        if (args.size() < 3 || args.size() > 4) { printToolUsage(out); return 1; }
+        return unpackStudio(args[1], args[2], args.size() > 3 ? args[3] : std::string(), out) ? 0 : 1;
+    }
+    if (cmd == "replay-edit") {
+        if (args.size() < 3 || args.size() > 4 || (args.size() == 4 && args[3] != "save")) { printToolUsage(out); return 1; }
+        return replayEdit(args[1], args[2], args.size() == 4, out) ? 0 : 1;
+    }
+    if (cmd == "autotrace") {
+        if (args.size() < 3 || args.size() > 6) { printToolUsage(out); return 1; }
+        TraceOptions opt;
+        if (args.size() > 3) opt.colors = std::max(2, std::min(kTraceMaxColors, std::atoi(args[3].c_str())));
+        if (args.size() > 4) opt.tolerance = std::max(0.0f, (float)std::atof(args[4].c_str()));
+        if (args.size() > 5) opt.minEdges = std::strtoul(args[5].c_str(), nullptr, 10);
+        return autotraceImage(args[1], args[2], opt, out) ? 0 : 1;
+    }
+    if (cmd == "batch") {
+        if (args.size() < 3) { printToolUsage(out); return 1; }
+        return runBatch(args[1], std::vector<std::string>(args.begin() + 2, args.end()), out) ? 0 : 1;
+    }
+    if (cmd == "index") {
+        if (args.size() > 2) { printToolUsage(out); return 1; }
+        return refreshArtIndex(args.size() > 1 ? args[1] : galleryRoot("."), out) ? 0 : 1;
+    }
+    if (cmd == "find") {
+        size_t first = 1;
+        std::string root = galleryRoot(".");
+        if (args.size() > 1 && args[1].compare(0, 5, "root=") == 0) { root = args[1].substr(5); first = 2; }
+        return findArt(root, std::vector<std::string>(args.begin() + first, args.end()), out) ? 0 : 1;
+    }
+    if (cmd == "reference") {
+        if (args.size() < 3 || args.size() > 7) { printToolUsage(out); return 1; }
+        std::string file = args[1] + "/reference.txt";
+        if (args[2] == "none") { std::remove(file.c_str()); return 0; }
+        Underlay u;
+        u.file = args[2];
+        if (args.size() > 3) u.x = (float)std::atof(args[3].c_str());
+        if (args.size() > 4) u.y = (float)std::atof(args[4].c_str());
+        if (args.size() > 5) u.scale = (float)std::atof(args[5].c_str());
+        if (args.size() > 6) u.opacity = std::max(0, std::min(255, std::atoi(args[6].c_str())));
+        if (u.scale <= 0.0f) { out << "Scale must be positive\n"; return 1; }
+        if (!writeReference(file, u)) { out << "Cannot write " << file << "\n"; return 1; }
+        return 0;
+    }
+    if (cmd == "serve") {
+        if (args.size() < 2 || args.size() > 4) { printToolUsage(out); return 1; }
+        size_t scenes = args.size() > 2 ? std::strtoul(args[2].c_str(), nullptr, 10) : 8;
+        unsigned threads = args.size() > 3 ? (unsigned)std::strtoul(args[3].c_str(), nullptr, 10) : std::max(2u, std::thread::hardware_concurrency());
+        return serveStudio(args[1], scenes, std::max(1u, threads), out) ? 0 : 1;
+    }
+    return -1;
 }
 
-int main() {
+int main(int argc, char** argv) {
+    if (argc > 1) {
+        std::vector<std::string> args(argv + 1, argv + argc);
+        int status = runToolCommand(args, std::cout);
+        if (status < 0) {
+            std::cerr << "Unknown command: " << args[0] << "\n";
+            printToolUsage(std::cerr);
+            return 1;
+        }
+        return status;
+    }
+
     std::string basePath;
     if (!getBasePathFromCwd(basePath)) {
         return 1;
     }
 
     // Prefer GUI; if it fails (e.g., no fonts), fall back to CLI
-    if (!runGuiTerminal(basePath)) {
+    AppShell shell;
+    if (!runGuiTerminal(shell, basePath)) {
+        if (shell.window) SDL_HideWindow(shell.window);
         std::cout << "Atelier Terminal — type 'help' for commands. Type 'exit' to quit.\n";
     while (true) {
         std::cout << "> ";
-        std::string cmd;
-        if (!(std::cin >> cmd)) break;
+        std::string line;
+        if (!std::getline(std::cin, line)) break;
+        std::vector<std::string> args = splitCommandLine(line);
+        if (args.empty()) continue;
+        const std::string& cmd = args[0];
         if (cmd == "help") {
             showHelpFromJson("/home/user/Atelier_lab/Programs/commands.json");
+            printToolUsage(std::cout);
         } else if (cmd == "draw") {
-            runViewer(basePath);
+            runViewer(shell, basePath);
+            if (shell.window) SDL_HideWindow(shell.window);
             if (exitCliAfterSDL) { break; }
+        } else if (cmd == "gallery") {
+            if (runGallery(shell, basePath)) std::cout << "Opened " << basePath << "\n";
+            if (shell.window) SDL_HideWindow(shell.window);
         } else if (cmd == "edit") {
-            editMode(basePath);
+            editMode(shell, basePath, args.size() == 3 && args[1] == "record" ? args[2] : std::string());
+            if (shell.window) SDL_HideWindow(shell.window);
             if (exitCliAfterSDL) { break; }
         } else if (cmd == "exit" || cmd == "quit") {
             break;
-        } else {
+        } else if (runToolCommand(args, std::cout) < 0) {
             std::cout << "Unknown command. Type 'help'.\n";
             }
         }
     }
+    closeAppShell(shell);
     return 0;
 }